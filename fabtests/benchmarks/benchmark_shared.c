@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <netinet/in.h>
 
 #include <rdma/fi_errno.h>
 
@@ -70,6 +71,36 @@ void ft_benchmark_usage(void)
 			"# of iterations > window size");
 }
 
+/*
+ * Duplicate the active fi_info for opening endpoints in addition to the
+ * control endpoint.  Source ports and names are cleared so that the new
+ * endpoint does not collide with the address already in use.
+ */
+struct fi_info *ft_dupinfo_ephemeral(void)
+{
+	struct fi_info *info;
+	struct sockaddr *sa;
+
+	info = fi_dupinfo(fi);
+	if (!info || !info->src_addr)
+		return info;
+
+	sa = info->src_addr;
+	if ((info->addr_format == FI_SOCKADDR_IN ||
+	     info->addr_format == FI_SOCKADDR) && sa->sa_family == AF_INET) {
+		((struct sockaddr_in *) sa)->sin_port = 0;
+	} else if ((info->addr_format == FI_SOCKADDR_IN6 ||
+		    info->addr_format == FI_SOCKADDR) &&
+		   sa->sa_family == AF_INET6) {
+		((struct sockaddr_in6 *) sa)->sin6_port = 0;
+	} else {
+		free(info->src_addr);
+		info->src_addr = NULL;
+		info->src_addrlen = 0;
+	}
+	return info;
+}
+
 int pingpong(void)
 {
 	int ret, i;
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Completion rate test for RDM endpoints.
+ *
+ * The client streams windows of small messages and the server
+ * acknowledges each window once every receive has completed.  Both sides
+ * reap their completions in batches of up to -n entries, either by
+ * polling fi_cq_read() or by blocking in fi_cq_sread() (-c sread), so the
+ * result is dominated by the cost of writing, signalling and reading CQ
+ * entries rather than by data movement.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+static int batch = 16;
+static struct fi_cq_err_entry *comp;
+static struct fi_context *rate_ctx;
+
+/* fi_cq_err_entry can be cast to any CQ entry format */
+static int rate_reap(struct fid_cq *cq, uint64_t *cur, uint64_t total)
+{
+	size_t count;
+	ssize_t ret;
+
+	while (*cur < total) {
+		count = MIN((uint64_t) batch, total - *cur);
+		if (opts.comp_method == FT_COMP_SREAD)
+			ret = fi_cq_sread(cq, comp, count, NULL, -1);
+		else
+			ret = fi_cq_read(cq, comp, count);
+
+		if (ret > 0) {
+			*cur += ret;
+		} else if (ret == -FI_EAVAIL) {
+			return ft_cq_readerr(cq);
+		} else if (ret != -FI_EAGAIN) {
+			FT_PRINTERR(opts.comp_method == FT_COMP_SREAD ?
+				    "fi_cq_sread" : "fi_cq_read", ret);
+			return (int) ret;
+		}
+	}
+	return 0;
+}
+
+/*
+ * As in bandwidth(), the server's rx_seq is one ahead because of the
+ * pre-posted control receive, which picks up the first message.
+ */
+static int rate_round(void)
+{
+	int i, ret;
+
+	if (opts.dst_addr) {
+		for (i = 0; i < opts.window_size; i++) {
+			ret = ft_post_tx(ep, remote_fi_addr, opts.transfer_size,
+					 NO_CQ_DATA, &rate_ctx[i]);
+			if (ret)
+				return ret;
+		}
+
+		ret = rate_reap(txcq, &tx_cq_cntr, tx_seq);
+		if (ret)
+			return ret;
+		return ft_rx(ep, 4);
+	}
+
+	for (i = 0; i < opts.window_size; i++) {
+		ret = ft_post_rx(ep, opts.transfer_size, &rate_ctx[i]);
+		if (ret)
+			return ret;
+	}
+
+	ret = rate_reap(rxcq, &rx_cq_cntr, rx_seq - 1);
+	if (ret)
+		return ret;
+	return ft_tx(ep, remote_fi_addr, 4, &tx_ctx);
+}
+
+static int run(void)
+{
+	char name[FT_STR_LEN];
+	int i, ret;
+
+	comp = calloc(batch, sizeof(*comp));
+	rate_ctx = calloc(opts.window_size, sizeof(*rate_ctx));
+	if (!comp || !rate_ctx)
+		return -FI_ENOMEM;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		if (i == opts.warmup_iterations)
+			ft_start();
+		ret = rate_round();
+		if (ret)
+			return ret;
+	}
+	ft_stop();
+
+	if (opts.dst_addr) {
+		snprintf(name, sizeof(name), "batch_%d_%s", batch,
+			 opts.comp_method == FT_COMP_SREAD ? "sread" : "read");
+		show_perf(name, opts.transfer_size, opts.iterations, &start,
+			  &end, opts.window_size);
+	}
+
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW | FT_OPT_SIZE;
+	opts.transfer_size = 4;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "n:h" CS_OPTS INFO_OPTS
+			    BENCHMARK_OPTS)) != -1) {
+		switch (op) {
+		case 'n':
+			batch = atoi(optarg);
+			if (batch < 1) {
+				fprintf(stderr, "batch size must be positive\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Completion rate test for RDM "
+				   "endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-n <int>", "max completions reaped "
+					    "per CQ read (default: 16)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = run();
+
+	free(comp);
+	free(rate_ctx);
+	ft_free_res();
+	return ft_exit_code(ret);
+}
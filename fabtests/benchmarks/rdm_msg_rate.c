@@ -0,0 +1,812 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Multi-threaded message rate test for RDM endpoints.
+ *
+ * Each worker thread streams windows of tagged messages to its peer worker
+ * and waits for a zero-byte acknowledgement after every window.  Workers
+ * either own an endpoint in a shared domain (ep), share the control
+ * endpoint (shared), or own one tx/rx context pair of a scalable endpoint
+ * (sep).  The control endpoint set up by ft_init_fabric() is only used for
+ * address exchange and synchronization.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+enum rate_mode {
+	RATE_MODE_EP,
+	RATE_MODE_SHARED,
+	RATE_MODE_SEP,
+};
+
+enum rate_output {
+	RATE_OUT_TEXT,
+	RATE_OUT_CSV,
+	RATE_OUT_JSON,
+};
+
+static const char *rate_mode_str[] = {
+	[RATE_MODE_EP] = "ep",
+	[RATE_MODE_SHARED] = "shared",
+	[RATE_MODE_SEP] = "sep",
+};
+
+/* Keep benchmark tags clear of the sequence tags used on the control path */
+#define RATE_TAG_BASE	(1ULL << 40)
+#define RATE_DATA_TAG(id) (RATE_TAG_BASE | ((uint64_t) (id) << 1))
+#define RATE_ACK_TAG(id) (RATE_DATA_TAG(id) | 1)
+#define RATE_CQ_BATCH	16
+#define RATE_MAX_THREADS 256
+#define RATE_MAX_CPUS	1024
+
+struct rate_worker;
+
+struct rate_ctx {
+	struct fi_context2 context;
+	struct rate_worker *worker;
+};
+
+struct rate_worker {
+	int id;
+	pthread_t thread;
+	struct fid_ep *tx_ep;
+	struct fid_ep *rx_ep;
+	struct fid_cq *txcq;
+	struct fid_cq *rxcq;
+	struct fid_mr *mr;
+	void *desc;
+	char *buf;
+	fi_addr_t peer;
+	struct rate_ctx *ctx;
+	struct rate_ctx ack_ctx;
+
+	/* updated by whichever thread reaps the completion */
+	volatile uint64_t tx_done;
+	volatile uint64_t rx_done;
+	uint64_t tx_posted;
+	uint64_t rx_posted;
+
+	struct timespec start;
+	struct timespec end;
+	int ret;
+};
+
+static enum rate_mode mode = RATE_MODE_EP;
+static enum rate_output output = RATE_OUT_TEXT;
+static int thread_cnt = 1;
+static int force_thread_safe;
+static int *cpus;
+static int cpu_cnt;
+
+static struct rate_worker *workers;
+static struct fid_ep *sep;
+static struct fid_av *sep_av;
+static int rx_ctx_bits;
+static volatile int ready_cnt;
+
+static int rate_parse_cpus(char *list)
+{
+	char *tok, *saveptr, *dash;
+	int first, last, i;
+
+	cpus = calloc(RATE_MAX_CPUS, sizeof(*cpus));
+	if (!cpus)
+		return -FI_ENOMEM;
+
+	for (tok = strtok_r(list, ",", &saveptr); tok;
+	     tok = strtok_r(NULL, ",", &saveptr)) {
+		first = atoi(tok);
+		dash = strchr(tok, '-');
+		last = dash ? atoi(dash + 1) : first;
+		if (first < 0 || last < first || last >= RATE_MAX_CPUS)
+			return -FI_EINVAL;
+
+		for (i = first; i <= last && cpu_cnt < RATE_MAX_CPUS; i++)
+			cpus[cpu_cnt++] = i;
+	}
+
+	return cpu_cnt ? 0 : -FI_EINVAL;
+}
+
+static void rate_pin_thread(struct rate_worker *worker)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	cpu_set_t set;
+	int ret;
+
+	if (!cpu_cnt)
+		return;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpus[worker->id % cpu_cnt], &set);
+	ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (ret)
+		FT_PRINTERR("pthread_setaffinity_np", -ret);
+#endif
+}
+
+/*
+ * In shared mode any thread may reap another worker's completion, so
+ * completions are credited to the worker recorded in the context.
+ */
+static int rate_poll_cq(struct fid_cq *cq, int is_tx)
+{
+	struct fi_cq_tagged_entry comp[RATE_CQ_BATCH];
+	struct rate_ctx *ctx;
+	int ret, i;
+
+	ret = fi_cq_read(cq, comp, RATE_CQ_BATCH);
+	if (ret > 0) {
+		for (i = 0; i < ret; i++) {
+			ctx = comp[i].op_context;
+			if (is_tx)
+				__sync_fetch_and_add(&ctx->worker->tx_done, 1);
+			else
+				__sync_fetch_and_add(&ctx->worker->rx_done, 1);
+		}
+		return 0;
+	}
+
+	if (ret == -FI_EAVAIL)
+		return ft_cq_readerr(cq);
+
+	return ret == -FI_EAGAIN ? 0 : ret;
+}
+
+static int rate_wait(struct rate_worker *worker)
+{
+	int ret;
+
+	while (worker->tx_done < worker->tx_posted ||
+	       worker->rx_done < worker->rx_posted) {
+		if (worker->tx_done < worker->tx_posted) {
+			ret = rate_poll_cq(worker->txcq, 1);
+			if (ret)
+				return ret;
+		}
+		if (worker->rx_done < worker->rx_posted) {
+			ret = rate_poll_cq(worker->rxcq, 0);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int rate_post(struct rate_worker *worker, int is_tx, size_t size,
+		     void *buf, uint64_t tag, struct rate_ctx *ctx)
+{
+	int ret;
+
+	for (;;) {
+		if (is_tx)
+			ret = fi_tsend(worker->tx_ep, buf, size, worker->desc,
+				       worker->peer, tag, ctx);
+		else
+			ret = fi_trecv(worker->rx_ep, buf, size, worker->desc,
+				       FI_ADDR_UNSPEC, tag, 0, ctx);
+		if (!ret)
+			break;
+		if (ret != -FI_EAGAIN) {
+			FT_PRINTERR(is_tx ? "fi_tsend" : "fi_trecv", ret);
+			return ret;
+		}
+
+		ret = rate_poll_cq(is_tx ? worker->txcq : worker->rxcq, is_tx);
+		if (ret)
+			return ret;
+	}
+
+	if (is_tx)
+		worker->tx_posted++;
+	else
+		worker->rx_posted++;
+	return 0;
+}
+
+static int rate_window(struct rate_worker *worker, int cnt)
+{
+	size_t size = opts.transfer_size;
+	int ret, i;
+
+	if (opts.dst_addr) {
+		ret = rate_post(worker, 0, 0, NULL, RATE_ACK_TAG(worker->id),
+				&worker->ack_ctx);
+		if (ret)
+			return ret;
+
+		for (i = 0; i < cnt; i++) {
+			ret = rate_post(worker, 1, size, worker->buf + i * size,
+					RATE_DATA_TAG(worker->id),
+					&worker->ctx[i]);
+			if (ret)
+				return ret;
+		}
+		return rate_wait(worker);
+	}
+
+	for (i = 0; i < cnt; i++) {
+		ret = rate_post(worker, 0, size, worker->buf + i * size,
+				RATE_DATA_TAG(worker->id), &worker->ctx[i]);
+		if (ret)
+			return ret;
+	}
+
+	ret = rate_wait(worker);
+	if (ret)
+		return ret;
+
+	ret = rate_post(worker, 1, 0, NULL, RATE_ACK_TAG(worker->id),
+			&worker->ack_ctx);
+	if (ret)
+		return ret;
+
+	return rate_wait(worker);
+}
+
+static void *rate_worker_run(void *arg)
+{
+	struct rate_worker *worker = arg;
+	int total, cnt, i;
+
+	rate_pin_thread(worker);
+	worker->tx_done = worker->tx_posted = 0;
+	worker->rx_done = worker->rx_posted = 0;
+
+	__sync_fetch_and_add(&ready_cnt, 1);
+	while (ready_cnt < thread_cnt)
+		;
+
+	for (i = 0; i < opts.warmup_iterations; i += cnt) {
+		cnt = MIN(opts.window_size, opts.warmup_iterations - i);
+		worker->ret = rate_window(worker, cnt);
+		if (worker->ret)
+			return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &worker->start);
+	total = opts.iterations;
+	for (i = 0; i < total; i += cnt) {
+		cnt = MIN(opts.window_size, total - i);
+		worker->ret = rate_window(worker, cnt);
+		if (worker->ret)
+			return NULL;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &worker->end);
+
+	return NULL;
+}
+
+static int rate_alloc_worker_buf(struct rate_worker *worker, size_t size)
+{
+	int ret, i;
+
+	worker->buf = calloc(1, size);
+	worker->ctx = calloc(opts.window_size, sizeof(*worker->ctx));
+	if (!worker->buf || !worker->ctx)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < opts.window_size; i++)
+		worker->ctx[i].worker = worker;
+	worker->ack_ctx.worker = worker;
+
+	if (!(fi->domain_attr->mr_mode & FI_MR_LOCAL))
+		return 0;
+
+	ret = fi_mr_reg(domain, worker->buf, size, FI_SEND | FI_RECV, 0,
+			FT_TX_MR_KEY + 1 + worker->id, 0, &worker->mr, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_mr_reg", ret);
+		return ret;
+	}
+	worker->desc = fi_mr_desc(worker->mr);
+	return 0;
+}
+
+static int rate_open_cqs(struct rate_worker *worker)
+{
+	struct fi_cq_attr attr = {
+		.format = FI_CQ_FORMAT_TAGGED,
+		.wait_obj = FI_WAIT_NONE,
+		.size = opts.window_size + 1,
+	};
+	int ret;
+
+	ret = fi_cq_open(domain, &attr, &worker->txcq, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_cq_open", ret);
+		return ret;
+	}
+
+	ret = fi_cq_open(domain, &attr, &worker->rxcq, NULL);
+	if (ret)
+		FT_PRINTERR("fi_cq_open", ret);
+	return ret;
+}
+
+static int rate_setup_ep(void)
+{
+	struct fi_info *info;
+	struct rate_worker *worker;
+	int ret, i;
+
+	info = ft_dupinfo_ephemeral();
+	if (!info)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < thread_cnt; i++) {
+		worker = &workers[i];
+		ret = rate_open_cqs(worker);
+		if (ret)
+			goto out;
+
+		ret = fi_endpoint(domain, info, &worker->tx_ep, NULL);
+		if (ret) {
+			FT_PRINTERR("fi_endpoint", ret);
+			goto out;
+		}
+		worker->rx_ep = worker->tx_ep;
+
+		ret = ft_enable_ep(worker->tx_ep, eq, av, worker->txcq,
+				   worker->rxcq, NULL, NULL);
+		if (ret)
+			goto out;
+	}
+
+	for (i = 0; i < thread_cnt; i++) {
+		ret = ft_init_av_addr(av, workers[i].tx_ep, &workers[i].peer);
+		if (ret)
+			goto out;
+	}
+out:
+	fi_freeinfo(info);
+	return ret;
+}
+
+static int rate_setup_shared(void)
+{
+	int i;
+
+	for (i = 0; i < thread_cnt; i++) {
+		workers[i].tx_ep = ep;
+		workers[i].rx_ep = ep;
+		workers[i].txcq = txcq;
+		workers[i].rxcq = rxcq;
+		workers[i].peer = remote_fi_addr;
+	}
+	return 0;
+}
+
+static int rate_setup_sep(void)
+{
+	struct fi_av_attr attr = {
+		.type = fi->domain_attr->av_type,
+		.count = 1,
+	};
+	struct fi_info *info;
+	struct rate_worker *worker;
+	fi_addr_t remote_sep;
+	int ret, i;
+
+	info = ft_dupinfo_ephemeral();
+	if (!info)
+		return -FI_ENOMEM;
+
+	info->ep_attr->tx_ctx_cnt = thread_cnt;
+	info->ep_attr->rx_ctx_cnt = thread_cnt;
+	ret = fi_scalable_ep(domain, info, &sep, NULL);
+	fi_freeinfo(info);
+	if (ret) {
+		FT_PRINTERR("fi_scalable_ep", ret);
+		return ret;
+	}
+
+	while (thread_cnt >> ++rx_ctx_bits)
+		;
+	attr.rx_ctx_bits = rx_ctx_bits;
+	ret = fi_av_open(domain, &attr, &sep_av, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_av_open", ret);
+		return ret;
+	}
+
+	ret = fi_scalable_ep_bind(sep, &sep_av->fid, 0);
+	if (ret) {
+		FT_PRINTERR("fi_scalable_ep_bind", ret);
+		return ret;
+	}
+
+	for (i = 0; i < thread_cnt; i++) {
+		worker = &workers[i];
+		ret = rate_open_cqs(worker);
+		if (ret)
+			return ret;
+
+		ret = fi_tx_context(sep, i, NULL, &worker->tx_ep, NULL);
+		if (ret) {
+			FT_PRINTERR("fi_tx_context", ret);
+			return ret;
+		}
+		ret = fi_rx_context(sep, i, NULL, &worker->rx_ep, NULL);
+		if (ret) {
+			FT_PRINTERR("fi_rx_context", ret);
+			return ret;
+		}
+
+		FT_EP_BIND(worker->tx_ep, worker->txcq, FI_SEND);
+		FT_EP_BIND(worker->rx_ep, worker->rxcq, FI_RECV);
+
+		ret = fi_enable(worker->tx_ep);
+		if (ret) {
+			FT_PRINTERR("fi_enable", ret);
+			return ret;
+		}
+		ret = fi_enable(worker->rx_ep);
+		if (ret) {
+			FT_PRINTERR("fi_enable", ret);
+			return ret;
+		}
+	}
+
+	ret = fi_enable(sep);
+	if (ret) {
+		FT_PRINTERR("fi_enable", ret);
+		return ret;
+	}
+
+	ret = ft_init_av_addr(sep_av, sep, &remote_sep);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < thread_cnt; i++)
+		workers[i].peer = fi_rx_addr(remote_sep, i, rx_ctx_bits);
+	return 0;
+}
+
+static void rate_free_res(void)
+{
+	int i;
+
+	if (!workers)
+		return;
+
+	for (i = 0; i < thread_cnt; i++) {
+		if (mode != RATE_MODE_SHARED) {
+			if (workers[i].rx_ep != workers[i].tx_ep)
+				FT_CLOSE_FID(workers[i].rx_ep);
+			FT_CLOSE_FID(workers[i].tx_ep);
+			FT_CLOSE_FID(workers[i].txcq);
+			FT_CLOSE_FID(workers[i].rxcq);
+		}
+		FT_CLOSE_FID(workers[i].mr);
+		free(workers[i].buf);
+		free(workers[i].ctx);
+	}
+	FT_CLOSE_FID(sep);
+	FT_CLOSE_FID(sep_av);
+	free(workers);
+	workers = NULL;
+}
+
+static void rate_show(size_t size)
+{
+	static int header = 1;
+	struct timespec *start = NULL, *end = NULL;
+	double elapsed, total_rate, thread_rate, min_rate = 0, max_rate = 0;
+	uint64_t msgs = (uint64_t) opts.iterations * thread_cnt;
+	const char *prov, *threading;
+	int i;
+
+	for (i = 0; i < thread_cnt; i++) {
+		if (!start || get_elapsed(start, &workers[i].start, NANO) < 0)
+			start = &workers[i].start;
+		if (!end || get_elapsed(end, &workers[i].end, NANO) > 0)
+			end = &workers[i].end;
+
+		thread_rate = opts.iterations /
+			      (double) get_elapsed(&workers[i].start,
+						   &workers[i].end, MICRO);
+		if (!i || thread_rate < min_rate)
+			min_rate = thread_rate;
+		if (!i || thread_rate > max_rate)
+			max_rate = thread_rate;
+	}
+
+	elapsed = (double) get_elapsed(start, end, MICRO);
+	total_rate = msgs / elapsed;
+
+	prov = fi->fabric_attr->prov_name;
+	threading = fi_tostr(&fi->domain_attr->threading, FI_TYPE_THREADING);
+
+	switch (output) {
+	case RATE_OUT_CSV:
+		if (header)
+			printf("provider,mode,threading,threads,window,bytes,"
+			       "msgs,usec,Mmsgs/sec,MB/sec,"
+			       "min_thread_Mmsgs/sec,max_thread_Mmsgs/sec\n");
+		printf("%s,%s,%s,%d,%d,%zu,%" PRIu64 ",%.0f,%.4f,%.2f,"
+		       "%.4f,%.4f\n", prov, rate_mode_str[mode], threading,
+		       thread_cnt, opts.window_size, size, msgs, elapsed,
+		       total_rate, total_rate * size, min_rate, max_rate);
+		break;
+	case RATE_OUT_JSON:
+		printf("%s{ \"provider\": \"%s\", \"mode\": \"%s\", "
+		       "\"threading\": \"%s\", \"threads\": %d, "
+		       "\"window\": %d, \"bytes\": %zu, \"msgs\": %" PRIu64
+		       ", \"usec\": %.0f, \"mmsgs_per_sec\": %.4f, "
+		       "\"mb_per_sec\": %.2f, \"min_thread_mmsgs_per_sec\": "
+		       "%.4f, \"max_thread_mmsgs_per_sec\": %.4f }",
+		       header ? "[\n  " : ",\n  ", prov, rate_mode_str[mode],
+		       threading, thread_cnt, opts.window_size, size, msgs,
+		       elapsed, total_rate, total_rate * size, min_rate,
+		       max_rate);
+		break;
+	default:
+		if (header)
+			printf("# %s %s\n%-8s%-8s%-8s%-8s%-10s%8s %12s%10s"
+			       "%12s%12s\n", prov, threading, "mode",
+			       "threads", "window", "bytes", "msgs", "time",
+			       "Mmsgs/sec", "MB/sec", "min/thread",
+			       "max/thread");
+		printf("%-8s%-8d%-8d%-8zu%-10" PRIu64 "%8.2fs%12.4f%10.2f"
+		       "%12.4f%12.4f\n", rate_mode_str[mode], thread_cnt,
+		       opts.window_size, size, msgs, elapsed / 1000000.0,
+		       total_rate, total_rate * size, min_rate, max_rate);
+		break;
+	}
+	header = 0;
+}
+
+static int rate_run_size(size_t size)
+{
+	int ret, i;
+
+	opts.transfer_size = size;
+	ready_cnt = 0;
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < thread_cnt; i++) {
+		ret = pthread_create(&workers[i].thread, NULL,
+				     rate_worker_run, &workers[i]);
+		if (ret) {
+			FT_PRINTERR("pthread_create", -ret);
+			return -ret;
+		}
+	}
+
+	for (i = 0; i < thread_cnt; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].ret && !ret)
+			ret = workers[i].ret;
+	}
+	if (ret)
+		return ret;
+
+	rate_show(size);
+	return 0;
+}
+
+static int run(void)
+{
+	size_t max_size = 0;
+	int i, ret;
+
+	opts.av_size = thread_cnt + 1;
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	workers = calloc(thread_cnt, sizeof(*workers));
+	if (!workers)
+		return -FI_ENOMEM;
+
+	if (opts.options & FT_OPT_SIZE) {
+		max_size = opts.transfer_size;
+	} else {
+		for (i = 0; i < TEST_CNT; i++) {
+			if (ft_use_size(i, opts.sizes_enabled))
+				max_size = MAX(max_size, test_size[i].size);
+		}
+	}
+	max_size = MIN(max_size, fi->ep_attr->max_msg_size);
+
+	for (i = 0; i < thread_cnt; i++) {
+		workers[i].id = i;
+		ret = rate_alloc_worker_buf(&workers[i],
+					    max_size * opts.window_size);
+		if (ret)
+			return ret;
+	}
+
+	switch (mode) {
+	case RATE_MODE_SHARED:
+		ret = rate_setup_shared();
+		break;
+	case RATE_MODE_SEP:
+		ret = rate_setup_sep();
+		break;
+	default:
+		ret = rate_setup_ep();
+		break;
+	}
+	if (ret)
+		return ret;
+
+	if (opts.options & FT_OPT_SIZE) {
+		ret = rate_run_size(opts.transfer_size);
+	} else {
+		for (i = 0; i < TEST_CNT && !ret; i++) {
+			if (!ft_use_size(i, opts.sizes_enabled) ||
+			    test_size[i].size > max_size)
+				continue;
+			ret = rate_run_size(test_size[i].size);
+		}
+	}
+	if (ret)
+		return ret;
+
+	if (output == RATE_OUT_JSON)
+		printf("\n]\n");
+
+	return ft_finalize();
+}
+
+static void rate_usage(char *name)
+{
+	ft_csusage(name, "Multi-threaded message rate test for RDM endpoints.");
+	FT_PRINT_OPTS_USAGE("-W <window>", "number of messages in flight per "
+			    "thread (default: 64)");
+	FT_PRINT_OPTS_USAGE("-n <threads>", "number of worker threads "
+			    "(default: 1)");
+	FT_PRINT_OPTS_USAGE("-x <mode>", "ep: endpoint per thread, shared: "
+			    "one endpoint, sep: scalable endpoint context per "
+			    "thread (default: ep)");
+	FT_PRINT_OPTS_USAGE("-L", "request FI_THREAD_SAFE in every mode");
+	FT_PRINT_OPTS_USAGE("-A <cpu list>", "pin worker threads to cpus, "
+			    "e.g. 0,2,4-7");
+	FT_PRINT_OPTS_USAGE("-O <format>", "output format: text, csv, json");
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW;
+	opts.window_size = 64;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "W:n:x:LA:O:h" CS_OPTS INFO_OPTS)) !=
+	       -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'W':
+			opts.window_size = atoi(optarg);
+			break;
+		case 'n':
+			thread_cnt = atoi(optarg);
+			break;
+		case 'x':
+			if (!strcasecmp(optarg, "ep")) {
+				mode = RATE_MODE_EP;
+			} else if (!strcasecmp(optarg, "shared")) {
+				mode = RATE_MODE_SHARED;
+			} else if (!strcasecmp(optarg, "sep")) {
+				mode = RATE_MODE_SEP;
+			} else {
+				rate_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'L':
+			force_thread_safe = 1;
+			break;
+		case 'A':
+			if (rate_parse_cpus(optarg)) {
+				rate_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'O':
+			if (!strcasecmp(optarg, "csv")) {
+				output = RATE_OUT_CSV;
+			} else if (!strcasecmp(optarg, "json")) {
+				output = RATE_OUT_JSON;
+			} else if (!strcasecmp(optarg, "text")) {
+				output = RATE_OUT_TEXT;
+			} else {
+				rate_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+			rate_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	if (thread_cnt < 1 || thread_cnt > RATE_MAX_THREADS ||
+	    opts.window_size < 1) {
+		rate_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = FI_TAGGED;
+	hints->mode = FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->tx_attr->tclass = FI_TC_BULK_DATA;
+
+	if (force_thread_safe || mode == RATE_MODE_SHARED) {
+		hints->domain_attr->threading = FI_THREAD_SAFE;
+	} else {
+		hints->domain_attr->threading = FI_THREAD_COMPLETION;
+	}
+
+	if (mode == RATE_MODE_SEP) {
+		hints->caps |= FI_NAMED_RX_CTX;
+		hints->ep_attr->tx_ctx_cnt = thread_cnt;
+		hints->ep_attr->rx_ctx_cnt = thread_cnt;
+	}
+
+	ret = run();
+
+	rate_free_res();
+	ft_free_res();
+	free(cpus);
+	return ft_exit_code(ret);
+}
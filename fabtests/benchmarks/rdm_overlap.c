@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compute/communication overlap test for RDM endpoints.
+ *
+ * For each message size the client measures three things, averaged over
+ * the iterations:
+ *
+ *   comm    - time to post a window of sends and wait for completion
+ *   compute - time spent in a busy loop that never touches the CQ
+ *   total   - time to post the window, run the busy loop, then wait
+ *
+ * Overlap is the share of the shorter phase that was hidden by the
+ * longer one: (comm + compute - total) / min(comm, compute).  A provider
+ * that only makes progress from inside fi_cq_read shows little overlap
+ * for transfers that need more than one round trip (e.g. rendezvous).
+ * Set FI_PROGRESS_THREADS and request automatic progress (-r auto) to
+ * let tcp, shm and rxm hand progress to background threads and compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+static uint64_t compute_usec;
+static volatile double overlap_work;
+
+struct overlap_result {
+	double comm_usec;
+	double compute_usec;
+	double total_usec;
+};
+
+static void overlap_compute(uint64_t usec)
+{
+	struct timespec a, b;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	do {
+		for (i = 0; i < 256; i++)
+			overlap_work = overlap_work * 1.000001 + 1.0;
+		clock_gettime(CLOCK_MONOTONIC, &b);
+	} while ((uint64_t) get_elapsed(&a, &b, MICRO) < usec);
+}
+
+static int overlap_post_window(void)
+{
+	int i, ret;
+
+	for (i = 0; i < opts.window_size; i++) {
+		if (opts.dst_addr)
+			ret = ft_post_tx(ep, remote_fi_addr, opts.transfer_size,
+					 NO_CQ_DATA, &tx_ctx_arr[i].context);
+		else
+			ret = ft_post_rx(ep, opts.transfer_size,
+					 &rx_ctx_arr[i].context);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * The receiver acknowledges each window, so the client's timing covers
+ * delivery of the whole window.  As in bandwidth(), rx_seq is always one
+ * ahead because of the pre-posted control receive.
+ */
+static int overlap_wait_window(void)
+{
+	int ret;
+
+	if (opts.dst_addr) {
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			return ret;
+		return ft_rx(ep, 4);
+	}
+
+	ret = ft_get_rx_comp(rx_seq - 1);
+	if (ret)
+		return ret;
+	return ft_tx(ep, remote_fi_addr, 4, &tx_ctx);
+}
+
+/* One window; if usec is non-zero, compute between posting and waiting */
+static int overlap_window(uint64_t usec, int64_t *elapsed)
+{
+	struct timespec a, b;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	ret = overlap_post_window();
+	if (ret)
+		return ret;
+
+	if (usec)
+		overlap_compute(usec);
+
+	ret = overlap_wait_window();
+	if (ret)
+		return ret;
+	clock_gettime(CLOCK_MONOTONIC, &b);
+
+	*elapsed = get_elapsed(&a, &b, NANO);
+	return 0;
+}
+
+/*
+ * The server only receives.  It runs the same number of windows and
+ * keeps polling, so any lack of overlap comes from the client side.
+ */
+static int overlap_phase(uint64_t usec, double *avg_usec)
+{
+	int64_t elapsed, sum = 0;
+	int i, ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		ret = overlap_window(opts.dst_addr ? usec : 0, &elapsed);
+		if (ret)
+			return ret;
+		if (i >= opts.warmup_iterations)
+			sum += elapsed;
+	}
+
+	*avg_usec = sum / 1000.0 / opts.iterations;
+	return 0;
+}
+
+static int overlap_test(struct overlap_result *res)
+{
+	struct timespec a, b;
+	uint64_t usec;
+	int ret;
+
+	ret = overlap_phase(0, &res->comm_usec);
+	if (ret)
+		return ret;
+
+	usec = compute_usec ? compute_usec : (uint64_t) res->comm_usec;
+	if (!usec)
+		usec = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	overlap_compute(usec);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	res->compute_usec = get_elapsed(&a, &b, NANO) / 1000.0;
+
+	return overlap_phase(usec, &res->total_usec);
+}
+
+static void overlap_print_header(void)
+{
+	const char *model;
+
+	switch (fi->domain_attr->data_progress) {
+	case FI_PROGRESS_AUTO:
+		model = "auto";
+		break;
+	case FI_PROGRESS_MANUAL:
+		model = "manual";
+		break;
+	default:
+		model = "unspec";
+		break;
+	}
+
+	printf("# provider: %s, data progress: %s, window: %d\n",
+	       fi->fabric_attr->prov_name, model, opts.window_size);
+	printf("%-10s %12s %12s %12s %9s\n", "bytes", "comm(us)",
+	       "compute(us)", "total(us)", "overlap%");
+}
+
+static void overlap_print(struct overlap_result *res)
+{
+	double shorter, overlap;
+	char str[FT_STR_LEN];
+
+	shorter = MIN(res->comm_usec, res->compute_usec);
+	overlap = shorter > 0 ? (res->comm_usec + res->compute_usec -
+				 res->total_usec) / shorter * 100.0 : 0;
+	if (overlap < 0)
+		overlap = 0;
+	else if (overlap > 100)
+		overlap = 100;
+
+	printf("%-10s %12.2f %12.2f %12.2f %9.1f\n",
+	       size_str(str, opts.transfer_size), res->comm_usec,
+	       res->compute_usec, res->total_usec, overlap);
+}
+
+static int run_size(void)
+{
+	struct overlap_result res;
+	int ret;
+
+	ret = overlap_test(&res);
+	if (ret)
+		return ret;
+
+	if (opts.dst_addr)
+		overlap_print(&res);
+	return 0;
+}
+
+static int run(void)
+{
+	int i, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	if (opts.dst_addr)
+		overlap_print_header();
+
+	if (!(opts.options & FT_OPT_SIZE)) {
+		for (i = 0; i < TEST_CNT; i++) {
+			if (!ft_use_size(i, opts.sizes_enabled))
+				continue;
+			opts.transfer_size = test_size[i].size;
+			if (opts.transfer_size > fi->ep_attr->max_msg_size)
+				continue;
+			ret = run_size();
+			if (ret)
+				return ret;
+		}
+	} else {
+		ret = run_size();
+		if (ret)
+			return ret;
+	}
+
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	enum fi_progress progress = FI_PROGRESS_UNSPEC;
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW;
+	opts.window_size = 16;
+	opts.iterations = 100;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "x:r:h" CS_OPTS INFO_OPTS
+			    BENCHMARK_OPTS)) != -1) {
+		switch (op) {
+		case 'x':
+			compute_usec = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			if (!strcasecmp(optarg, "auto")) {
+				progress = FI_PROGRESS_AUTO;
+			} else if (!strcasecmp(optarg, "manual")) {
+				progress = FI_PROGRESS_MANUAL;
+			} else {
+				fprintf(stderr, "unknown progress model %s\n",
+					optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Compute/communication overlap test "
+				   "for RDM endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-x <usec>", "compute time per window "
+					    "(default: measured comm time)");
+			FT_PRINT_OPTS_USAGE("-r <auto|manual>", "data progress "
+					    "model to request (default: provider's)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+	hints->domain_attr->data_progress = progress;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
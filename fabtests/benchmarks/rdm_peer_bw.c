@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Many-peer bandwidth test for RDM endpoints.
+ *
+ * The client opens a number of endpoints (-c), each of which is a
+ * separate peer of the server's single endpoint, and streams a window of
+ * messages from every peer at once.  The server acknowledges each round
+ * once all messages have arrived.  Reported bandwidth is the aggregate
+ * over all peers.  With connection-based providers each peer is its own
+ * connection, so this shows how well the receive side scales with the
+ * number of connections (e.g. FI_SOCKETS_PE_WORKERS for sockets).
+ *
+ * With -u every round is an unexpected message storm: the client posts
+ * sends from all peers until the provider pushes back, and only then
+ * does the server drain them and post its receives.  This shows how the
+ * receive side holds unexpected messages and what that costs the
+ * senders.  Synchronization moves out of band in this mode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+static int peer_cnt = 8;
+static int storm;
+static struct fid_ep **peer_eps;
+static struct fi_context *peer_ctx;
+
+static int peer_setup_eps(void)
+{
+	struct fi_info *info;
+	int ret = 0, i;
+
+	peer_eps = calloc(peer_cnt, sizeof(*peer_eps));
+	peer_ctx = calloc((size_t) peer_cnt * opts.window_size,
+			  sizeof(*peer_ctx));
+	if (!peer_eps || !peer_ctx)
+		return -FI_ENOMEM;
+
+	/* The server receives every peer on its control endpoint */
+	if (!opts.dst_addr)
+		return 0;
+
+	peer_eps[0] = ep;
+	info = ft_dupinfo_ephemeral();
+	if (!info)
+		return -FI_ENOMEM;
+
+	for (i = 1; i < peer_cnt; i++) {
+		ret = fi_endpoint(domain, info, &peer_eps[i], NULL);
+		if (ret) {
+			FT_PRINTERR("fi_endpoint", ret);
+			break;
+		}
+
+		ret = ft_enable_ep(peer_eps[i], eq, av, txcq, rxcq,
+				   NULL, NULL);
+		if (ret)
+			break;
+	}
+
+	fi_freeinfo(info);
+	return ret;
+}
+
+static void peer_free_eps(void)
+{
+	int i;
+
+	if (peer_eps) {
+		for (i = 1; i < peer_cnt; i++)
+			FT_CLOSE_FID(peer_eps[i]);
+	}
+	free(peer_eps);
+	free(peer_ctx);
+}
+
+/* Posts sends without retrying, returning how many were accepted */
+static int peer_post_storm(void)
+{
+	ssize_t ret;
+	int i;
+
+	for (i = 0; i < opts.window_size * peer_cnt; i++) {
+		ret = fi_send(peer_eps[i % peer_cnt], tx_buf,
+			      opts.transfer_size + ft_tx_prefix_size(),
+			      mr_desc, remote_fi_addr, &peer_ctx[i]);
+		if (ret == -FI_EAGAIN)
+			break;
+		if (ret) {
+			FT_PRINTERR("fi_send", ret);
+			return (int) ret;
+		}
+		tx_seq++;
+	}
+	return i;
+}
+
+/*
+ * Posts are interleaved across peers so that all connections have data
+ * in flight together.  As in bandwidth(), the server's rx_seq is one
+ * ahead because of the pre-posted control receive.
+ */
+static int peer_round(void)
+{
+	int i = 0, ret;
+
+	if (opts.dst_addr) {
+		if (storm) {
+			i = peer_post_storm();
+			if (i < 0)
+				return i;
+			ret = ft_sync();
+			if (ret)
+				return ret;
+		}
+
+		for (; i < opts.window_size * peer_cnt; i++) {
+			ret = ft_post_tx(peer_eps[i % peer_cnt], remote_fi_addr,
+					 opts.transfer_size, NO_CQ_DATA,
+					 &peer_ctx[i]);
+			if (ret)
+				return ret;
+		}
+
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			return ret;
+		return ft_rx(ep, 4);
+	}
+
+	if (storm) {
+		ret = ft_sync();
+		if (ret)
+			return ret;
+		/* progress queues the storm as unexpected messages */
+		(void) fi_cq_read(rxcq, NULL, 0);
+	}
+
+	for (i = 0; i < opts.window_size * peer_cnt; i++) {
+		ret = ft_post_rx(ep, opts.transfer_size, &peer_ctx[i]);
+		if (ret)
+			return ret;
+	}
+
+	ret = ft_get_rx_comp(rx_seq - 1);
+	if (ret)
+		return ret;
+	return ft_tx(ep, remote_fi_addr, 4, &tx_ctx);
+}
+
+/*
+ * The server's last receive of the previous size is still posted, and is
+ * only as large as that size.  An in-band sync completes it and reposts a
+ * full-size buffer before the next size starts, even with -b or -u,
+ * where ft_sync() goes out of band.
+ */
+static int peer_sync(void)
+{
+	int ret;
+
+	if (opts.dst_addr) {
+		ret = ft_tx(ep, remote_fi_addr, 1, &tx_ctx);
+		if (ret)
+			return ret;
+		return ft_rx(ep, 1);
+	}
+
+	ret = ft_rx(ep, 1);
+	if (ret)
+		return ret;
+	return ft_tx(ep, remote_fi_addr, 1, &tx_ctx);
+}
+
+static int run_size(void)
+{
+	char name[FT_STR_LEN];
+	int i, ret;
+
+	ret = peer_sync();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		if (i == opts.warmup_iterations)
+			ft_start();
+		ret = peer_round();
+		if (ret)
+			return ret;
+	}
+	ft_stop();
+
+	if (opts.dst_addr) {
+		snprintf(name, sizeof(name), "%d_peers", peer_cnt);
+		show_perf(name, opts.transfer_size, opts.iterations, &start,
+			  &end, opts.window_size * peer_cnt);
+	}
+	return 0;
+}
+
+static int run(void)
+{
+	int i, ret;
+
+	opts.av_size = peer_cnt + 1;
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	ret = peer_setup_eps();
+	if (ret)
+		return ret;
+
+	if (!(opts.options & FT_OPT_SIZE)) {
+		for (i = 0; i < TEST_CNT; i++) {
+			if (!ft_use_size(i, opts.sizes_enabled))
+				continue;
+			opts.transfer_size = test_size[i].size;
+			if (opts.transfer_size > fi->ep_attr->max_msg_size)
+				continue;
+			ret = run_size();
+			if (ret)
+				return ret;
+		}
+	} else {
+		ret = run_size();
+		if (ret)
+			return ret;
+	}
+
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW;
+	opts.window_size = 16;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "c:uh" CS_OPTS INFO_OPTS
+			    BENCHMARK_OPTS)) != -1) {
+		switch (op) {
+		case 'c':
+			peer_cnt = atoi(optarg);
+			if (peer_cnt < 1) {
+				fprintf(stderr, "peer count must be positive\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'u':
+			storm = 1;
+			opts.options |= FT_OPT_OOB_SYNC | FT_OPT_OOB_ADDR_EXCH;
+			break;
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Many-peer bandwidth test for RDM "
+				   "endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-c <int>", "number of client peers, "
+					    "each with its own endpoint "
+					    "(default: 8)");
+			FT_PRINT_OPTS_USAGE("-u", "unexpected message storm: "
+					    "receives are posted after the "
+					    "sends");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = run();
+
+	peer_free_eps();
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,714 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Tag matching stress test for RDM endpoints.
+ *
+ * For every (K, M) pair both peers pre-post K receives that never match
+ * the measured traffic, a configurable share of which use wildcard tags.
+ * Every message in the measured phases must therefore be compared against
+ * the K pre-posted entries:
+ *
+ *  - posted latency: tagged pingpong, receives posted ahead of the send
+ *  - posted rate: windows of tagged sends into pre-posted receives
+ *  - unexpected: each side sends M messages ahead of their receives,
+ *    which are then posted in reverse order, so that every receive has to
+ *    search the whole unexpected queue
+ *
+ * The K filler receives are consumed by matching sends at the end of each
+ * pass, so the test does not rely on fi_cancel support.  Measured traffic
+ * runs over a dedicated endpoint; the control endpoint is only used for
+ * address exchange and synchronization.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+enum match_output {
+	MATCH_OUT_TEXT,
+	MATCH_OUT_CSV,
+	MATCH_OUT_JSON,
+};
+
+/* The upper tag bits select the traffic class, the lower bits an index */
+#define MATCH_FILLER_TAG	(1ULL << 32)
+#define MATCH_UNEXP_TAG		(2ULL << 32)
+#define MATCH_DATA_TAG		(3ULL << 32)
+#define MATCH_MARKER_TAG	(4ULL << 32)
+#define MATCH_GO_TAG		(MATCH_MARKER_TAG | 1)
+#define MATCH_REPLY_TAG		(MATCH_MARKER_TAG | 2)
+#define MATCH_INDEX_MASK	0xFFFFFFFFULL
+
+#define MATCH_MAX_DEPTHS	16
+#define MATCH_CQ_BATCH		16
+
+static size_t default_depths[] = { 0, 16, 256, 1024 };
+
+static size_t posted_depths[MATCH_MAX_DEPTHS];
+static size_t unexp_depths[MATCH_MAX_DEPTHS];
+static int posted_cnt, unexp_cnt;
+static int wildcard_pct;
+static int any_source;
+static enum match_output output = MATCH_OUT_TEXT;
+
+static struct fid_ep *data_ep;
+static struct fid_cq *data_txcq, *data_rxcq;
+static struct fid_mr *data_mr;
+static void *data_desc;
+static char *data_buf;
+static fi_addr_t data_peer;
+static struct fi_context2 *match_filler_ctx, *match_rx_ctx, *match_tx_ctx;
+static size_t rx_ring, tx_ring, max_posted, max_unexp;
+static uint64_t tx_posted, tx_done, rx_posted, rx_done;
+
+struct match_result {
+	size_t posted;
+	size_t unexp;
+	double lat_usec;
+	double rate;
+	double unexp_usec;
+};
+
+static int match_parse_depths(char *list, size_t *depths, int *cnt)
+{
+	char *tok, *saveptr;
+
+	*cnt = 0;
+	for (tok = strtok_r(list, ",", &saveptr); tok;
+	     tok = strtok_r(NULL, ",", &saveptr)) {
+		if (*cnt == MATCH_MAX_DEPTHS || atol(tok) < 0 ||
+		    atol(tok) > MATCH_INDEX_MASK)
+			return -FI_EINVAL;
+		depths[(*cnt)++] = atol(tok);
+	}
+	return *cnt ? 0 : -FI_EINVAL;
+}
+
+static int match_poll(struct fid_cq *cq, uint64_t *done)
+{
+	struct fi_cq_tagged_entry comp[MATCH_CQ_BATCH];
+	int ret;
+
+	ret = fi_cq_read(cq, comp, MATCH_CQ_BATCH);
+	if (ret > 0) {
+		*done += ret;
+		return 0;
+	}
+
+	if (ret == -FI_EAVAIL)
+		return ft_cq_readerr(cq);
+
+	return ret == -FI_EAGAIN ? 0 : ret;
+}
+
+static int match_wait(uint64_t tx_target, uint64_t rx_target)
+{
+	int ret;
+
+	while (tx_done < tx_target || rx_done < rx_target) {
+		if (tx_done < tx_target) {
+			ret = match_poll(data_txcq, &tx_done);
+			if (ret)
+				return ret;
+		}
+		if (rx_done < rx_target) {
+			ret = match_poll(data_rxcq, &rx_done);
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+static int match_wait_all(void)
+{
+	return match_wait(tx_posted, rx_posted);
+}
+
+static inline char *match_slot(size_t i)
+{
+	return data_buf + (i % rx_ring) * opts.transfer_size;
+}
+
+static int match_trecv(uint64_t tag, uint64_t ignore, void *buf,
+		       struct fi_context2 *ctx)
+{
+	int ret;
+
+	for (;;) {
+		ret = fi_trecv(data_ep, buf, opts.transfer_size, data_desc,
+			       any_source ? FI_ADDR_UNSPEC : data_peer,
+			       tag, ignore, ctx);
+		if (!ret)
+			return 0;
+		if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_trecv", ret);
+			return ret;
+		}
+		ret = match_poll(data_rxcq, &rx_done);
+		if (ret)
+			return ret;
+	}
+}
+
+static int match_post_recv(uint64_t tag, size_t slot)
+{
+	int ret;
+
+	ret = match_trecv(tag, 0, match_slot(slot),
+			  &match_rx_ctx[rx_posted % rx_ring]);
+	if (!ret)
+		rx_posted++;
+	return ret;
+}
+
+static int match_post_send(uint64_t tag, size_t size)
+{
+	int ret;
+
+	for (;;) {
+		ret = fi_tsend(data_ep, data_buf, size, data_desc, data_peer,
+			       tag, &match_tx_ctx[tx_posted % tx_ring]);
+		if (!ret)
+			break;
+		if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_tsend", ret);
+			return ret;
+		}
+		ret = match_poll(data_txcq, &tx_done);
+		if (ret)
+			return ret;
+	}
+	tx_posted++;
+	return 0;
+}
+
+/*
+ * Fillers are not counted in rx_posted until they are drained, as they
+ * stay queued for the whole pass.  Wildcard fillers are spread evenly
+ * across the queue.
+ */
+static int match_post_fillers(size_t cnt)
+{
+	uint64_t ignore;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < cnt; i++) {
+		ignore = ((i + 1) * wildcard_pct / 100 != i * wildcard_pct / 100) ?
+			 MATCH_INDEX_MASK : 0;
+		ret = match_trecv(MATCH_FILLER_TAG | i, ignore, data_buf,
+				  &match_filler_ctx[i]);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Filler messages are matched in order, so message i always lands in the
+ * i'th filler receive whether that receive is specific or a wildcard.
+ */
+static int match_drain_fillers(size_t cnt)
+{
+	size_t i;
+	int ret;
+
+	for (i = 0; i < cnt; i++) {
+		ret = match_post_send(MATCH_FILLER_TAG | i, 0);
+		if (ret)
+			return ret;
+	}
+	rx_posted += cnt;
+	return match_wait_all();
+}
+
+static int match_latency(struct match_result *res)
+{
+	struct timespec a, b;
+	int i, ret, total;
+
+	total = opts.iterations + opts.warmup_iterations;
+	if (opts.dst_addr) {
+		for (i = 0; i < total; i++) {
+			if (i == opts.warmup_iterations)
+				clock_gettime(CLOCK_MONOTONIC, &a);
+
+			ret = match_post_recv(MATCH_REPLY_TAG, 0);
+			if (ret)
+				return ret;
+			ret = match_post_send(MATCH_DATA_TAG | i,
+					      opts.transfer_size);
+			if (ret)
+				return ret;
+			ret = match_wait_all();
+			if (ret)
+				return ret;
+		}
+	} else {
+		ret = match_post_recv(MATCH_DATA_TAG, 0);
+		if (ret)
+			return ret;
+
+		for (i = 0; i < total; i++) {
+			if (i == opts.warmup_iterations)
+				clock_gettime(CLOCK_MONOTONIC, &a);
+
+			ret = match_wait(tx_posted, rx_posted);
+			if (ret)
+				return ret;
+			/* post the next receive before the peer can send */
+			if (i + 1 < total) {
+				ret = match_post_recv(MATCH_DATA_TAG | (i + 1),
+						      i + 1);
+				if (ret)
+					return ret;
+			}
+			ret = match_post_send(MATCH_REPLY_TAG, 0);
+			if (ret)
+				return ret;
+			ret = match_wait(tx_posted, rx_posted - (i + 1 < total));
+			if (ret)
+				return ret;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &b);
+
+	res->lat_usec = get_elapsed(&a, &b, NANO) / 1000.0 /
+			opts.iterations / 2;
+	return 0;
+}
+
+static int match_rate(struct match_result *res)
+{
+	struct timespec a, b;
+	int i, j, ret, cnt;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	for (i = 0; i < opts.iterations; i += cnt) {
+		cnt = MIN(opts.window_size, opts.iterations - i);
+		if (opts.dst_addr) {
+			ret = match_post_recv(MATCH_GO_TAG, 0);
+			if (ret)
+				return ret;
+			ret = match_wait_all();
+			if (ret)
+				return ret;
+
+			for (j = 0; j < cnt; j++) {
+				ret = match_post_send(MATCH_DATA_TAG | (i + j),
+						      opts.transfer_size);
+				if (ret)
+					return ret;
+			}
+		} else {
+			for (j = 0; j < cnt; j++) {
+				ret = match_post_recv(MATCH_DATA_TAG | (i + j),
+						      j);
+				if (ret)
+					return ret;
+			}
+			ret = match_post_send(MATCH_GO_TAG, 0);
+			if (ret)
+				return ret;
+		}
+		ret = match_wait_all();
+		if (ret)
+			return ret;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &b);
+
+	res->rate = opts.iterations / (double) get_elapsed(&a, &b, MICRO);
+	return 0;
+}
+
+/*
+ * The marker follows the unexpected messages on the same path, so once it
+ * is received the peer's messages are queued as unexpected.
+ */
+static int match_unexp(struct match_result *res)
+{
+	struct timespec a, b;
+	uint64_t tx_target;
+	size_t i;
+	int ret;
+
+	ret = match_post_recv(MATCH_MARKER_TAG, 0);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < res->unexp; i++) {
+		ret = match_post_send(MATCH_UNEXP_TAG | i, opts.transfer_size);
+		if (ret)
+			return ret;
+	}
+	ret = match_post_send(MATCH_MARKER_TAG, 0);
+	if (ret)
+		return ret;
+
+	tx_target = tx_posted;
+	ret = match_wait(0, rx_posted);
+	if (ret)
+		return ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	for (i = res->unexp; i > 0; i--) {
+		ret = match_post_recv(MATCH_UNEXP_TAG | (i - 1), i);
+		if (ret)
+			return ret;
+	}
+	ret = match_wait(0, rx_posted);
+	if (ret)
+		return ret;
+	clock_gettime(CLOCK_MONOTONIC, &b);
+
+	res->unexp_usec = res->unexp ?
+			  get_elapsed(&a, &b, NANO) / 1000.0 / res->unexp : 0;
+	return match_wait(tx_target, 0);
+}
+
+static void match_show(struct match_result *res)
+{
+	static int header = 1;
+	const char *prov = fi->fabric_attr->prov_name;
+
+	switch (output) {
+	case MATCH_OUT_CSV:
+		if (header)
+			printf("provider,posted,unexpected,wildcard_pct,"
+			       "any_source,bytes,iters,posted_lat_usec,"
+			       "posted_Mmsgs/sec,unexp_usec/msg\n");
+		printf("%s,%zu,%zu,%d,%d,%zu,%d,%.3f,%.4f,%.3f\n", prov,
+		       res->posted, res->unexp, wildcard_pct, any_source,
+		       opts.transfer_size, opts.iterations, res->lat_usec,
+		       res->rate, res->unexp_usec);
+		break;
+	case MATCH_OUT_JSON:
+		printf("%s{ \"provider\": \"%s\", \"posted\": %zu, "
+		       "\"unexpected\": %zu, \"wildcard_pct\": %d, "
+		       "\"any_source\": %s, \"bytes\": %zu, \"iters\": %d, "
+		       "\"posted_lat_usec\": %.3f, "
+		       "\"posted_mmsgs_per_sec\": %.4f, "
+		       "\"unexp_usec_per_msg\": %.3f }",
+		       header ? "[\n  " : ",\n  ", prov, res->posted,
+		       res->unexp, wildcard_pct,
+		       any_source ? "true" : "false", opts.transfer_size,
+		       opts.iterations, res->lat_usec, res->rate,
+		       res->unexp_usec);
+		break;
+	default:
+		if (header)
+			printf("# %s wildcard %d%%%s\n%-10s%-10s%-8s%-8s%14s"
+			       "%12s%16s\n", prov, wildcard_pct,
+			       any_source ? " any source" : "", "posted",
+			       "unexp", "bytes", "iters", "lat usec",
+			       "Mmsgs/sec", "unexp usec/msg");
+		printf("%-10zu%-10zu%-8zu%-8d%14.3f%12.4f%16.3f\n",
+		       res->posted, res->unexp, opts.transfer_size,
+		       opts.iterations, res->lat_usec, res->rate,
+		       res->unexp_usec);
+		break;
+	}
+	header = 0;
+}
+
+static int match_run_pass(size_t posted, size_t unexp)
+{
+	struct match_result res = { .posted = posted, .unexp = unexp };
+	int ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ret = match_post_fillers(posted);
+	if (ret)
+		return ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ret = match_latency(&res);
+	if (ret)
+		return ret;
+
+	ret = match_rate(&res);
+	if (ret)
+		return ret;
+
+	ret = match_unexp(&res);
+	if (ret)
+		return ret;
+
+	ret = match_drain_fillers(posted);
+	if (ret)
+		return ret;
+
+	match_show(&res);
+	return 0;
+}
+
+static int match_open_data_ep(void)
+{
+	struct fi_cq_attr cq_attr = {
+		.format = FI_CQ_FORMAT_TAGGED,
+		.wait_obj = FI_WAIT_NONE,
+	};
+	struct fi_info *info;
+	size_t buf_size;
+	int ret;
+
+	rx_ring = MAX(max_unexp, (size_t) opts.window_size) + 2;
+	tx_ring = MAX(rx_ring, max_posted + 1);
+	match_filler_ctx = calloc(max_posted + 1, sizeof(*match_filler_ctx));
+	match_rx_ctx = calloc(rx_ring, sizeof(*match_rx_ctx));
+	match_tx_ctx = calloc(tx_ring, sizeof(*match_tx_ctx));
+	buf_size = rx_ring * MAX(opts.transfer_size, 1);
+	data_buf = calloc(1, buf_size);
+	if (!match_filler_ctx || !match_rx_ctx || !match_tx_ctx || !data_buf)
+		return -FI_ENOMEM;
+
+	if (fi->domain_attr->mr_mode & FI_MR_LOCAL) {
+		ret = fi_mr_reg(domain, data_buf, buf_size, FI_SEND | FI_RECV,
+				0, FT_TX_MR_KEY + 1, 0, &data_mr, NULL);
+		if (ret) {
+			FT_PRINTERR("fi_mr_reg", ret);
+			return ret;
+		}
+		data_desc = fi_mr_desc(data_mr);
+	}
+
+	cq_attr.size = tx_ring + max_posted;
+	ret = fi_cq_open(domain, &cq_attr, &data_txcq, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_cq_open", ret);
+		return ret;
+	}
+	ret = fi_cq_open(domain, &cq_attr, &data_rxcq, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_cq_open", ret);
+		return ret;
+	}
+
+	info = ft_dupinfo_ephemeral();
+	if (!info)
+		return -FI_ENOMEM;
+
+	ret = fi_endpoint(domain, info, &data_ep, NULL);
+	fi_freeinfo(info);
+	if (ret) {
+		FT_PRINTERR("fi_endpoint", ret);
+		return ret;
+	}
+
+	ret = ft_enable_ep(data_ep, eq, av, data_txcq, data_rxcq, NULL, NULL);
+	if (ret)
+		return ret;
+
+	return ft_init_av_addr(av, data_ep, &data_peer);
+}
+
+static void match_free_res(void)
+{
+	FT_CLOSE_FID(data_ep);
+	FT_CLOSE_FID(data_txcq);
+	FT_CLOSE_FID(data_rxcq);
+	FT_CLOSE_FID(data_mr);
+	free(data_buf);
+	free(match_filler_ctx);
+	free(match_rx_ctx);
+	free(match_tx_ctx);
+}
+
+static int run(void)
+{
+	int i, j, ret;
+
+	opts.av_size = 2;
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < posted_cnt; i++)
+		max_posted = MAX(max_posted, posted_depths[i]);
+	for (i = 0; i < unexp_cnt; i++)
+		max_unexp = MAX(max_unexp, unexp_depths[i]);
+
+	ret = match_open_data_ep();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < posted_cnt; i++) {
+		for (j = 0; j < unexp_cnt; j++) {
+			if (posted_depths[i] + MAX(unexp_depths[j],
+			    (size_t) opts.window_size) + 2 >
+			    fi->rx_attr->size ||
+			    unexp_depths[j] + 1 > fi->tx_attr->size) {
+				fprintf(stderr, "skipping posted %zu unexpected "
+					"%zu: exceeds queue size\n",
+					posted_depths[i], unexp_depths[j]);
+				continue;
+			}
+
+			ret = match_run_pass(posted_depths[i],
+					     unexp_depths[j]);
+			if (ret)
+				return ret;
+		}
+	}
+
+	if (output == MATCH_OUT_JSON)
+		printf("\n]\n");
+
+	return ft_finalize();
+}
+
+static void match_usage(char *name)
+{
+	ft_csusage(name, "Tag matching stress test for RDM endpoints.");
+	FT_PRINT_OPTS_USAGE("-q <list>", "comma separated numbers of "
+			    "pre-posted non-matching receives "
+			    "(default: 0,16,256,1024)");
+	FT_PRINT_OPTS_USAGE("-u <list>", "comma separated numbers of "
+			    "unexpected messages (default: 0,16,256,1024)");
+	FT_PRINT_OPTS_USAGE("-X <percent>", "share of pre-posted receives "
+			    "using wildcard tags (default: 0)");
+	FT_PRINT_OPTS_USAGE("-y", "post receives from any source");
+	FT_PRINT_OPTS_USAGE("-W <window>", "messages per window in the rate "
+			    "phase (default: 64)");
+	FT_PRINT_OPTS_USAGE("-O <format>", "output format: text, csv, json");
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.window_size = 64;
+	opts.transfer_size = 64;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "q:u:X:yW:O:h" CS_OPTS INFO_OPTS)) !=
+	       -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'q':
+			if (match_parse_depths(optarg, posted_depths,
+					       &posted_cnt)) {
+				match_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'u':
+			if (match_parse_depths(optarg, unexp_depths,
+					       &unexp_cnt)) {
+				match_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'X':
+			wildcard_pct = atoi(optarg);
+			break;
+		case 'y':
+			any_source = 1;
+			break;
+		case 'W':
+			opts.window_size = atoi(optarg);
+			break;
+		case 'O':
+			if (!strcasecmp(optarg, "csv")) {
+				output = MATCH_OUT_CSV;
+			} else if (!strcasecmp(optarg, "json")) {
+				output = MATCH_OUT_JSON;
+			} else if (!strcasecmp(optarg, "text")) {
+				output = MATCH_OUT_TEXT;
+			} else {
+				match_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+			match_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	if (wildcard_pct < 0 || wildcard_pct > 100 || opts.window_size < 1) {
+		match_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!posted_cnt) {
+		memcpy(posted_depths, default_depths, sizeof(default_depths));
+		posted_cnt = ARRAY_SIZE(default_depths);
+	}
+	if (!unexp_cnt) {
+		memcpy(unexp_depths, default_depths, sizeof(default_depths));
+		unexp_cnt = ARRAY_SIZE(default_depths);
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = FI_TAGGED;
+	if (!any_source)
+		hints->caps |= FI_DIRECTED_RECV;
+	hints->mode = FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+	hints->tx_attr->msg_order = FI_ORDER_SAS;
+	hints->rx_attr->msg_order = FI_ORDER_SAS;
+
+	ret = run();
+
+	match_free_res();
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * RMA message rate test against many registered regions.
+ *
+ * The server registers -R regions of the transfer size and sends their
+ * keys to the client, which then issues small RMA operations in windows,
+ * each targeting a different region in a scattered order.  Every
+ * operation makes the target look its key up, so with enough regions the
+ * result reflects the cost of the provider's memory key verification.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+#define RATE_MR_KEY 0x100000
+
+static int region_cnt = 16384;
+static char *region_buf;
+static struct fid_mr **region_mr;
+static struct fi_rma_iov *region_iov;
+
+static int rate_reg_regions(void)
+{
+	uint64_t key;
+	char *region;
+	int i, ret;
+
+	region_buf = calloc(region_cnt, opts.transfer_size);
+	region_mr = calloc(region_cnt, sizeof(*region_mr));
+	if (!region_buf || !region_mr)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < region_cnt; i++) {
+		region = region_buf + (size_t) i * opts.transfer_size;
+		key = (fi->domain_attr->mr_mode & FI_MR_PROV_KEY) ?
+		      0 : RATE_MR_KEY + i;
+		ret = fi_mr_reg(domain, region, opts.transfer_size,
+				FI_REMOTE_READ | FI_REMOTE_WRITE, 0, key, 0,
+				&region_mr[i], NULL);
+		if (ret) {
+			FT_PRINTERR("fi_mr_reg", ret);
+			return ret;
+		}
+
+		if (fi->domain_attr->mr_mode & FI_MR_ENDPOINT) {
+			ret = fi_mr_bind(region_mr[i], &ep->fid, 0);
+			if (!ret)
+				ret = fi_mr_enable(region_mr[i]);
+			if (ret) {
+				FT_PRINTERR("fi_mr_bind", ret);
+				return ret;
+			}
+		}
+
+		region_iov[i].addr = (fi->domain_attr->mr_mode &
+				      FI_MR_VIRT_ADDR) ? (uintptr_t) region : 0;
+		region_iov[i].key = fi_mr_key(region_mr[i]);
+	}
+	return 0;
+}
+
+/* Keys are passed through the regular tx buffer, as many per message as
+ * it holds.
+ */
+static int rate_exchange_keys(void)
+{
+	size_t per_msg;
+	int i, cnt, ret;
+
+	per_msg = opts.transfer_size / sizeof(*region_iov);
+	if (!per_msg) {
+		fprintf(stderr, "transfer size is too small\n");
+		return -FI_EINVAL;
+	}
+
+	for (i = 0; i < region_cnt; i += cnt) {
+		cnt = (int) MIN(per_msg, (size_t) (region_cnt - i));
+		if (opts.dst_addr) {
+			ret = ft_rx(ep, cnt * sizeof(*region_iov));
+			if (ret)
+				return ret;
+			memcpy(&region_iov[i], rx_buf + ft_rx_prefix_size(),
+			       cnt * sizeof(*region_iov));
+		} else {
+			memcpy(tx_buf + ft_tx_prefix_size(), &region_iov[i],
+			       cnt * sizeof(*region_iov));
+			ret = ft_tx(ep, remote_fi_addr,
+				    cnt * sizeof(*region_iov), &tx_ctx);
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+static int rate_round(uint64_t *next)
+{
+	int i, ret;
+
+	for (i = 0; i < opts.window_size; i++) {
+		ret = ft_post_rma(opts.rma_op, ep, opts.transfer_size,
+				  &region_iov[*next], &tx_ctx_arr[i].context);
+		if (ret)
+			return ret;
+
+		/* a large prime stride visits every region */
+		*next = (*next + 7919) % region_cnt;
+	}
+	return ft_get_tx_comp(tx_seq);
+}
+
+static int run(void)
+{
+	char name[FT_STR_LEN];
+	uint64_t next = 0;
+	int i, ret;
+
+	region_iov = calloc(region_cnt, sizeof(*region_iov));
+	if (!region_iov)
+		return -FI_ENOMEM;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	if (!opts.dst_addr) {
+		ret = rate_reg_regions();
+		if (ret)
+			return ret;
+	}
+
+	ret = rate_exchange_keys();
+	if (ret)
+		return ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	if (opts.dst_addr) {
+		for (i = 0; i < opts.iterations + opts.warmup_iterations;
+		     i++) {
+			if (i == opts.warmup_iterations)
+				ft_start();
+			ret = rate_round(&next);
+			if (ret)
+				return ret;
+		}
+		ft_stop();
+
+		snprintf(name, sizeof(name), "%d_regions", region_cnt);
+		show_perf(name, opts.transfer_size, opts.iterations, &start,
+			  &end, opts.window_size);
+	}
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	return ft_finalize();
+}
+
+static void rate_free_regions(void)
+{
+	int i;
+
+	if (region_mr) {
+		for (i = 0; i < region_cnt; i++)
+			FT_CLOSE_FID(region_mr[i]);
+	}
+	free(region_mr);
+	free(region_buf);
+	free(region_iov);
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW | FT_OPT_SIZE;
+	opts.transfer_size = 64;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "R:ho:" CS_OPTS INFO_OPTS
+			    BENCHMARK_OPTS)) != -1) {
+		switch (op) {
+		case 'R':
+			region_cnt = atoi(optarg);
+			if (region_cnt < 1) {
+				fprintf(stderr, "region count must be "
+					"positive\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			ret = ft_parse_rma_opts(op, optarg, hints, &opts);
+			if (ret)
+				return ret;
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "RMA message rate test against "
+				   "many registered regions.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-o <op>", "rma op type: read|write "
+					    "(default: write)");
+			FT_PRINT_OPTS_USAGE("-R <int>", "number of registered "
+					    "target regions (default: 16384)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	if (opts.rma_op == FT_RMA_WRITEDATA) {
+		fprintf(stderr, "writedata is not supported by this test\n");
+		return EXIT_FAILURE;
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG | FI_RMA;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = run();
+
+	rate_free_regions();
+	ft_free_res();
+	return ft_exit_code(ret);
+}
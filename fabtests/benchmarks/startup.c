@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Library start up time test.
+ *
+ * Forks a number of processes that start at the same time, as the ranks
+ * of a job on one node would.  Each process measures:
+ *
+ *   first  - the first fi_getinfo call, which loads the providers
+ *   repeat - the same call repeated, averaged over the iterations
+ *   open   - opening a fabric and a domain for the first result
+ *
+ * The parent never calls into libfabric, so every process starts cold.
+ * Compare FI_PROVIDER_LAZY_INIT=0 against the default, and set
+ * FI_GETINFO_CACHE_DIR to share results between the processes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+
+struct startup_result {
+	int	ret;
+	double	first_usec;
+	double	repeat_usec;
+	double	open_usec;
+};
+
+static int procs = 1;
+static int iterations = 100;
+
+static double startup_usec(struct timespec *a, struct timespec *b)
+{
+	return get_elapsed(a, b, NANO) / 1000.0;
+}
+
+static int startup_getinfo(struct fi_info **info)
+{
+	return fi_getinfo(FT_FIVERSION, NULL, NULL, 0, hints, info);
+}
+
+static void startup_run(struct startup_result *res)
+{
+	struct fi_info *info = NULL;
+	struct timespec a, b;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	res->ret = startup_getinfo(&fi);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	if (res->ret)
+		return;
+	res->first_usec = startup_usec(&a, &b);
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	for (i = 0; i < iterations; i++) {
+		res->ret = startup_getinfo(&info);
+		fi_freeinfo(info);
+		if (res->ret)
+			return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	res->repeat_usec = iterations ?
+			   startup_usec(&a, &b) / iterations : 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	res->ret = fi_fabric(fi->fabric_attr, &fabric, NULL);
+	if (res->ret)
+		return;
+	res->ret = fi_domain(fabric, fi, &domain, NULL);
+	if (res->ret)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	res->open_usec = startup_usec(&a, &b);
+}
+
+/* Each child reports its result through the pipe and exits */
+static void startup_child(int start_fd, int result_fd)
+{
+	struct startup_result res = { 0 };
+	char go;
+
+	if (read(start_fd, &go, 1) != 1)
+		res.ret = -FI_EIO;
+	else
+		startup_run(&res);
+
+	if (write(result_fd, &res, sizeof(res)) != sizeof(res))
+		res.ret = -FI_EIO;
+
+	ft_free_res();
+	_exit(res.ret ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void startup_print(const char *name, double *val, int cnt)
+{
+	double sum = 0, max = 0, min = 0;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		sum += val[i];
+		if (!i || val[i] > max)
+			max = val[i];
+		if (!i || val[i] < min)
+			min = val[i];
+	}
+
+	printf("%-8s %12.2f %12.2f %12.2f\n", name, cnt ? sum / cnt : 0,
+	       min, max);
+}
+
+static int startup_test(void)
+{
+	struct startup_result res;
+	double *first, *repeat, *open;
+	int start[2], result[2];
+	int i, cnt = 0, status, ret = 0;
+	pid_t pid;
+
+	first = calloc(procs * 3, sizeof(*first));
+	if (!first)
+		return -FI_ENOMEM;
+	repeat = first + procs;
+	open = repeat + procs;
+
+	if (pipe(start) || pipe(result)) {
+		perror("pipe");
+		free(first);
+		return -FI_EOTHER;
+	}
+
+	for (i = 0; i < procs; i++) {
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			ret = -FI_EOTHER;
+			break;
+		}
+		if (!pid) {
+			close(start[1]);
+			close(result[0]);
+			startup_child(start[0], result[1]);
+		}
+	}
+	procs = i;
+
+	/* release all children at once */
+	close(start[0]);
+	close(result[1]);
+	for (i = 0; i < procs; i++) {
+		if (write(start[1], "g", 1) != 1)
+			break;
+	}
+	close(start[1]);
+
+	while (read(result[0], &res, sizeof(res)) == sizeof(res)) {
+		if (res.ret) {
+			FT_PRINTERR("startup", res.ret);
+			ret = res.ret;
+			continue;
+		}
+		first[cnt] = res.first_usec;
+		repeat[cnt] = res.repeat_usec;
+		open[cnt] = res.open_usec;
+		cnt++;
+	}
+	close(result[0]);
+
+	while (wait(&status) > 0)
+		;
+
+	printf("# processes: %d, iterations: %d, provider: %s\n", procs,
+	       iterations, hints->fabric_attr->prov_name ?
+	       hints->fabric_attr->prov_name : "any");
+	printf("%-8s %12s %12s %12s\n", "usec", "avg", "min", "max");
+	startup_print("first", first, cnt);
+	startup_print("repeat", repeat, cnt);
+	startup_print("open", open, cnt);
+
+	free(first);
+	if (!ret && cnt != procs)
+		ret = -FI_EOTHER;
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "I:N:h" INFO_OPTS)) != -1) {
+		switch (op) {
+		case 'I':
+			iterations = atoi(optarg);
+			break;
+		case 'N':
+			procs = atoi(optarg);
+			break;
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "Library start up time test.");
+			FT_PRINT_OPTS_USAGE("-I <number>", "fi_getinfo calls to "
+					    "time after the first (default: 100)");
+			FT_PRINT_OPTS_USAGE("-N <number>", "processes started at "
+					    "the same time (default: 1)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (procs < 1 || iterations < 0) {
+		fprintf(stderr, "invalid process or iteration count\n");
+		return EXIT_FAILURE;
+	}
+
+	hints->mode = ~0;
+	hints->domain_attr->mode = ~0;
+	hints->domain_attr->mr_mode = ~(FI_MR_BASIC | FI_MR_SCALABLE);
+
+	ret = startup_test();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Bandwidth test for FI_EP_SOCK_STREAM endpoints (e.g. ofi_rstream).
+ *
+ * The client streams iterations * transfer size bytes to the server,
+ * which acknowledges once everything has arrived.  The same exchange can
+ * be run over plain TCP sockets (-T) for a baseline, and the server can
+ * consume data in place from the provider's receive ring (-z) when the
+ * rstream zero-copy receive extension is available.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_cm.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+#ifdef HAVE_RDMA_FI_EXT_RSTREAM_H
+#include <rdma/fi_ext_rstream.h>
+#endif
+
+static int use_sock;
+static int use_lend;
+static char *stream_buf;
+#ifdef HAVE_RDMA_FI_EXT_RSTREAM_H
+static struct fi_rstream_ops_ep *rstream_ops;
+#endif
+
+static ssize_t stream_send(const void *data, size_t len)
+{
+	size_t offset;
+	ssize_t ret;
+
+	for (offset = 0; offset < len; ) {
+		if (use_sock) {
+			ret = send(sock, (char *) data + offset, len - offset, 0);
+			if (ret < 0)
+				ret = (errno == EAGAIN) ? -FI_EAGAIN : -errno;
+		} else {
+			ret = fi_send(ep, (char *) data + offset, len - offset,
+				      NULL, 0, NULL);
+		}
+		if (ret < 0 && ret != -FI_EAGAIN) {
+			FT_PRINTERR("send", ret);
+			return ret;
+		}
+		if (ret > 0)
+			offset += ret;
+		else
+			sched_yield();
+	}
+
+	return 0;
+}
+
+static ssize_t stream_recv_lend(size_t len)
+{
+#ifdef HAVE_RDMA_FI_EXT_RSTREAM_H
+	size_t offset;
+	ssize_t ret;
+	void *data;
+
+	for (offset = 0; offset < len; ) {
+		ret = rstream_ops->recv_lend(ep, &data, len - offset);
+		if (ret == -FI_EAGAIN) {
+			sched_yield();
+			continue;
+		}
+		if (ret < 0) {
+			FT_PRINTERR("recv_lend", ret);
+			return ret;
+		}
+
+		/* stream_buf holds the expected pattern */
+		if ((opts.options & FT_OPT_VERIFY_DATA) &&
+		    memcmp(data, stream_buf + offset, ret)) {
+			fprintf(stderr, "Data check error in lent buffer at "
+				"byte %zu\n", offset);
+			return -FI_EIO;
+		}
+
+		offset += ret;
+		ret = rstream_ops->recv_release(ep, ret);
+		if (ret) {
+			FT_PRINTERR("recv_release", ret);
+			return ret;
+		}
+	}
+
+	return 0;
+#else
+	return -FI_ENOSYS;
+#endif
+}
+
+static ssize_t stream_recv(void *data, size_t len)
+{
+	size_t offset;
+	ssize_t ret;
+
+	if (use_lend)
+		return stream_recv_lend(len);
+
+	for (offset = 0; offset < len; ) {
+		if (use_sock) {
+			ret = recv(sock, (char *) data + offset, len - offset, 0);
+			if (ret == 0)
+				ret = -FI_ENOTCONN;
+			else if (ret < 0)
+				ret = (errno == EAGAIN) ? -FI_EAGAIN : -errno;
+		} else {
+			ret = fi_recv(ep, (char *) data + offset, len - offset,
+				      NULL, 0, NULL);
+		}
+		if (ret < 0 && ret != -FI_EAGAIN) {
+			FT_PRINTERR("recv", ret);
+			return ret;
+		}
+		if (ret > 0)
+			offset += ret;
+		else
+			sched_yield();
+	}
+
+	return 0;
+}
+
+static int stream_sync(void)
+{
+	char c = 0;
+	int ret, lend = use_lend;
+
+	use_lend = 0;
+	if (opts.dst_addr) {
+		ret = stream_send(&c, 1);
+		if (!ret)
+			ret = stream_recv(&c, 1);
+	} else {
+		ret = stream_recv(&c, 1);
+		if (!ret)
+			ret = stream_send(&c, 1);
+	}
+	use_lend = lend;
+	return ret;
+}
+
+static int stream_init_ep(void)
+{
+	int ret;
+
+	ret = fi_endpoint(domain, fi, &ep, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_endpoint", ret);
+		return ret;
+	}
+
+	FT_EP_BIND(ep, eq, 0);
+
+	ret = fi_enable(ep);
+	if (ret) {
+		FT_PRINTERR("fi_enable", ret);
+		return ret;
+	}
+
+	if (!use_lend)
+		return 0;
+
+#ifdef HAVE_RDMA_FI_EXT_RSTREAM_H
+	ret = fi_open_ops(&ep->fid, FI_RSTREAM_EP_OPS_1, 0,
+			  (void **) &rstream_ops, NULL);
+	if (ret)
+		FT_PRINTERR("fi_open_ops", ret);
+#else
+	fprintf(stderr, "zero-copy receive requires fi_ext_rstream.h\n");
+	ret = -FI_ENOSYS;
+#endif
+	return ret;
+}
+
+static int stream_server_connect(void)
+{
+	int ret;
+
+	ret = ft_start_server();
+	if (ret)
+		return ret;
+
+	ret = ft_retrieve_conn_req(eq, &fi);
+	if (ret)
+		return ret;
+
+	ret = fi_domain(fabric, fi, &domain, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_domain", ret);
+		return ret;
+	}
+
+	ret = stream_init_ep();
+	if (ret)
+		return ret;
+
+	return ft_accept_connection(ep, eq);
+}
+
+static int stream_client_connect(void)
+{
+	int ret;
+
+	ret = ft_getinfo(hints, &fi);
+	if (ret)
+		return ret;
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		return ret;
+
+	ret = stream_init_ep();
+	if (ret)
+		return ret;
+
+	return ft_connect_ep(ep, eq, fi->dest_addr);
+}
+
+static int sock_connect(void)
+{
+	int ret;
+
+	if (opts.dst_addr)
+		return ft_sock_connect(opts.dst_addr, opts.dst_port ?
+				       opts.dst_port : default_port);
+
+	ret = ft_sock_listen(opts.src_addr, opts.src_port ?
+			     opts.src_port : default_port);
+	if (ret)
+		return ret;
+
+	return ft_sock_accept();
+}
+
+/* ft_use_size() checks fi, which sockets mode never opens */
+static int stream_use_size(int index)
+{
+	if (!use_sock)
+		return ft_use_size(index, opts.sizes_enabled);
+
+	return (opts.sizes_enabled == FT_ENABLE_ALL) ||
+	       (opts.sizes_enabled & test_size[index].enable_flags);
+}
+
+static int run_size(void)
+{
+	int i, ret;
+
+	if ((opts.options & FT_OPT_VERIFY_DATA) && (opts.dst_addr || use_lend))
+		ft_fill_buf(stream_buf, opts.transfer_size);
+
+	ret = stream_sync();
+	if (ret)
+		return ret;
+
+	if (opts.dst_addr) {
+		ft_start();
+		for (i = 0; i < opts.iterations; i++) {
+			ret = stream_send(stream_buf, opts.transfer_size);
+			if (ret)
+				return ret;
+		}
+		ret = stream_recv(stream_buf, 1);
+		if (ret)
+			return ret;
+		ft_stop();
+
+		show_perf(use_sock ? "tcp_sockets" : NULL, opts.transfer_size,
+			  opts.iterations, &start, &end, 1);
+		return 0;
+	}
+
+	for (i = 0; i < opts.iterations; i++) {
+		ret = stream_recv(stream_buf, opts.transfer_size);
+		if (ret)
+			return ret;
+		if ((opts.options & FT_OPT_VERIFY_DATA) && !use_lend) {
+			ret = ft_check_buf(stream_buf, opts.transfer_size);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return stream_send(stream_buf, 1);
+}
+
+static int run(void)
+{
+	size_t max_size;
+	int i, ret;
+
+	max_size = (opts.options & FT_OPT_SIZE) ? opts.transfer_size :
+		   FT_BENCHMARK_MAX_MSG_SIZE;
+	stream_buf = calloc(1, max_size);
+	if (!stream_buf)
+		return -FI_ENOMEM;
+
+	if (use_sock)
+		ret = sock_connect();
+	else
+		ret = opts.dst_addr ? stream_client_connect() :
+		      stream_server_connect();
+	if (ret)
+		return ret;
+
+	if (!(opts.options & FT_OPT_SIZE)) {
+		for (i = 0; i < TEST_CNT; i++) {
+			if (!stream_use_size(i))
+				continue;
+			opts.transfer_size = test_size[i].size;
+			ret = run_size();
+			if (ret)
+				return ret;
+		}
+	} else {
+		ret = run_size();
+		if (ret)
+			return ret;
+	}
+
+	ret = stream_sync();
+	if (use_sock)
+		ft_sock_shutdown(sock);
+	else
+		fi_shutdown(ep, 0);
+	return ret;
+}
+
+static void set_stream_hints(void)
+{
+	hints->ep_attr->type = FI_EP_SOCK_STREAM;
+	hints->caps = FI_MSG;
+	hints->domain_attr->mr_mode = 0;
+	hints->addr_format = FI_SOCKADDR;
+	hints->domain_attr->threading = FI_THREAD_SAFE;
+	hints->domain_attr->data_progress = FI_PROGRESS_MANUAL;
+	hints->domain_attr->control_progress = FI_PROGRESS_AUTO;
+	hints->tx_attr->msg_order = FI_ORDER_SAS;
+	hints->rx_attr->msg_order = FI_ORDER_SAS;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	/* no CQs on stream endpoints */
+	opts.options = FT_OPT_BW;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "Tzh" CS_OPTS INFO_OPTS
+			    BENCHMARK_OPTS)) != -1) {
+		switch (op) {
+		case 'T':
+			use_sock = 1;
+			break;
+		case 'z':
+			use_lend = 1;
+			break;
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Bandwidth test for stream endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-T", "use plain TCP sockets instead "
+					    "of libfabric (baseline)");
+			FT_PRINT_OPTS_USAGE("-z", "server receives in place "
+					    "through the rstream zero-copy "
+					    "receive extension");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	/* only the server receives bulk data */
+	if (opts.dst_addr)
+		use_lend = 0;
+	if (use_lend && use_sock) {
+		fprintf(stderr, "-z and -T are mutually exclusive\n");
+		return EXIT_FAILURE;
+	}
+
+	set_stream_hints();
+
+	ret = run();
+
+	free(stream_buf);
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -2847,6 +2847,8 @@ void ft_usage(char *name, char *desc)
 	FT_PRINT_OPTS_USAGE("-U", "run fabtests with FI_DELIVERY_COMPLETE set");
 	FT_PRINT_OPTS_USAGE("", "Only the following tests support this option for now:");
 	FT_PRINT_OPTS_USAGE("", "fi_bw");
+	FT_PRINT_OPTS_USAGE("", "fi_msg_bw");
+	FT_PRINT_OPTS_USAGE("", "fi_msg_pingpong");
 	FT_PRINT_OPTS_USAGE("", "fi_rdm");
 	FT_PRINT_OPTS_USAGE("", "fi_rdm_atomic");
 	FT_PRINT_OPTS_USAGE("", "fi_rdm_pingpong");
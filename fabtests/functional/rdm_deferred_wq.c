@@ -47,9 +47,17 @@ uint64_t n_trig, rx_exp;
 static char *result_buf, *compare_buf;
 static struct fid_mr *mr_result, *mr_compare;
 int use_alias = 0;
+int run_latency = 0;
 struct fid_ep *trig_ep;
 enum fi_op_type tested_op;
 
+struct lat_req {
+	struct fi_deferred_work work;
+	struct fi_op_msg op_msg;
+	struct iovec iov;
+};
+static struct lat_req *lat_reqs;
+
 static void format_simple_msg(struct fi_msg *msg, struct iovec *iov, void *src,
 			      size_t size, void *ctx)
 {
@@ -94,8 +102,8 @@ static void format_simple_msg_rma(struct fi_msg_rma *msg, struct iovec *iov,
 	iov->iov_len = size;
 	msg->msg_iov = iov;
 
-	rma_iov->addr = 0;
-	rma_iov->key = FT_MR_KEY;
+	rma_iov->addr = remote.addr;
+	rma_iov->key = remote.key;
 	rma_iov->len = size;
 	msg->rma_iov = rma_iov;
 }
@@ -119,9 +127,9 @@ static void format_simple_msg_atomic(struct fi_msg_atomic *msg, struct fi_ioc *i
 	iov->count = size;
 	msg->msg_iov = iov;
 
-	rma_iov->addr = 0;
+	rma_iov->addr = remote.addr;
 	rma_iov->count = size;
-	rma_iov->key = FT_MR_KEY;
+	rma_iov->key = remote.key;
 	msg->rma_iov = rma_iov;
 }
 
@@ -149,6 +157,25 @@ static void format_simple_msg_compare(struct fi_msg_compare *msg, struct fi_ioc
 	msg->msg_iov = iov;
 }
 
+/* Counters without a wait object cannot be waited on; poll them instead.
+ * test_cntr has no endpoint bound to it, so reading it alone would not
+ * progress the endpoint; read the endpoint counters as well.
+ */
+static int wait_cntr(struct fid_cntr *cntr, uint64_t total)
+{
+	int ret;
+
+	ret = fi_cntr_wait(cntr, total, -1);
+	if (ret != -FI_ENOSYS)
+		return ret;
+
+	while (fi_cntr_read(cntr) < total) {
+		(void) fi_cntr_read(rxcntr);
+		(void) fi_cntr_read(txcntr);
+	}
+	return 0;
+}
+
 static int check_data()
 {
 	int ret, i;
@@ -172,7 +199,7 @@ static int check_data()
 		break;
 	case FI_OP_CNTR_SET:
 	case FI_OP_CNTR_ADD:
-		ret  = fi_cntr_wait(test_cntr, 10, -1);
+		ret = wait_cntr(test_cntr, 10);
 		if (ret)
 			return ret;
 		break;
@@ -198,18 +225,19 @@ static int send_wait_check()
 
 	if (opts.dst_addr) {
 		ret = fi_write(ep, tx_buf, strlen(welcome_text), mr_desc,
-				remote_fi_addr, 0, FT_MR_KEY, &tx_ctx);
+				remote_fi_addr, remote.addr, remote.key,
+				&tx_ctx);
  		if (ret) {
  			FT_PRINTERR("fi_write", ret);
  			return ret;
 		}
 	}
 
-	ret = fi_cntr_wait(test_cntr, n_trig, -1);
+	ret = wait_cntr(test_cntr, n_trig);
 	if (ret)
 		return ret;
 
-	ret = fi_cntr_wait(rxcntr, rx_exp, -1);
+	ret = wait_cntr(rxcntr, rx_exp);
 	if (ret)
 		return ret;
 
@@ -412,18 +440,21 @@ static int trigger()
 {
 	int ret;
 
-	//both sides start with both counters at 2, client will initiate triggering write
-	//which will trigger txcntr on client and rxcntr on server
+	//client will initiate triggering write which will trigger txcntr on
+	//client and rxcntr on server
 	//rx_exp = number of rx completions we should expect on that side
 	//n_trig = total number of triggers on work queue to expect completed
+	//all earlier transfers have completed, so both counters match the
+	//sequence numbers
+	rx_exp = rx_seq;
 	if (opts.dst_addr) {
 		work.triggering_cntr = txcntr;
-		rx_exp = 2;
+		work.threshold = tx_seq + 1;
 	} else {
 		work.triggering_cntr = rxcntr;
-		rx_exp = 3;
+		work.threshold = rx_seq + 1;
+		rx_exp++;
 	}
-	work.threshold = 3;
 
 	if (tested_op != FI_OP_CNTR_ADD && tested_op != FI_OP_CNTR_SET)
 		work.completion_cntr = test_cntr;
@@ -477,6 +508,90 @@ static int trigger()
 	return ret;
 }
 
+/*
+ * Deferred pingpong: every send and receive of the exchange is queued up
+ * front, chained on test_cntr, which counts the deferred receives (plus one
+ * to start the chain).  Once started, the provider drives the whole
+ * exchange without the application posting anything, so the result can be
+ * compared with fi_rdm_cntr_pingpong, where the host posts each transfer.
+ */
+static int queue_lat_msg(struct lat_req *req, enum fi_op_type op_type,
+			 void *buf, uint64_t threshold)
+{
+	int ret;
+
+	format_simple_msg(&req->op_msg.msg, &req->iov, buf,
+			  opts.transfer_size, &req->work.context);
+	req->op_msg.ep = ep;
+	req->op_msg.flags = 0;
+
+	req->work.op_type = op_type;
+	req->work.op.msg = &req->op_msg;
+	req->work.triggering_cntr = test_cntr;
+	req->work.threshold = threshold;
+	req->work.completion_cntr = op_type == FI_OP_RECV ? test_cntr : NULL;
+
+	ret = fi_control(&domain->fid, FI_QUEUE_WORK, &req->work);
+	if (ret)
+		FT_PRINTERR("fi_control", ret);
+	return ret;
+}
+
+static int run_latency_test()
+{
+	struct lat_req *req;
+	uint64_t k, n = opts.iterations;
+	int ret;
+
+	lat_reqs = calloc(n * 2, sizeof(*lat_reqs));
+	if (!lat_reqs)
+		return -FI_ENOMEM;
+
+	/* receive k is posted once receive k - 1 has completed; the client
+	 * sends alongside it, while the server replies once it completes
+	 */
+	for (k = 1, req = lat_reqs; k <= n; k++) {
+		ret = queue_lat_msg(req++, FI_OP_RECV, rx_buf, k);
+		if (ret)
+			return ret;
+		ret = queue_lat_msg(req++, FI_OP_SEND, tx_buf,
+				    opts.dst_addr ? k : k + 1);
+		if (ret)
+			return ret;
+	}
+
+	/* consume the pre-posted receive so that it cannot take a message
+	 * meant for the chain; this also syncs both sides
+	 */
+	ret = ft_tx(ep, remote_fi_addr, strlen(welcome_text), &tx_ctx);
+	if (ret)
+		return ret;
+	ret = ft_get_rx_comp(rx_seq);
+	if (ret)
+		return ret;
+
+	ft_start();
+	ret = fi_cntr_add(test_cntr, 1);
+	if (ret) {
+		FT_PRINTERR("fi_cntr_add", ret);
+		return ret;
+	}
+
+	/* test_cntr has no endpoint bound to drive progress, so wait on the
+	 * endpoint counters, which also count the deferred transfers
+	 */
+	ret = ft_get_rx_comp(rx_seq + n);
+	if (ret)
+		return ret;
+	ret = ft_get_tx_comp(tx_seq + n);
+	if (ret)
+		return ret;
+	ft_stop();
+
+	show_perf(NULL, opts.transfer_size, opts.iterations, &start, &end, 2);
+	return 0;
+}
+
 static void init_buf_vals()
 {
 	switch (tested_op) {
@@ -571,6 +686,7 @@ static void free_mr_res()
 	FT_CLOSE_FID(mr_compare);
 	free(result_buf);
 	free(compare_buf);
+	free(lat_reqs);
 }
 
 int main(int argc, char **argv)
@@ -588,15 +704,18 @@ int main(int argc, char **argv)
 
 	tested_op = FI_OP_CNTR_SET;
 
-	while ((op = getopt(argc, argv, "aT:h" ADDR_OPTS INFO_OPTS)) != -1) {
+	while ((op = getopt(argc, argv, "aLT:h" CS_OPTS INFO_OPTS)) != -1) {
 		switch (op) {
 		default:
-			ft_parse_addr_opts(op, optarg, &opts);
+			ft_parsecsopts(op, optarg, &opts);
 			ft_parseinfo(op, optarg, hints, &opts);
 			break;
 		case 'a':
 			use_alias = 1;
 			break;
+		case 'L':
+			run_latency = 1;
+			break;
 		case 'T':
 			if (!strncasecmp("msg", optarg, 3))
 				tested_op = FI_OP_RECV;
@@ -613,7 +732,12 @@ int main(int argc, char **argv)
 			break;
 		case '?':
 		case 'h':
-			ft_usage(argv[0], "A simple RDM client-sever triggered RMA example with alias ep.");
+			ft_csusage(argv[0], "A simple RDM client-sever triggered RMA example with alias ep.");
+			FT_PRINT_OPTS_USAGE("-T <op>", "triggered op: msg|tagged|rma|"
+					    "atomic|f_atomic|c_atomic");
+			FT_PRINT_OPTS_USAGE("-a", "trigger through an alias ep");
+			FT_PRINT_OPTS_USAGE("-L", "measure the latency of a deferred "
+					    "send/recv pingpong");
 			return EXIT_FAILURE;
 		}
 	}
@@ -622,6 +746,21 @@ int main(int argc, char **argv)
 		opts.dst_addr = argv[optind];
 
 	hints->ep_attr->type = FI_EP_RDM;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+
+	if (run_latency) {
+		hints->caps = FI_MSG | FI_TRIGGER;
+		opts.options &= ~FT_OPT_SKIP_REG_MR;
+
+		ret = ft_init_fabric();
+		if (!ret)
+			ret = ft_cntr_open(&test_cntr);
+		if (!ret)
+			ret = run_latency_test();
+		goto out;
+	}
+
 	hints->caps = FI_MSG | FI_RMA | FI_RMA_EVENT | FI_TRIGGER;
 
 	if (tested_op == FI_OP_TSEND)
@@ -631,8 +770,9 @@ int main(int argc, char **argv)
 		 tested_op == FI_OP_COMPARE_ATOMIC)
 		hints->caps |= FI_ATOMIC;
 
-	hints->mode = FI_CONTEXT;
-	hints->domain_attr->mr_mode = opts.mr_mode;
+	/* the triggered write must land after the triggering write */
+	if (tested_op == FI_OP_READ)
+		hints->tx_attr->msg_order = FI_ORDER_WAW;
 
 	ret = ft_init_fabric();
 	if (ret)
@@ -657,16 +797,17 @@ int main(int argc, char **argv)
 	if (ret)
 		return ret;
 
-	ret = run_test();
+	ret = ft_exchange_keys(&remote);
 	if (ret)
 		return ret;
 
-	free_mr_res();
-
-	ret = fi_close(&test_cntr->fid);
+	ret = run_test();
 	if (ret)
-		FT_PRINTERR("fi_cntr_close", ret);
+		return ret;
 
+out:
+	free_mr_res();
+	FT_CLOSE_FID(test_cntr);
 	ft_free_res();
 	return ft_exit_code(ret);
 }
@@ -456,6 +456,195 @@ struct coll_test tests[] = {
 
 const int NUM_TESTS = ARRAY_SIZE(tests);
 
+/*
+ * Performance mode: time each collective over a sweep of sizes and report
+ * the per-operation latency as min/avg/max across ranks.
+ */
+struct coll_perf_test {
+	char *name;
+	enum fi_collective_op op;
+	enum fi_op reduce_op;
+	int (*post)(size_t count, void *ctx);
+	bool sized;
+};
+
+static uint64_t *perf_send_buf;
+static uint64_t *perf_recv_buf;
+
+static int barrier_perf_post(size_t count, void *ctx)
+{
+	return fi_barrier(ep, coll_addr, ctx);
+}
+
+static int allreduce_perf_post(size_t count, void *ctx)
+{
+	return fi_allreduce(ep, perf_send_buf, count, NULL, perf_recv_buf,
+			    NULL, coll_addr, FI_UINT64, FI_SUM, 0, ctx);
+}
+
+static int allgather_perf_post(size_t count, void *ctx)
+{
+	return fi_allgather(ep, perf_send_buf, count, NULL, perf_recv_buf,
+			    NULL, coll_addr, FI_UINT64, 0, ctx);
+}
+
+static int broadcast_perf_post(size_t count, void *ctx)
+{
+	return fi_broadcast(ep, pm_job.my_rank ? perf_recv_buf : perf_send_buf,
+			    count, NULL, coll_addr, 0, FI_UINT64, 0, ctx);
+}
+
+static int scatter_perf_post(size_t count, void *ctx)
+{
+	return fi_scatter(ep, pm_job.my_rank ? NULL : perf_send_buf, count,
+			  NULL, perf_recv_buf, NULL, coll_addr, 0, FI_UINT64,
+			  0, ctx);
+}
+
+struct coll_perf_test perf_tests[] = {
+	{ "barrier", FI_BARRIER, FI_NOOP, barrier_perf_post, false },
+	{ "allreduce", FI_ALLREDUCE, FI_SUM, allreduce_perf_post, true },
+	{ "allgather", FI_ALLGATHER, FI_NOOP, allgather_perf_post, true },
+	{ "broadcast", FI_BROADCAST, FI_NOOP, broadcast_perf_post, true },
+	{ "scatter", FI_SCATTER, FI_NOOP, scatter_perf_post, true },
+};
+
+static void coll_perf_show(struct coll_perf_test *test, size_t size,
+			   double *usec)
+{
+	static int header = 1;
+	double min = usec[0], max = usec[0], sum = 0;
+	size_t i;
+
+	for (i = 0; i < pm_job.num_ranks; i++) {
+		min = MIN(min, usec[i]);
+		max = MAX(max, usec[i]);
+		sum += usec[i];
+	}
+
+	if (opts.machr) {
+		if (header)
+			printf("---\n%s:\n", fi->fabric_attr->prov_name);
+		printf("- { op: %s, ranks: %zu, xfer_size: %zu, "
+		       "iterations: %d, min_usec: %f, avg_usec: %f, "
+		       "max_usec: %f }\n", test->name, pm_job.num_ranks, size,
+		       opts.iterations, min, sum / pm_job.num_ranks, max);
+	} else {
+		if (header)
+			printf("%-12s%-8s%-10s%-10s%12s%12s%12s\n", "op",
+			       "ranks", "bytes", "iters", "min usec",
+			       "avg usec", "max usec");
+		printf("%-12s%-8zu%-10zu%-10d%12.2f%12.2f%12.2f\n",
+		       test->name, pm_job.num_ranks, size, opts.iterations,
+		       min, sum / pm_job.num_ranks, max);
+	}
+	header = 0;
+}
+
+static int coll_perf_run_size(struct coll_perf_test *test, size_t size)
+{
+	struct timespec start, end;
+	uint64_t done_flag;
+	double usec, *all_usec;
+	size_t count = size / sizeof(uint64_t);
+	int i, err;
+
+	all_usec = calloc(pm_job.num_ranks, sizeof(*all_usec));
+	if (!all_usec)
+		return -FI_ENOMEM;
+
+	pm_barrier();
+	for (i = 0; i < opts.warmup_iterations + opts.iterations; i++) {
+		if (i == opts.warmup_iterations)
+			clock_gettime(CLOCK_MONOTONIC, &start);
+
+		err = test->post(count, &done_flag);
+		if (err) {
+			FT_ERR("%s failed: %d (%s)\n", test->name, err,
+			       fi_strerror(-err));
+			goto out;
+		}
+
+		err = wait_for_comp(&done_flag);
+		if (err)
+			goto out;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	usec = get_elapsed(&start, &end, NANO) / 1000.0 / opts.iterations;
+	err = pm_allgather(&usec, all_usec, sizeof(usec));
+	if (err)
+		goto out;
+
+	if (!pm_job.my_rank)
+		coll_perf_show(test, size, all_usec);
+out:
+	free(all_usec);
+	return err;
+}
+
+static int coll_perf_run_test(struct coll_perf_test *test)
+{
+	struct fi_collective_attr attr = {
+		.op = test->reduce_op,
+		.datatype = test->sized ? FI_UINT64 : FI_VOID,
+	};
+	int i, err;
+
+	err = fi_query_collective(domain, test->op, &attr, 0);
+	if (err) {
+		if (!pm_job.my_rank)
+			printf("%-12s not supported: %s\n", test->name,
+			       fi_strerror(-err));
+		return 0;
+	}
+
+	if (!test->sized)
+		return coll_perf_run_size(test, 0);
+
+	for (i = 0; i < TEST_CNT; i++) {
+		if (!ft_use_size(i, opts.sizes_enabled) ||
+		    test_size[i].size < sizeof(uint64_t) ||
+		    test_size[i].size > opts.transfer_size)
+			continue;
+
+		err = coll_perf_run_size(test, test_size[i].size);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+static int coll_perf_run(void)
+{
+	size_t buf_size;
+	int i, err;
+
+	buf_size = MAX(opts.transfer_size, sizeof(uint64_t)) *
+		   pm_job.num_ranks;
+	perf_send_buf = calloc(1, buf_size);
+	perf_recv_buf = calloc(1, buf_size);
+	if (!perf_send_buf || !perf_recv_buf) {
+		err = -FI_ENOMEM;
+		goto out;
+	}
+
+	err = coll_setup();
+	if (err)
+		goto out;
+
+	coll_addr = fi_mc_addr(coll_mc);
+	for (i = 0; i < ARRAY_SIZE(perf_tests) && !err; i++)
+		err = coll_perf_run_test(&perf_tests[i]);
+
+	pm_barrier();
+	coll_teardown();
+out:
+	free(perf_send_buf);
+	free(perf_recv_buf);
+	return err;
+}
+
 static inline int setup_hints()
 {
 	hints->ep_attr->type = FI_EP_RDM;
@@ -463,7 +652,8 @@ static inline int setup_hints()
 	hints->mode = FI_CONTEXT;
 	hints->domain_attr->control_progress = FI_PROGRESS_MANUAL;
 	hints->domain_attr->data_progress = FI_PROGRESS_MANUAL;
-	hints->fabric_attr->prov_name = strdup("tcp");
+	if (!hints->fabric_attr->prov_name)
+		hints->fabric_attr->prov_name = strdup("tcp");
 	return FI_SUCCESS;
 }
 
@@ -551,6 +741,11 @@ int multinode_run_tests(int argc, char **argv)
 	if (ret)
 		return ret;
 
+	if (pm_job.perf) {
+		ret = coll_perf_run();
+		goto out;
+	}
+
 	for (i = 0; i < NUM_TESTS && !ret; i++) {
 		FT_DEBUG("Running Test: %s \n", tests[i].name);
 
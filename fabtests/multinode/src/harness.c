@@ -293,7 +293,7 @@ int main(int argc, char **argv)
 	if (!hints)
 		return EXIT_FAILURE;
 
-	while ((c = getopt(argc, argv, "n:C:h" CS_OPTS INFO_OPTS)) != -1) {
+	while ((c = getopt(argc, argv, "n:C:Th" CS_OPTS INFO_OPTS)) != -1) {
 		switch (c) {
 		default:
 			ft_parse_addr_opts(c, optarg, &opts);
@@ -306,9 +306,19 @@ int main(int argc, char **argv)
 		case 'C':
 			pm_job.transfer_method = parse_caps(optarg);
 			break;
+		case 'T':
+			pm_job.perf = true;
+			break;
 		case '?':
 		case 'h':
 			ft_usage(argv[0], "A simple multinode test");
+			FT_PRINT_OPTS_USAGE("-n <ranks>", "number of processes");
+			FT_PRINT_OPTS_USAGE("-C <mode>", "transfer mode: msg, rma");
+			FT_PRINT_OPTS_USAGE("-T", "time collectives instead of "
+					    "checking results (fi_multinode_coll)");
+			FT_PRINT_OPTS_USAGE("-I <number>", "number of iterations");
+			FT_PRINT_OPTS_USAGE("-S <size>", "largest collective size "
+					    "in performance mode");
 			return EXIT_FAILURE;
 		}
 	}
@@ -157,6 +157,7 @@ short_tests=(
 	"fi_rdm_atomic -I 5 -o all"
 	"fi_rdm_atomic -I 5 -o all -U"
 	"fi_rdm_cntr_pingpong -I 5"
+	"fi_rdm_deferred_wq -L -I 5"
 	"fi_multi_recv -e rdm -I 5"
 	"fi_multi_recv -e msg -I 5"
 	"fi_rdm_pingpong -I 5"
@@ -171,6 +172,13 @@ short_tests=(
 	"fi_rdm_tagged_bw -I 5 -U"
 	"fi_rdm_tagged_bw -I 5 -v"
 	"fi_rdm_tagged_bw -I 5 -v -U"
+	"fi_rdm_msg_rate -I 64 -n 2"
+	"fi_rdm_msg_rate -I 64 -n 2 -x shared"
+	"fi_rdm_tagged_match -I 5 -q 0,64 -u 0,64"
+	"fi_rdm_overlap -I 5"
+	"fi_rdm_peer_bw -I 5 -c 4"
+	"fi_rdm_cq_rate -I 64"
+	"fi_rma_mr_rate -I 5 -R 1024"
 	"fi_dgram_pingpong -I 5"
 )
 
@@ -193,6 +201,7 @@ standard_tests=(
 	"fi_rdm_atomic -o all -I 1000"
 	"fi_rdm_atomic -o all -I 1000 -U"
 	"fi_rdm_cntr_pingpong"
+	"fi_rdm_deferred_wq -L"
 	"fi_multi_recv -e rdm"
 	"fi_multi_recv -e msg"
 	"fi_rdm_pingpong"
@@ -211,6 +220,20 @@ standard_tests=(
 	"fi_rdm_tagged_bw -U"
 	"fi_rdm_tagged_bw -v"
 	"fi_rdm_tagged_bw -v -U"
+	"fi_rdm_msg_rate -n 4"
+	"fi_rdm_msg_rate -n 4 -x shared"
+	"fi_rdm_msg_rate -n 4 -L"
+	"fi_rdm_tagged_match"
+	"fi_rdm_tagged_match -X 50 -y"
+	"fi_rdm_overlap"
+	"fi_rdm_overlap -r manual"
+	"fi_rdm_peer_bw"
+	"fi_rdm_peer_bw -u"
+	"fi_rdm_cq_rate"
+	"fi_rdm_cq_rate -n 1"
+	"fi_rdm_cq_rate -c sread"
+	"fi_rma_mr_rate"
+	"fi_rma_mr_rate -o read"
 	"fi_dgram_pingpong"
 	"fi_dgram_pingpong -k"
 )
@@ -223,6 +246,7 @@ unit_tests=(
 	"fi_cq_test"
 	"fi_mr_test"
 	"fi_cntr_test"
+	"fi_startup -N 4 -I 10"
 )
 
 complex_tests=(
@@ -233,6 +257,7 @@ multinode_tests=(
 	"fi_multinode -C msg"
 	"fi_multinode -C rma"
 	"fi_multinode_coll"
+	"fi_multinode_coll -T -I 10"
 )
 
 function errcho {
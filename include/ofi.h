@@ -208,6 +208,16 @@ struct fid_nic *ofi_nic_dup(const struct fid_nic *nic);
 int ofi_nic_tostr(const struct fid *fid_nic, char *buf, size_t len);
 
 struct fi_provider *ofi_get_hook(const char *name);
+void ofi_load_all_provs(void);
+
+void ofi_getinfo_cache_init(void);
+void ofi_getinfo_cache_fini(void);
+char *ofi_getinfo_cache_key(uint32_t version, const char *node,
+			    const char *service, uint64_t flags,
+			    const struct fi_info *hints);
+int ofi_getinfo_cache_get(const char *key, struct fi_info **info);
+void ofi_getinfo_cache_put(const char *key, const struct fi_info *info,
+			   bool src_given);
 
 void fi_log_init(void);
 void fi_log_fini(void);
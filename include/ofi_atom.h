@@ -355,6 +355,20 @@ typedef atomic_long	ofi_atomic_int64_t;
 OFI_ATOMIC_DEFINE(32)
 OFI_ATOMIC_DEFINE(64)
 
+/*
+ * Ordering for lock-free readers.  An acquire fence keeps earlier loads
+ * from moving past later loads and stores; a release fence keeps earlier
+ * loads and stores from moving past later stores.  Only the C11 atomics
+ * give ofi_atomic_get/set any ordering of their own.
+ */
+#ifdef HAVE_ATOMICS
+#define ofi_atomic_acquire_fence() atomic_thread_fence(memory_order_acquire)
+#define ofi_atomic_release_fence() atomic_thread_fence(memory_order_release)
+#else
+#define ofi_atomic_acquire_fence() ofi_atomic_mb()
+#define ofi_atomic_release_fence() ofi_atomic_mb()
+#endif
+
 #ifdef __cplusplus
 }
 #endif
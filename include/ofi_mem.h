@@ -41,6 +41,7 @@
 #include <string.h>
 #include <ofi_list.h>
 #include <ofi_osd.h>
+#include <ofi_perf.h>
 
 
 #ifdef INCLUDE_VALGRIND
@@ -459,14 +460,18 @@ static inline void *ofi_buf_alloc(struct ofi_bufpool *pool)
 	struct ofi_bufpool_hdr *buf_hdr;
 
 	assert(!(pool->attr.flags & OFI_BUFPOOL_INDEXED));
+	ofi_perf_region_start(OFI_PERF_BUF_ALLOC);
 	if (OFI_UNLIKELY(ofi_bufpool_empty(pool))) {
-		if (ofi_bufpool_grow(pool))
+		if (ofi_bufpool_grow(pool)) {
+			ofi_perf_region_end(OFI_PERF_BUF_ALLOC);
 			return NULL;
+		}
 	}
 
 	slist_remove_head_container(&pool->free_list.entries,
 				struct ofi_bufpool_hdr, buf_hdr, entry.slist);
 	assert(++buf_hdr->region->use_cnt);
+	ofi_perf_region_end(OFI_PERF_BUF_ALLOC);
 	return ofi_buf_data(buf_hdr);
 }
 
@@ -201,11 +201,41 @@ extern struct ofi_mem_monitor *rocr_monitor;
  * a region has been registered for the specified operation.
  */
 
+/*
+ * With FI_MR_PROV_KEY, keys index a table of slots: the low 32 bits hold
+ * the slot index and the high 32 bits the slot's generation, which is
+ * never 0.  Keys requested by the user, and provider keys issued once
+ * the table is full, are kept in the rbtree.  The table grows by whole
+ * chunks.  The chunk directory is allocated once at its maximum size, so
+ * growing never moves or frees memory a lock-free reader may be using;
+ * chunks and the directory are only freed by ofi_mr_map_close.  slot_cnt
+ * is stored with release order after a new chunk is in place, and loaded
+ * with acquire order by readers before they touch the directory.
+ */
+#define OFI_MR_SLOT_CHUNK_SHIFT	10
+#define OFI_MR_SLOT_CHUNK	(1 << OFI_MR_SLOT_CHUNK_SHIFT)
+#define OFI_MR_SLOT_CHUNK_MAX	4096
+
+struct ofi_mr_slot {
+	/* 0 while the slot is free */
+	ofi_atomic64_t		key;
+	uint64_t		access;
+	uint64_t		offset;
+	struct iovec		iov;
+	void			*context;
+	uint32_t		gen;
+	uint32_t		next_free;
+};
+
 struct ofi_mr_map {
 	const struct fi_provider *prov;
 	struct ofi_rbmap	*rbtree;
 	uint64_t		key;
 	int			mode;
+	struct ofi_mr_slot	**slots;
+	ofi_atomic32_t		slot_cnt;
+	/* index + 1 of the first free slot, 0 if none */
+	uint32_t		free_slot;
 };
 
 int ofi_mr_map_init(const struct fi_provider *in_prov, int mode,
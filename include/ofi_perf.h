@@ -62,6 +62,7 @@ enum {
 enum {
 	OFI_PMC_CPU_CYCLES,
 	OFI_PMC_CPU_INSTR,
+	OFI_PMC_CPU_CACHE_MISS,
 };
 
 enum {
@@ -179,6 +180,44 @@ static inline void ofi_perfset_end(struct ofi_perfset *set, size_t index)
 	ofi_perf_end(set->ctx, &set->data[index]);
 }
 
+/*
+ * Instrumented regions:
+ *
+ * Regions mark internal stages of the data path.  Setting FI_PERF_REGIONS
+ * samples one out of every FI_PERF_REGION_SAMPLE entries into each region
+ * and accumulates elapsed time, CPU cycles, instructions, and cache misses
+ * per thread.  Totals are logged at the trace level when the process exits.
+ * When disabled, a region costs a single predictable branch.
+ */
+enum ofi_perf_region {
+	OFI_PERF_SMR_PROGRESS_CMD,
+	OFI_PERF_TCPX_PROGRESS_RX,
+	OFI_PERF_RXM_HANDLE_COMP,
+	OFI_PERF_MR_CACHE_SEARCH,
+	OFI_PERF_CQ_WRITE,
+	OFI_PERF_BUF_ALLOC,
+	OFI_PERF_REGION_MAX
+};
+
+/* Non-zero until initialization proves regions are disabled. */
+extern int ofi_perf_region_active;
+
+void ofi_perf_region_init(void);
+void ofi_perf_region_enter(enum ofi_perf_region region);
+void ofi_perf_region_exit(enum ofi_perf_region region);
+
+static inline void ofi_perf_region_start(enum ofi_perf_region region)
+{
+	if (OFI_UNLIKELY(ofi_perf_region_active))
+		ofi_perf_region_enter(region);
+}
+
+static inline void ofi_perf_region_end(enum ofi_perf_region region)
+{
+	if (OFI_UNLIKELY(ofi_perf_region_active))
+		ofi_perf_region_exit(region);
+}
+
 
 #ifdef __cplusplus
 }
@@ -52,7 +52,7 @@ extern "C" {
 #endif
 
 
-#define SMR_VERSION	1
+#define SMR_VERSION	2
 
 #ifdef HAVE_ATOMICS
 #define SMR_FLAG_ATOMIC	(1 << 0)
@@ -89,6 +89,7 @@ enum {
 #define SMR_TX_COMPLETION	(1 << 2)
 #define SMR_RX_COMPLETION	(1 << 3)
 #define SMR_MULTI_RECV		(1 << 4)
+#define SMR_DELIVERY_COMPLETE	(1 << 5)
 
 /* CMA capability */
 enum {
@@ -197,6 +198,10 @@ struct smr_peer_data {
 	struct smr_addr		addr;
 	uint32_t		sar_status;
 	uint32_t		name_sent;
+	uint32_t		rnr_status; /* set by the owner of the region
+					       while it holds too many pinned
+					       unexpected messages from the
+					       peer */
 };
 
 extern struct dlist_entry ep_name_list;
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _OFI_TRACE_H_
+#define _OFI_TRACE_H_
+
+#include "config.h"
+
+#include <stdint.h>
+#include <ofi.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary tracepoints
+ *
+ * Tracepoints are compiled in with --enable-trace and enabled at runtime
+ * by setting FI_TRACE_FILE.  Each thread records fixed size events into
+ * its own ring buffer, without taking locks or formatting text, so that
+ * tracing disturbs protocol timing as little as possible.  When a ring
+ * fills, the oldest events are overwritten.  Rings are written to
+ * <FI_TRACE_FILE>.<pid> at exit, or when FI_TRACE_SIGNAL is received.
+ * The fi_trace2json utility converts that file into Chrome trace JSON.
+ *
+ * Events whose names end in _BEGIN or _END are reported as durations;
+ * all other events are reported as instants.  Providers add events by
+ * extending OFI_TRACE_EVENTS.  The meaning of the arguments is specific
+ * to each event and noted below.
+ */
+#define OFI_TRACE_EVENTS(FUNC)						\
+	FUNC(OFI_TRACE_RXM_STATE),	/* msg_id, old, new state */	\
+	FUNC(OFI_TRACE_SHM_CMD_BEGIN),	/* op, op_src, size, msg_id */	\
+	FUNC(OFI_TRACE_SHM_CMD_END),	/* op, ret */			\
+	FUNC(OFI_TRACE_TCP_RX_HDR),	/* op, flags, size, hdr len */	\
+	FUNC(OFI_TRACE_TCP_TX_QUEUE),	/* op, tx pending */		\
+	FUNC(OFI_TRACE_TCP_TX_DONE),	/* op, flags, size, ret */	\
+	FUNC(OFI_TRACE_RXD_ACK_TX),	/* peer, seq_no, rx window */	\
+	FUNC(OFI_TRACE_RXD_ACK_RX),	/* peer, seq_no, tx window */	\
+	FUNC(OFI_TRACE_RXD_RETRANSMIT),	/* peer, seq_no, retry count */	\
+	FUNC(OFI_TRACE_MAX)
+
+enum ofi_trace_event {
+	OFI_TRACE_EVENTS(OFI_ENUM_VAL)
+};
+
+extern const char *ofi_trace_event_str[];
+
+#define OFI_TRACE_ARGS		4
+#define OFI_TRACE_NAME_LEN	32
+#define OFI_TRACE_MAGIC		0x45434152544f4649ULL	/* "OFITRACE" */
+#define OFI_TRACE_VERSION	1
+
+struct ofi_trace_rec {
+	uint64_t	ts;		/* nanoseconds */
+	uint32_t	event;
+	uint32_t	tid;
+	uint64_t	arg[OFI_TRACE_ARGS];
+};
+
+/*
+ * File layout: an ofi_trace_file_hdr, followed by event_cnt
+ * ofi_trace_name entries, followed by ring_cnt rings.  Each ring is an
+ * ofi_trace_ring_hdr followed by rec_cnt records, oldest first.
+ */
+struct ofi_trace_file_hdr {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	pid;
+	uint32_t	event_cnt;
+	uint32_t	ring_cnt;
+	uint64_t	dropped;
+};
+
+struct ofi_trace_name {
+	char		name[OFI_TRACE_NAME_LEN];
+	char		phase;		/* 'B', 'E' or 'i' */
+	uint8_t		pad[7];
+};
+
+struct ofi_trace_ring_hdr {
+	uint32_t	tid;
+	uint32_t	pad;
+	uint64_t	rec_cnt;
+};
+
+#if ENABLE_TRACE
+
+/* Non-zero until initialization proves tracing is disabled. */
+extern int ofi_trace_active;
+
+void ofi_trace_init(void);
+void ofi_trace_record(enum ofi_trace_event event, uint64_t arg0,
+		      uint64_t arg1, uint64_t arg2, uint64_t arg3);
+void ofi_trace_flush(void);
+
+#define OFI_TRACEPOINT(event, a0, a1, a2, a3)				\
+	do {								\
+		if (OFI_UNLIKELY(ofi_trace_active))			\
+			ofi_trace_record(event, (uint64_t) (a0),	\
+					 (uint64_t) (a1),		\
+					 (uint64_t) (a2),		\
+					 (uint64_t) (a3));		\
+	} while (0)
+
+#else /* ENABLE_TRACE */
+
+static inline void ofi_trace_init(void)
+{
+}
+
+static inline void ofi_trace_flush(void)
+{
+}
+
+#define OFI_TRACEPOINT(event, a0, a1, a2, a3) do {} while (0)
+
+#endif /* ENABLE_TRACE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _OFI_TRACE_H_ */
@@ -46,6 +46,7 @@
 #define _OFI_TREE_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 
 
 enum ofi_node_color {
@@ -53,19 +54,39 @@ enum ofi_node_color {
 	RED
 };
 
+struct ofi_rbrange {
+	uint64_t		start;
+	uint64_t		len;
+};
+
+/* Small keys may be kept in the node itself, so that walking the tree
+ * does not dereference the stored data.
+ */
+union ofi_rbkey {
+	uint64_t		u64;
+	struct ofi_rbrange	range;
+};
+
 struct ofi_rbnode {
 	struct ofi_rbnode	*left;
 	struct ofi_rbnode	*right;
 	struct ofi_rbnode	*parent;
 	enum ofi_node_color	color;
 	void			*data;
+	union ofi_rbkey		key;
 };
 
+struct ofi_rbslab;
+
 struct ofi_rbmap {
 	struct ofi_rbnode	*root;
 	struct ofi_rbnode	sentinel;
 	struct ofi_rbnode	*free_list;
 
+	/* nodes are carved from cache aligned slabs, which grow in size */
+	struct ofi_rbslab	*slabs;
+	size_t			slab_size;
+
 	/* compare()
 	 *	= 0: a == b
 	 *	< 0: a < b
@@ -73,24 +94,64 @@ struct ofi_rbmap {
 	 */
 	int			(*compare)(struct ofi_rbmap *map,
 					   void *key, void *data);
+
+	/* Set for maps whose keys are stored inline, in which case it is
+	 * used in place of compare().  key_size bytes are copied from the
+	 * key into the node on insert.
+	 */
+	int			(*key_compare)(struct ofi_rbmap *map, void *key,
+					       union ofi_rbkey *node_key);
+	size_t			key_size;
 };
 
 struct ofi_rbmap *
 ofi_rbmap_create(int (*compare)(struct ofi_rbmap *map, void *key, void *data));
+struct ofi_rbmap *
+ofi_rbmap_create_keyed(int (*key_compare)(struct ofi_rbmap *map, void *key,
+					  union ofi_rbkey *node_key),
+		       size_t key_size);
 void ofi_rbmap_destroy(struct ofi_rbmap *map);
 void ofi_rbmap_init(struct ofi_rbmap *map,
 		int (*compare)(struct ofi_rbmap *map, void *key, void *data));
+void ofi_rbmap_init_keyed(struct ofi_rbmap *map,
+		int (*key_compare)(struct ofi_rbmap *map, void *key,
+				   union ofi_rbkey *node_key),
+		size_t key_size);
 void ofi_rbmap_cleanup(struct ofi_rbmap *map);
 
+/* Inline key comparisons.  Range keys compare equal when they overlap,
+ * which orders a map of disjoint ranges.
+ */
+int ofi_rbkey_u64_compare(struct ofi_rbmap *map, void *key,
+			  union ofi_rbkey *node_key);
+int ofi_rbkey_range_compare(struct ofi_rbmap *map, void *key,
+			    union ofi_rbkey *node_key);
+
 struct ofi_rbnode *ofi_rbmap_get_root(struct ofi_rbmap *map);
 struct ofi_rbnode *ofi_rbmap_find(struct ofi_rbmap *map, void *key);
 struct ofi_rbnode *ofi_rbmap_search(struct ofi_rbmap *map, void *key,
 		int (*compare)(struct ofi_rbmap *map, void *key, void *data));
+struct ofi_rbnode *ofi_rbmap_search_key(struct ofi_rbmap *map, void *key,
+		int (*key_compare)(struct ofi_rbmap *map, void *key,
+				   union ofi_rbkey *node_key));
 int ofi_rbmap_insert(struct ofi_rbmap *map, void *key, void *data,
 		struct ofi_rbnode **node);
 void ofi_rbmap_delete(struct ofi_rbmap *map, struct ofi_rbnode *node);
 int ofi_rbmap_find_delete(struct ofi_rbmap *map, void *key);
 int ofi_rbmap_empty(struct ofi_rbmap *map);
 
+/* In order traversal.  Each call returns NULL past the end of the map.
+ * lower_bound returns the first node that the key does not compare
+ * greater than; with range keys, this is the first range overlapping
+ * or following the key.
+ */
+struct ofi_rbnode *ofi_rbmap_first(struct ofi_rbmap *map);
+struct ofi_rbnode *ofi_rbmap_last(struct ofi_rbmap *map);
+struct ofi_rbnode *ofi_rbmap_next(struct ofi_rbmap *map,
+				  struct ofi_rbnode *node);
+struct ofi_rbnode *ofi_rbmap_prev(struct ofi_rbmap *map,
+				  struct ofi_rbnode *node);
+struct ofi_rbnode *ofi_rbmap_lower_bound(struct ofi_rbmap *map, void *key);
+
 
 #endif /* OFI_TREE_H_ */
@@ -182,6 +182,7 @@ struct util_fabric {
 	const struct fi_provider *prov;
 
 	struct dlist_entry	domain_list;
+	struct util_progress	*progress;
 };
 
 int ofi_fabric_init(const struct fi_provider *prov,
@@ -212,12 +213,41 @@ struct util_domain {
 	struct ofi_mr_map	mr_map;
 	enum fi_threading	threading;
 	enum fi_progress	data_progress;
+	/* set by providers that hand progress to the fabric's workers */
+	bool			auto_progress;
+
+	/*
+	 * Deferred work queue (FI_QUEUE_WORK).  Requests wait on their
+	 * triggering counter until its threshold is reached, then move to
+	 * deferred_ready and are issued by the next CQ or counter progress
+	 * call.  deferred_lock protects all deferred work state of the
+	 * domain, including the lists kept on its CQs and counters.
+	 */
+	fastlock_t		deferred_lock;
+	struct dlist_entry	deferred_list;
+	struct dlist_entry	deferred_ready;
+	ofi_atomic32_t		deferred_ready_cnt;
+	bool			deferred_running;
 };
 
 int ofi_domain_init(struct fid_fabric *fabric_fid, const struct fi_info *info,
 		     struct util_domain *domain, void *context);
 int ofi_domain_bind(struct fid *fid, struct fid *bfid, uint64_t flags);
 int ofi_domain_close(struct util_domain *domain);
+int ofi_domain_control(struct fid *fid, int command, void *arg);
+
+int ofi_deferred_queue(struct util_domain *domain,
+		       struct fi_deferred_work *work);
+int ofi_deferred_cancel(struct util_domain *domain,
+			struct fi_deferred_work *work);
+void ofi_deferred_flush(struct util_domain *domain, struct fid_cntr *cntr);
+void ofi_deferred_run(struct util_domain *domain);
+
+static inline void ofi_deferred_progress(struct util_domain *domain)
+{
+	if (ofi_atomic_get32(&domain->deferred_ready_cnt))
+		ofi_deferred_run(domain);
+}
 
 static const uint64_t ofi_rx_mr_flags[] = {
 	[ofi_op_msg] = FI_RECV,
@@ -474,6 +504,65 @@ struct util_wait_yield {
 int ofi_wait_yield_open(struct fid_fabric *fabric, struct fi_wait_attr *attr,
 			struct fid_wait **waitset);
 
+/*
+ * Poll set notification
+ *
+ * CQs and counters keep a list of the application poll sets that track
+ * them, and queue themselves on those sets' ready lists when they gain
+ * entries.
+ */
+struct util_poll_notify {
+	struct dlist_entry	list;
+	fastlock_t		lock;
+};
+
+void ofi_poll_notify_init(struct util_poll_notify *notify);
+void ofi_poll_notify_cleanup(struct util_poll_notify *notify,
+			     struct fid *fid);
+void ofi_poll_notify_ready(struct util_poll_notify *notify);
+
+static inline void ofi_poll_notify(struct util_poll_notify *notify)
+{
+	if (!dlist_empty(&notify->list))
+		ofi_poll_notify_ready(notify);
+}
+
+/*
+ * Auto progress
+ *
+ * A fabric may run a small pool of worker threads that drive progress
+ * for registered items (typically CQs or endpoints) of domains opened
+ * with FI_PROGRESS_AUTO.  Workers spin for a short time after activity,
+ * then block on a util_wait_fd that nests the wait objects of their
+ * items.  Items without a wait object are still polled at least once per
+ * spin interval.  An item may point at a sequence counter that
+ * application threads bump when they progress it themselves; the worker
+ * backs off from such items rather than contending for their locks.
+ */
+struct util_progress_worker;
+
+/* Returns true if the call found work to do */
+typedef bool (*ofi_progress_func)(void *arg);
+
+struct util_progress_item {
+	struct dlist_entry		entry;
+	struct util_progress_worker	*worker;
+	ofi_progress_func		progress;
+	void				*arg;
+	struct fid			*wait_fid;
+	ofi_wait_try_func		wait_try;
+	const volatile uint32_t		*poll_seq;
+	uint32_t			last_seq;
+};
+
+void ofi_progress_init(void);
+size_t ofi_progress_threads(void);
+bool ofi_progress_enabled(const struct fi_info *info);
+int ofi_progress_add(struct util_fabric *fabric,
+		     struct util_progress_item *item);
+void ofi_progress_del(struct util_progress_item *item);
+void ofi_progress_ep_detach(struct util_ep *ep);
+
 /*
  * Completion queue
  *
@@ -516,6 +605,14 @@ struct util_cq {
 	int			internal_wait;
 	ofi_atomic32_t		signaled;
 	ofi_cq_progress_func	progress;
+
+	struct util_progress_item progress_item;
+	volatile uint32_t	progress_seq;
+	struct util_poll_notify	poll_notify;
+
+	/* issued deferred work whose completion is reported here */
+	struct dlist_entry	deferred_list;
+	ofi_atomic32_t		deferred_cnt;
 };
 
 int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
@@ -524,6 +621,7 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 int ofi_check_bind_cq_flags(struct util_ep *ep, struct util_cq *cq,
 			    uint64_t flags);
 void ofi_cq_progress(struct util_cq *cq);
+int ofi_cq_progress_add(struct util_cq *cq, struct fid *wait_fid);
 int ofi_cq_cleanup(struct util_cq *cq);
 int ofi_cq_control(struct fid *fid, int command, void *arg);
 ssize_t ofi_cq_read(struct fid_cq *cq_fid, void *buf, size_t count);
@@ -541,6 +639,20 @@ int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 			  size_t len, void *buf, uint64_t data, uint64_t tag,
 			  fi_addr_t src);
 
+bool ofi_deferred_complete(struct util_cq *cq, void **context, uint64_t err);
+void ofi_deferred_cleanup_cq(struct util_cq *cq);
+
+/* Returns true if the completion belongs to deferred work and must not be
+ * reported to the application.  Otherwise, context is updated to the one
+ * the application supplied with the deferred work.
+ */
+static inline bool
+ofi_cq_deferred_comp(struct util_cq *cq, void **context, uint64_t err)
+{
+	return ofi_atomic_get32(&cq->deferred_cnt) &&
+	       ofi_deferred_complete(cq, context, err);
+}
+
 static inline void util_cq_signal(struct util_cq *cq)
 {
 	assert(cq->wait);
@@ -576,6 +688,10 @@ ofi_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 {
 	int ret;
 
+	if (OFI_UNLIKELY(ofi_cq_deferred_comp(cq, &context, 0)))
+		return 0;
+
+	ofi_perf_region_start(OFI_PERF_CQ_WRITE);
 	cq->cq_fastlock_acquire(&cq->cq_lock);
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_entry(cq, context, flags, len, buf, data, tag);
@@ -585,6 +701,8 @@ ofi_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 					    buf, data, tag, FI_ADDR_NOTAVAIL);
 	}
 	cq->cq_fastlock_release(&cq->cq_lock);
+	ofi_poll_notify(&cq->poll_notify);
+	ofi_perf_region_end(OFI_PERF_CQ_WRITE);
 	return ret;
 }
 
@@ -594,6 +712,10 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 {
 	int ret;
 
+	if (OFI_UNLIKELY(ofi_cq_deferred_comp(cq, &context, 0)))
+		return 0;
+
+	ofi_perf_region_start(OFI_PERF_CQ_WRITE);
 	cq->cq_fastlock_acquire(&cq->cq_lock);
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_src_entry(cq, context, flags, len, buf, data,
@@ -604,6 +726,8 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 					    buf, data, tag, src);
 	}
 	cq->cq_fastlock_release(&cq->cq_lock);
+	ofi_poll_notify(&cq->poll_notify);
+	ofi_perf_region_end(OFI_PERF_CQ_WRITE);
 	return ret;
 }
 
@@ -650,25 +774,55 @@ struct util_cntr {
 	ofi_atomic64_t		cnt;
 	ofi_atomic64_t		err;
 
-	uint64_t		checkpoint_cnt;
-	uint64_t		checkpoint_err;
-
 	struct dlist_entry	ep_list;
 	fastlock_t		ep_list_lock;
 
 	int			internal_wait;
 	ofi_cntr_progress_func	progress;
+	struct util_poll_notify	poll_notify;
+
+	/*
+	 * Threshold waits, used with internal fd based wait objects.
+	 * Blocked fi_cntr_wait() callers record the lowest threshold they
+	 * need in wake_threshold (UINT64_MAX if none) and sleep on the wait
+	 * object, which includes wake_fd.  Updates make wake_fd readable only
+	 * when the count reaches wake_threshold or an error is reported, and
+	 * it stays readable until every waiter that was registered at the
+	 * time has seen it.
+	 */
+	int			threshold_wait;
+	ofi_atomic64_t		wake_threshold;
+	int			wake_fd[2];
+	int			wake_set;
+	fastlock_t		wake_lock;
+	uint64_t		wake_gen;
+	size_t			waiter_cnt;
+	size_t			wake_pending;
+
+	/* deferred work waiting on the counter, ordered by threshold */
+	struct dlist_entry	deferred_list;
+	ofi_atomic64_t		deferred_threshold;
 };
 
+#define OFI_DEFERRED_NO_THRESHOLD UINT64_MAX
+
+void ofi_deferred_trigger(struct util_cntr *cntr);
+void ofi_deferred_cleanup_cntr(struct util_cntr *cntr);
+
 void ofi_cntr_progress(struct util_cntr *cntr);
 int ofi_cntr_init(const struct fi_provider *prov, struct fid_domain *domain,
 		  struct fi_cntr_attr *attr, struct util_cntr *cntr,
 		  ofi_cntr_progress_func progress, void *context);
 int ofi_cntr_cleanup(struct util_cntr *cntr);
+void ofi_cntr_wake(struct util_cntr *cntr);
+
 static inline void util_cntr_signal(struct util_cntr *cntr)
 {
 	assert(cntr->wait);
-	cntr->wait->signal(cntr->wait);
+	if (cntr->threshold_wait)
+		ofi_cntr_wake(cntr);
+	else
+		cntr->wait->signal(cntr->wait);
 }
 
 static inline void ofi_cntr_inc_noop(struct util_cntr *cntr)
@@ -687,7 +841,8 @@ static inline void ofi_cntr_inc(struct util_cntr *cntr)
 
 struct util_av_entry {
 	ofi_atomic32_t	use_cnt;
-	UT_hash_handle	hh;
+	/* odd while the entry is free, bumped on every insert and removal */
+	ofi_atomic32_t	gen;
 	/*
 	 * data includes 'addr' and any other additional fields
 	 * associated with av_entry. 'addr' must be the first
@@ -697,6 +852,14 @@ struct util_av_entry {
 	char		data[];
 };
 
+struct util_av_index {
+	/* odd while the index is rebuilt in place */
+	ofi_atomic32_t		seq;
+	size_t			size;
+	struct util_av_index	*retired;
+	ofi_atomic64_t		slot[];
+};
+
 struct util_av {
 	struct fid_av		av_fid;
 	struct util_domain	*domain;
@@ -705,7 +868,14 @@ struct util_av {
 	fastlock_t		lock;
 	const struct fi_provider *prov;
 
-	struct util_av_entry	*hash;
+	/*
+	 * Reverse (address to fi_addr) lookups go through an open addressing
+	 * index of entry pointers, see util_av.c.  Lookups are lock-free;
+	 * updates are serialized by the AV lock.
+	 */
+	ofi_atomic64_t		index;
+	size_t			index_used;
+	size_t			index_tombs;
 	struct ofi_bufpool	*av_entry_pool;
 
 	struct util_coll_mc	*coll_mc;
@@ -791,10 +961,32 @@ ofi_ip_av_straddr(struct fid_av *av, const void *addr, char *buf, size_t *len);
 /*
  * Poll set
  */
+struct util_poll_entry {
+	struct dlist_entry	entry;
+	struct dlist_entry	ready_entry;
+	struct dlist_entry	notify_entry;
+	struct util_poll	*pollset;
+	struct fid		*fid;
+	/* set if the member is tracked through its wait fd */
+	struct util_wait	*wait;
+	int			fd;
+	ofi_atomic32_t		ready;
+	/* counter values last reported */
+	uint64_t		checkpoint_cnt;
+	uint64_t		checkpoint_err;
+};
+
 struct util_poll {
 	struct fid_poll		poll_fid;
 	struct util_domain	*domain;
+	/* members checked on every call */
 	struct dlist_entry	fid_list;
+	/* members checked only once queued on ready_list */
+	struct dlist_entry	tracked_list;
+	struct dlist_entry	ready_list;
+	fastlock_t		ready_lock;
+	ofi_epoll_t		epoll_fd;
+	bool			epoll_open;
 	fastlock_t		lock;
 	ofi_atomic32_t		ref;
 	const struct fi_provider *prov;
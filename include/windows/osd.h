@@ -1022,6 +1022,8 @@ typedef LONGLONG ofi_atomic_int_64_t;
 
 #endif /* HAVE_BUILTIN_ATOMICS */
 
+#define ofi_atomic_mb() MemoryBarrier()
+
 static inline int ofi_set_thread_affinity(const char *s)
 {
 	OFI_UNUSED(s);
@@ -147,6 +147,12 @@ static inline int pthread_yield(void)
 	return 0;
 }
 
+static inline int sched_yield(void)
+{
+	(void) SwitchToThread();
+	return 0;
+}
+
 /*
  * TODO: temporary solution
  * Need to re-implement
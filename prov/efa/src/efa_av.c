@@ -406,7 +406,7 @@ find_out:
 			*(uint64_t *)addr, *fi_addr);
 	goto out;
 err_free_av_entry:
-	ofi_ibuf_free(util_av_entry);
+	ofi_av_remove_addr(&av->util_av, *fi_addr);
 out:
 	fastlock_release(&av->util_av.lock);
 	return ret;
@@ -633,7 +633,7 @@ static int efa_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr,
 	fastlock_release(&av->util_av.lock);
 	goto out;
 err_free_av_entry:
-	ofi_ibuf_free(util_av_entry);
+	ofi_av_remove_addr(&av->util_av, fi_addr[i]);
 release_lock:
 	fastlock_release(&av->util_av.lock);
 out:
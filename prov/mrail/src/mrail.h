@@ -53,6 +53,7 @@
 #include <ofi_proto.h>
 #include <ofi_prov.h>
 #include <ofi_enosys.h>
+#include <ofi_recvwin.h>
 
 #define MRAIL_MAX_INFO 100
 
@@ -79,7 +80,8 @@ extern size_t mrail_num_info;
 enum {
 	MRAIL_POLICY_FIXED,
 	MRAIL_POLICY_ROUND_ROBIN,
-	MRAIL_POLICY_STRIPING
+	MRAIL_POLICY_STRIPING,
+	MRAIL_POLICY_ADAPTIVE
 };
 
 #define MRAIL_MAX_CONFIG		8
@@ -92,6 +94,8 @@ struct mrail_config {
 extern struct mrail_config mrail_config[MRAIL_MAX_CONFIG];
 extern int mrail_num_config;
 extern int mrail_local_rank;
+extern bool mrail_adaptive;
+extern size_t mrail_recvwin_size;
 
 extern struct fi_ops_rma mrail_ops_rma;
 
@@ -178,6 +182,10 @@ struct mrail_tx_buf {
 	struct mrail_rndv_hdr	rndv_hdr;
 	struct mrail_rndv_req	*rndv_req;
 	fid_t			rndv_mr_fid;
+	/* rail load tracking, see mrail_rail_post() */
+	uint32_t		rail;
+	size_t			len;
+	uint64_t		start;
 };
 
 struct mrail_pkt {
@@ -242,19 +250,27 @@ struct mrail_av {
 	size_t num_avs;
 };
 
-struct mrail_peer_info {
-	struct slist	ooo_recv_queue;
-	fi_addr_t	addr;
-	uint32_t	seq_no;
-	uint32_t	expected_seq_no;
-};
-
 struct mrail_ooo_recv {
 	struct slist_entry 		entry;
 	struct fi_cq_tagged_entry 	comp;
 	uint32_t 			seq_no;
 };
 
+OFI_DECL_RECVWIN_BUF(struct mrail_ooo_recv *, mrail_recvwin, uint32_t);
+
+#define MRAIL_DEF_RECVWIN_SIZE		1024
+
+struct mrail_peer_info {
+	/* Early messages within mrail_recvwin_size of expected_seq_no are
+	 * indexed by seq_no in recvwin, allocated on the first one.  Those
+	 * further ahead are kept sorted in ooo_recv_queue. */
+	struct slist		ooo_recv_queue;
+	struct mrail_recvwin	*recvwin;
+	fi_addr_t		addr;
+	uint32_t		seq_no;
+	uint32_t		expected_seq_no;
+};
+
 typedef int (*mrail_cq_process_comp_func_t)(struct fi_cq_tagged_entry *comp,
 					    fi_addr_t src_addr);
 struct mrail_cq {
@@ -264,12 +280,30 @@ struct mrail_cq {
 	mrail_cq_process_comp_func_t	process_comp;
 };
 
+/*
+ * Per-rail estimates used by the adaptive policy.  The averages are only
+ * updated under the endpoint lock.
+ */
+struct mrail_rail_stats {
+	ofi_atomic64_t	outstanding;	/* bytes posted, not yet completed */
+	uint64_t	lat_ns;		/* average completion latency */
+	double		bw;		/* average throughput in bytes/ns */
+};
+
+/* Only transfers at least this large update the throughput estimate */
+#define MRAIL_ADAPTIVE_BW_MIN		4096
+/* Every n-th adaptive send uses round-robin to refresh idle rails */
+#define MRAIL_ADAPTIVE_PROBE		64
+/* A rail's stripe is never weighted below 1/n of the fastest rail's */
+#define MRAIL_ADAPTIVE_MIN_WEIGHT	16
+
 struct mrail_ep {
 	struct util_ep		util_ep;
 	struct fi_info		*info;
 	struct {
 		struct fid_ep 		*ep;
 		struct fi_info		*info;
+		struct mrail_rail_stats	stats;
 	}			*rails;
 	size_t			num_eps;
 	ofi_atomic32_t		tx_rail;
@@ -377,14 +411,46 @@ static inline int mrail_get_policy(size_t size)
 	return mrail_config[i].policy;
 }
 
-static inline size_t mrail_get_tx_rail(struct mrail_ep *mrail_ep, int policy)
+size_t mrail_get_tx_rail_adaptive(struct mrail_ep *mrail_ep, size_t len);
+
+static inline size_t mrail_get_tx_rail(struct mrail_ep *mrail_ep, int policy,
+				       size_t len)
+{
+	switch (policy) {
+	case MRAIL_POLICY_FIXED:
+		return mrail_ep->default_tx_rail;
+	case MRAIL_POLICY_ADAPTIVE:
+		return mrail_get_tx_rail_adaptive(mrail_ep, len);
+	default:
+		return mrail_get_tx_rail_rr(mrail_ep);
+	}
+}
+
+/*
+ * Account for a transfer of len bytes posted to a rail.  Every call must be
+ * matched by mrail_rail_complete() once the rail reports the completion, or
+ * by mrail_rail_cancel() if the post failed.
+ */
+static inline void mrail_rail_post(struct mrail_ep *mrail_ep, uint32_t rail,
+				   size_t len, uint64_t *start)
 {
-	return policy == MRAIL_POLICY_FIXED ?
-				mrail_ep->default_tx_rail :
-				mrail_get_tx_rail_rr(mrail_ep);
+	if (!mrail_adaptive)
+		return;
+
+	ofi_atomic_add64(&mrail_ep->rails[rail].stats.outstanding, len);
+	*start = ofi_gettime_ns();
+}
 
+static inline void mrail_rail_cancel(struct mrail_ep *mrail_ep, uint32_t rail,
+				     size_t len)
+{
+	if (mrail_adaptive)
+		ofi_atomic_sub64(&mrail_ep->rails[rail].stats.outstanding, len);
 }
 
+void mrail_rail_complete(struct mrail_ep *mrail_ep, uint32_t rail,
+			 size_t len, uint64_t start);
+
 struct mrail_subreq {
 	struct fi_context context;
 	struct mrail_req *parent;
@@ -393,6 +459,9 @@ struct mrail_subreq {
 	struct fi_rma_iov rma_iov[MRAIL_IOV_LIMIT];
 	size_t iov_count;
 	size_t rma_iov_count;
+	uint32_t rail;
+	size_t len;
+	uint64_t start;
 };
 
 struct mrail_req {
@@ -405,6 +474,8 @@ struct mrail_req {
 	ofi_atomic32_t expected_subcomps;
 	int op_type;
 	int pending_subreq;
+	/* subreqs are sized for, and must be posted to, subreq->rail */
+	bool weighted;
 	struct mrail_subreq subreqs[];
 };
 
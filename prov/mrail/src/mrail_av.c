@@ -32,6 +32,18 @@
 
 #include "mrail.h"
 
+static int mrail_av_free_recvwin(struct util_av *av, void *addr,
+				 fi_addr_t fi_addr, void *arg)
+{
+	struct mrail_peer_info *peer_info = addr;
+
+	if (peer_info->recvwin) {
+		ofi_recvwin_free(peer_info->recvwin);
+		free(peer_info->recvwin);
+	}
+	return 0;
+}
+
 static int mrail_av_close(struct fid *fid)
 {
 	struct mrail_av *mrail_av = container_of(fid, struct mrail_av,
@@ -44,6 +56,8 @@ static int mrail_av_close(struct fid *fid)
 	free(mrail_av->avs);
 	free(mrail_av->rail_addrlen);
 
+	ofi_av_elements_iter(&mrail_av->util_av, mrail_av_free_recvwin, NULL);
+
 	ret = ofi_av_close(&mrail_av->util_av);
 	if (ret)
 		retv = ret;
@@ -136,8 +150,10 @@ static int mrail_av_insert(struct fid_av *av_fid, const void *addr, size_t count
 		}
 
 		peer_info->addr = index_rail0;
+		fastlock_acquire(&mrail_av->util_av.lock);
 		ret = ofi_av_insert_addr(&mrail_av->util_av, peer_info,
 					 &index);
+		fastlock_release(&mrail_av->util_av.lock);
 		if (ret) {
 			FI_WARN(&mrail_prov, FI_LOG_AV, \
 				"Unable to get rail fi_addr\n");
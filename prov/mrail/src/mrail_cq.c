@@ -34,6 +34,35 @@
 
 #include "mrail.h"
 
+/*
+ * Small transfers feed the latency average and large ones the throughput
+ * average, so neither is skewed by the other.
+ */
+void mrail_rail_complete(struct mrail_ep *mrail_ep, uint32_t rail,
+			 size_t len, uint64_t start)
+{
+	struct mrail_rail_stats *stats;
+	uint64_t lat;
+
+	if (!mrail_adaptive)
+		return;
+
+	stats = &mrail_ep->rails[rail].stats;
+	lat = MAX(ofi_gettime_ns() - start, 1);
+
+	ofi_ep_lock_acquire(&mrail_ep->util_ep);
+	ofi_atomic_sub64(&stats->outstanding, len);
+	if (len < MRAIL_ADAPTIVE_BW_MIN) {
+		stats->lat_ns = stats->lat_ns ?
+				(7 * stats->lat_ns + lat) / 8 : lat;
+	} else {
+		stats->bw = stats->bw > 0 ?
+			    (7 * stats->bw + (double) len / lat) / 8 :
+			    (double) len / lat;
+	}
+	ofi_ep_lock_release(&mrail_ep->util_ep);
+}
+
 static int mrail_cq_write_send_comp(struct util_cq *cq,
 				    struct mrail_tx_buf *tx_buf)
 {
@@ -314,18 +343,39 @@ static struct mrail_recv *mrail_match_recv(struct mrail_ep *mrail_ep,
 	return recv;
 }
 
+/* Should only be called while holding the EP's lock */
+static void mrail_peer_next_seq(struct mrail_peer_info *peer_info)
+{
+	peer_info->expected_seq_no++;
+	if (peer_info->recvwin)
+		ofi_recvwin_slide(peer_info->recvwin);
+}
+
+/* Should only be called while holding the EP's lock */
 static
 struct mrail_ooo_recv *mrail_get_next_recv(struct mrail_peer_info *peer_info)
 {
 	struct slist *queue = &peer_info->ooo_recv_queue;
 	struct mrail_ooo_recv *ooo_recv;
 
+	/* Without a window (its allocation failed), every early message is
+	 * in the sorted queue, which still delivers them in order. */
+	if (peer_info->recvwin) {
+		ooo_recv = *ofi_recvwin_peek(peer_info->recvwin);
+		if (ooo_recv) {
+			assert(ooo_recv->seq_no == peer_info->expected_seq_no);
+			*ofi_recvwin_get_next_msg(peer_info->recvwin) = NULL;
+			peer_info->expected_seq_no++;
+			return ooo_recv;
+		}
+	}
+
 	if (!slist_empty(queue)) {
 		ooo_recv = container_of(queue->head, struct mrail_ooo_recv,
 				entry);
 		if (ooo_recv->seq_no == peer_info->expected_seq_no) {
 			slist_remove_head(queue);
-			peer_info->expected_seq_no++;
+			mrail_peer_next_seq(peer_info);
 			return ooo_recv;
 		}
 	}
@@ -374,6 +424,24 @@ static int mrail_ooo_recv_before(struct slist_entry *item, const void *arg)
 	return (new_recv->seq_no < ooo_recv->seq_no);
 }
 
+static struct mrail_recvwin *
+mrail_alloc_recvwin(struct mrail_peer_info *peer_info)
+{
+	struct mrail_recvwin *recvwin;
+
+	recvwin = malloc(sizeof(*recvwin));
+	if (!recvwin)
+		return NULL;
+
+	ofi_recvwin_buf_alloc(recvwin, mrail_recvwin_size);
+	if (!recvwin->pending) {
+		free(recvwin);
+		return NULL;
+	}
+	recvwin->exp_msg_id = peer_info->expected_seq_no;
+	return recvwin;
+}
+
 /* Should only be called while holding the EP's lock */
 static void mrail_save_ooo_recv(struct mrail_ep *mrail_ep,
 				struct mrail_peer_info *peer_info,
@@ -393,8 +461,17 @@ static void mrail_save_ooo_recv(struct mrail_ep *mrail_ep,
 	ooo_recv->seq_no = seq_no;
 	memcpy(&ooo_recv->comp, comp, sizeof(*comp));
 
-	slist_insert_before_first_match(queue, mrail_ooo_recv_before,
-					&ooo_recv->entry);
+	if (!peer_info->recvwin)
+		peer_info->recvwin = mrail_alloc_recvwin(peer_info);
+
+	if (peer_info->recvwin &&
+	    ofi_recvwin_id_valid(peer_info->recvwin, seq_no)) {
+		ofi_recvwin_queue_msg(peer_info->recvwin, &ooo_recv, seq_no);
+	} else {
+		/* Too far ahead for the window: keep it sorted on the side */
+		slist_insert_before_first_match(queue, mrail_ooo_recv_before,
+						&ooo_recv->entry);
+	}
 
 	FI_DBG(&mrail_prov, FI_LOG_CQ, "saved ooo_recv seq=%d\n", seq_no);
 }
@@ -442,7 +519,7 @@ static int mrail_handle_recv_completion(struct fi_cq_tagged_entry *comp,
 	ofi_ep_lock_acquire(&mrail_ep->util_ep);
 	if (seq_no == peer_info->expected_seq_no) {
 		/* This message was received in order */
-		peer_info->expected_seq_no++;
+		mrail_peer_next_seq(peer_info);
 		/* Requesting FI_AV_TABLE from the underlying provider allows
 		 * us to use src_addr as an int here. */
 		recv = mrail_match_recv(mrail_ep, comp, (int) src_addr);
@@ -517,6 +594,8 @@ static void mrail_handle_rma_completion(struct util_cq *cq,
 
 	subreq = comp->op_context;
 	req = subreq->parent;
+	mrail_rail_complete(req->mrail_ep, subreq->rail, subreq->len,
+			    subreq->start);
 
 	if (ofi_atomic_dec32(&req->expected_subcomps) == 0) {
 		if (req->comp.flags & MRAIL_RNDV_FLAG) {
@@ -578,6 +657,8 @@ void mrail_poll_cq(struct util_cq *cq)
 			mrail_handle_rma_completion(cq, &comp);
 		} else if (comp.flags & FI_SEND) {
 			tx_buf = comp.op_context;
+			mrail_rail_complete(tx_buf->ep, tx_buf->rail,
+					    tx_buf->len, tx_buf->start);
 			if (tx_buf->hdr.protocol == MRAIL_PROTO_RNDV) {
 				if (tx_buf->hdr.protocol_cmd == MRAIL_RNDV_REQ) {
 					/* buf will be freed when ACK comes */
@@ -338,6 +338,42 @@ static struct mrail_tx_buf *mrail_get_tx_buf(struct mrail_ep *mrail_ep,
 	return tx_buf;
 }
 
+/*
+ * Pick the rail expected to finish a send of len bytes first, based on the
+ * bytes already queued on it, its small message latency, and its
+ * throughput.  Rails without samples look free and are tried first.  Called
+ * with the endpoint lock held.
+ */
+size_t mrail_get_tx_rail_adaptive(struct mrail_ep *mrail_ep, size_t len)
+{
+	struct mrail_rail_stats *stats;
+	uint64_t cost, best_cost = UINT64_MAX;
+	int64_t queued;
+	uint32_t seq;
+	size_t i, rail = 0;
+
+	seq = ofi_atomic_inc32(&mrail_ep->tx_rail) - 1;
+	if (!(seq % MRAIL_ADAPTIVE_PROBE))
+		return (seq / MRAIL_ADAPTIVE_PROBE) % mrail_ep->num_eps;
+
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		stats = &mrail_ep->rails[i].stats;
+		queued = MAX(ofi_atomic_get64(&stats->outstanding), 0);
+
+		cost = stats->lat_ns;
+		if (stats->bw > 0)
+			cost += (uint64_t) ((queued + len) / stats->bw);
+		else
+			cost += stats->lat_ns * queued / MAX(len, 1);
+
+		if (cost < best_cost) {
+			best_cost = cost;
+			rail = i;
+		}
+	}
+	return rail;
+}
+
 /*
  * This is an internal send that doesn't use seq_no and doesn't update
  * the counters. The call doesn't return -FI_EAGAIN.
@@ -350,12 +386,13 @@ int mrail_send_rndv_ack_blocking(struct mrail_ep *mrail_ep,
 	struct mrail_tx_buf *tx_buf;
 	size_t rndv_pkt_size = sizeof(tx_buf->hdr) + sizeof(tx_buf->rndv_hdr);
 	int policy = mrail_get_policy(rndv_pkt_size);
-	uint32_t i = mrail_get_tx_rail(mrail_ep, policy);
+	uint32_t i;
 	struct fi_msg msg;
 	ssize_t ret;
 	uint64_t flags = FI_COMPLETION;
 
 	ofi_ep_lock_acquire(&mrail_ep->util_ep);
+	i = mrail_get_tx_rail(mrail_ep, policy, rndv_pkt_size);
 
 	tx_buf = mrail_get_tx_buf(mrail_ep, context, 0, ofi_op_tagged, 0);
 	if (OFI_UNLIKELY(!tx_buf))
@@ -380,6 +417,9 @@ int mrail_send_rndv_ack_blocking(struct mrail_ep *mrail_ep,
 	FI_DBG(&mrail_prov, FI_LOG_EP_DATA, "Posting rdnv ack "
 	       " dest_addr: 0x%" PRIx64 " on rail: %d\n", dest_addr, i);
 
+	tx_buf->rail = i;
+	tx_buf->len = rndv_pkt_size;
+	mrail_rail_post(mrail_ep, i, rndv_pkt_size, &tx_buf->start);
 	do {
 		ret = fi_sendmsg(mrail_ep->rails[i].ep, &msg, flags);
 		if (ret == -FI_EAGAIN) {
@@ -393,6 +433,7 @@ int mrail_send_rndv_ack_blocking(struct mrail_ep *mrail_ep,
 	if (ret) {
 		FI_WARN(&mrail_prov, FI_LOG_EP_DATA,
 			"Unable to fi_sendmsg on rail: %" PRIu32 "\n", i);
+		mrail_rail_cancel(mrail_ep, i, rndv_pkt_size);
 		ofi_buf_free(tx_buf);
 	}
 
@@ -488,7 +529,7 @@ mrail_send_common(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 	struct iovec *iov_dest = alloca(sizeof(*iov_dest) * (count + 1));
 	struct mrail_tx_buf *tx_buf;
 	int policy = mrail_get_policy(len);
-	uint32_t rail = mrail_get_tx_rail(mrail_ep, policy);
+	uint32_t rail;
 	struct fi_msg msg;
 	ssize_t ret;
 	size_t total_len;
@@ -496,9 +537,11 @@ mrail_send_common(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 	peer_info = ofi_av_get_addr(mrail_ep->util_ep.av, (int) dest_addr);
 
 	ofi_ep_lock_acquire(&mrail_ep->util_ep);
+	rail = mrail_get_tx_rail(mrail_ep, policy, len);
 
 	tx_buf = mrail_get_tx_buf(mrail_ep, context, peer_info->seq_no++,
-				  ofi_op_tagged, flags | op);
+				  op == FI_TAGGED ? ofi_op_tagged : ofi_op_msg,
+				  flags | op);
 	if (OFI_UNLIKELY(!tx_buf)) {
 		ret = -FI_ENOMEM;
 		goto err1;
@@ -538,10 +581,15 @@ mrail_send_common(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 	       " dest_addr: 0x%" PRIx64 " tag: 0x%" PRIx64 " seq: %d"
 	       " on rail: %d\n", len, dest_addr, tag, peer_info->seq_no - 1, rail);
 
+	tx_buf->rail = rail;
+	tx_buf->len = total_len;
+	mrail_rail_post(mrail_ep, rail, total_len, &tx_buf->start);
+
 	ret = fi_sendmsg(mrail_ep->rails[rail].ep, &msg, flags | FI_COMPLETION);
 	if (ret) {
 		FI_WARN(&mrail_prov, FI_LOG_EP_DATA,
 			"Unable to fi_sendmsg on rail: %" PRIu32 "\n", rail);
+		mrail_rail_cancel(mrail_ep, rail, total_len);
 		goto err2;
 	} else if (!(flags & FI_COMPLETION)) {
 		ofi_ep_tx_cntr_inc(&mrail_ep->util_ep);
@@ -1049,6 +1097,8 @@ int mrail_ep_open(struct fid_domain *domain_fid, struct fi_info *info,
 
 	ofi_atomic_initialize32(&mrail_ep->tx_rail, 0);
 	ofi_atomic_initialize32(&mrail_ep->rx_rail, 0);
+	for (i = 0; i < mrail_ep->num_eps; i++)
+		ofi_atomic_initialize64(&mrail_ep->rails[i].stats.outstanding, 0);
 	mrail_ep->default_tx_rail = mrail_local_rank % mrail_ep->num_eps;
 
 	*ep_fid = &mrail_ep->util_ep.ep_fid;
@@ -75,6 +75,7 @@ static ssize_t mrail_post_subreq(uint32_t rail,
 	uint64_t flags = req->flags;
 
 	mrail_subreq_to_rail(subreq, rail, rail_iov, rail_descs, rail_rma_iov);
+	subreq->rail = rail;
 
 	msg.msg_iov		= rail_iov;
 	msg.desc		= rail_descs;
@@ -84,6 +85,7 @@ static ssize_t mrail_post_subreq(uint32_t rail,
 	msg.rma_iov_count	= subreq->rma_iov_count;
 	msg.context		= &subreq->context;
 
+	mrail_rail_post(mrail_ep, rail, subreq->len, &subreq->start);
 	if (req->op_type == FI_READ) {
 		ret = fi_readmsg(mrail_ep->rails[rail].ep, &msg, flags);
 	} else {
@@ -98,6 +100,8 @@ static ssize_t mrail_post_subreq(uint32_t rail,
 		ret = fi_writemsg(mrail_ep->rails[rail].ep, &msg, flags);
 	}
 
+	if (ret)
+		mrail_rail_cancel(mrail_ep, rail, subreq->len);
 	return ret;
 }
 
@@ -106,14 +110,17 @@ static ssize_t mrail_post_req(struct mrail_req *req)
 	size_t i;
 	uint32_t rail;
 	ssize_t ret = 0;
+	struct mrail_subreq *subreq;
 
 	while (req->pending_subreq >= 0) {
+		subreq = &req->subreqs[req->pending_subreq];
+
 		/* Try all rails before giving up */
 		for (i = 0; i < req->mrail_ep->num_eps; ++i) {
-			rail = mrail_get_tx_rail_rr(req->mrail_ep);
+			rail = req->weighted ? subreq->rail :
+				mrail_get_tx_rail_rr(req->mrail_ep);
 
-			ret = mrail_post_subreq(rail,
-					&req->subreqs[req->pending_subreq]);
+			ret = mrail_post_subreq(rail, subreq);
 			if (ret != -FI_EAGAIN) {
 				break;
 			} else {
@@ -180,6 +187,50 @@ void mrail_progress_deferred_reqs(struct mrail_ep *mrail_ep)
 	}
 }
 
+/*
+ * Stripe i goes to rail i, sized in proportion to the rail's observed
+ * throughput.  Returns false, leaving the stripes unset, until every rail
+ * has reported a throughput estimate.
+ */
+static bool mrail_weight_subreqs(struct mrail_ep *mrail_ep,
+				 struct mrail_req *req, size_t total_len)
+{
+	double bw, min_bw, max_bw = 0, sum = 0;
+	size_t i, assigned = 0;
+	bool weighted = true;
+
+	if (!mrail_adaptive)
+		return false;
+
+	ofi_ep_lock_acquire(&mrail_ep->util_ep);
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		bw = mrail_ep->rails[i].stats.bw;
+		if (bw <= 0) {
+			weighted = false;
+			goto out;
+		}
+		max_bw = MAX(max_bw, bw);
+	}
+
+	/* Keep a share on slow rails so that their estimates stay current */
+	min_bw = max_bw / MRAIL_ADAPTIVE_MIN_WEIGHT;
+	for (i = 0; i < mrail_ep->num_eps; i++)
+		sum += MAX(mrail_ep->rails[i].stats.bw, min_bw);
+
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		bw = MAX(mrail_ep->rails[i].stats.bw, min_bw);
+		req->subreqs[i].len = (size_t) (total_len * (bw / sum));
+		req->subreqs[i].rail = (uint32_t) i;
+		assigned += req->subreqs[i].len;
+	}
+
+	/* The first stripe gets what rounding left over */
+	req->subreqs[mrail_ep->num_eps - 1].len += total_len - assigned;
+out:
+	ofi_ep_lock_release(&mrail_ep->util_ep);
+	return weighted;
+}
+
 static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 		const struct fi_msg_rma *msg, struct mrail_req *req)
 {
@@ -188,23 +239,28 @@ static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 	size_t subreq_count;
 	size_t total_len;
 	size_t chunk_len;
-	size_t subreq_len;
 	size_t iov_index;
 	size_t iov_offset;
 	size_t rma_iov_index;
 	size_t rma_iov_offset;
 	int i;
 
-	/* For now, stripe across all rails.
-	 * This could be determined by a dynamic scheduler instead.
+	/* Stripe across all rails, weighted by throughput if the adaptive
+	 * policy has estimates for them, equally otherwise.
 	 */
 	subreq_count = mrail_ep->num_eps;
 
-	total_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count); 
-	chunk_len = total_len / subreq_count;
+	total_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count);
+	req->weighted = mrail_weight_subreqs(mrail_ep, req, total_len);
+	if (!req->weighted) {
+		chunk_len = total_len / subreq_count;
+		for (i = 0; i < subreq_count; i++)
+			req->subreqs[i].len = chunk_len;
+
+		/* The first chunk is the longest */
+		req->subreqs[subreq_count - 1].len += total_len % subreq_count;
+	}
 
-	/* The first chunk is the longest */
-	subreq_len =  chunk_len + (total_len % subreq_count);
 	iov_index = 0;
 	iov_offset = 0;
 	rma_iov_index = 0;
@@ -227,7 +283,7 @@ static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 				&subreq->iov_count,
 				(struct iovec *)msg->msg_iov, msg->desc,
 				msg->iov_count, &iov_index, &iov_offset,
-				subreq_len);
+				subreq->len);
 		if (ret) {
 			goto out;
 		}
@@ -235,13 +291,10 @@ static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 		ret = ofi_copy_rma_iov(subreq->rma_iov, &subreq->rma_iov_count,
 				(struct fi_rma_iov *)msg->rma_iov,
 				msg->rma_iov_count, &rma_iov_index,
-				&rma_iov_offset, subreq_len);
+				&rma_iov_offset, subreq->len);
 		if (ret) {
 			goto out;
 		}
-
-		/* All the other chunks have the same length */
-		subreq_len = chunk_len;
 	}
 
 	ofi_atomic_initialize32(&req->expected_subcomps, subreq_count);
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _FI_EXT_RSTREAM_H_
+#define _FI_EXT_RSTREAM_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <rdma/fi_endpoint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FI_RSTREAM_EP_OPS_1 "rstream ep ops 1"
+
+/*
+ * Zero-copy receive.  recv_lend returns up to len bytes of received data
+ * in place in the endpoint's receive ring, setting *buf to the start of
+ * the data.  Lent bytes are not returned to the peer until released with
+ * recv_release, which must be called in the order the data was lent.
+ * recv_lend returns the number of bytes lent, or -FI_EAGAIN if no data
+ * has arrived.  recv_release returns 0 on success.
+ */
+struct fi_rstream_ops_ep {
+	size_t size;
+	ssize_t (*recv_lend)(struct fid_ep *ep, void **buf, size_t len);
+	ssize_t (*recv_release)(struct fid_ep *ep, size_t len);
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FI_EXT_RSTREAM_H_ */
@@ -55,6 +55,8 @@
 #include <ofi_prov.h>
 #include <ofi_enosys.h>
 
+#include "fi_ext_rstream.h"
+
 
 #define RSTREAM_CAPS (FI_MSG | FI_SEND | FI_RECV | FI_LOCAL_COMM | FI_REMOTE_COMM)
 #define RSTREAM_DEFAULT_QP_SIZE 384
@@ -62,6 +64,11 @@
 #define RSTREAM_MR_BITS 15
 #define RSTREAM_DEFAULT_MR_SEG_SIZE (1 << RSTREAM_MR_BITS)
 
+/* ring sizing from the bandwidth-delay product */
+#define RSTREAM_DEFAULT_RTT 100 /* usec */
+#define RSTREAM_DEFAULT_LINK_SPEED 10000000000ULL /* bits per sec */
+#define RSTREAM_DEFAULT_DIRECT_SEND_SIZE (1 << 14)
+
 #define RSTREAM_MAX_POLL_TIME 10
 
 #define RSTREAM_MAX_MR_BITS 20
@@ -73,6 +80,9 @@
 #define RSTREAM_CREDIT_MASK ((RSTREAM_CREDITS_MAX - 1) << RSTREAM_CREDIT_OFFSET)
 #define RSTREAM_RSOCKETV2 2
 
+/* total_len in the credit update must fit the length field */
+#define RSTREAM_MAX_MR_SEG_SIZE (RSTREAM_MR_MAX >> 1)
+
 /*iWARP, have to also track msg len [msglen, target_credits, target_mr_len]*/
 #define RSTREAM_USING_IWARP (rstream_info.ep_attr->protocol == FI_PROTO_IWARP)
 #define RSTREAM_IWARP_DATA_SIZE sizeof(uint32_t)
@@ -86,6 +96,10 @@ extern struct fi_provider rstream_prov;
 extern struct util_prov rstream_util_prov;
 extern struct fi_fabric_attr rstream_fabric_attr;
 
+extern size_t rstream_window_size;
+extern int rstream_rtt;
+extern size_t rstream_direct_send_size;
+
 /* util structs ~ user layer fds */
 
 struct rstream_fabric {
@@ -96,6 +110,9 @@ struct rstream_fabric {
 struct rstream_domain {
 	struct util_domain util_domain;
 	struct fid_domain *msg_domain;
+	uint64_t core_mr_mode;
+	ofi_atomic64_t mr_key;
+	uint32_t window_size;
 };
 
 enum rstream_msg_type {
@@ -140,6 +157,7 @@ struct rstream_cm_data {
 struct rstream_ctx_data {
 	struct fi_context ctx;
 	size_t len;
+	int direct;
 };
 
 OFI_DECLARE_FREESTACK(struct rstream_ctx_data, rstream_tx_ctx_fs);
@@ -169,6 +187,7 @@ struct rstream_ep {
 	struct util_ep util_ep;
 	struct fid_ep *ep_fd;
 	struct fid_domain *msg_domain;
+	struct rstream_domain *domain;
 	struct rstream_lmr_data local_mr;
 	struct rstream_rmr_data remote_data;
 	struct fid_cq *cq;
@@ -177,6 +196,10 @@ struct rstream_ep {
 	uint32_t rx_ctx_index;
 	struct rstream_tx_ctx_fs *tx_ctxs;
 	struct rstream_cq_data rx_cq_data;
+	uint32_t direct_pending;
+	/* rx ring bytes lent to the app, and consumed bytes queued behind them */
+	uint32_t rx_lent;
+	uint32_t rx_held;
 	fastlock_t send_lock;
 	fastlock_t recv_lock;
 	/* must take send/recv lock before cq_lock */
@@ -217,6 +240,9 @@ extern struct fi_ops_msg rstream_ops_msg;
 extern int rstream_passive_ep(struct fid_fabric *fabric, struct fi_info *info,
 	struct fid_pep **pep, void *context);
 extern void rstream_process_cm_event(struct rstream_ep *ep, void *cm_data);
+extern uint64_t rstream_mr_key(struct rstream_domain *domain);
+extern ssize_t rstream_recv_lend(struct fid_ep *ep_fid, void **buf, size_t len);
+extern ssize_t rstream_recv_release(struct fid_ep *ep_fid, size_t len);
 
 int rstream_fabric_open(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
 	void *context);
@@ -34,13 +34,13 @@
 
 
 struct fi_tx_attr rstream_tx_attr = {
-	.caps = RSTREAM_CAPS,
+	.caps = FI_MSG | FI_SEND,
 	.msg_order = FI_ORDER_SAS,
 	.size = RSTREAM_DEFAULT_QP_SIZE,
 };
 
 struct fi_rx_attr rstream_rx_attr = {
-	.caps = RSTREAM_CAPS,
+	.caps = FI_MSG | FI_RECV,
 	.msg_order = FI_ORDER_SAS,
 	.size = RSTREAM_DEFAULT_QP_SIZE,
 };
@@ -69,7 +69,7 @@ struct fi_domain_attr rstream_domain_attr = {
 };
 
 struct fi_fabric_attr rstream_fabric_attr = {
-	.prov_version = FI_VERSION(1, 8),
+	.prov_version = OFI_VERSION_DEF_PROV,
 };
 
 struct fi_info rstream_info = {
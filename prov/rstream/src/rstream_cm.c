@@ -40,7 +40,12 @@ static void rstream_format_data(struct rstream_cm_data *cm,
 
 	cm->version = RSTREAM_RSOCKETV2;
 	cm->max_rx_credits = htons(ep->qp_win.max_rx_credits);
-	cm->base_addr = htonll((uintptr_t)ep->local_mr.rx.data_start);
+	/* offset based addressing unless the core uses virtual addresses */
+	if (ep->domain->core_mr_mode & FI_MR_VIRT_ADDR)
+		cm->base_addr = htonll((uintptr_t)ep->local_mr.rx.data_start);
+	else
+		cm->base_addr = htonll((uintptr_t)ep->local_mr.rx.data_start -
+			(uintptr_t)ep->local_mr.base_addr);
 	cm->rkey = htonll(ep->local_mr.rkey);
 	cm->rmr_size = htonl(ep->local_mr.rx.size);
 }
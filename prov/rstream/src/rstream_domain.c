@@ -32,6 +32,37 @@
 
 #include "rstream.h"
 
+/*
+ * Size the rings to cover the bandwidth-delay product of the core link so
+ * that a single stream can keep the wire busy.  The link speed comes from
+ * the core NIC attributes when the provider reports it.
+ */
+static uint32_t rstream_calc_window_size(const struct fi_info *cinfo)
+{
+	uint64_t speed = RSTREAM_DEFAULT_LINK_SPEED;
+	uint64_t bdp;
+
+	if (rstream_window_size)
+		return MIN(MAX(rstream_window_size, RSTREAM_DEFAULT_MR_SEG_SIZE),
+			RSTREAM_MAX_MR_SEG_SIZE);
+
+	if (cinfo->nic && cinfo->nic->link_attr &&
+	    cinfo->nic->link_attr->speed)
+		speed = cinfo->nic->link_attr->speed;
+
+	bdp = roundup_power_of_two(speed / 8 * rstream_rtt / 1000000);
+	return MIN(MAX(bdp, RSTREAM_DEFAULT_MR_SEG_SIZE),
+		RSTREAM_MAX_MR_SEG_SIZE);
+}
+
+/* keys must be unique when the core provider does not select them */
+uint64_t rstream_mr_key(struct rstream_domain *domain)
+{
+	if (domain->core_mr_mode & FI_MR_PROV_KEY)
+		return 0;
+
+	return ofi_atomic_inc64(&domain->mr_key);
+}
 
 static int rstream_domain_close(fid_t fid)
 {
@@ -107,6 +138,12 @@ int rstream_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err1;
 
+	rstream_domain->core_mr_mode = cinfo->domain_attr->mr_mode;
+	rstream_domain->window_size = rstream_calc_window_size(cinfo);
+	ofi_atomic_initialize64(&rstream_domain->mr_key, 0);
+	FI_INFO(&rstream_prov, FI_LOG_DOMAIN, "ring size %u\n",
+		rstream_domain->window_size);
+
 	ret = ofi_domain_init(fabric, info, &rstream_domain->util_domain,
 		context);
 	if (ret)
@@ -117,6 +154,7 @@ int rstream_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	(*domain)->mr = &rstream_domain_mr_ops;
 	(*domain)->ops = &rstream_domain_ops;
 
+	fi_freeinfo(cinfo);
 	return 0;
 err1:
 	if (cinfo)
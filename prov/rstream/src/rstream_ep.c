@@ -88,7 +88,7 @@ static int rstream_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 	return ret;
 }
 
-static int rstream_reg_mrs(struct fid_domain *domain,
+static int rstream_reg_mrs(struct rstream_domain *domain,
 	struct rstream_lmr_data *lmr)
 {
 	int ret;
@@ -101,9 +101,12 @@ static int rstream_reg_mrs(struct fid_domain *domain,
 	full_mr_size = full_mr_size + rx_meta_data_offset;
 	lmr->base_addr = malloc(full_mr_size);
 
-	ret = fi_mr_reg(domain, lmr->base_addr, full_mr_size,
+	if (!lmr->base_addr)
+		return -FI_ENOMEM;
+
+	ret = fi_mr_reg(domain->msg_domain, lmr->base_addr, full_mr_size,
 		FI_READ | FI_WRITE | FI_REMOTE_READ | FI_REMOTE_WRITE,
-		0, 0, 0, &lmr->mr, NULL);
+		0, rstream_mr_key(domain), 0, &lmr->mr, NULL);
 	if (ret)
 		return ret;
 
@@ -149,7 +152,7 @@ static int rstream_ep_ctrl(struct fid *fid, int command, void *arg)
 
 	switch (command) {
 	case FI_ENABLE:
-		ret = rstream_reg_mrs(rstream_ep->msg_domain,
+		ret = rstream_reg_mrs(rstream_ep->domain,
 			&rstream_ep->local_mr);
 		if (ret)
 			goto err1;
@@ -178,12 +181,31 @@ err1:
 	return ret;
 }
 
+static struct fi_rstream_ops_ep rstream_ext_ops_ep = {
+	.size = sizeof(struct fi_rstream_ops_ep),
+	.recv_lend = rstream_recv_lend,
+	.recv_release = rstream_recv_release,
+};
+
+static int rstream_ep_ops_open(struct fid *fid, const char *name,
+	uint64_t flags, void **ops, void *context)
+{
+	if (flags)
+		return -FI_EBADFLAGS;
+
+	if (strcmp(name, FI_RSTREAM_EP_OPS_1))
+		return -FI_EINVAL;
+
+	*ops = &rstream_ext_ops_ep;
+	return 0;
+}
+
 static struct fi_ops rstream_ep_fi_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = rstream_ep_close,
 	.bind = rstream_ep_bind,
 	.control = rstream_ep_ctrl,
-	.ops_open = fi_no_ops_open,
+	.ops_open = rstream_ep_ops_open,
 };
 
 static int rstream_ep_setopt(fid_t fid, int level, int optname,
@@ -267,8 +289,9 @@ int rstream_ep_open(struct fid_domain *domain, struct fi_info *info,
 		free(rstream_pep);
 
 	rstream_ep->msg_domain = rstream_domain->msg_domain;
-	rstream_ep->local_mr.tx.size = RSTREAM_DEFAULT_MR_SEG_SIZE;
-	rstream_ep->local_mr.rx.size = RSTREAM_DEFAULT_MR_SEG_SIZE;
+	rstream_ep->domain = rstream_domain;
+	rstream_ep->local_mr.tx.size = rstream_domain->window_size;
+	rstream_ep->local_mr.rx.size = rstream_domain->window_size;
 
 	rstream_ep->qp_win.max_tx_credits = rstream_info.tx_attr->size;
 	rstream_ep->qp_win.ctrl_credits = RSTREAM_MAX_CTRL;
@@ -413,6 +436,10 @@ void rstream_process_cm_event(struct rstream_ep *ep, void *cm_data)
 	ep->remote_data.mr.data_start = (void *)ntohll(rcv_data->base_addr);
 	ep->remote_data.mr.size = ntohl(rcv_data->rmr_size);
 	ep->remote_data.mr.avail_size = ep->remote_data.mr.size;
+	FI_INFO(&rstream_prov, FI_LOG_EP_CTRL,
+		"send window: local ring %u, peer ring %u, peer credits %u\n",
+		ep->local_mr.tx.size, ep->remote_data.mr.size,
+		ep->qp_win.target_rx_credits);
 
 	for(i = 0; i < ep->qp_win.max_rx_credits; i++) {
 		rstream_post_cq_data_recv(ep, NULL);
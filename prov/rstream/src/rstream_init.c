@@ -35,6 +35,9 @@
 #include <sys/socket.h>
 #include <netdb.h>
 
+size_t rstream_window_size = 0;
+int rstream_rtt = RSTREAM_DEFAULT_RTT;
+size_t rstream_direct_send_size = RSTREAM_DEFAULT_DIRECT_SEND_SIZE;
 
 static void rstream_iwarp_settings(struct fi_info *core_info)
 {
@@ -55,9 +58,13 @@ int rstream_info_to_core(uint32_t version, const struct fi_info *irstream_info,
 {
 	core_info->ep_attr->type = FI_EP_MSG;
 	core_info->ep_attr->protocol = FI_PROTO_UNSPEC;
+	core_info->ep_attr->protocol_version = 0;
 	core_info->caps = FI_RMA | FI_MSG;
+	core_info->tx_attr->caps = core_info->caps;
+	core_info->rx_attr->caps = core_info->caps;
 	core_info->domain_attr->caps = FI_LOCAL_COMM | FI_REMOTE_COMM;
 	core_info->domain_attr->mr_mode = FI_MR_LOCAL | OFI_MR_BASIC_MAP;
+	core_info->domain_attr->mr_iov_limit = 0;
 	core_info->tx_attr->op_flags = FI_COMPLETION;
 	core_info->rx_attr->op_flags = FI_COMPLETION;
 	core_info->fabric_attr->api_version =  FI_VERSION(1, 8);
@@ -94,6 +101,7 @@ int rstream_info_to_rstream(uint32_t version, const struct fi_info *core_info,
 {
 	info->caps = RSTREAM_CAPS;
 	info->mode = 0;
+	update_rstream_info(core_info);
 
 	*info->tx_attr = *rstream_info.tx_attr;
 	*info->rx_attr = *rstream_info.rx_attr;
@@ -101,7 +109,6 @@ int rstream_info_to_rstream(uint32_t version, const struct fi_info *core_info,
 	*info->ep_attr = *rstream_info.ep_attr;
 	info->fabric_attr->api_version = FI_VERSION(1, 8);
 	info->fabric_attr->prov_version = FI_VERSION(1, 0);
-	update_rstream_info(core_info);
 
 	return 0;
 }
@@ -177,5 +184,25 @@ struct util_prov rstream_util_prov = {
 
 RSTREAM_INI
 {
+	fi_param_define(&rstream_prov, "window_size", FI_PARAM_SIZE_T,
+			"Size in bytes of the send and receive rings of each "
+			"endpoint.  The default (0) sizes the rings to the "
+			"bandwidth-delay product of the core link.");
+	fi_param_define(&rstream_prov, "rtt", FI_PARAM_INT,
+			"Round trip time in microseconds used to estimate the "
+			"bandwidth-delay product (default: %d).",
+			RSTREAM_DEFAULT_RTT);
+	fi_param_define(&rstream_prov, "direct_send_size", FI_PARAM_SIZE_T,
+			"Sends of at least this many bytes are written directly "
+			"from the user buffer into the peer's receive ring "
+			"instead of being staged in the send ring.  0 disables "
+			"direct sends (default: %d).",
+			RSTREAM_DEFAULT_DIRECT_SEND_SIZE);
+
+	fi_param_get_size_t(&rstream_prov, "window_size", &rstream_window_size);
+	fi_param_get_int(&rstream_prov, "rtt", &rstream_rtt);
+	fi_param_get_size_t(&rstream_prov, "direct_send_size",
+			    &rstream_direct_send_size);
+
 	return &rstream_prov;
 }
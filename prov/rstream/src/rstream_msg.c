@@ -124,20 +124,26 @@ static struct fi_context *rstream_get_tx_ctx(struct rstream_ep *ep, int len)
 		return NULL;
 
 	rtn_ctx->len = len;
+	rtn_ctx->direct = 0;
 	return &rtn_ctx->ctx;
 }
 
-static int rstream_return_tx_ctx(struct fi_context *ctx_ptr,
+static void rstream_free_contig_len(struct rstream_mr_seg *mr, uint32_t len);
+
+/* direct sends never took space in the local tx ring */
+static void rstream_return_tx_ctx(struct fi_context *ctx_ptr,
 	struct rstream_ep *ep)
 {
-	int len;
 	struct rstream_tx_ctx_fs *fs = ep->tx_ctxs;
 
 	struct rstream_ctx_data *ctx_data = (struct rstream_ctx_data *)ctx_ptr;
-	len = ctx_data->len;
+	if (ctx_data->direct) {
+		assert(ep->direct_pending);
+		ep->direct_pending--;
+	} else {
+		rstream_free_contig_len(&ep->local_mr.tx, ctx_data->len);
+	}
 	ofi_freestack_push(fs, ctx_data);
-
-	return len;
 }
 
 static ssize_t rstream_inject(struct fid_ep *ep_fid, const void *buf, size_t len,
@@ -153,16 +159,16 @@ static ssize_t rstream_print_cq_error(struct fid_cq *cq)
 	const char *errmsg;
 
 	ret = fi_cq_readerr(cq, &cq_entry, 0);
-	if (cq_entry.err == FI_ENOMSG) {
-		ret = FI_ENOMSG;
+	if (ret < 0)
 		return ret;
-	}
+	if (cq_entry.err == FI_ENOMSG)
+		return -FI_ENOMSG;
 
 	errmsg = fi_cq_strerror(cq, cq_entry.prov_errno,
 		cq_entry.err_data, NULL, 0);
-	fprintf(stderr, "CQ error msg: %s\n", errmsg);
+	FI_WARN(&rstream_prov, FI_LOG_CQ, "CQ error msg: %s\n", errmsg);
 
-	return ret;
+	return -cq_entry.err;
 }
 
 static void rstream_update_tx_credits(struct rstream_ep *ep,
@@ -365,7 +371,11 @@ static enum rstream_msg_type rstream_cqe_msg_type(struct rstream_ep *ep,
 {
 	enum rstream_msg_type type = RSTREAM_MSG_UNKNOWN;
 
-	if (cq_entry->flags & FI_REMOTE_WRITE || cq_entry->flags & FI_RECV ||
+	/* some core providers echo FI_REMOTE_CQ_DATA in tx completions */
+	if (cq_entry->flags & FI_WRITE || cq_entry->flags & FI_SEND) {
+		type = RSTREAM_TX_MSG_COMP;
+	} else if (cq_entry->flags & FI_REMOTE_WRITE ||
+		cq_entry->flags & FI_RECV ||
 		cq_entry->flags & FI_REMOTE_CQ_DATA) {
 		if (RSTREAM_USING_IWARP)
 			format_iwarp_cq_data(ep, cq_entry);
@@ -375,8 +385,6 @@ static enum rstream_msg_type rstream_cqe_msg_type(struct rstream_ep *ep,
 		} else {
 			type = RSTREAM_RX_MSG_COMP;
 		}
-	} else if (cq_entry->flags & FI_WRITE || cq_entry->flags & FI_SEND) {
-		type = RSTREAM_TX_MSG_COMP;
 	}
 
 	return type;
@@ -390,11 +398,8 @@ static ssize_t rstream_check_cq(struct rstream_ep *ep,
 
 	ret = fi_cq_read(ep->cq, completion_entry, max_num);
 	if (ret < 0 && ret != -FI_EAGAIN) {
-		if (ret == -FI_EAVAIL) {
-			ret = rstream_print_cq_error(ep->cq);
-			fprintf(stderr, "error from %s:%d\n", __FILE__, __LINE__);
-			return ret;
-		}
+		if (ret == -FI_EAVAIL)
+			return rstream_print_cq_error(ep->cq);
 	}
 	assert(ret == -FI_EAGAIN || ret == max_num);
 
@@ -409,7 +414,6 @@ ssize_t rstream_process_cq(struct rstream_ep *ep, enum rstream_msg_type type)
 	uint16_t rx_completions = 0;
 	struct rstream_timer timer = {.poll_time = 0};
 	enum rstream_msg_type comp_type;
-	int len;
 
 	fastlock_acquire(&ep->cq_lock);
 	do {
@@ -431,9 +435,8 @@ ssize_t rstream_process_cq(struct rstream_ep *ep, enum rstream_msg_type type)
 				}
 				rx_completions++;
 			} else if (comp_type == RSTREAM_TX_MSG_COMP) {
-				len = rstream_return_tx_ctx(cq_entry.op_context, ep);
+				rstream_return_tx_ctx(cq_entry.op_context, ep);
 				rstream_update_tx_credits(ep, ret);
-				rstream_free_contig_len(&ep->local_mr.tx, len);
 			} else {
 				ret = -FI_ENOMSG;
 				goto out;
@@ -477,11 +480,11 @@ static uint32_t get_send_addrs_and_len(struct rstream_ep *ep, char **tx_addr,
 	return available_len;
 }
 
-static ssize_t rstream_can_send(struct rstream_ep *ep)
+static ssize_t rstream_can_send(struct rstream_ep *ep, int direct)
 {
 	ssize_t ret;
 
-	if (rstream_tx_mr_full(ep) || rstream_target_mr_full(ep) ||
+	if ((!direct && rstream_tx_mr_full(ep)) || rstream_target_mr_full(ep) ||
 		rstream_target_rx_full(ep)) {
 		ret = rstream_process_cq(ep, RSTREAM_CTRL_MSG);
 		if (ret < 0)
@@ -497,6 +500,95 @@ static ssize_t rstream_can_send(struct rstream_ep *ep)
 	return 0;
 }
 
+static ssize_t rstream_wait_direct(struct rstream_ep *ep)
+{
+	ssize_t ret;
+
+	while (ep->direct_pending) {
+		ret = rstream_process_cq(ep, RSTREAM_TX_MSG_COMP);
+		if (ret < 0 && ret != -FI_EAGAIN)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Large sends skip the tx ring and are written straight from the user
+ * buffer into the peer's rx ring.  The user owns the buffer again once
+ * we return, so the writes have to complete first. */
+static ssize_t rstream_send_direct(struct rstream_ep *ep, const void *buf,
+	size_t len)
+{
+	struct rstream_ctx_data *ctx;
+	struct fid_mr *mr = NULL;
+	void *desc = NULL;
+	char *remote_addr = NULL;
+	size_t sent_len = 0;
+	uint32_t curr_len;
+	ssize_t ret, wait_ret;
+
+	if (ep->domain->core_mr_mode & FI_MR_LOCAL) {
+		ret = fi_mr_reg(ep->msg_domain, buf, len, FI_WRITE, 0,
+			rstream_mr_key(ep->domain), 0, &mr, NULL);
+		if (ret)
+			return ret;
+		desc = fi_mr_desc(mr);
+	}
+
+	fastlock_acquire(&ep->send_lock);
+	do {
+		ret = rstream_can_send(ep, 1);
+		if (ret < 0)
+			break;
+
+		curr_len = MIN(len - sent_len,
+			rstream_calc_contig_len(&ep->remote_data.mr));
+		if (curr_len == 0) {
+			ret = -FI_EAGAIN;
+			break;
+		}
+
+		/* take the context before reserving space at the target */
+		ctx = (struct rstream_ctx_data *) rstream_get_tx_ctx(ep, 0);
+		if (!ctx) {
+			ret = -FI_EAGAIN;
+			break;
+		}
+		curr_len = rstream_alloc_contig_len_available(&ep->remote_data.mr,
+			&remote_addr, curr_len);
+		ctx->len = curr_len;
+		ctx->direct = 1;
+
+		ret = fi_writedata(ep->ep_fd, (char *)buf + sent_len, curr_len,
+			desc, 0, 0, (uint64_t)remote_addr, ep->remote_data.rkey,
+			&ctx->ctx);
+		if (ret != 0) {
+			FI_DBG(&rstream_prov, FI_LOG_EP_DATA,
+				"error: fi_write failed: %zd", ret);
+			ofi_freestack_push(ep->tx_ctxs, ctx);
+			break;
+		}
+
+		ep->direct_pending++;
+		sent_len = sent_len + curr_len;
+		ep->qp_win.target_rx_credits--;
+		ep->qp_win.tx_credits--;
+	} while (sent_len < len);
+
+	wait_ret = rstream_wait_direct(ep);
+	fastlock_release(&ep->send_lock);
+
+	if (mr)
+		fi_close(&mr->fid);
+
+	if (ret < 0 && ret != -FI_EAGAIN)
+		return ret;
+	if (wait_ret)
+		return wait_ret;
+
+	return sent_len ? sent_len : -FI_EAGAIN;
+}
+
 static ssize_t rstream_send(struct fid_ep *ep_fid, const void *buf, size_t len,
 	void *desc, fi_addr_t dest_addr, void *context)
 {
@@ -510,9 +602,13 @@ static ssize_t rstream_send(struct fid_ep *ep_fid, const void *buf, size_t len,
 	uint32_t curr_avail_len = len;
 	void *ctx;
 
+	if (!RSTREAM_USING_IWARP && rstream_direct_send_size &&
+		len >= rstream_direct_send_size)
+		return rstream_send_direct(ep, buf, len);
+
 	fastlock_acquire(&ep->send_lock);
 	do {
-		ret = rstream_can_send(ep);
+		ret = rstream_can_send(ep, 0);
 		if (ret < 0) {
 			if (ret < 0 && ret != -FI_EAGAIN) {
 				goto err;
@@ -579,7 +675,7 @@ static ssize_t rstream_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 
 	if (flags == FI_PEEK) {
 		fastlock_acquire(&ep->send_lock);
-		ret = rstream_can_send(ep);
+		ret = rstream_can_send(ep, 0);
 		fastlock_release(&ep->send_lock);
 		return ret;
 	} else {
@@ -655,7 +751,9 @@ static ssize_t rstream_recv(struct fid_ep *ep_fid, void *buf, size_t len,
 
 	if ((len - copy_out_len)) {
 		ret = rstream_process_cq(ep, RSTREAM_RX_MSG_COMP);
-		if(ret < 0 && ret != -FI_EAGAIN) {
+		/* hand back data that arrived before the error first */
+		if(ret < 0 && ret != -FI_EAGAIN && !copy_out_len &&
+			!ep->local_mr.rx.avail_size) {
 			fastlock_release(&ep->recv_lock);
 			return ret;
 		}
@@ -664,9 +762,15 @@ static ssize_t rstream_recv(struct fid_ep *ep_fid, void *buf, size_t len,
 			((char *)buf + copy_out_len), (len - copy_out_len));
 	}
 
-	fastlock_acquire(&ep->send_lock);
-	ret = rstream_update_target(ep, 0, copy_out_len);
-	fastlock_release(&ep->send_lock);
+	/* ring space behind lent data can't go back to the peer yet */
+	if (ep->rx_lent) {
+		ep->rx_held += copy_out_len;
+		ret = 0;
+	} else {
+		fastlock_acquire(&ep->send_lock);
+		ret = rstream_update_target(ep, 0, copy_out_len);
+		fastlock_release(&ep->send_lock);
+	}
 	fastlock_release(&ep->recv_lock);
 	if(ret < 0 && ret != -FI_EAGAIN) {
 		return ret;
@@ -679,6 +783,66 @@ static ssize_t rstream_recv(struct fid_ep *ep_fid, void *buf, size_t len,
 	return -FI_EAGAIN;
 }
 
+ssize_t rstream_recv_lend(struct fid_ep *ep_fid, void **buf, size_t len)
+{
+	struct rstream_ep *ep = container_of(ep_fid, struct rstream_ep,
+		util_ep.ep_fid);
+	char *rx_data_ptr = NULL;
+	uint32_t lend_len;
+	ssize_t ret;
+
+	if (RSTREAM_USING_IWARP)
+		return -FI_ENOSYS;
+
+	fastlock_acquire(&ep->recv_lock);
+	if (!rstream_calc_contig_len(&ep->local_mr.rx)) {
+		ret = rstream_process_cq(ep, RSTREAM_RX_MSG_COMP);
+		if (ret < 0 && ret != -FI_EAGAIN) {
+			fastlock_release(&ep->recv_lock);
+			return ret;
+		}
+	}
+
+	lend_len = rstream_alloc_contig_len_available(&ep->local_mr.rx,
+		&rx_data_ptr, MIN(len, RSTREAM_MR_MAX));
+	ep->rx_lent += lend_len;
+	fastlock_release(&ep->recv_lock);
+
+	if (!lend_len)
+		return -FI_EAGAIN;
+
+	*buf = rx_data_ptr;
+	return lend_len;
+}
+
+ssize_t rstream_recv_release(struct fid_ep *ep_fid, size_t len)
+{
+	struct rstream_ep *ep = container_of(ep_fid, struct rstream_ep,
+		util_ep.ep_fid);
+	uint32_t free_len;
+	ssize_t ret;
+
+	fastlock_acquire(&ep->recv_lock);
+	if (len > ep->rx_lent) {
+		fastlock_release(&ep->recv_lock);
+		return -FI_EINVAL;
+	}
+
+	ep->rx_lent -= len;
+	free_len = len;
+	if (!ep->rx_lent) {
+		free_len += ep->rx_held;
+		ep->rx_held = 0;
+	}
+
+	fastlock_acquire(&ep->send_lock);
+	ret = rstream_update_target(ep, 0, free_len);
+	fastlock_release(&ep->send_lock);
+	fastlock_release(&ep->recv_lock);
+
+	return (ret < 0 && ret != -FI_EAGAIN) ? ret : 0;
+}
+
 static ssize_t rstream_recvv(struct fid_ep *ep_fid, const struct iovec *iov,
 	void **desc, size_t count, fi_addr_t src_addr, void *context)
 {
@@ -55,6 +55,7 @@
 #include <ofi_tree.h>
 #include <ofi_atomic.h>
 #include <ofi_indexer.h>
+#include <ofi_trace.h>
 #include "rxd_proto.h"
 
 #ifndef _RXD_H_
@@ -1088,6 +1088,8 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 	struct rxd_base_hdr *hdr;
 
 	rxd_peer(ep, peer)->tx_window = ack->ext_hdr.rx_id;
+	OFI_TRACEPOINT(OFI_TRACE_RXD_ACK_RX, peer, ack->base_hdr.seq_no,
+		       ack->ext_hdr.rx_id, 0);
 
 	if (rxd_peer(ep, peer)->last_rx_ack == ack->base_hdr.seq_no)
 		return;
@@ -580,6 +580,8 @@ void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 	ack->base_hdr.seq_no = rxd_peer(rxd_ep, peer)->rx_seq_no;
 	ack->ext_hdr.rx_id = rxd_peer(rxd_ep, peer)->rx_window;
 	rxd_peer(rxd_ep, peer)->last_tx_ack = ack->base_hdr.seq_no;
+	OFI_TRACEPOINT(OFI_TRACE_RXD_ACK_TX, peer, ack->base_hdr.seq_no,
+		       ack->ext_hdr.rx_id, 0);
 
 	dlist_insert_tail(&pkt_entry->d_entry, &rxd_ep->ctrl_pkts);
 	if (rxd_ep_send_pkt(rxd_ep, pkt_entry))
@@ -932,6 +934,9 @@ static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
 		    current < rxd_get_retry_time(pkt_entry->timestamp, peer->retry_cnt))
 			break;
 		retry = 1;
+		OFI_TRACEPOINT(OFI_TRACE_RXD_RETRANSMIT, pkt_entry->peer,
+			       rxd_get_base_hdr(pkt_entry)->seq_no,
+			       peer->retry_cnt, 0);
 		ret = rxd_ep_send_pkt(ep, pkt_entry);
 		if (ret)
 			break;
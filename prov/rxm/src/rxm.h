@@ -55,6 +55,7 @@
 #include <ofi_proto.h>
 #include <ofi_iov.h>
 #include <ofi_hmem.h>
+#include <ofi_trace.h>
 
 #ifndef _RXM_H_
 #define _RXM_H_
@@ -94,6 +95,9 @@ extern size_t rxm_buffer_size;
 		       PRIx64 " %s -> %s\n", (buf)->pkt.ctrl_hdr.msg_id,\
 		       rxm_proto_state_str[(buf)->hdr.state],		\
 		       rxm_proto_state_str[new_state]);			\
+		OFI_TRACEPOINT(OFI_TRACE_RXM_STATE,			\
+			       (buf)->pkt.ctrl_hdr.msg_id,		\
+			       (buf)->hdr.state, new_state, 0);		\
 		(buf)->hdr.state = new_state;				\
 	} while (0)
 
@@ -494,6 +498,10 @@ struct rxm_tx_buf {
 		struct rxm_iov atomic_result;
 	};
 
+	/* Protocol tuning state, set for SAR and rendezvous sends */
+	struct rxm_tune *tune;
+	uint64_t tune_start;
+
 	struct {
 		struct iovec iov[RXM_IOV_LIMIT];
 		void *desc[RXM_IOV_LIMIT];
@@ -657,6 +665,39 @@ struct rxm_rndv_ops {
 			      void *buf);
 };
 
+enum rxm_peer_class {
+	RXM_PEER_REMOTE,
+	RXM_PEER_LOCAL,
+	RXM_PEER_CLASS_MAX,
+};
+
+enum rxm_tune_proto {
+	RXM_TUNE_RNDV,
+	RXM_TUNE_SAR,
+	RXM_TUNE_PROTO_MAX,
+};
+
+#define RXM_TUNE_CALIB		16
+#define RXM_TUNE_EXPLORE	4
+#define RXM_TUNE_INTERVAL	32
+#define RXM_TUNE_MAX_SEGS	64
+#define RXM_TUNE_BUCKETS	64
+
+/*
+ * Auto-tuned crossover between SAR and rendezvous for one class of peers.
+ * Sends near sar_limit record their cost (time until the send completes,
+ * in ns per KiB) and every RXM_TUNE_INTERVAL samples the limit moves
+ * toward the cheaper protocol.  While calib is non-zero, sends near the
+ * limit alternate between the protocols so that both have fresh samples.
+ */
+struct rxm_tune {
+	size_t			sar_limit;
+	uint64_t		cost[RXM_TUNE_PROTO_MAX];
+	uint32_t		samples[RXM_TUNE_PROTO_MAX];
+	uint32_t		calib;
+	uint64_t		picked[RXM_TUNE_BUCKETS][RXM_TUNE_PROTO_MAX];
+};
+
 struct rxm_ep {
 	struct util_ep 		util_ep;
 	struct fi_info 		*rxm_info;
@@ -666,6 +707,8 @@ struct rxm_ep {
 	struct fid_eq 		*msg_eq;
 	struct fid_cq 		*msg_cq;
 	uint64_t		msg_cq_last_poll;
+	struct util_progress_item progress_item;
+	size_t			msg_comp_cnt;
 	struct fid_ep 		*srx_ctx;
 	size_t 			comp_per_progress;
 	int			cq_eq_fairness;
@@ -682,6 +725,10 @@ struct rxm_ep {
 	size_t			sar_limit;
 	size_t			tx_credit;
 
+	bool			auto_tune;
+	size_t			tune_max;
+	struct rxm_tune		tune[RXM_PEER_CLASS_MAX];
+
 	struct ofi_bufpool	*rx_pool;
 	struct ofi_bufpool	*tx_pool;
 	struct rxm_pkt		*inject_pkt;
@@ -710,6 +757,7 @@ struct rxm_conn {
 	struct dlist_entry sar_deferred_rx_msg_list;
 
 	uint32_t rndv_tx_credits;
+	uint8_t peer_class;
 };
 
 extern struct fi_provider rxm_prov;
@@ -745,6 +793,16 @@ void rxm_ep_progress(struct util_ep *util_ep);
 void rxm_ep_progress_coll(struct util_ep *util_ep);
 void rxm_ep_do_progress(struct util_ep *util_ep);
 
+void rxm_tune_init(struct rxm_ep *rxm_ep);
+void rxm_tune_report(struct rxm_ep *rxm_ep);
+void rxm_tune_conn(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn);
+bool rxm_tune_use_sar(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		      size_t data_len);
+void rxm_tune_start(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		    struct rxm_tx_buf *tx_buf);
+void rxm_tune_finish(struct rxm_ep *rxm_ep, struct rxm_tx_buf *tx_buf,
+		     enum rxm_tune_proto proto);
+
 void rxm_handle_eager(struct rxm_rx_buf *rx_buf);
 void rxm_handle_coll_eager(struct rxm_rx_buf *rx_buf);
 void rxm_finish_eager_send(struct rxm_ep *rxm_ep,
@@ -112,6 +112,12 @@ rxm_ep_atomic_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	assert(msg->iov_count <= RXM_IOV_LIMIT &&
 	       msg->rma_iov_count <= RXM_IOV_LIMIT);
 
+	if (flags & FI_TRIGGER) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+			"FI_TRIGGER not supported, use FI_QUEUE_WORK\n");
+		return -FI_ENOSYS;
+	}
+
 	if (flags & FI_REMOTE_CQ_DATA) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
 			"atomic with remote CQ data not supported\n");
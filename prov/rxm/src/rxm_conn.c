@@ -447,6 +447,7 @@ void rxm_cmap_process_connect(struct rxm_cmap *cmap,
 	} else {
 		assert(handle->state == RXM_CMAP_CONNREQ_RECV);
 	}
+	rxm_tune_conn(cmap->ep, rxm_conn);
 	RXM_CM_UPDATE_STATE(handle, RXM_CMAP_CONNECTED);
 }
 
@@ -745,8 +746,11 @@ int rxm_cmap_alloc(struct rxm_ep *rxm_ep, struct rxm_cmap_attr *attr)
 
 		assert(ep->domain->threading == FI_THREAD_SAFE);
 		rxm_ep->do_progress = true;
+		/* With progress threads the CM thread only handles
+		 * connection events */
 		if (pthread_create(&cmap->cm_thread, 0,
-				   rxm_ep->rxm_info->caps & FI_ATOMIC ?
+				   (rxm_ep->rxm_info->caps & FI_ATOMIC) &&
+				   !ep->domain->auto_progress ?
 				   rxm_conn_atomic_progress :
 				   rxm_conn_progress, ep)) {
 			FI_WARN(ep->av->prov, FI_LOG_EP_CTRL,
@@ -1066,7 +1070,9 @@ static void rxm_flush_msg_cq(struct rxm_ep *rxm_ep)
 	do {
 		ret = fi_cq_read(rxm_ep->msg_cq, &comp, 1);
 		if (ret > 0) {
+			ofi_perf_region_start(OFI_PERF_RXM_HANDLE_COMP);
 			ret = rxm_handle_comp(rxm_ep, &comp);
+			ofi_perf_region_end(OFI_PERF_RXM_HANDLE_COMP);
 			if (OFI_UNLIKELY(ret)) {
 				rxm_cq_write_error_all(rxm_ep, ret);
 			} else {
@@ -238,6 +238,7 @@ static bool rxm_complete_sar(struct rxm_ep *rxm_ep,
 	case RXM_SAR_SEG_LAST:
 		first_tx_buf = ofi_bufpool_get_ibuf(rxm_ep->tx_pool,
 						tx_buf->pkt.ctrl_hdr.msg_id);
+		rxm_tune_finish(rxm_ep, first_tx_buf, RXM_TUNE_SAR);
 		rxm_free_rx_buf(rxm_ep, first_tx_buf);
 		rxm_free_rx_buf(rxm_ep, tx_buf);
 		return true;
@@ -297,6 +298,7 @@ static void rxm_rndv_tx_finish(struct rxm_ep *rxm_ep,
 		tx_buf->write_rndv.done_buf = NULL;
 	}
 	ofi_ep_tx_cntr_inc(&rxm_ep->util_ep);
+	rxm_tune_finish(rxm_ep, tx_buf, RXM_TUNE_RNDV);
 	rxm_free_rx_buf(rxm_ep, tx_buf);
 }
 
@@ -1881,7 +1883,9 @@ void rxm_ep_do_progress(struct util_ep *util_ep)
 	do {
 		ret = fi_cq_read(rxm_ep->msg_cq, &comp, 1);
 		if (ret > 0) {
+			ofi_perf_region_start(OFI_PERF_RXM_HANDLE_COMP);
 			ret = rxm_handle_comp(rxm_ep, &comp);
+			ofi_perf_region_end(OFI_PERF_RXM_HANDLE_COMP);
 			if (ret) {
 				// We don't have enough info to write a good
 				// error entry to the CQ at this point
@@ -1906,6 +1910,7 @@ void rxm_ep_do_progress(struct util_ep *util_ep)
 			}
 		}
 	} while ((ret > 0) && (++comp_read < rxm_ep->comp_per_progress));
+	rxm_ep->msg_comp_cnt += comp_read;
 
 	if (!dlist_empty(&rxm_ep->deferred_tx_conn_queue)) {
 		dlist_foreach_container_safe(&rxm_ep->deferred_tx_conn_queue,
@@ -144,7 +144,7 @@ static struct fi_ops rxm_domain_fi_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = rxm_domain_close,
 	.bind = fi_no_bind,
-	.control = fi_no_control,
+	.control = ofi_domain_control,
 	.ops_open = fi_no_ops_open,
 };
 
@@ -541,6 +541,8 @@ int rxm_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 		goto err3;
 	}
 
+	rxm_domain->util_domain.auto_progress = ofi_progress_enabled(info);
+
 	/* We turn off the mr map mode bit FI_MR_PROV_KEY.  We always use the
 	 * key returned by the MSG provider.  That key may be generated by the
 	 * MSG provider, or will be provided as input by the rxm provider.
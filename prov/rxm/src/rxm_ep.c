@@ -997,6 +997,7 @@ rxm_alloc_rndv_buf(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 				 flags, &(*rndv_buf)->pkt);
 	(*rndv_buf)->pkt.ctrl_hdr.msg_id = ofi_buf_index(*rndv_buf);
 	(*rndv_buf)->app_context = context;
+	rxm_tune_start(rxm_ep, rxm_conn, *rndv_buf);
 	(*rndv_buf)->flags = flags;
 	(*rndv_buf)->rma.count = count;
 
@@ -1192,6 +1193,7 @@ rxm_send_sar(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	if (!first_tx_buf)
 		return -FI_EAGAIN;
 
+	rxm_tune_start(rxm_ep, rxm_conn, first_tx_buf);
 	ret = ofi_copy_from_hmem_iov(first_tx_buf->pkt.data, rxm_eager_limit,
 				     iface, device, iov, count, iov_offset);
 	assert(ret == rxm_eager_limit);
@@ -1503,6 +1505,12 @@ rxm_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	uint64_t device;
 	ssize_t ret;
 
+	if (flags & FI_TRIGGER) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+			"FI_TRIGGER not supported, use FI_QUEUE_WORK\n");
+		return -FI_ENOSYS;
+	}
+
 	data_len = ofi_total_iov_len(iov, count);
 	total_len = sizeof(struct rxm_pkt) + data_len;
 
@@ -1515,7 +1523,7 @@ rxm_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		ret = rxm_send_eager(rxm_ep, rxm_conn, iov, desc, count,
 				     context, data, flags, tag, op,
 				     data_len, total_len);
-	} else if (data_len <= rxm_ep->sar_limit) {
+	} else if (rxm_tune_use_sar(rxm_ep, rxm_conn, data_len)) {
 		ret = rxm_send_sar(rxm_ep, rxm_conn, iov, desc, (uint8_t) count,
 				   context, data, flags, tag, op, data_len,
 				   rxm_ep_sar_calc_segs_cnt(rxm_ep, data_len));
@@ -2306,6 +2314,10 @@ static int rxm_ep_close(struct fid *fid)
 	struct rxm_ep *rxm_ep;
 
 	rxm_ep = container_of(fid, struct rxm_ep, util_ep.ep_fid.fid);
+	rxm_tune_report(rxm_ep);
+	ofi_progress_del(&rxm_ep->progress_item);
+	ofi_progress_ep_detach(&rxm_ep->util_ep);
+
 	if (rxm_ep->cmap)
 		rxm_cmap_free(rxm_ep->cmap);
 
@@ -2550,6 +2562,7 @@ static void rxm_ep_settings_init(struct rxm_ep *rxm_ep)
 	rxm_ep->buffered_limit = rxm_eager_limit;
 
 	rxm_ep_sar_init(rxm_ep);
+	rxm_tune_init(rxm_ep);
 	rxm_config_direct_send(rxm_ep);
 
  	FI_INFO(&rxm_prov, FI_LOG_CORE,
@@ -2616,6 +2629,38 @@ static int rxm_ep_enable_check(struct rxm_ep *rxm_ep)
 	return 0;
 }
 
+/* Work that is not tied to a msg CQ event keeps the worker polling */
+static bool rxm_ep_auto_progress(void *arg)
+{
+	struct rxm_ep *rxm_ep = arg;
+	size_t comp_cnt = rxm_ep->msg_comp_cnt;
+
+	rxm_ep->util_ep.progress(&rxm_ep->util_ep);
+	return rxm_ep->msg_comp_cnt != comp_cnt ||
+	       !dlist_empty(&rxm_ep->repost_ready_list) ||
+	       !dlist_empty(&rxm_ep->deferred_tx_conn_queue);
+}
+
+/* Data progress is driven by the fabric's progress threads */
+static int rxm_ep_progress_add(struct rxm_ep *rxm_ep)
+{
+	struct util_cq *cq;
+
+	if (!rxm_ep->util_ep.domain->auto_progress)
+		return 0;
+
+	cq = rxm_ep->util_ep.rx_cq ? rxm_ep->util_ep.rx_cq :
+				     rxm_ep->util_ep.tx_cq;
+
+	rxm_ep->progress_item.progress = rxm_ep_auto_progress;
+	rxm_ep->progress_item.arg = rxm_ep;
+	rxm_ep->progress_item.wait_fid = &rxm_ep->msg_cq->fid;
+	rxm_ep->progress_item.wait_try = rxm_ep_trywait_cq;
+	rxm_ep->progress_item.poll_seq = cq ? &cq->progress_seq : NULL;
+	return ofi_progress_add(rxm_ep->util_ep.domain->fabric,
+				&rxm_ep->progress_item);
+}
+
 static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 {
 	int ret;
@@ -2671,6 +2716,13 @@ static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 				goto err;
 			}
 		}
+
+		ret = rxm_ep_progress_add(rxm_ep);
+		if (ret) {
+			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+				"unable to start auto progress\n");
+			goto err;
+		}
 		break;
 	default:
 		return -FI_ENOSYS;
@@ -150,6 +150,8 @@ int rxm_info_to_core(uint32_t version, const struct fi_info *hints,
 	}
 
 	core_info->ep_attr->type = FI_EP_MSG;
+	/* rxm drives progress of the core provider */
+	core_info->domain_attr->data_progress = FI_PROGRESS_MANUAL;
 
 	if (rxm_use_srx(hints, base_info)) {
 		FI_DBG(&rxm_prov, FI_LOG_FABRIC,
@@ -529,6 +531,13 @@ RXM_INI
 			"Force auto-progress for data transfers even if app "
 			"requested manual progress (default: false/no).");
 
+	fi_param_define(&rxm_prov, "auto_tune", FI_PARAM_BOOL,
+			"Adjust the SAR limit at runtime, separately for peers "
+			"on the local node and remote peers, based on the "
+			"observed cost of SAR and rendezvous sends near the "
+			"limit.  FI_OFI_RXM_SAR_LIMIT sets the starting point.  "
+			"(default: false)");
+
 	fi_param_define(&rxm_prov, "use_rndv_write", FI_PARAM_BOOL,
 			"Set this environment variable to control the  "
 			"RxM Rendezvous protocol.  If set (1), RxM will use "
@@ -75,6 +75,12 @@ rxm_ep_rma_common(struct rxm_ep *rxm_ep, const struct fi_msg_rma *msg,
 
 	assert(msg->rma_iov_count <= rxm_ep->rxm_info->tx_attr->rma_iov_limit);
 
+	if (flags & FI_TRIGGER) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+			"FI_TRIGGER not supported, use FI_QUEUE_WORK\n");
+		return -FI_ENOSYS;
+	}
+
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
 
 	ret = rxm_get_conn(rxm_ep, msg->addr, &rxm_conn);
@@ -285,6 +291,12 @@ rxm_ep_rma_inject_common(struct rxm_ep *rxm_ep, const struct fi_msg_rma *msg,
 
 	assert(total_size <= rxm_ep->rxm_info->tx_attr->inject_size);
 
+	if (flags & FI_TRIGGER) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+			"FI_TRIGGER not supported, use FI_QUEUE_WORK\n");
+		return -FI_ENOSYS;
+	}
+
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
 
 	ret = rxm_get_conn(rxm_ep, msg->addr, &rxm_conn);
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <ofi_net.h>
+#include "rxm.h"
+
+static const char *rxm_peer_class_str[RXM_PEER_CLASS_MAX] = {
+	[RXM_PEER_REMOTE] = "remote",
+	[RXM_PEER_LOCAL] = "local",
+};
+
+void rxm_tune_init(struct rxm_ep *rxm_ep)
+{
+	int i, ret = 0;
+
+	fi_param_get_bool(&rxm_prov, "auto_tune", &ret);
+	rxm_ep->auto_tune = (ret != 0);
+	if (!rxm_ep->auto_tune)
+		return;
+
+	/* Nothing to choose between if SAR is disabled */
+	if (rxm_ep->sar_limit <= rxm_eager_limit) {
+		FI_INFO(&rxm_prov, FI_LOG_CORE, "SAR protocol disabled, "
+			"protocol auto-tuning disabled\n");
+		rxm_ep->auto_tune = false;
+		return;
+	}
+
+	rxm_ep->tune_max = MAX(rxm_ep->sar_limit,
+			       rxm_eager_limit * RXM_TUNE_MAX_SEGS);
+	for (i = 0; i < RXM_PEER_CLASS_MAX; i++) {
+		memset(&rxm_ep->tune[i], 0, sizeof(rxm_ep->tune[i]));
+		rxm_ep->tune[i].sar_limit = rxm_ep->sar_limit;
+		rxm_ep->tune[i].calib = RXM_TUNE_CALIB;
+	}
+}
+
+void rxm_tune_report(struct rxm_ep *rxm_ep)
+{
+	struct rxm_tune *tune;
+	int i, j;
+
+	if (!rxm_ep->auto_tune)
+		return;
+
+	for (i = 0; i < RXM_PEER_CLASS_MAX; i++) {
+		tune = &rxm_ep->tune[i];
+		FI_INFO(&rxm_prov, FI_LOG_EP_DATA, "%s peers: SAR limit %zu, "
+			"cost SAR %" PRIu64 " rndv %" PRIu64 " ns/KiB\n",
+			rxm_peer_class_str[i], tune->sar_limit,
+			tune->cost[RXM_TUNE_SAR], tune->cost[RXM_TUNE_RNDV]);
+
+		for (j = 0; j < RXM_TUNE_BUCKETS; j++) {
+			if (!tune->picked[j][RXM_TUNE_SAR] &&
+			    !tune->picked[j][RXM_TUNE_RNDV])
+				continue;
+			FI_INFO(&rxm_prov, FI_LOG_EP_DATA, "%s peers: "
+				"size <= %" PRIu64 ": SAR %" PRIu64
+				" rndv %" PRIu64 "\n", rxm_peer_class_str[i],
+				(uint64_t) 2 << j, tune->picked[j][RXM_TUNE_SAR],
+				tune->picked[j][RXM_TUNE_RNDV]);
+		}
+	}
+}
+
+/* Peers reached through a loopback address or the local endpoint's own
+ * address are on this node.  Providers that do not use socket addresses
+ * keep every peer in the remote class.
+ */
+void rxm_tune_conn(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn)
+{
+	union ofi_sock_ip local, peer;
+	size_t len;
+
+	rxm_conn->peer_class = RXM_PEER_REMOTE;
+	if (!rxm_ep->auto_tune)
+		return;
+
+	switch (rxm_ep->msg_info->addr_format) {
+	case FI_SOCKADDR:
+	case FI_SOCKADDR_IN:
+	case FI_SOCKADDR_IN6:
+		break;
+	default:
+		return;
+	}
+
+	len = sizeof(peer);
+	if (fi_getpeer(rxm_conn->msg_ep, &peer, &len))
+		return;
+
+	len = sizeof(local);
+	if (fi_getname(&rxm_conn->msg_ep->fid, &local, &len))
+		return;
+
+	if (ofi_is_loopback_addr(&peer.sa) ||
+	    ofi_equals_ipaddr(&local.sa, &peer.sa))
+		rxm_conn->peer_class = RXM_PEER_LOCAL;
+}
+
+/* Only sends that could reasonably use either protocol are measured */
+static bool rxm_tune_near(struct rxm_tune *tune, size_t data_len)
+{
+	return data_len > MAX(tune->sar_limit / 2, rxm_eager_limit) &&
+	       data_len <= tune->sar_limit * 2;
+}
+
+bool rxm_tune_use_sar(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		      size_t data_len)
+{
+	struct rxm_tune *tune;
+	bool sar;
+
+	if (!rxm_ep->auto_tune)
+		return data_len <= rxm_ep->sar_limit;
+
+	tune = &rxm_ep->tune[rxm_conn->peer_class];
+	if (data_len > rxm_ep->tune_max)
+		sar = false;
+	else if (tune->calib && rxm_tune_near(tune, data_len))
+		sar = --tune->calib & 1;
+	else
+		sar = data_len <= tune->sar_limit;
+
+	tune->picked[ofi_msb(data_len - 1) - 1][sar ? RXM_TUNE_SAR :
+						    RXM_TUNE_RNDV]++;
+	return sar;
+}
+
+void rxm_tune_start(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		    struct rxm_tx_buf *tx_buf)
+{
+	struct rxm_tune *tune;
+
+	tx_buf->tune = NULL;
+	if (!rxm_ep->auto_tune)
+		return;
+
+	tune = &rxm_ep->tune[rxm_conn->peer_class];
+	if (!rxm_tune_near(tune, tx_buf->pkt.hdr.size))
+		return;
+
+	tx_buf->tune = tune;
+	tx_buf->tune_start = ofi_gettime_ns();
+}
+
+/* Move the limit a quarter of the way toward the cheaper protocol, but
+ * only when it is cheaper by more than the noise margin of 1/8.  Keep
+ * exploring near the new limit so a shift in load is noticed.
+ */
+static void rxm_tune_adjust(struct rxm_tune *tune, size_t tune_max)
+{
+	uint64_t sar = tune->cost[RXM_TUNE_SAR];
+	uint64_t rndv = tune->cost[RXM_TUNE_RNDV];
+	size_t limit = tune->sar_limit;
+
+	if (tune->samples[RXM_TUNE_SAR] && tune->samples[RXM_TUNE_RNDV]) {
+		if (sar * 8 < rndv * 7)
+			limit = MIN(limit + limit / 4, tune_max);
+		else if (rndv * 8 < sar * 7)
+			limit = MAX(limit - limit / 4, rxm_eager_limit);
+	}
+
+	if (limit != tune->sar_limit) {
+		FI_INFO(&rxm_prov, FI_LOG_EP_DATA, "SAR limit %zu -> %zu "
+			"(cost SAR %" PRIu64 " rndv %" PRIu64 " ns/KiB)\n",
+			tune->sar_limit, limit, sar, rndv);
+		tune->sar_limit = limit;
+	}
+
+	tune->samples[RXM_TUNE_SAR] = 0;
+	tune->samples[RXM_TUNE_RNDV] = 0;
+	tune->calib = RXM_TUNE_EXPLORE;
+}
+
+/* Called on local completion.  A SAR send completes once its last segment
+ * is sent, a rendezvous send once the peer has acknowledged the transfer,
+ * so SAR costs leave out the round trip that rendezvous costs include.
+ * The sender has no later point at which SAR delivery is known, so the
+ * bias is accepted and documented in fi_rxm(7).
+ */
+void rxm_tune_finish(struct rxm_ep *rxm_ep, struct rxm_tx_buf *tx_buf,
+		     enum rxm_tune_proto proto)
+{
+	struct rxm_tune *tune = tx_buf->tune;
+	uint64_t cost;
+
+	if (!tune)
+		return;
+
+	tx_buf->tune = NULL;
+	cost = (ofi_gettime_ns() - tx_buf->tune_start) * 1024 /
+	       tx_buf->pkt.hdr.size;
+	cost = MAX(cost, 1);
+
+	if (tune->cost[proto])
+		tune->cost[proto] = tune->cost[proto] -
+				    tune->cost[proto] / 8 + cost / 8;
+	else
+		tune->cost[proto] = cost;
+
+	tune->samples[proto]++;
+	if (tune->samples[RXM_TUNE_SAR] + tune->samples[RXM_TUNE_RNDV] >=
+	    RXM_TUNE_INTERVAL)
+		rxm_tune_adjust(tune, rxm_ep->tune_max);
+}
@@ -62,6 +62,7 @@
 #include <ofi_util.h>
 #include <ofi_atomic.h>
 #include <ofi_iov.h>
+#include <ofi_trace.h>
 
 #ifndef _SMR_H_
 #define _SMR_H_
@@ -69,6 +70,8 @@
 struct smr_env {
 	size_t sar_threshold;
 	int disable_cma;
+	size_t bounce_size;
+	size_t mmap_cache_size;
 };
 
 extern struct smr_env smr_env;
@@ -129,6 +132,7 @@ struct smr_tx_entry {
 	int		next;
 	void		*map_ptr;
 	struct smr_ep_name *map_name;
+	struct smr_mmap_seg *map_seg;
 	enum fi_hmem_iface	iface;
 	uint64_t		device;
 	int			fd;
@@ -182,13 +186,24 @@ static inline enum fi_hmem_iface smr_get_mr_hmem_iface(struct util_domain *domai
 	return ((struct ofi_mr *) *desc)->iface;
 }
 
+/*
+ * Unexpected messages that fit a bounce buffer are copied out on arrival so
+ * that the sender's command slot, inject buffer or pending tx entry is
+ * released right away; buf then holds the payload.  Others stay pinned
+ * until matched.  Once SMR_RNR_THRESHOLD of them are pinned for a peer
+ * while half of the command queue is in use, its rnr_status asks it to
+ * stop sending anything but inline and inject messages.
+ */
+#define SMR_RNR_THRESHOLD	4
+
 struct smr_unexp_msg {
 	struct dlist_entry entry;
 	struct smr_cmd cmd;
+	void *buf;
+	int err;
 };
 
 OFI_DECLARE_FREESTACK(struct smr_rx_entry, smr_recv_fs);
-OFI_DECLARE_FREESTACK(struct smr_unexp_msg, smr_unexp_fs);
 OFI_DECLARE_FREESTACK(struct smr_tx_entry, smr_pend_fs);
 OFI_DECLARE_FREESTACK(struct smr_sar_entry, smr_sar_fs);
 
@@ -264,6 +279,44 @@ struct smr_sock_info {
 	struct smr_cmap_entry	peers[SMR_MAX_PEERS];
 };
 
+/*
+ * Segments used by the mmap protocol are cached per peer and size class,
+ * so that creating, mapping and unlinking a file is paid once per segment
+ * instead of once per message.  The sender bounds the total size of its
+ * cached segments by smr_env.mmap_cache_size, freeing idle segments to
+ * make room.  The receiver keeps the most recently used mappings of each
+ * peer, up to the number of segments a peer may cache, and drops them
+ * when the peer is removed.  Messages using a cached segment set
+ * SMR_MMAP_CACHED in their msg_id, the rest of which identifies the
+ * segment.
+ */
+#define SMR_MMAP_CACHE_MIN_SHIFT	16
+#define SMR_MMAP_CACHE_MAX_SHIFT	24
+#define SMR_MMAP_CACHE_CLASSES		(SMR_MMAP_CACHE_MAX_SHIFT - \
+					 SMR_MMAP_CACHE_MIN_SHIFT + 1)
+#define SMR_MMAP_CACHE_DEPTH		2
+#define SMR_MMAP_CACHE_SIZE		(64ULL << 20)
+#define SMR_MMAP_CACHED			(1ULL << 63)
+
+struct smr_mmap_seg {
+	struct smr_ep_name	*name;
+	void			*ptr;
+	size_t			size;
+	uint64_t		id;
+	bool			busy;
+};
+
+struct smr_mmap_tx_cache {
+	struct smr_mmap_seg	seg[SMR_MMAP_CACHE_CLASSES][SMR_MMAP_CACHE_DEPTH];
+};
+
+struct smr_mmap_rx_seg {
+	struct dlist_entry	entry;
+	char			name[SMR_NAME_MAX];
+	void			*ptr;
+	size_t			size;
+};
+
 struct smr_ep {
 	struct util_ep		util_ep;
 	smr_rx_comp_func	rx_comp;
@@ -277,7 +330,9 @@ struct smr_ep {
 	struct smr_recv_fs	*recv_fs; /* protected by rx_cq lock */
 	struct smr_queue	recv_queue;
 	struct smr_queue	trecv_queue;
-	struct smr_unexp_fs	*unexp_fs;
+	struct ofi_bufpool	*unexp_pool;
+	struct ofi_bufpool	*bounce_pool;
+	uint32_t		unexp_pinned[SMR_MAX_PEERS];
 	struct smr_pend_fs	*pend_fs;
 	struct smr_sar_fs	*sar_fs;
 	struct smr_queue	unexp_msg_queue;
@@ -286,6 +341,13 @@ struct smr_ep {
 
 	int			ep_idx;
 	struct smr_sock_info	*sock_info;
+
+	/* indexed by peer id; tx is protected by the tx_cq lock, rx by
+	 * the region lock
+	 */
+	struct smr_mmap_tx_cache *mmap_tx[SMR_MAX_PEERS];
+	size_t			mmap_tx_size;
+	struct dlist_entry	mmap_rx[SMR_MAX_PEERS];
 };
 
 #define smr_ep_rx_flags(smr_ep) ((smr_ep)->util_ep.rx_op_flags)
@@ -298,6 +360,22 @@ static inline int smr_mmap_name(char *shm_name, const char *ep_name,
 			ep_name, msg_id);
 }
 
+static inline int smr_mmap_seg_name(char *shm_name, const char *ep_name,
+				    uint64_t seg_id)
+{
+	return snprintf(shm_name, SMR_NAME_MAX - 1, "%s_s%" PRIu64,
+			ep_name, seg_id);
+}
+
+void smr_mmap_cache_init(struct smr_ep *ep);
+void smr_mmap_cache_cleanup(struct smr_ep *ep);
+struct smr_mmap_seg *smr_mmap_seg_get(struct smr_ep *ep, int64_t id,
+				      size_t size);
+void smr_mmap_seg_put(struct smr_mmap_seg *seg);
+void smr_mmap_rx_flush(struct smr_ep *ep, int64_t id);
+void *smr_mmap_rx_map(struct smr_ep *ep, int64_t id, uint64_t seg_id,
+		      size_t size);
+
 int smr_endpoint(struct fid_domain *domain, struct fi_info *info,
 		  struct fid_ep **ep, void *context);
 void smr_ep_exchange_fds(struct smr_ep *ep, int64_t id);
@@ -327,7 +405,7 @@ int smr_format_ze_ipc(struct smr_ep *ep, int64_t id, struct smr_cmd *cmd,
 		      const struct iovec *iov, uint64_t device,
 		      size_t total_len, struct smr_region *smr,
 		      struct smr_resp *resp, struct smr_tx_entry *pend);
-int smr_format_mmap(struct smr_ep *ep, struct smr_cmd *cmd,
+int smr_format_mmap(struct smr_ep *ep, int64_t id, struct smr_cmd *cmd,
 		    const struct iovec *iov, size_t count, size_t total_len,
 		    struct smr_tx_entry *pend, struct smr_resp *resp);
 void smr_format_sar(struct smr_cmd *cmd, enum fi_hmem_iface iface, uint64_t deivce,
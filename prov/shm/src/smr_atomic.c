@@ -154,6 +154,12 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 	assert(compare_count <= SMR_IOV_LIMIT);
 	assert(rma_count <= SMR_IOV_LIMIT);
 
+	if (op_flags & FI_TRIGGER) {
+		FI_WARN(&smr_prov, FI_LOG_EP_DATA,
+			"FI_TRIGGER not supported, use FI_QUEUE_WORK\n");
+		return -FI_ENOSYS;
+	}
+
 	id = smr_verify_peer(ep, addr);
 	if (id < 0)
 		return -FI_EAGAIN;
@@ -149,6 +149,8 @@ static int smr_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr, size_t count
 			util_ep = container_of(av_entry, struct util_ep, av_entry);
 			smr_ep = container_of(util_ep, struct smr_ep, util_ep);
 			smr_unmap_from_endpoint(smr_ep->region, id);
+			smr_ep->unexp_pinned[id] = 0;
+			smr_mmap_rx_flush(smr_ep, id);
 		}
 		smr_av->used--;
 	}
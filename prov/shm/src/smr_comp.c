@@ -53,6 +53,7 @@ smr_write_err_comp(struct util_cq *cq, void *context,
 		   uint64_t flags, uint64_t tag, uint64_t err)
 {
 	struct fi_cq_err_entry err_entry;
+	int ret;
 
 	memset(&err_entry, 0, sizeof err_entry);
 	err_entry.op_context = context;
@@ -60,7 +61,9 @@ smr_write_err_comp(struct util_cq *cq, void *context,
 	err_entry.tag = tag;
 	err_entry.err = err;
 	err_entry.prov_errno = -err;
-	return ofi_cq_insert_error(cq, &err_entry);
+	ret = ofi_cq_insert_error(cq, &err_entry);
+	ofi_poll_notify(&cq->poll_notify);
+	return ret;
 }
 
 static int
@@ -68,18 +71,25 @@ smr_write_comp(struct util_cq *cq, void *context,
 	       uint64_t flags, size_t len, void *buf,
 	       uint64_t tag, uint64_t data, uint64_t err)
 {
+	int ret;
+
+	if (ofi_cq_deferred_comp(cq, &context, err))
+		return 0;
+
 	if (err)
 		return smr_write_err_comp(cq, context, flags, tag, err);
 
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_entry(cq, context, flags, len,
 				   buf, data, tag);
-		return 0;
+		ret = 0;
 	} else {
-		return ofi_cq_write_overflow(cq, context, flags,
-					     len, buf, data, tag,
-					     FI_ADDR_NOTAVAIL);
+		ret = ofi_cq_write_overflow(cq, context, flags,
+					    len, buf, data, tag,
+					    FI_ADDR_NOTAVAIL);
 	}
+	ofi_poll_notify(&cq->poll_notify);
+	return ret;
 }
 
 static int
@@ -87,17 +97,24 @@ smr_write_src_comp(struct util_cq *cq, void *context,
 		   uint64_t flags, size_t len, void *buf, fi_addr_t addr,
 		   uint64_t tag, uint64_t data, uint64_t err)
 {
+	int ret;
+
+	if (ofi_cq_deferred_comp(cq, &context, err))
+		return 0;
+
 	if (err)
 		return smr_write_err_comp(cq, context, flags, tag, err);
 
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_src_entry(cq, context, flags, len,
 				       buf, data, tag, addr);
-		return 0;
+		ret = 0;
 	} else {
-		return ofi_cq_write_overflow(cq, context, flags,
-					     len, buf, data, tag, addr);
+		ret = ofi_cq_write_overflow(cq, context, flags,
+					    len, buf, data, tag, addr);
 	}
+	ofi_poll_notify(&cq->poll_notify);
+	return ret;
 }
 
 int smr_tx_comp(struct smr_ep *ep, void *context, uint32_t op,
@@ -62,9 +62,16 @@ int smr_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	if (ret)
 		goto free;
 
+	/* shm has no fds to wait on; idle progress threads poll on a timer */
+	ret = ofi_cq_progress_add(util_cq, NULL);
+	if (ret)
+		goto cleanup;
+
 	(*cq_fid) = &util_cq->cq_fid;
 	return 0;
 
+cleanup:
+	ofi_cq_cleanup(util_cq);
 free:
 	free(util_cq);
 	return ret;
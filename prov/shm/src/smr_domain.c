@@ -67,7 +67,7 @@ static struct fi_ops smr_domain_fi_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = smr_domain_close,
 	.bind = fi_no_bind,
-	.control = fi_no_control,
+	.control = ofi_domain_control,
 	.ops_open = fi_no_ops_open,
 };
 
@@ -99,6 +99,8 @@ int smr_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 		return ret;
 	}
 
+	smr_domain->util_domain.auto_progress = ofi_progress_enabled(info);
+
 	smr_fabric = container_of(fabric, struct smr_fabric, util_fabric.fabric_fid);
 	fastlock_acquire(&smr_fabric->util_fabric.lock);
 	smr_domain->fast_rma = smr_fast_rma_enabled(info->domain_attr->mr_mode,
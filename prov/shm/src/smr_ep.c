@@ -322,6 +322,8 @@ void smr_generic_format(struct smr_cmd *cmd, int64_t peer_id, uint32_t op,
 		cmd->msg.hdr.op_flags |= SMR_REMOTE_CQ_DATA;
 	if (op_flags & FI_COMPLETION)
 		cmd->msg.hdr.op_flags |= SMR_TX_COMPLETION;
+	if (op_flags & FI_DELIVERY_COMPLETE)
+		cmd->msg.hdr.op_flags |= SMR_DELIVERY_COMPLETE;
 }
 
 void smr_format_inline(struct smr_cmd *cmd, enum fi_hmem_iface iface,
@@ -389,7 +391,33 @@ int smr_format_ze_ipc(struct smr_ep *ep, int64_t id, struct smr_cmd *cmd,
 	return FI_SUCCESS;
 }
 
-int smr_format_mmap(struct smr_ep *ep, struct smr_cmd *cmd,
+static int smr_format_mmap_seg(struct smr_ep *ep, struct smr_cmd *cmd,
+			       const struct iovec *iov, size_t count,
+			       size_t total_len, struct smr_tx_entry *pend,
+			       struct smr_resp *resp, struct smr_mmap_seg *seg)
+{
+	if (cmd->msg.hdr.op != ofi_op_read_req) {
+		if (ofi_copy_from_iov(seg->ptr, total_len, iov, count, 0)
+		    != total_len) {
+			FI_WARN(&smr_prov, FI_LOG_EP_CTRL, "copy from iov error\n");
+			smr_mmap_seg_put(seg);
+			return -FI_EIO;
+		}
+	} else {
+		pend->map_ptr = seg->ptr;
+	}
+
+	cmd->msg.hdr.op_src = smr_src_mmap;
+	cmd->msg.hdr.msg_id = seg->id | SMR_MMAP_CACHED;
+	cmd->msg.hdr.src_data = smr_get_offset(ep->region, resp);
+	cmd->msg.hdr.size = total_len;
+	pend->map_name = NULL;
+	pend->map_seg = seg;
+
+	return 0;
+}
+
+int smr_format_mmap(struct smr_ep *ep, int64_t id, struct smr_cmd *cmd,
 		    const struct iovec *iov, size_t count, size_t total_len,
 		    struct smr_tx_entry *pend, struct smr_resp *resp)
 {
@@ -397,6 +425,12 @@ int smr_format_mmap(struct smr_ep *ep, struct smr_cmd *cmd,
 	int fd, ret, num;
 	uint64_t msg_id;
 	struct smr_ep_name *map_name;
+	struct smr_mmap_seg *seg;
+
+	seg = smr_mmap_seg_get(ep, id, total_len);
+	if (seg)
+		return smr_format_mmap_seg(ep, cmd, iov, count, total_len,
+					   pend, resp, seg);
 
 	msg_id = ep->msg_id++;
 	map_name = calloc(1, sizeof(*map_name));
@@ -453,6 +487,7 @@ int smr_format_mmap(struct smr_ep *ep, struct smr_cmd *cmd,
 	cmd->msg.hdr.src_data = smr_get_offset(ep->region, resp);
 	cmd->msg.hdr.size = total_len;
 	pend->map_name = map_name;
+	pend->map_seg = NULL;
 
 	close(fd);
 	return 0;
@@ -560,6 +595,8 @@ static int smr_ep_close(struct fid *fid)
 
 	ep = container_of(fid, struct smr_ep, util_ep.ep_fid.fid);
 
+	ofi_progress_ep_detach(&ep->util_ep);
+
 	if (ep->sock_info) {
 		fd_signal_set(&ep->sock_info->signal);
 		pthread_join(ep->sock_info->listener_thread, NULL);
@@ -571,11 +608,13 @@ static int smr_ep_close(struct fid *fid)
 
 	ofi_endpoint_close(&ep->util_ep);
 
+	smr_mmap_cache_cleanup(ep);
 	if (ep->region)
 		smr_free(ep->region);
 
 	smr_recv_fs_free(ep->recv_fs);
-	smr_unexp_fs_free(ep->unexp_fs);
+	ofi_bufpool_destroy(ep->unexp_pool);
+	ofi_bufpool_destroy(ep->bounce_pool);
 	smr_pend_fs_free(ep->pend_fs);
 	smr_sar_fs_free(ep->sar_fs);
 	free((void *)ep->name);
@@ -1064,10 +1103,19 @@ static struct fi_ops smr_ep_fi_ops = {
 static int smr_endpoint_name(struct smr_ep *ep, char *name, char *addr,
 			     size_t addrlen)
 {
+	/* room for the prefix and any pid */
+	char default_addr[sizeof(SMR_PREFIX) + 12];
 	const char *start;
 	memset(name, 0, SMR_NAME_MAX);
-	if (!addr || addrlen > SMR_NAME_MAX)
+
+	/* without a source address, pick the same one fi_getinfo would */
+	if (!addr) {
+		snprintf(default_addr, sizeof(default_addr), "%s%d",
+			 SMR_PREFIX, getpid());
+		addr = default_addr;
+	} else if (addrlen > SMR_NAME_MAX) {
 		return -FI_EINVAL;
+	}
 
 	pthread_mutex_lock(&ep_list_lock);
 	ep->ep_idx = smr_global_ep_idx++;
@@ -1096,20 +1144,30 @@ int smr_endpoint(struct fid_domain *domain, struct fi_info *info,
 
 	ret = smr_endpoint_name(ep, name, info->src_addr, info->src_addrlen);
 	if (ret)
-		goto err2;
+		goto err1;
 	ret = smr_setname(&ep->util_ep.ep_fid.fid, name, SMR_NAME_MAX);
 	if (ret)
-		goto err2;
+		goto err1;
 
 	ep->rx_size = info->rx_attr->size;
 	ep->tx_size = info->tx_attr->size;
 	ret = ofi_endpoint_init(domain, &smr_util_prov, info, &ep->util_ep, context,
 				smr_ep_progress);
 	if (ret)
-		goto err1;
+		goto err2;
+
+	ret = ofi_bufpool_create(&ep->unexp_pool, sizeof(struct smr_unexp_msg),
+				 16, 0, info->rx_attr->size,
+				 OFI_BUFPOOL_NO_TRACK);
+	if (ret)
+		goto err3;
+
+	ret = ofi_bufpool_create(&ep->bounce_pool, smr_env.bounce_size,
+				 16, 0, 64, OFI_BUFPOOL_NO_TRACK);
+	if (ret)
+		goto err4;
 
 	ep->recv_fs = smr_recv_fs_create(info->rx_attr->size, NULL, NULL);
-	ep->unexp_fs = smr_unexp_fs_create(info->rx_attr->size, NULL, NULL);
 	ep->pend_fs = smr_pend_fs_create(info->tx_attr->size, NULL, NULL);
 	ep->sar_fs = smr_sar_fs_create(info->rx_attr->size, NULL, NULL);
 	smr_init_queue(&ep->recv_queue, smr_match_msg);
@@ -1117,6 +1175,7 @@ int smr_endpoint(struct fid_domain *domain, struct fi_info *info,
 	smr_init_queue(&ep->unexp_msg_queue, smr_match_unexp_msg);
 	smr_init_queue(&ep->unexp_tagged_queue, smr_match_unexp_tagged);
 	dlist_init(&ep->sar_list);
+	smr_mmap_cache_init(ep);
 
 	ep->min_multi_recv_size = SMR_INJECT_SIZE;
 
@@ -1131,9 +1190,13 @@ int smr_endpoint(struct fid_domain *domain, struct fi_info *info,
 	*ep_fid = &ep->util_ep.ep_fid;
 	return 0;
 
-err1:
-	free((void *)ep->name);
+err4:
+	ofi_bufpool_destroy(ep->unexp_pool);
+err3:
+	ofi_endpoint_close(&ep->util_ep);
 err2:
+	free((void *)ep->name);
+err1:
 	free(ep);
 	return ret;
 }
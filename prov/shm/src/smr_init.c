@@ -41,6 +41,8 @@ extern struct sigaction *old_action;
 struct smr_env smr_env = {
 	.sar_threshold = SIZE_MAX,
 	.disable_cma = false,
+	.bounce_size = SMR_INJECT_SIZE,
+	.mmap_cache_size = SMR_MMAP_CACHE_SIZE,
 };
 
 static void smr_init_env(void)
@@ -49,6 +51,14 @@ static void smr_init_env(void)
 	fi_param_get_size_t(&smr_prov, "tx_size", &smr_info.tx_attr->size);
 	fi_param_get_size_t(&smr_prov, "rx_size", &smr_info.rx_attr->size);
 	fi_param_get_bool(&smr_prov, "disable_cma", &smr_env.disable_cma);
+	fi_param_get_size_t(&smr_prov, "bounce_size", &smr_env.bounce_size);
+	smr_env.bounce_size = MAX(smr_env.bounce_size, SMR_INJECT_SIZE);
+	fi_param_get_size_t(&smr_prov, "mmap_cache_size",
+			    &smr_env.mmap_cache_size);
+
+	/* progress threads let shm offer automatic data progress */
+	if (ofi_progress_threads())
+		smr_info.domain_attr->data_progress = FI_PROGRESS_AUTO;
 }
 
 static void smr_resolve_addr(const char *node, const char *service,
@@ -218,6 +228,15 @@ SHM_INI
 			 Default: 1024");
 	fi_param_define(&smr_prov, "disable_cma", FI_PARAM_BOOL,
 			"Manually disables CMA. Default: false");
+	fi_param_define(&smr_prov, "bounce_size", FI_PARAM_SIZE_T,
+			"Max size of an unexpected message that is copied \
+			 into a receive side buffer on arrival, releasing \
+			 the sender's resources before it is matched. \
+			 Default: 4096");
+	fi_param_define(&smr_prov, "mmap_cache_size", FI_PARAM_SIZE_T,
+			"Max total size of the shared memory segments an \
+			 endpoint keeps cached for the mmap protocol. \
+			 Default: 67108864 (64 MiB)");
 
 	smr_init_env();
 
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "smr.h"
+
+static int smr_mmap_class(size_t size)
+{
+	int shift = SMR_MMAP_CACHE_MIN_SHIFT;
+
+	while (shift <= SMR_MMAP_CACHE_MAX_SHIFT && ((size_t) 1 << shift) < size)
+		shift++;
+	return shift - SMR_MMAP_CACHE_MIN_SHIFT;
+}
+
+void smr_mmap_cache_init(struct smr_ep *ep)
+{
+	int i;
+
+	for (i = 0; i < SMR_MAX_PEERS; i++)
+		dlist_init(&ep->mmap_rx[i]);
+}
+
+static void smr_mmap_seg_free(struct smr_ep *ep, struct smr_mmap_seg *seg)
+{
+	munmap(seg->ptr, seg->size);
+	shm_unlink(seg->name->name);
+	ep->mmap_tx_size -= seg->size;
+
+	pthread_mutex_lock(&ep_list_lock);
+	dlist_remove(&seg->name->entry);
+	pthread_mutex_unlock(&ep_list_lock);
+	free(seg->name);
+	seg->name = NULL;
+}
+
+static void smr_mmap_rx_free(struct smr_mmap_rx_seg *rx_seg)
+{
+	dlist_remove(&rx_seg->entry);
+	munmap(rx_seg->ptr, rx_seg->size);
+	free(rx_seg);
+}
+
+void smr_mmap_cache_cleanup(struct smr_ep *ep)
+{
+	struct smr_mmap_rx_seg *rx_seg;
+	struct smr_mmap_seg *seg;
+	int i, j, k;
+
+	for (i = 0; i < SMR_MAX_PEERS; i++) {
+		while (!dlist_empty(&ep->mmap_rx[i])) {
+			rx_seg = container_of(ep->mmap_rx[i].next,
+					      struct smr_mmap_rx_seg, entry);
+			smr_mmap_rx_free(rx_seg);
+		}
+
+		if (!ep->mmap_tx[i])
+			continue;
+
+		for (j = 0; j < SMR_MMAP_CACHE_CLASSES; j++) {
+			for (k = 0; k < SMR_MMAP_CACHE_DEPTH; k++) {
+				seg = &ep->mmap_tx[i]->seg[j][k];
+				if (seg->name)
+					smr_mmap_seg_free(ep, seg);
+			}
+		}
+		free(ep->mmap_tx[i]);
+		ep->mmap_tx[i] = NULL;
+	}
+}
+
+static int smr_mmap_seg_create(struct smr_ep *ep, struct smr_mmap_seg *seg,
+			       size_t size)
+{
+	struct smr_ep_name *name;
+	uint64_t seg_id;
+	int fd, ret;
+
+	name = calloc(1, sizeof(*name));
+	if (!name)
+		return -FI_ENOMEM;
+
+	seg_id = ep->msg_id++;
+	if (smr_mmap_seg_name(name->name, ep->name, seg_id) < 0) {
+		ret = -FI_EINVAL;
+		goto free;
+	}
+
+	/* listed so that the signal handlers unlink it on abnormal exit */
+	pthread_mutex_lock(&ep_list_lock);
+	dlist_insert_tail(&name->entry, &ep_name_list);
+	pthread_mutex_unlock(&ep_list_lock);
+
+	fd = shm_open(name->name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		ret = -errno;
+		goto remove;
+	}
+
+	if (ftruncate(fd, size) < 0) {
+		ret = -errno;
+		goto unlink;
+	}
+
+	seg->ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (seg->ptr == MAP_FAILED) {
+		ret = -errno;
+		goto unlink;
+	}
+	close(fd);
+
+	seg->name = name;
+	seg->size = size;
+	seg->id = seg_id;
+	ep->mmap_tx_size += size;
+	return 0;
+
+unlink:
+	shm_unlink(name->name);
+	close(fd);
+remove:
+	pthread_mutex_lock(&ep_list_lock);
+	dlist_remove(&name->entry);
+	pthread_mutex_unlock(&ep_list_lock);
+free:
+	free(name);
+	return ret;
+}
+
+/* Frees idle segments, largest first, until size more bytes fit within
+ * the cache limit.  Peers are not tracked by recent use; this only runs
+ * when a segment has to be created anyway.
+ */
+static bool smr_mmap_tx_reserve(struct smr_ep *ep, size_t size)
+{
+	struct smr_mmap_seg *seg;
+	int i, j, k;
+
+	if (size > smr_env.mmap_cache_size)
+		return false;
+
+	for (j = SMR_MMAP_CACHE_CLASSES - 1; j >= 0; j--) {
+		for (i = 0; i < SMR_MAX_PEERS; i++) {
+			if (ep->mmap_tx_size + size <= smr_env.mmap_cache_size)
+				return true;
+
+			if (!ep->mmap_tx[i])
+				continue;
+
+			for (k = 0; k < SMR_MMAP_CACHE_DEPTH; k++) {
+				seg = &ep->mmap_tx[i]->seg[j][k];
+				if (seg->name && !seg->busy)
+					smr_mmap_seg_free(ep, seg);
+			}
+		}
+	}
+	return ep->mmap_tx_size + size <= smr_env.mmap_cache_size;
+}
+
+/* Returns an idle segment that fits size, or NULL if the message is too
+ * large to cache, every segment of its class is in flight, or the cache
+ * limit is reached by segments in flight.
+ */
+struct smr_mmap_seg *smr_mmap_seg_get(struct smr_ep *ep, int64_t id,
+				      size_t size)
+{
+	struct smr_mmap_seg *seg;
+	size_t seg_size;
+	int class, i, ret;
+
+	class = smr_mmap_class(size);
+	if (class >= SMR_MMAP_CACHE_CLASSES)
+		return NULL;
+
+	if (!ep->mmap_tx[id]) {
+		ep->mmap_tx[id] = calloc(1, sizeof(*ep->mmap_tx[id]));
+		if (!ep->mmap_tx[id])
+			return NULL;
+	}
+
+	for (i = 0; i < SMR_MMAP_CACHE_DEPTH; i++) {
+		seg = &ep->mmap_tx[id]->seg[class][i];
+		if (seg->busy)
+			continue;
+
+		if (!seg->name) {
+			seg_size = (size_t) 1 <<
+				   (class + SMR_MMAP_CACHE_MIN_SHIFT);
+			if (!smr_mmap_tx_reserve(ep, seg_size))
+				return NULL;
+
+			ret = smr_mmap_seg_create(ep, seg, seg_size);
+			if (ret) {
+				FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+					"unable to create mmap segment: %s\n",
+					fi_strerror(-ret));
+				return NULL;
+			}
+		}
+		seg->busy = true;
+		return seg;
+	}
+	return NULL;
+}
+
+void smr_mmap_seg_put(struct smr_mmap_seg *seg)
+{
+	seg->busy = false;
+}
+
+/* Drops the mappings of a removed peer, whose id may be reused. */
+void smr_mmap_rx_flush(struct smr_ep *ep, int64_t id)
+{
+	struct smr_mmap_rx_seg *rx_seg;
+
+	fastlock_acquire(&ep->region->lock);
+	while (!dlist_empty(&ep->mmap_rx[id])) {
+		rx_seg = container_of(ep->mmap_rx[id].next,
+				      struct smr_mmap_rx_seg, entry);
+		smr_mmap_rx_free(rx_seg);
+	}
+	fastlock_release(&ep->region->lock);
+}
+
+/* Returns the receive side mapping of a peer's cached segment, mapping it
+ * on first use.  Mappings are kept in order of use, and the least recently
+ * used one is dropped once the peer has more than it may cache.
+ */
+void *smr_mmap_rx_map(struct smr_ep *ep, int64_t id, uint64_t seg_id,
+		      size_t size)
+{
+	struct smr_mmap_rx_seg *rx_seg;
+	struct dlist_entry *item, *tmp;
+	char name[SMR_NAME_MAX];
+	const char *peer_name;
+	size_t prefix_len;
+	void *ptr;
+	int fd, cnt;
+
+	peer_name = ep->region->map->peers[id].peer.name;
+	if (smr_mmap_seg_name(name, peer_name, seg_id) < 0)
+		return NULL;
+
+	dlist_foreach_container(&ep->mmap_rx[id], struct smr_mmap_rx_seg,
+				rx_seg, entry) {
+		if (!strcmp(rx_seg->name, name)) {
+			dlist_remove(&rx_seg->entry);
+			dlist_insert_tail(&rx_seg->entry, &ep->mmap_rx[id]);
+			return rx_seg->ptr;
+		}
+	}
+
+	/* drop segments left behind by an earlier peer at this address */
+	prefix_len = strlen(peer_name);
+	cnt = 0;
+	dlist_foreach_safe(&ep->mmap_rx[id], item, tmp) {
+		rx_seg = container_of(item, struct smr_mmap_rx_seg, entry);
+		if (strncmp(rx_seg->name, peer_name, prefix_len) ||
+		    strncmp(rx_seg->name + prefix_len, "_s", 2))
+			smr_mmap_rx_free(rx_seg);
+		else
+			cnt++;
+	}
+
+	for (; cnt >= SMR_MMAP_CACHE_CLASSES * SMR_MMAP_CACHE_DEPTH; cnt--) {
+		rx_seg = container_of(ep->mmap_rx[id].next,
+				      struct smr_mmap_rx_seg, entry);
+		smr_mmap_rx_free(rx_seg);
+	}
+
+	rx_seg = calloc(1, sizeof(*rx_seg));
+	if (!rx_seg)
+		return NULL;
+
+	fd = shm_open(name, O_RDWR, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL, "shm_open error %s\n",
+			strerror(errno));
+		goto free;
+	}
+
+	size = (size_t) 1 << (smr_mmap_class(size) + SMR_MMAP_CACHE_MIN_SHIFT);
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL, "mmap error %s\n",
+			strerror(errno));
+		goto free;
+	}
+
+	strcpy(rx_seg->name, name);
+	rx_seg->ptr = ptr;
+	rx_seg->size = size;
+	dlist_insert_tail(&rx_seg->entry, &ep->mmap_rx[id]);
+	return ptr;
+
+free:
+	free(rx_seg);
+	return NULL;
+}
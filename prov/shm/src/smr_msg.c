@@ -170,6 +170,12 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 
 	assert(iov_count <= SMR_IOV_LIMIT);
 
+	if (op_flags & FI_TRIGGER) {
+		FI_WARN(&smr_prov, FI_LOG_EP_DATA,
+			"FI_TRIGGER not supported, use FI_QUEUE_WORK\n");
+		return -FI_ENOSYS;
+	}
+
 	id = smr_verify_peer(ep, addr);
 	if (id < 0)
 		return -FI_EAGAIN;
@@ -203,7 +209,8 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
 		smr_format_inject(cmd, iface, device, iov, iov_count, peer_smr, tx_buf);
 	} else {
-		if (ofi_cirque_isfull(smr_resp_queue(ep->region))) {
+		if (ofi_cirque_isfull(smr_resp_queue(ep->region)) ||
+		    smr_peer_data(peer_smr)[peer_id].rnr_status) {
 			ret = -FI_EAGAIN;
 			goto unlock_cq;
 		}
@@ -232,7 +239,7 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 					smr_peer_data(ep->region)[id].sar_status = 1;
 				}
 			} else {
-				ret = smr_format_mmap(ep, cmd, iov, iov_count,
+				ret = smr_format_mmap(ep, id, cmd, iov, iov_count,
 						      total_len, pend, resp);
 			}
 			if (ret) {
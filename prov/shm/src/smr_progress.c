@@ -103,7 +103,7 @@ static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 			return -FI_EAGAIN;
 		break;
 	case smr_src_mmap:
-		if (!pending->map_name)
+		if (!pending->map_name && !pending->map_seg)
 			break;
 		if (pending->cmd.msg.hdr.op == ofi_op_read_req) {
 			if (!*err) {
@@ -117,7 +117,14 @@ static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 					*err = -FI_EIO;
 				}
 			}
-			munmap(pending->map_ptr, pending->cmd.msg.hdr.size);
+			if (!pending->map_seg)
+				munmap(pending->map_ptr,
+				       pending->cmd.msg.hdr.size);
+		}
+		if (pending->map_seg) {
+			smr_mmap_seg_put(pending->map_seg);
+			pending->map_seg = NULL;
+			break;
 		}
 		shm_unlink(pending->map_name->name);
 		dlist_remove(&pending->map_name->entry);
@@ -280,6 +287,30 @@ out:
 	return -ret;
 }
 
+static int smr_mmap_copy(struct smr_cmd *cmd, void *mapped_ptr,
+			 struct iovec *iov, size_t iov_count,
+			 size_t *total_len)
+{
+	if (cmd->msg.hdr.op == ofi_op_read_req) {
+		*total_len = ofi_total_iov_len(iov, iov_count);
+		if (ofi_copy_from_iov(mapped_ptr, *total_len, iov, iov_count, 0)
+		    != *total_len) {
+			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+				"mmap iov copy in error\n");
+			return -FI_EIO;
+		}
+	} else {
+		*total_len = ofi_copy_to_iov(iov, iov_count, 0, mapped_ptr,
+				      cmd->msg.hdr.size);
+		if (*total_len != cmd->msg.hdr.size) {
+			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+				"mmap iov copy out error\n");
+			return -FI_EIO;
+		}
+	}
+	return 0;
+}
+
 static int smr_mmap_peer_copy(struct smr_ep *ep, struct smr_cmd *cmd,
 				 struct iovec *iov, size_t iov_count,
 				 size_t *total_len)
@@ -289,6 +320,16 @@ static int smr_mmap_peer_copy(struct smr_ep *ep, struct smr_cmd *cmd,
 	int fd, num;
 	int ret = 0;
 
+	if (cmd->msg.hdr.msg_id & SMR_MMAP_CACHED) {
+		mapped_ptr = smr_mmap_rx_map(ep, cmd->msg.hdr.id,
+				cmd->msg.hdr.msg_id & ~SMR_MMAP_CACHED,
+				cmd->msg.hdr.size);
+		if (!mapped_ptr)
+			return -FI_EIO;
+		return smr_mmap_copy(cmd, mapped_ptr, iov, iov_count,
+				     total_len);
+	}
+
 	num = smr_mmap_name(shm_name,
 			ep->region->map->peers[cmd->msg.hdr.id].peer.name,
 			cmd->msg.hdr.msg_id);
@@ -311,27 +352,8 @@ static int smr_mmap_peer_copy(struct smr_ep *ep, struct smr_cmd *cmd,
 		goto unlink_close;
 	}
 
-	if (cmd->msg.hdr.op == ofi_op_read_req) {
-		*total_len = ofi_total_iov_len(iov, iov_count);
-		if (ofi_copy_from_iov(mapped_ptr, *total_len, iov, iov_count, 0)
-		    != *total_len) {
-			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
-				"mmap iov copy in error\n");
-			ret = -FI_EIO;
-			goto munmap;
-		}
-	} else {
-		*total_len = ofi_copy_to_iov(iov, iov_count, 0, mapped_ptr,
-				      cmd->msg.hdr.size);
-		if (*total_len != cmd->msg.hdr.size) {
-			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
-				"mmap iov copy out error\n");
-			ret = -FI_EIO;
-			goto munmap;
-		}
-	}
+	ret = smr_mmap_copy(cmd, mapped_ptr, iov, iov_count, total_len);
 
-munmap:
 	munmap(mapped_ptr, cmd->msg.hdr.size);
 unlink_close:
 	shm_unlink(shm_name);
@@ -583,16 +605,51 @@ out:
 	return err;
 }
 
-static int smr_progress_msg_common(struct smr_ep *ep, struct smr_cmd *cmd,
-				   struct smr_rx_entry *entry)
+static int smr_complete_msg(struct smr_ep *ep, struct smr_cmd *cmd,
+			    struct smr_rx_entry *entry, size_t total_len,
+			    struct smr_sar_entry *sar)
 {
-	struct smr_sar_entry *sar = NULL;
-	size_t total_len = 0;
 	uint16_t comp_flags;
 	void *comp_buf;
 	int ret;
 	bool free_entry = true;
 
+	comp_buf = entry->iov[0].iov_base;
+	comp_flags = (cmd->msg.hdr.op_flags | entry->flags) & ~SMR_MULTI_RECV;
+
+	if (entry->flags & SMR_MULTI_RECV) {
+		free_entry = smr_progress_multi_recv(ep, entry, total_len);
+		if (free_entry) {
+			comp_flags |= SMR_MULTI_RECV;
+			if (sar)
+				sar->rx_entry.flags |= SMR_MULTI_RECV;
+		}
+	}
+
+	if (!sar) {
+		ret = smr_complete_rx(ep, entry->context, cmd->msg.hdr.op,
+				comp_flags, total_len, comp_buf, cmd->msg.hdr.id,
+				cmd->msg.hdr.tag, cmd->msg.hdr.data, entry->err);
+		if (ret) {
+			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+				"unable to process rx completion\n");
+		}
+	}
+
+	if (free_entry) {
+		dlist_remove(&entry->entry);
+		ofi_freestack_push(ep->recv_fs, entry);
+		return 1;
+	}
+	return 0;
+}
+
+static int smr_progress_msg_common(struct smr_ep *ep, struct smr_cmd *cmd,
+				   struct smr_rx_entry *entry)
+{
+	struct smr_sar_entry *sar = NULL;
+	size_t total_len = 0;
+
 	switch (cmd->msg.hdr.op_src) {
 	case smr_src_inline:
 		entry->err = smr_progress_inline(cmd, entry->iface, entry->device,
@@ -629,34 +686,92 @@ static int smr_progress_msg_common(struct smr_ep *ep, struct smr_cmd *cmd,
 		entry->err = -FI_EINVAL;
 	}
 
-	comp_buf = entry->iov[0].iov_base;
-	comp_flags = (cmd->msg.hdr.op_flags | entry->flags) & ~SMR_MULTI_RECV;
+	return smr_complete_msg(ep, cmd, entry, total_len, sar);
+}
 
-	if (entry->flags & SMR_MULTI_RECV) {
-		free_entry = smr_progress_multi_recv(ep, entry, total_len);
-		if (free_entry) {
-			comp_flags |= SMR_MULTI_RECV;
-			if (sar)
-				sar->rx_entry.flags |= SMR_MULTI_RECV;
-		}
-	}
+static int smr_progress_unexp_bounce(struct smr_ep *ep,
+				     struct smr_unexp_msg *unexp,
+				     struct smr_rx_entry *entry)
+{
+	size_t total_len = 0;
 
-	if (!sar) {
-		ret = smr_complete_rx(ep, entry->context, cmd->msg.hdr.op,
-				comp_flags, total_len, comp_buf, cmd->msg.hdr.id,
-				cmd->msg.hdr.tag, cmd->msg.hdr.data, entry->err);
-		if (ret) {
+	if (unexp->err) {
+		entry->err = unexp->err;
+	} else {
+		total_len = ofi_copy_to_hmem_iov(entry->iface, entry->device,
+						 entry->iov, entry->iov_count, 0,
+						 unexp->buf,
+						 unexp->cmd.msg.hdr.size);
+		if (total_len != unexp->cmd.msg.hdr.size) {
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
-				"unable to process rx completion\n");
+				"recv truncated");
+			entry->err = -FI_EIO;
 		}
 	}
 
-	if (free_entry) {
-		dlist_remove(&entry->entry);
-		ofi_freestack_push(ep->recv_fs, entry);
-		return 1;
+	if (unexp->buf != unexp->cmd.msg.data.msg)
+		ofi_buf_free(unexp->buf);
+
+	return smr_complete_msg(ep, &unexp->cmd, entry, total_len, NULL);
+}
+
+static void smr_unexp_bounce(struct smr_ep *ep, struct smr_unexp_msg *unexp)
+{
+	struct smr_cmd *cmd = &unexp->cmd;
+	struct smr_inject_buf *tx_buf;
+	struct iovec iov;
+	size_t total_len;
+
+	unexp->buf = NULL;
+	unexp->err = 0;
+
+	switch (cmd->msg.hdr.op_src) {
+	case smr_src_inline:
+		unexp->buf = cmd->msg.data.msg;
+		ep->region->cmd_cnt++;
+		return;
+	case smr_src_inject:
+		unexp->buf = ofi_buf_alloc(ep->bounce_pool);
+		if (!unexp->buf)
+			break;
+		tx_buf = smr_get_ptr(ep->region, (size_t) cmd->msg.hdr.src_data);
+		memcpy(unexp->buf, tx_buf->data, cmd->msg.hdr.size);
+		smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
+		ep->region->cmd_cnt++;
+		return;
+	case smr_src_iov:
+	case smr_src_mmap:
+		/* the sender completes once the payload is copied out */
+		if (cmd->msg.hdr.size > smr_env.bounce_size ||
+		    cmd->msg.hdr.op_flags & SMR_DELIVERY_COMPLETE)
+			break;
+		unexp->buf = ofi_buf_alloc(ep->bounce_pool);
+		if (!unexp->buf)
+			break;
+		iov.iov_base = unexp->buf;
+		iov.iov_len = cmd->msg.hdr.size;
+		unexp->err = cmd->msg.hdr.op_src == smr_src_iov ?
+			     smr_progress_iov(cmd, &iov, 1, &total_len, ep, 0) :
+			     smr_progress_mmap(cmd, &iov, 1, &total_len, ep);
+		return;
+	default:
+		break;
 	}
-	return 0;
+
+	/* only push back once free commands are getting scarce */
+	if (++ep->unexp_pinned[cmd->msg.hdr.id] >= SMR_RNR_THRESHOLD &&
+	    ep->region->cmd_cnt < ep->rx_size / 2)
+		smr_peer_data(ep->region)[cmd->msg.hdr.id].rnr_status = 1;
+}
+
+static void smr_unexp_unpin(struct smr_ep *ep, int64_t id)
+{
+	/* the count is reset if the peer was removed from the AV */
+	if (!ep->unexp_pinned[id])
+		return;
+
+	if (--ep->unexp_pinned[id] < SMR_RNR_THRESHOLD)
+		smr_peer_data(ep->region)[id].rnr_status = 0;
 }
 
 static void smr_progress_connreq(struct smr_ep *ep, struct smr_cmd *cmd)
@@ -711,11 +826,12 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 					     recv_queue->match_func,
 					     &match_attr);
 	if (!dlist_entry) {
-		if (ofi_freestack_isempty(ep->unexp_fs))
+		unexp = ofi_buf_alloc(ep->unexp_pool);
+		if (!unexp)
 			return -FI_EAGAIN;
-		unexp = ofi_freestack_pop(ep->unexp_fs);
 		memcpy(&unexp->cmd, cmd, sizeof(*cmd));
 		ofi_cirque_discard(smr_cmd_queue(ep->region));
+		smr_unexp_bounce(ep, unexp);
 		if (cmd->msg.hdr.op == ofi_op_msg) {
 			dlist_insert_tail(&unexp->entry, &ep->unexp_msg_queue.list);
 		} else {
@@ -917,6 +1033,9 @@ static void smr_progress_cmd(struct smr_ep *ep)
 
 	while (!ofi_cirque_isempty(smr_cmd_queue(ep->region))) {
 		cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
+		OFI_TRACEPOINT(OFI_TRACE_SHM_CMD_BEGIN, cmd->msg.hdr.op,
+			       cmd->msg.hdr.op_src, cmd->msg.hdr.size,
+			       cmd->msg.hdr.msg_id);
 
 		switch (cmd->msg.hdr.op) {
 		case ofi_op_msg:
@@ -947,6 +1066,8 @@ static void smr_progress_cmd(struct smr_ep *ep)
 				"unidentified operation type\n");
 			ret = -FI_EINVAL;
 		}
+		OFI_TRACEPOINT(OFI_TRACE_SHM_CMD_END, cmd->msg.hdr.op,
+			       ret, 0, 0);
 		if (ret) {
 			if (ret != -FI_EAGAIN) {
 				FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -1015,7 +1136,10 @@ void smr_ep_progress(struct util_ep *util_ep)
 	ep = container_of(util_ep, struct smr_ep, util_ep);
 
 	smr_progress_resp(ep);
+
+	ofi_perf_region_start(OFI_PERF_SMR_PROGRESS_CMD);
 	smr_progress_cmd(ep);
+	ofi_perf_region_end(OFI_PERF_SMR_PROGRESS_CMD);
 
 	smr_progress_sar_list(ep);
 }
@@ -1042,8 +1166,13 @@ int smr_progress_unexp_queue(struct smr_ep *ep, struct smr_rx_entry *entry,
 	multi_recv = entry->flags & SMR_MULTI_RECV;
 	while (dlist_entry) {
 		unexp_msg = container_of(dlist_entry, struct smr_unexp_msg, entry);
-		ret = smr_progress_msg_common(ep, &unexp_msg->cmd, entry);
-		ofi_freestack_push(ep->unexp_fs, unexp_msg);
+		if (unexp_msg->buf) {
+			ret = smr_progress_unexp_bounce(ep, unexp_msg, entry);
+		} else {
+			smr_unexp_unpin(ep, unexp_msg->cmd.msg.hdr.id);
+			ret = smr_progress_msg_common(ep, &unexp_msg->cmd, entry);
+		}
+		ofi_buf_free(unexp_msg);
 		if (!multi_recv || ret)
 			break;
 
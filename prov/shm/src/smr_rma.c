@@ -107,6 +107,12 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 	assert(iov_count <= SMR_IOV_LIMIT);
 	assert(rma_count <= SMR_IOV_LIMIT);
 
+	if (op_flags & FI_TRIGGER) {
+		FI_WARN(&smr_prov, FI_LOG_EP_DATA,
+			"FI_TRIGGER not supported, use FI_QUEUE_WORK\n");
+		return -FI_ENOSYS;
+	}
+
 	domain = container_of(ep->util_ep.domain, struct smr_domain, util_domain);
 
 	id = smr_verify_peer(ep, addr);
@@ -200,7 +206,7 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 					smr_peer_data(ep->region)[id].sar_status = 1;
 				}
 			} else {
-				ret = smr_format_mmap(ep, cmd, iov, iov_count,
+				ret = smr_format_mmap(ep, id, cmd, iov, iov_count,
 						      total_len, pend, resp);
 			}
 			if (ret) {
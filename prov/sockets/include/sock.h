@@ -89,6 +89,8 @@
 #define SOCK_PE_POLL_TIMEOUT (100000)
 #define SOCK_PE_MAX_ENTRIES (128)
 #define SOCK_PE_WAITTIME (10)
+#define SOCK_PE_DEF_WORKERS (1)
+#define SOCK_PE_MAX_WORKERS (16)
 
 #define SOCK_EQ_DEF_SZ (1<<8)
 #define SOCK_CQ_DEF_SZ (1<<8)
@@ -194,11 +196,17 @@ struct sock_conn {
 	struct dlist_entry ep_entry;
 };
 
-struct sock_conn_map {
-	struct sock_conn *table;
+struct sock_conn_pollset {
 	ofi_epoll_t epoll_set;
 	void **epoll_ctxs;
 	int epoll_ctxs_sz;
+};
+
+struct sock_conn_map {
+	struct sock_conn *table;
+	/* one poll set per PE worker, indexed by sock_pe_worker_index() */
+	struct sock_conn_pollset *pollsets;
+	int num_pollsets;
 	int used;
 	int size;
 	fastlock_t lock;
@@ -650,7 +658,7 @@ struct sock_rx_ctx {
 	struct dlist_entry pe_entry;
 	struct dlist_entry cq_entry;
 
-	struct dlist_entry pe_entry_list;
+	struct dlist_entry pe_entry_list[SOCK_PE_MAX_WORKERS];
 	struct dlist_entry rx_entry_list;
 	struct dlist_entry rx_buffered_list;
 	struct dlist_entry ep_list;
@@ -691,9 +699,12 @@ struct sock_tx_ctx {
 	struct dlist_entry pe_entry;
 	struct dlist_entry cq_entry;
 
-	struct dlist_entry pe_entry_list;
+	struct dlist_entry pe_entry_list[SOCK_PE_MAX_WORKERS];
 	struct dlist_entry ep_list;
 
+	/* connection of the op being written, protected by rb_lock */
+	struct sock_conn *commit_conn;
+
 	struct fi_tx_attr attr;
 	fastlock_t lock;
 };
@@ -843,8 +854,10 @@ struct sock_pe_entry {
 	size_t cache_sz;
 };
 
-struct sock_pe {
+struct sock_pe_worker {
+	struct sock_pe *pe;
 	struct sock_domain *domain;
+	int idx;
 	int num_free_entries;
 	struct sock_pe_entry pe_table[SOCK_PE_MAX_ENTRIES];
 	fastlock_t lock;
@@ -860,15 +873,42 @@ struct sock_pe {
 	struct dlist_entry busy_list;
 	struct dlist_entry pool_list;
 
-	struct dlist_entry tx_list;
-	struct dlist_entry rx_list;
-
 	pthread_t progress_thread;
 	volatile int do_progress;
 	struct sock_pe_entry *pe_atomic;
 	ofi_epoll_t epoll_set;
 };
 
+/*
+ * The progress engine is split into workers.  Each connection is owned by
+ * one worker, selected by sock_pe_worker_index().  All socket I/O and
+ * pe_entry state for a connection is handled under its owner's lock, so
+ * workers only contend on the shared TX/RX contexts.  The context lists
+ * are shared by all workers; each worker's list_lock protects its walk, and
+ * updates take every worker's list_lock.
+ */
+struct sock_pe {
+	struct sock_domain *domain;
+	int num_workers;
+	struct sock_pe_worker *workers;
+	fastlock_t atomic_lock;
+
+	struct dlist_entry tx_list;
+	struct dlist_entry rx_list;
+};
+
+static inline int sock_pe_worker_index(int fd, int num_workers)
+{
+	return fd < 0 ? 0 : fd % num_workers;
+}
+
+static inline struct sock_pe_worker *
+sock_pe_conn_worker(struct sock_pe *pe, struct sock_conn *conn)
+{
+	return &pe->workers[sock_pe_worker_index(conn->sock_fd,
+						 pe->num_workers)];
+}
+
 typedef int (*sock_cq_report_fn) (struct sock_cq *cq, fi_addr_t addr,
 				  struct sock_pe_entry *pe_entry);
 
@@ -879,6 +919,19 @@ struct sock_cq_overflow_entry_t {
 	char cq_entry[];
 };
 
+/*
+ * Completion ring: a power-of-two array of slots, each holding the
+ * source address followed by one cq entry of the CQ's format.  Producers
+ * (PE workers and application threads reporting inline completions) are
+ * serialized by prod_lock and publish entries by advancing tail; readers
+ * consume under cons_lock by advancing head.  Neither side blocks the
+ * other.
+ */
+struct sock_cq_slot {
+	fi_addr_t src_addr;
+	char cq_entry[];
+};
+
 struct sock_cq {
 	struct fid_cq cq_fid;
 	struct sock_domain *domain;
@@ -886,11 +939,26 @@ struct sock_cq {
 	ofi_atomic32_t ref;
 	struct fi_cq_attr attr;
 
-	struct ofi_ringbuf addr_rb;
-	struct ofi_ringbuffd cq_rbfd;
-	struct ofi_ringbuf cqerr_rb;
+	char *ring;
+	size_t ring_mask;
+	size_t slot_size;
+	ofi_atomic64_t head;
+	ofi_atomic64_t tail;
+	fastlock_t prod_lock;
+	fastlock_t cons_lock;
 	struct dlist_entry overflow_list;
-	pthread_mutex_t lock;
+	ofi_atomic32_t overflow_cnt;
+
+	/*
+	 * The wait fd is only written while a thread is blocked in sread
+	 * (waiters) or once it has been handed to the application through
+	 * FI_GETWAIT (fd_exported).
+	 */
+	struct fd_signal wait_fd;
+	ofi_atomic32_t waiters;
+	ofi_atomic32_t fd_exported;
+
+	struct ofi_ringbuf cqerr_rb;
 	pthread_mutex_t list_lock;
 
 	struct fid_wait *waitset;
@@ -1052,6 +1120,7 @@ int sock_cq_report_error(struct sock_cq *cq, struct sock_pe_entry *entry,
 			 size_t olen, int err, int prov_errno, void *err_data,
 			 size_t err_data_size);
 int sock_cq_progress(struct sock_cq *cq);
+int sock_cq_ready(struct sock_cq *cq);
 void sock_cq_add_tx_ctx(struct sock_cq *cq, struct sock_tx_ctx *tx_ctx);
 void sock_cq_remove_tx_ctx(struct sock_cq *cq, struct sock_tx_ctx *tx_ctx);
 void sock_cq_add_rx_ctx(struct sock_cq *cq, struct sock_rx_ctx *rx_ctx);
@@ -1106,6 +1175,8 @@ void sock_tx_ctx_read_op_send(struct sock_tx_ctx *tx_ctx,
 		struct sock_op *op, uint64_t *flags, uint64_t *context,
 		uint64_t *dest_addr, uint64_t *buf, struct sock_ep_attr **ep_attr,
 		struct sock_conn **conn);
+void sock_tx_ctx_peek_op_send(struct sock_tx_ctx *tx_ctx, uint64_t *flags,
+		struct sock_conn **conn);
 
 int sock_poll_open(struct fid_domain *domain, struct fi_poll_attr *attr,
 		   struct fid_poll **pollset);
@@ -1143,6 +1214,11 @@ struct sock_pe *sock_pe_init(struct sock_domain *domain);
 void sock_pe_add_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *ctx);
 void sock_pe_add_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *ctx);
 void sock_pe_signal(struct sock_pe *pe);
+void sock_pe_signal_worker(struct sock_pe_worker *worker);
+void sock_pe_lock_lists(struct sock_pe *pe);
+void sock_pe_unlock_lists(struct sock_pe *pe);
+void sock_pe_lock_workers(struct sock_pe *pe);
+void sock_pe_unlock_workers(struct sock_pe *pe);
 void sock_pe_poll_add(struct sock_pe *pe, int fd);
 void sock_pe_poll_del(struct sock_pe *pe, int fd);
 
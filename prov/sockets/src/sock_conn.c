@@ -96,21 +96,32 @@ err:
 int sock_conn_map_init(struct sock_ep *ep, int init_size)
 {
 	struct sock_conn_map *map = &ep->attr->cmap;
-	int ret;
+	int i, ret;
+
 	map->table = calloc(init_size, sizeof(*map->table));
 	if (!map->table)
 		return -FI_ENOMEM;
 
-	map->epoll_ctxs = calloc(init_size, sizeof(*map->epoll_ctxs));
-	if (!map->epoll_ctxs)
+	map->num_pollsets = ep->attr->domain->pe->num_workers;
+	map->pollsets = calloc(map->num_pollsets, sizeof(*map->pollsets));
+	if (!map->pollsets)
 		goto err1;
 
-	ret = ofi_epoll_create(&map->epoll_set);
-	if (ret < 0) {
-		SOCK_LOG_ERROR("failed to create epoll set, "
-			       "error - %d (%s)\n", ret,
-			       strerror(ret));
-		goto err2;
+	for (i = 0; i < map->num_pollsets; i++) {
+		map->pollsets[i].epoll_ctxs =
+			calloc(init_size, sizeof(*map->pollsets[i].epoll_ctxs));
+		if (!map->pollsets[i].epoll_ctxs)
+			goto err2;
+
+		ret = ofi_epoll_create(&map->pollsets[i].epoll_set);
+		if (ret < 0) {
+			SOCK_LOG_ERROR("failed to create epoll set, "
+				       "error - %d (%s)\n", ret,
+				       strerror(ret));
+			free(map->pollsets[i].epoll_ctxs);
+			goto err2;
+		}
+		map->pollsets[i].epoll_ctxs_sz = init_size;
 	}
 
 	fastlock_init(&map->lock);
@@ -119,7 +130,11 @@ int sock_conn_map_init(struct sock_ep *ep, int init_size)
 	return 0;
 
 err2:
-	free(map->epoll_ctxs);
+	while (i--) {
+		ofi_epoll_close(map->pollsets[i].epoll_set);
+		free(map->pollsets[i].epoll_ctxs);
+	}
+	free(map->pollsets);
 err1:
 	free(map->table);
 	return -FI_ENOMEM;
@@ -153,17 +168,22 @@ void sock_conn_map_destroy(struct sock_ep_attr *ep_attr)
 	}
 	free(cmap->table);
 	cmap->table = NULL;
-	free(cmap->epoll_ctxs);
-	cmap->epoll_ctxs = NULL;
-	cmap->epoll_ctxs_sz = 0;
+	for (i = 0; i < cmap->num_pollsets; i++) {
+		ofi_epoll_close(cmap->pollsets[i].epoll_set);
+		free(cmap->pollsets[i].epoll_ctxs);
+	}
+	free(cmap->pollsets);
+	cmap->pollsets = NULL;
+	cmap->num_pollsets = 0;
 	cmap->used = cmap->size = 0;
-	ofi_epoll_close(cmap->epoll_set);
 	fastlock_destroy(&cmap->lock);
 }
 
 void sock_conn_release_entry(struct sock_conn_map *map, struct sock_conn *conn)
 {
-	ofi_epoll_del(map->epoll_set, conn->sock_fd);
+	int idx = sock_pe_worker_index(conn->sock_fd, map->num_pollsets);
+
+	ofi_epoll_del(map->pollsets[idx].epoll_set, conn->sock_fd);
 	ofi_close_socket(conn->sock_fd);
 
 	conn->address_published = 0;
@@ -188,6 +208,7 @@ static struct sock_conn *sock_conn_map_insert(struct sock_ep_attr *ep_attr,
 {
 	int index;
 	struct sock_conn_map *map = &ep_attr->cmap;
+	struct sock_conn_pollset *pollset;
 
 	if (map->size == map->used) {
 		index = sock_conn_get_next_index(map);
@@ -211,7 +232,10 @@ static struct sock_conn *sock_conn_map_insert(struct sock_ep_attr *ep_attr,
 	                  (ep_attr->ep_type == FI_EP_MSG ?
 	                   SOCK_OPTS_KEEPALIVE : 0));
 
-	if (ofi_epoll_add(map->epoll_set, conn_fd, OFI_EPOLL_IN, &map->table[index]))
+	pollset = &map->pollsets[sock_pe_worker_index(conn_fd,
+						      map->num_pollsets)];
+	if (ofi_epoll_add(pollset->epoll_set, conn_fd, OFI_EPOLL_IN,
+			  &map->table[index]))
 		SOCK_LOG_ERROR("failed to add to epoll set: %d\n", conn_fd);
 
 	map->table[index].address_published = addr_published;
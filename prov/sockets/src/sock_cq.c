@@ -170,14 +170,45 @@ static ssize_t sock_cq_entry_size(struct sock_cq *sock_cq)
 	return size;
 }
 
+static inline struct sock_cq_slot *sock_cq_slot(struct sock_cq *cq,
+					       uint64_t idx)
+{
+	return (struct sock_cq_slot *) (cq->ring +
+					(idx & cq->ring_mask) * cq->slot_size);
+}
+
+int sock_cq_ready(struct sock_cq *cq)
+{
+	return ofi_atomic_get64(&cq->tail) != ofi_atomic_get64(&cq->head) ||
+	       ofi_atomic_get32(&cq->overflow_cnt) ||
+	       ofi_rbused(&cq->cqerr_rb);
+}
+
+/*
+ * Called by producers after publishing entries.  The store to tail and
+ * the load of waiters pair with the increment of waiters and the ring
+ * check in sock_cq_wait, so either the waiter sees the new entry or we
+ * see the waiter.
+ */
+static inline void sock_cq_wake(struct sock_cq *cq)
+{
+	if (ofi_atomic_get32(&cq->waiters) ||
+	    ofi_atomic_get32(&cq->fd_exported))
+		fd_signal_set(&cq->wait_fd);
+}
+
 static ssize_t _sock_cq_write(struct sock_cq *cq, fi_addr_t addr,
 			      const void *buf, size_t len)
 {
 	ssize_t ret;
+	uint64_t tail;
+	struct sock_cq_slot *slot;
 	struct sock_cq_overflow_entry_t *overflow_entry;
 
-	pthread_mutex_lock(&cq->lock);
-	if (ofi_rbfdavail(&cq->cq_rbfd) < len) {
+	fastlock_acquire(&cq->prod_lock);
+	tail = ofi_atomic_get64(&cq->tail);
+	if (ofi_atomic_get32(&cq->overflow_cnt) ||
+	    tail - ofi_atomic_get64(&cq->head) > cq->ring_mask) {
 		SOCK_LOG_ERROR("Not enough space in CQ\n");
 		overflow_entry = calloc(1, sizeof(*overflow_entry) + len);
 		if (!overflow_entry) {
@@ -189,26 +220,23 @@ static ssize_t _sock_cq_write(struct sock_cq *cq, fi_addr_t addr,
 		overflow_entry->len = len;
 		overflow_entry->addr = addr;
 		dlist_insert_tail(&overflow_entry->entry, &cq->overflow_list);
+		ofi_atomic_inc32(&cq->overflow_cnt);
 		ret = len;
 		goto out;
 	}
 
-
-	ofi_rbwrite(&cq->addr_rb, &addr, sizeof(addr));
-	ofi_rbcommit(&cq->addr_rb);
-
-	ofi_rbfdwrite(&cq->cq_rbfd, buf, len);
-	if (cq->domain->progress_mode == FI_PROGRESS_MANUAL)
-		ofi_rbcommit(&cq->cq_rbfd.rb);
-	else
-		ofi_rbfdcommit(&cq->cq_rbfd);
+	slot = sock_cq_slot(cq, tail);
+	slot->src_addr = addr;
+	memcpy(slot->cq_entry, buf, len);
+	ofi_atomic_set64(&cq->tail, tail + 1);
+	sock_cq_wake(cq);
 
 	ret = len;
 
 	if (cq->signal)
 		sock_wait_signal(cq->waitset);
 out:
-	pthread_mutex_unlock(&cq->lock);
+	fastlock_release(&cq->prod_lock);
 	return ret;
 }
 
@@ -290,60 +318,89 @@ static void sock_cq_set_report_fn(struct sock_cq *sock_cq)
 	}
 }
 
-static inline void sock_cq_copy_overflow_list(struct sock_cq *cq, size_t count)
+/* Refill ring slots freed by a read; caller holds cons_lock */
+static void sock_cq_copy_overflow_list(struct sock_cq *cq)
 {
-	size_t i;
+	uint64_t tail;
+	struct sock_cq_slot *slot;
 	struct sock_cq_overflow_entry_t *overflow_entry;
 
-	for (i = 0; i < count && !dlist_empty(&cq->overflow_list); i++) {
+	fastlock_acquire(&cq->prod_lock);
+	tail = ofi_atomic_get64(&cq->tail);
+	while (!dlist_empty(&cq->overflow_list) &&
+	       tail - ofi_atomic_get64(&cq->head) <= cq->ring_mask) {
 		overflow_entry = container_of(cq->overflow_list.next,
 					      struct sock_cq_overflow_entry_t,
 					      entry);
-		ofi_rbwrite(&cq->addr_rb, &overflow_entry->addr, sizeof(fi_addr_t));
-		ofi_rbcommit(&cq->addr_rb);
-
-		ofi_rbfdwrite(&cq->cq_rbfd, &overflow_entry->cq_entry[0], overflow_entry->len);
-		if (cq->domain->progress_mode == FI_PROGRESS_MANUAL)
-			ofi_rbcommit(&cq->cq_rbfd.rb);
-		else
-			ofi_rbfdcommit(&cq->cq_rbfd);
+		slot = sock_cq_slot(cq, tail++);
+		slot->src_addr = overflow_entry->addr;
+		memcpy(slot->cq_entry, &overflow_entry->cq_entry[0],
+		       overflow_entry->len);
 
 		dlist_remove(&overflow_entry->entry);
+		ofi_atomic_dec32(&cq->overflow_cnt);
 		free(overflow_entry);
 	}
+	ofi_atomic_set64(&cq->tail, tail);
+	sock_cq_wake(cq);
+	fastlock_release(&cq->prod_lock);
 }
 
-static inline ssize_t sock_cq_rbuf_read(struct sock_cq *cq, void *buf,
-					size_t count, fi_addr_t *src_addr,
-					size_t cq_entry_len)
+static ssize_t sock_cq_ring_read(struct sock_cq *cq, void *buf,
+				 size_t count, fi_addr_t *src_addr)
 {
-	size_t i;
-	fi_addr_t addr;
+	size_t i, avail;
+	uint64_t head;
+	struct sock_cq_slot *slot;
+
+	fastlock_acquire(&cq->cons_lock);
+	head = ofi_atomic_get64(&cq->head);
+	avail = (size_t) (ofi_atomic_get64(&cq->tail) - head);
+	count = MIN(count, avail);
 
-	ofi_rbfdread(&cq->cq_rbfd, buf, cq_entry_len * count);
 	for (i = 0; i < count; i++) {
-		ofi_rbread(&cq->addr_rb, &addr, sizeof(addr));
+		slot = sock_cq_slot(cq, head + i);
+		memcpy((char *) buf + i * cq->cq_entry_size, slot->cq_entry,
+		       cq->cq_entry_size);
 		if (src_addr)
-			src_addr[i] = addr;
+			src_addr[i] = slot->src_addr;
 	}
-	sock_cq_copy_overflow_list(cq, count);
+	ofi_atomic_set64(&cq->head, head + count);
+
+	if (count && ofi_atomic_get32(&cq->overflow_cnt))
+		sock_cq_copy_overflow_list(cq);
+	fastlock_release(&cq->cons_lock);
 	return count;
 }
 
+/*
+ * Block until the ring has entries, the CQ is signaled or the timeout
+ * expires.  Registering as a waiter before re-checking the ring means a
+ * producer that publishes after the check will write the wait fd.
+ */
+static int sock_cq_wait(struct sock_cq *cq, int timeout)
+{
+	int ret = 0;
+
+	ofi_atomic_inc32(&cq->waiters);
+	fd_signal_reset(&cq->wait_fd);
+	if (sock_cq_ready(cq))
+		fd_signal_set(&cq->wait_fd);
+	else if (!ofi_atomic_get32(&cq->signaled))
+		ret = fd_signal_poll(&cq->wait_fd, timeout);
+	ofi_atomic_dec32(&cq->waiters);
+	return ret;
+}
+
 static ssize_t sock_cq_sreadfrom(struct fid_cq *cq, void *buf, size_t count,
 			fi_addr_t *src_addr, const void *cond, int timeout)
 {
-	int ret = 0;
+	ssize_t ret = 0;
 	size_t threshold;
 	struct sock_cq *sock_cq;
 	uint64_t start_ms;
-	ssize_t cq_entry_len, avail;
 
 	sock_cq = container_of(cq, struct sock_cq, cq_fid);
-	if (ofi_rbused(&sock_cq->cqerr_rb))
-		return -FI_EAVAIL;
-
-	cq_entry_len = sock_cq->cq_entry_size;
 	if (sock_cq->attr.wait_cond == FI_CQ_COND_THRESHOLD)
 		threshold = MIN((uintptr_t) cond, count);
 	else
@@ -351,62 +408,51 @@ static ssize_t sock_cq_sreadfrom(struct fid_cq *cq, void *buf, size_t count,
 
 	start_ms = (timeout >= 0) ? ofi_gettime_ms() : 0;
 
-	if (sock_cq->domain->progress_mode == FI_PROGRESS_MANUAL) {
-		while (1) {
-			sock_cq_progress(sock_cq);
-			pthread_mutex_lock(&sock_cq->lock);
-			avail = ofi_rbfdused(&sock_cq->cq_rbfd);
-			if (avail) {
-				ret = sock_cq_rbuf_read(sock_cq, buf,
-					MIN(threshold, (size_t)(avail / cq_entry_len)),
-					src_addr, cq_entry_len);
-			}
-			pthread_mutex_unlock(&sock_cq->lock);
-			if (ret)
-				return ret;
+	while (1) {
+		if (ofi_rbused(&sock_cq->cqerr_rb))
+			return -FI_EAVAIL;
 
-			if (timeout >= 0) {
-				timeout -= (int) (ofi_gettime_ms() - start_ms);
-				if (timeout <= 0)
-					return -FI_EAGAIN;
+		sock_cq_progress(sock_cq);
+		ret = sock_cq_ring_read(sock_cq, buf, threshold, src_addr);
+		if (ret)
+			return ret;
+
+		/*
+		 * The application may be polling the wait fd directly; clear
+		 * it once the ring is drained.  A completion may have slipped
+		 * in before the reset, so set it again if the ring is not
+		 * empty after all.
+		 */
+		if (ofi_atomic_get32(&sock_cq->fd_exported)) {
+			fd_signal_reset(&sock_cq->wait_fd);
+			if (sock_cq_ready(sock_cq)) {
+				fd_signal_set(&sock_cq->wait_fd);
+				ret = sock_cq_ring_read(sock_cq, buf, threshold,
+							src_addr);
+				if (ret)
+					return ret;
 			}
+		}
 
-			if (ofi_atomic_get32(&sock_cq->signaled)) {
-				ofi_atomic_set32(&sock_cq->signaled, 0);
-				return -FI_ECANCELED;
-			}
-		};
-	} else {
-		do {
-			pthread_mutex_lock(&sock_cq->lock);
-			ret = 0;
-			avail = ofi_rbfdused(&sock_cq->cq_rbfd);
-			if (avail) {
-				ret = sock_cq_rbuf_read(sock_cq, buf,
-					MIN(threshold, (size_t)(avail / cq_entry_len)),
-					src_addr, cq_entry_len);
-			} else {
-				ofi_rbfdreset(&sock_cq->cq_rbfd);
-			}
-			pthread_mutex_unlock(&sock_cq->lock);
-			if (ret && ret != -FI_EAGAIN)
-				return ret;
-
-			if (timeout >= 0) {
-				timeout -= (int) (ofi_gettime_ms() - start_ms);
-				if (timeout <= 0)
-					return -FI_EAGAIN;
-			}
+		if (timeout >= 0) {
+			timeout -= (int) (ofi_gettime_ms() - start_ms);
+			if (timeout <= 0)
+				return -FI_EAGAIN;
+		}
 
-			if (ofi_atomic_get32(&sock_cq->signaled)) {
-				ofi_atomic_set32(&sock_cq->signaled, 0);
-				return -FI_ECANCELED;
-			}
-			ret = ofi_rbfdwait(&sock_cq->cq_rbfd, timeout);
-		} while (ret > 0);
+		if (ofi_atomic_get32(&sock_cq->signaled)) {
+			ofi_atomic_set32(&sock_cq->signaled, 0);
+			return -FI_ECANCELED;
+		}
+
+		if (sock_cq->domain->progress_mode == FI_PROGRESS_AUTO) {
+			ret = sock_cq_wait(sock_cq, timeout);
+			if (ret)
+				break;
+		}
 	}
 
-	return (ret == 0 || ret == -FI_ETIMEDOUT || ret == -EINTR) ? -FI_EAGAIN : ret;
+	return (ret == -FI_ETIMEDOUT || ret == -FI_EINTR) ? -FI_EAGAIN : ret;
 }
 
 static ssize_t sock_cq_sread(struct fid_cq *cq, void *buf, size_t len,
@@ -440,7 +486,7 @@ static ssize_t sock_cq_readerr(struct fid_cq *cq, struct fi_cq_err_entry *buf,
 	if (sock_cq->domain->progress_mode == FI_PROGRESS_MANUAL)
 		sock_cq_progress(sock_cq);
 
-	pthread_mutex_lock(&sock_cq->lock);
+	fastlock_acquire(&sock_cq->prod_lock);
 	if (ofi_rbused(&sock_cq->cqerr_rb) >= sizeof(struct fi_cq_err_entry)) {
 		api_version = sock_cq->domain->fab->fab_fid.api_version;
 		ofi_rbread(&sock_cq->cqerr_rb, &entry, sizeof(entry));
@@ -463,7 +509,7 @@ static ssize_t sock_cq_readerr(struct fid_cq *cq, struct fi_cq_err_entry *buf,
 	} else {
 		ret = -FI_EAGAIN;
 	}
-	pthread_mutex_unlock(&sock_cq->lock);
+	fastlock_release(&sock_cq->prod_lock);
 	return ret;
 }
 
@@ -478,6 +524,7 @@ static const char *sock_cq_strerror(struct fid_cq *cq, int prov_errno,
 static int sock_cq_close(struct fid *fid)
 {
 	struct sock_cq *cq;
+	struct sock_cq_overflow_entry_t *overflow_entry;
 
 	cq = container_of(fid, struct sock_cq, cq_fid.fid);
 	if (ofi_atomic_get32(&cq->ref))
@@ -486,11 +533,20 @@ static int sock_cq_close(struct fid *fid)
 	if (cq->signal && cq->attr.wait_obj == FI_WAIT_MUTEX_COND)
 		sock_wait_close(&cq->waitset->fid);
 
-	ofi_rbfree(&cq->addr_rb);
+	while (!dlist_empty(&cq->overflow_list)) {
+		overflow_entry = container_of(cq->overflow_list.next,
+					      struct sock_cq_overflow_entry_t,
+					      entry);
+		dlist_remove(&overflow_entry->entry);
+		free(overflow_entry);
+	}
+
+	free(cq->ring);
 	ofi_rbfree(&cq->cqerr_rb);
-	ofi_rbfdfree(&cq->cq_rbfd);
+	fd_signal_free(&cq->wait_fd);
 
-	pthread_mutex_destroy(&cq->lock);
+	fastlock_destroy(&cq->prod_lock);
+	fastlock_destroy(&cq->cons_lock);
 	pthread_mutex_destroy(&cq->list_lock);
 	ofi_atomic_dec32(&cq->domain->ref);
 
@@ -504,9 +560,7 @@ static int sock_cq_signal(struct fid_cq *cq)
 	sock_cq = container_of(cq, struct sock_cq, cq_fid);
 
 	ofi_atomic_set32(&sock_cq->signaled, 1);
-	pthread_mutex_lock(&sock_cq->lock);
-	ofi_rbfdsignal(&sock_cq->cq_rbfd);
-	pthread_mutex_unlock(&sock_cq->lock);
+	fd_signal_set(&sock_cq->wait_fd);
 	return 0;
 }
 
@@ -536,7 +590,14 @@ static int sock_cq_control(struct fid *fid, int command, void *arg)
 		case FI_WAIT_NONE:
 		case FI_WAIT_FD:
 		case FI_WAIT_UNSPEC:
-			memcpy(arg, &cq->cq_rbfd.fd[OFI_RB_READ_FD], sizeof(int));
+			/*
+			 * From here on every completion must write the fd.
+			 * Set it once so entries queued before the export are
+			 * not missed.
+			 */
+			ofi_atomic_set32(&cq->fd_exported, 1);
+			fd_signal_set(&cq->wait_fd);
+			*(int *) arg = fd_signal_get(&cq->wait_fd);
 			break;
 
 		case FI_WAIT_SET:
@@ -631,6 +692,11 @@ int sock_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 
 	ofi_atomic_initialize32(&sock_cq->ref, 0);
 	ofi_atomic_initialize32(&sock_cq->signaled, 0);
+	ofi_atomic_initialize32(&sock_cq->waiters, 0);
+	ofi_atomic_initialize32(&sock_cq->fd_exported, 0);
+	ofi_atomic_initialize32(&sock_cq->overflow_cnt, 0);
+	ofi_atomic_initialize64(&sock_cq->head, 0);
+	ofi_atomic_initialize64(&sock_cq->tail, 0);
 	sock_cq->cq_fid.fid.fclass = FI_CLASS_CQ;
 	sock_cq->cq_fid.fid.context = context;
 	sock_cq->cq_fid.fid.ops = &sock_cq_fi_ops;
@@ -653,13 +719,16 @@ int sock_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	dlist_init(&sock_cq->ep_list);
 	dlist_init(&sock_cq->overflow_list);
 
-	ret = ofi_rbfdinit(&sock_cq->cq_rbfd, sock_cq->attr.size *
-			sock_cq->cq_entry_size);
-	if (ret)
+	sock_cq->slot_size = sizeof(struct sock_cq_slot) +
+			     sock_cq->cq_entry_size;
+	sock_cq->ring_mask = roundup_power_of_two(sock_cq->attr.size) - 1;
+	sock_cq->ring = calloc(sock_cq->ring_mask + 1, sock_cq->slot_size);
+	if (!sock_cq->ring) {
+		ret = -FI_ENOMEM;
 		goto err1;
+	}
 
-	ret = ofi_rbinit(&sock_cq->addr_rb,
-			sock_cq->attr.size * sizeof(fi_addr_t));
+	ret = fd_signal_init(&sock_cq->wait_fd);
 	if (ret)
 		goto err2;
 
@@ -668,7 +737,8 @@ int sock_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	if (ret)
 		goto err3;
 
-	pthread_mutex_init(&sock_cq->lock, NULL);
+	fastlock_init(&sock_cq->prod_lock);
+	fastlock_init(&sock_cq->cons_lock);
 
 	switch (sock_cq->attr.wait_obj) {
 	case FI_WAIT_NONE:
@@ -718,11 +788,13 @@ int sock_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	return 0;
 
 err4:
+	fastlock_destroy(&sock_cq->prod_lock);
+	fastlock_destroy(&sock_cq->cons_lock);
 	ofi_rbfree(&sock_cq->cqerr_rb);
 err3:
-	ofi_rbfree(&sock_cq->addr_rb);
+	fd_signal_free(&sock_cq->wait_fd);
 err2:
-	ofi_rbfdfree(&sock_cq->cq_rbfd);
+	free(sock_cq->ring);
 err1:
 	free(sock_cq);
 	return ret;
@@ -735,7 +807,7 @@ int sock_cq_report_error(struct sock_cq *cq, struct sock_pe_entry *entry,
 	int ret;
 	struct fi_cq_err_entry err_entry;
 
-	pthread_mutex_lock(&cq->lock);
+	fastlock_acquire(&cq->prod_lock);
 	if (ofi_rbavail(&cq->cqerr_rb) < sizeof(err_entry)) {
 		ret = -FI_ENOSPC;
 		goto out;
@@ -761,9 +833,9 @@ int sock_cq_report_error(struct sock_cq *cq, struct sock_pe_entry *entry,
 	ofi_rbcommit(&cq->cqerr_rb);
 	ret = 0;
 
-	ofi_rbfdsignal(&cq->cq_rbfd);
+	fd_signal_set(&cq->wait_fd);
 
 out:
-	pthread_mutex_unlock(&cq->lock);
+	fastlock_release(&cq->prod_lock);
 	return ret;
 }
@@ -45,6 +45,8 @@ struct sock_rx_ctx *sock_rx_ctx_alloc(const struct fi_rx_attr *attr,
 				      void *context, int use_shared)
 {
 	struct sock_rx_ctx *rx_ctx;
+	int i;
+
 	rx_ctx = calloc(1, sizeof(*rx_ctx));
 	if (!rx_ctx)
 		return NULL;
@@ -52,7 +54,8 @@ struct sock_rx_ctx *sock_rx_ctx_alloc(const struct fi_rx_attr *attr,
 	dlist_init(&rx_ctx->cq_entry);
 	dlist_init(&rx_ctx->pe_entry);
 
-	dlist_init(&rx_ctx->pe_entry_list);
+	for (i = 0; i < SOCK_PE_MAX_WORKERS; i++)
+		dlist_init(&rx_ctx->pe_entry_list[i]);
 	dlist_init(&rx_ctx->rx_entry_list);
 	dlist_init(&rx_ctx->rx_buffered_list);
 	dlist_init(&rx_ctx->ep_list);
@@ -91,6 +94,7 @@ static struct sock_tx_ctx *sock_tx_context_alloc(const struct fi_tx_attr *attr,
 {
 	struct sock_tx_ctx *tx_ctx;
 	struct fi_rx_attr rx_attr = {0};
+	int i;
 
 	tx_ctx = calloc(sizeof(*tx_ctx), 1);
 	if (!tx_ctx)
@@ -104,7 +108,8 @@ static struct sock_tx_ctx *sock_tx_context_alloc(const struct fi_tx_attr *attr,
 	dlist_init(&tx_ctx->cq_entry);
 	dlist_init(&tx_ctx->pe_entry);
 
-	dlist_init(&tx_ctx->pe_entry_list);
+	for (i = 0; i < SOCK_PE_MAX_WORKERS; i++)
+		dlist_init(&tx_ctx->pe_entry_list[i]);
 	dlist_init(&tx_ctx->ep_list);
 
 	fastlock_init(&tx_ctx->rb_lock);
@@ -179,7 +184,12 @@ void sock_tx_ctx_write(struct sock_tx_ctx *tx_ctx, const void *buf, size_t len)
 void sock_tx_ctx_commit(struct sock_tx_ctx *tx_ctx)
 {
 	ofi_rbcommit(&tx_ctx->rb);
-	sock_pe_signal(tx_ctx->domain->pe);
+	if (tx_ctx->commit_conn)
+		sock_pe_signal_worker(sock_pe_conn_worker(tx_ctx->domain->pe,
+							  tx_ctx->commit_conn));
+	else
+		sock_pe_signal(tx_ctx->domain->pe);
+	tx_ctx->commit_conn = NULL;
 	fastlock_release(&tx_ctx->rb_lock);
 }
 
@@ -201,6 +211,7 @@ void sock_tx_ctx_write_op_send(struct sock_tx_ctx *tx_ctx,
 	sock_tx_ctx_write(tx_ctx, &buf, sizeof(buf));
 	sock_tx_ctx_write(tx_ctx, &ep_attr, sizeof(ep_attr));
 	sock_tx_ctx_write(tx_ctx, &conn, sizeof(conn));
+	tx_ctx->commit_conn = conn;
 }
 
 void sock_tx_ctx_write_op_tsend(struct sock_tx_ctx *tx_ctx,
@@ -226,3 +237,17 @@ void sock_tx_ctx_read_op_send(struct sock_tx_ctx *tx_ctx,
 	ofi_rbread(&tx_ctx->rb, ep_attr, sizeof(*ep_attr));
 	ofi_rbread(&tx_ctx->rb, conn, sizeof(*conn));
 }
+
+/* Returns the flags and connection of the next op without consuming it */
+void sock_tx_ctx_peek_op_send(struct sock_tx_ctx *tx_ctx, uint64_t *flags,
+		struct sock_conn **conn)
+{
+	char hdr[sizeof(struct sock_op) + 4 * sizeof(uint64_t) +
+		 sizeof(struct sock_ep_attr *) + sizeof(struct sock_conn *)];
+	size_t flags_off = sizeof(struct sock_op);
+	size_t conn_off = sizeof(hdr) - sizeof(*conn);
+
+	ofi_rbpeek(&tx_ctx->rb, hdr, sizeof(hdr));
+	memcpy(flags, hdr + flags_off, sizeof(*flags));
+	memcpy(conn, hdr + conn_off, sizeof(*conn));
+}
@@ -664,7 +664,7 @@ static int sock_ep_close(struct fid *fid)
 		fastlock_release(&sock_ep->attr->av->list_lock);
 	}
 
-	pthread_mutex_lock(&sock_ep->attr->domain->pe->list_lock);
+	sock_pe_lock_lists(sock_ep->attr->domain->pe);
 	if (sock_ep->attr->tx_shared) {
 		fastlock_acquire(&sock_ep->attr->tx_ctx->lock);
 		dlist_remove(&sock_ep->attr->tx_ctx_entry);
@@ -676,7 +676,7 @@ static int sock_ep_close(struct fid *fid)
 		dlist_remove(&sock_ep->attr->rx_ctx_entry);
 		fastlock_release(&sock_ep->attr->rx_ctx->lock);
 	}
-	pthread_mutex_unlock(&sock_ep->attr->domain->pe->list_lock);
+	sock_pe_unlock_lists(sock_ep->attr->domain->pe);
 
 	if (sock_ep->attr->conn_handle.do_listen) {
 		fastlock_acquire(&sock_ep->attr->domain->conn_listener.signal_lock);
@@ -725,10 +725,10 @@ static int sock_ep_close(struct fid *fid)
 	if (sock_ep->attr->dest_addr)
 		free(sock_ep->attr->dest_addr);
 
-	fastlock_acquire(&sock_ep->attr->domain->pe->lock);
+	sock_pe_lock_workers(sock_ep->attr->domain->pe);
 	ofi_idm_reset(&sock_ep->attr->av_idm, NULL);
 	sock_conn_map_destroy(sock_ep->attr);
-	fastlock_release(&sock_ep->attr->domain->pe->lock);
+	sock_pe_unlock_workers(sock_ep->attr->domain->pe);
 
 	ofi_atomic_dec32(&sock_ep->attr->domain->ref);
 	fastlock_destroy(&sock_ep->attr->lock);
@@ -49,6 +49,7 @@
 #define SOCK_LOG_ERROR(...) _SOCK_LOG_ERROR(FI_LOG_FABRIC, __VA_ARGS__)
 
 int sock_pe_waittime = SOCK_PE_WAITTIME;
+int sock_pe_workers = SOCK_PE_DEF_WORKERS;
 const char sock_fab_name[] = "IP";
 const char sock_dom_name[] = "sockets";
 const char sock_prov_name[] = "sockets";
@@ -232,6 +233,11 @@ static void sock_read_default_params()
 {
 	if (!read_default_params) {
 		fi_param_get_int(&sock_prov, "pe_waittime", &sock_pe_waittime);
+		fi_param_get_int(&sock_prov, "pe_workers", &sock_pe_workers);
+		if (sock_pe_workers < 1)
+			sock_pe_workers = 1;
+		if (sock_pe_workers > SOCK_PE_MAX_WORKERS)
+			sock_pe_workers = SOCK_PE_MAX_WORKERS;
 		fi_param_get_int(&sock_prov, "conn_timeout", &sock_conn_timeout);
 		fi_param_get_int(&sock_prov, "max_conn_retry", &sock_conn_retry);
 		fi_param_get_int(&sock_prov, "def_conn_map_sz", &sock_cm_def_map_sz);
@@ -345,6 +351,11 @@ SOCKETS_INI
 	fi_param_define(&sock_prov, "pe_waittime", FI_PARAM_INT,
 			"How many milliseconds to spin while waiting for progress");
 
+	fi_param_define(&sock_prov, "pe_workers", FI_PARAM_INT,
+			"Number of progress engine workers per domain. Connections "
+			"are spread across workers, each with its own progress "
+			"thread and entry table (default: 1, max: 16)");
+
 	fi_param_define(&sock_prov, "conn_timeout", FI_PARAM_INT,
 			"How many milliseconds to wait for one connection establishment");
 
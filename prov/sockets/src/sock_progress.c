@@ -148,7 +148,7 @@ static inline void sock_pe_discard_field(struct sock_pe_entry *pe_entry)
 	}
 }
 
-static void sock_pe_release_entry(struct sock_pe *pe,
+static void sock_pe_release_entry(struct sock_pe_worker *pe,
 				  struct sock_pe_entry *pe_entry)
 {
 	assert((pe_entry->type != SOCK_PE_RX) ||
@@ -200,7 +200,7 @@ static void sock_pe_release_entry(struct sock_pe *pe,
 	SOCK_LOG_DBG("progress entry %p released\n", pe_entry);
 }
 
-static struct sock_pe_entry *sock_pe_acquire_entry(struct sock_pe *pe)
+static struct sock_pe_entry *sock_pe_acquire_entry(struct sock_pe_worker *pe)
 {
 	struct dlist_entry *entry;
 	struct sock_pe_entry *pe_entry;
@@ -460,7 +460,7 @@ static void sock_pe_report_tx_rma_write_err(struct sock_pe_entry *pe_entry,
 	pe_entry->completion_reported = 1;
 }
 
-static void sock_pe_progress_pending_ack(struct sock_pe *pe,
+static void sock_pe_progress_pending_ack(struct sock_pe_worker *pe,
 					 struct sock_pe_entry *pe_entry)
 {
 	int len, data_len, i;
@@ -522,7 +522,7 @@ static void sock_pe_progress_pending_ack(struct sock_pe *pe,
 	}
 }
 
-static void sock_pe_send_response(struct sock_pe *pe,
+static void sock_pe_send_response(struct sock_pe_worker *pe,
 				  struct sock_rx_ctx *rx_ctx,
 				  struct sock_pe_entry *pe_entry,
 				  size_t data_len, uint8_t op_type, int err)
@@ -568,7 +568,7 @@ static inline int sock_pe_read_response(struct sock_pe_entry *pe_entry)
 	return 0;
 }
 
-static int sock_pe_handle_ack(struct sock_pe *pe,
+static int sock_pe_handle_ack(struct sock_pe_worker *pe,
 			struct sock_pe_entry *pe_entry)
 {
 	struct sock_pe_entry *waiting_entry;
@@ -590,7 +590,7 @@ static int sock_pe_handle_ack(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_handle_error(struct sock_pe *pe,
+static int sock_pe_handle_error(struct sock_pe_worker *pe,
 				struct sock_pe_entry *pe_entry)
 {
 	struct sock_pe_entry *waiting_entry;
@@ -625,7 +625,7 @@ static int sock_pe_handle_error(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_handle_read_complete(struct sock_pe *pe,
+static int sock_pe_handle_read_complete(struct sock_pe_worker *pe,
 					struct sock_pe_entry *pe_entry)
 {
 	struct sock_pe_entry *waiting_entry;
@@ -660,7 +660,7 @@ static int sock_pe_handle_read_complete(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_handle_write_complete(struct sock_pe *pe,
+static int sock_pe_handle_write_complete(struct sock_pe_worker *pe,
 					struct sock_pe_entry *pe_entry)
 {
 	struct sock_pe_entry *waiting_entry;
@@ -682,7 +682,7 @@ static int sock_pe_handle_write_complete(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_handle_atomic_complete(struct sock_pe *pe,
+static int sock_pe_handle_atomic_complete(struct sock_pe_worker *pe,
 					  struct sock_pe_entry *pe_entry)
 {
 	size_t datatype_sz;
@@ -724,7 +724,7 @@ static int sock_pe_handle_atomic_complete(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_process_rx_read(struct sock_pe *pe,
+static int sock_pe_process_rx_read(struct sock_pe_worker *pe,
 					struct sock_rx_ctx *rx_ctx,
 					struct sock_pe_entry *pe_entry)
 {
@@ -775,7 +775,7 @@ static int sock_pe_process_rx_read(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_process_rx_write(struct sock_pe *pe,
+static int sock_pe_process_rx_write(struct sock_pe_worker *pe,
 					struct sock_rx_ctx *rx_ctx,
 					struct sock_pe_entry *pe_entry)
 {
@@ -877,7 +877,7 @@ static void sock_pe_do_atomic(void *cmp, void *dst, void *src,
 	}
 }
 
-static int sock_pe_recv_atomic_hdrs(struct sock_pe *pe,
+static int sock_pe_recv_atomic_hdrs(struct sock_pe_worker *pe,
 				    struct sock_pe_entry *pe_entry,
 				    size_t *datatype_sz, uint64_t *entry_len)
 {
@@ -938,7 +938,7 @@ static int sock_pe_recv_atomic_hdrs(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_process_rx_atomic(struct sock_pe *pe,
+static int sock_pe_process_rx_atomic(struct sock_pe_worker *pe,
 				struct sock_rx_ctx *rx_ctx,
 				struct sock_pe_entry *pe_entry)
 {
@@ -978,6 +978,8 @@ static int sock_pe_process_rx_atomic(struct sock_pe *pe,
 		pe->pe_atomic = pe_entry;
 	}
 
+	/* other workers may target the same memory */
+	fastlock_acquire(&pe->pe->atomic_lock);
 	offset = 0;
 	for (i = 0; i < pe_entry->pe.rx.rx_op.dest_iov_len; i++) {
 		sock_pe_do_atomic(pe_entry->pe.rx.atomic_cmp + offset,
@@ -989,6 +991,7 @@ static int sock_pe_process_rx_atomic(struct sock_pe *pe,
 			pe_entry->pe.rx.rx_op.atomic.res_iov_len);
 		offset += datatype_sz * pe_entry->pe.rx.rx_iov[i].ioc.count;
 	}
+	fastlock_release(&pe->pe->atomic_lock);
 
 	pe_entry->buf = pe_entry->pe.rx.rx_iov[0].iov.addr;
 	pe_entry->data_len = offset;
@@ -1016,7 +1019,7 @@ static int sock_pe_process_rx_atomic(struct sock_pe *pe,
  * atomic fetch operations.
  */
 static int
-sock_pe_process_rx_tatomic(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
+sock_pe_process_rx_tatomic(struct sock_pe_worker *pe, struct sock_rx_ctx *rx_ctx,
 			   struct sock_pe_entry *pe_entry)
 {
 	int ret = 0;
@@ -1316,7 +1319,7 @@ static int sock_pe_progress_buffered_rx(struct sock_rx_ctx *rx_ctx,
 	return 0;
 }
 
-static int sock_pe_process_rx_send(struct sock_pe *pe,
+static int sock_pe_process_rx_send(struct sock_pe_worker *pe,
 				struct sock_rx_ctx *rx_ctx,
 				struct sock_pe_entry *pe_entry)
 {
@@ -1468,7 +1471,7 @@ out:
 	return ret;
 }
 
-static int sock_pe_process_rx_conn_msg(struct sock_pe *pe,
+static int sock_pe_process_rx_conn_msg(struct sock_pe_worker *pe,
 					struct sock_rx_ctx *rx_ctx,
 					struct sock_pe_entry *pe_entry)
 {
@@ -1516,7 +1519,7 @@ static int sock_pe_process_rx_conn_msg(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_process_recv(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
+static int sock_pe_process_recv(struct sock_pe_worker *pe, struct sock_rx_ctx *rx_ctx,
 				struct sock_pe_entry *pe_entry)
 {
 	int ret;
@@ -1576,7 +1579,7 @@ out:
 	return ret;
 }
 
-static int sock_pe_peek_hdr(struct sock_pe *pe,
+static int sock_pe_peek_hdr(struct sock_pe_worker *pe,
 			     struct sock_pe_entry *pe_entry)
 {
 	int len;
@@ -1605,7 +1608,7 @@ static int sock_pe_peek_hdr(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_read_hdr(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
+static int sock_pe_read_hdr(struct sock_pe_worker *pe, struct sock_rx_ctx *rx_ctx,
 			     struct sock_pe_entry *pe_entry)
 {
 	struct sock_msg_hdr *msg_hdr;
@@ -1646,7 +1649,7 @@ static int sock_pe_read_hdr(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 	return 0;
 }
 
-static int sock_pe_progress_tx_atomic(struct sock_pe *pe,
+static int sock_pe_progress_tx_atomic(struct sock_pe_worker *pe,
 				      struct sock_pe_entry *pe_entry,
 				      struct sock_conn *conn)
 {
@@ -1738,7 +1741,7 @@ static int sock_pe_progress_tx_atomic(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_progress_tx_write(struct sock_pe *pe,
+static int sock_pe_progress_tx_write(struct sock_pe_worker *pe,
 				     struct sock_pe_entry *pe_entry,
 				     struct sock_conn *conn)
 {
@@ -1801,7 +1804,7 @@ static int sock_pe_progress_tx_write(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_progress_tx_read(struct sock_pe *pe,
+static int sock_pe_progress_tx_read(struct sock_pe_worker *pe,
 				    struct sock_pe_entry *pe_entry,
 				    struct sock_conn *conn)
 {
@@ -1842,7 +1845,7 @@ static int sock_pe_progress_tx_read(struct sock_pe *pe,
 }
 
 
-static int sock_pe_progress_tx_send(struct sock_pe *pe,
+static int sock_pe_progress_tx_send(struct sock_pe_worker *pe,
 				    struct sock_pe_entry *pe_entry,
 				    struct sock_conn *conn)
 {
@@ -1907,7 +1910,7 @@ static int sock_pe_progress_tx_send(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_progress_tx_conn_msg(struct sock_pe *pe,
+static int sock_pe_progress_tx_conn_msg(struct sock_pe_worker *pe,
 					struct sock_pe_entry *pe_entry,
 					struct sock_conn *conn)
 {
@@ -1936,7 +1939,7 @@ static int sock_pe_progress_tx_conn_msg(struct sock_pe *pe,
 	return 0;
 }
 
-static int sock_pe_progress_tx_entry(struct sock_pe *pe,
+static int sock_pe_progress_tx_entry(struct sock_pe_worker *pe,
 				     struct sock_tx_ctx *tx_ctx,
 				     struct sock_pe_entry *pe_entry)
 {
@@ -1975,7 +1978,7 @@ static int sock_pe_progress_tx_entry(struct sock_pe *pe,
 	}
 
 	if ((pe_entry->flags & FI_FENCE) &&
-	    (tx_ctx->pe_entry_list.next != &pe_entry->ctx_entry)) {
+	    (tx_ctx->pe_entry_list[pe->idx].next != &pe_entry->ctx_entry)) {
 		SOCK_LOG_DBG("Waiting for FI_FENCE\n");
 		goto out;
 	}
@@ -2018,7 +2021,7 @@ out:
 	return ret;
 }
 
-static int sock_pe_progress_rx_pe_entry(struct sock_pe *pe,
+static int sock_pe_progress_rx_pe_entry(struct sock_pe_worker *pe,
 					struct sock_pe_entry *pe_entry,
 					struct sock_rx_ctx *rx_ctx)
 {
@@ -2071,7 +2074,7 @@ out:
 	return 0;
 }
 
-static void sock_pe_new_rx_entry(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
+static void sock_pe_new_rx_entry(struct sock_pe_worker *pe, struct sock_rx_ctx *rx_ctx,
 				struct sock_ep_attr *ep_attr, struct sock_conn *conn)
 {
 	struct sock_pe_entry *pe_entry;
@@ -2104,10 +2107,10 @@ static void sock_pe_new_rx_entry(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 	SOCK_LOG_DBG("Inserting rx_entry to PE entry %p, conn: %p\n",
 		      pe_entry, pe_entry->conn);
 
-	dlist_insert_tail(&pe_entry->ctx_entry, &rx_ctx->pe_entry_list);
+	dlist_insert_tail(&pe_entry->ctx_entry, &rx_ctx->pe_entry_list[pe->idx]);
 }
 
-static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
+static int sock_pe_new_tx_entry(struct sock_pe_worker *pe, struct sock_tx_ctx *tx_ctx)
 {
 	int i, datatype_sz;
 	struct sock_msg_hdr *msg_hdr;
@@ -2126,7 +2129,7 @@ static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 	pe_entry->pe.tx.tx_ctx = tx_ctx;
 	pe_entry->completion_reported = 0;
 
-	dlist_insert_tail(&pe_entry->ctx_entry, &tx_ctx->pe_entry_list);
+	dlist_insert_tail(&pe_entry->ctx_entry, &tx_ctx->pe_entry_list[pe->idx]);
 
 	/* fill in PE tx entry */
 	msg_hdr = &pe_entry->msg_hdr;
@@ -2280,43 +2283,89 @@ static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 	return sock_pe_progress_tx_entry(pe, tx_ctx, pe_entry);
 }
 
-void sock_pe_signal(struct sock_pe *pe)
+void sock_pe_signal_worker(struct sock_pe_worker *worker)
 {
 	char c = 0;
-	if (pe->domain->progress_mode != FI_PROGRESS_AUTO)
+	if (worker->domain->progress_mode != FI_PROGRESS_AUTO)
 		return;
 
-	fastlock_acquire(&pe->signal_lock);
-	if (pe->wcnt == pe->rcnt) {
-		if (ofi_write_socket(pe->signal_fds[SOCK_SIGNAL_WR_FD], &c, 1) != 1)
+	fastlock_acquire(&worker->signal_lock);
+	if (worker->wcnt == worker->rcnt) {
+		if (ofi_write_socket(worker->signal_fds[SOCK_SIGNAL_WR_FD], &c, 1) != 1)
 			SOCK_LOG_ERROR("Failed to signal\n");
 		else
-			pe->wcnt++;
+			worker->wcnt++;
 	}
-	fastlock_release(&pe->signal_lock);
+	fastlock_release(&worker->signal_lock);
+}
+
+void sock_pe_signal(struct sock_pe *pe)
+{
+	int i;
+
+	for (i = 0; i < pe->num_workers; i++)
+		sock_pe_signal_worker(&pe->workers[i]);
+}
+
+void sock_pe_lock_lists(struct sock_pe *pe)
+{
+	int i;
+
+	for (i = 0; i < pe->num_workers; i++)
+		pthread_mutex_lock(&pe->workers[i].list_lock);
+}
+
+void sock_pe_unlock_lists(struct sock_pe *pe)
+{
+	int i;
+
+	for (i = pe->num_workers - 1; i >= 0; i--)
+		pthread_mutex_unlock(&pe->workers[i].list_lock);
+}
+
+void sock_pe_lock_workers(struct sock_pe *pe)
+{
+	int i;
+
+	for (i = 0; i < pe->num_workers; i++)
+		fastlock_acquire(&pe->workers[i].lock);
+}
+
+void sock_pe_unlock_workers(struct sock_pe *pe)
+{
+	int i;
+
+	for (i = pe->num_workers - 1; i >= 0; i--)
+		fastlock_release(&pe->workers[i].lock);
 }
 
 void sock_pe_poll_add(struct sock_pe *pe, int fd)
 {
-        fastlock_acquire(&pe->signal_lock);
-        if (ofi_epoll_add(pe->epoll_set, fd, OFI_EPOLL_IN, NULL))
-			SOCK_LOG_ERROR("failed to add to epoll set: %d\n", fd);
-        fastlock_release(&pe->signal_lock);
+	struct sock_pe_worker *worker;
+
+	worker = &pe->workers[sock_pe_worker_index(fd, pe->num_workers)];
+	fastlock_acquire(&worker->signal_lock);
+	if (ofi_epoll_add(worker->epoll_set, fd, OFI_EPOLL_IN, NULL))
+		SOCK_LOG_ERROR("failed to add to epoll set: %d\n", fd);
+	fastlock_release(&worker->signal_lock);
 }
 
 void sock_pe_poll_del(struct sock_pe *pe, int fd)
 {
-        fastlock_acquire(&pe->signal_lock);
-        if (ofi_epoll_del(pe->epoll_set, fd))
-			SOCK_LOG_DBG("failed to del from epoll set: %d\n", fd);
-        fastlock_release(&pe->signal_lock);
+	struct sock_pe_worker *worker;
+
+	worker = &pe->workers[sock_pe_worker_index(fd, pe->num_workers)];
+	fastlock_acquire(&worker->signal_lock);
+	if (ofi_epoll_del(worker->epoll_set, fd))
+		SOCK_LOG_DBG("failed to del from epoll set: %d\n", fd);
+	fastlock_release(&worker->signal_lock);
 }
 
 void sock_pe_add_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *ctx)
 {
 	struct dlist_entry *entry;
 	struct sock_tx_ctx *curr_ctx;
-	pthread_mutex_lock(&pe->list_lock);
+	sock_pe_lock_lists(pe);
 	for (entry = pe->tx_list.next; entry != &pe->tx_list;
 	     entry = entry->next) {
 		curr_ctx = container_of(entry, struct sock_tx_ctx, pe_entry);
@@ -2327,7 +2376,7 @@ void sock_pe_add_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *ctx)
 	dlist_insert_tail(&ctx->pe_entry, &pe->tx_list);
 	sock_pe_signal(pe);
 out:
-	pthread_mutex_unlock(&pe->list_lock);
+	sock_pe_unlock_lists(pe);
 	SOCK_LOG_DBG("TX ctx added to PE\n");
 }
 
@@ -2335,7 +2384,7 @@ void sock_pe_add_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *ctx)
 {
 	struct dlist_entry *entry;
 	struct sock_rx_ctx *curr_ctx;
-	pthread_mutex_lock(&pe->list_lock);
+	sock_pe_lock_lists(pe);
 	for (entry = pe->rx_list.next; entry != &pe->rx_list;
 	     entry = entry->next) {
 		curr_ctx = container_of(entry, struct sock_rx_ctx, pe_entry);
@@ -2345,51 +2394,53 @@ void sock_pe_add_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *ctx)
 	dlist_insert_tail(&ctx->pe_entry, &pe->rx_list);
 	sock_pe_signal(pe);
 out:
-	pthread_mutex_unlock(&pe->list_lock);
+	sock_pe_unlock_lists(pe);
 	SOCK_LOG_DBG("RX ctx added to PE\n");
 }
 
 void sock_pe_remove_tx_ctx(struct sock_tx_ctx *tx_ctx)
 {
-	pthread_mutex_lock(&tx_ctx->domain->pe->list_lock);
+	sock_pe_lock_lists(tx_ctx->domain->pe);
 	dlist_remove(&tx_ctx->pe_entry);
-	pthread_mutex_unlock(&tx_ctx->domain->pe->list_lock);
+	sock_pe_unlock_lists(tx_ctx->domain->pe);
 }
 
 void sock_pe_remove_rx_ctx(struct sock_rx_ctx *rx_ctx)
 {
-	pthread_mutex_lock(&rx_ctx->domain->pe->list_lock);
+	sock_pe_lock_lists(rx_ctx->domain->pe);
 	dlist_remove(&rx_ctx->pe_entry);
-	pthread_mutex_unlock(&rx_ctx->domain->pe->list_lock);
+	sock_pe_unlock_lists(rx_ctx->domain->pe);
 }
 
-static int sock_pe_progress_rx_ep(struct sock_pe *pe,
+static int sock_pe_progress_rx_ep(struct sock_pe_worker *pe,
 				  struct sock_ep_attr *ep_attr,
 				  struct sock_rx_ctx *rx_ctx)
 {
 	int i, num_fds;
 	struct sock_conn *conn;
 	struct sock_conn_map *map;
+	struct sock_conn_pollset *pollset;
 
 	map = &ep_attr->cmap;
 
 	if (!map->used)
 		return 0;
 
-	if (map->epoll_ctxs_sz < map->used) {
+	pollset = &map->pollsets[pe->idx];
+	if (pollset->epoll_ctxs_sz < map->used) {
 		uint64_t new_size = map->used * 2;
 		void *ctxs;
 
-		ctxs = realloc(map->epoll_ctxs,
-			       sizeof(*map->epoll_ctxs) * new_size);
+		ctxs = realloc(pollset->epoll_ctxs,
+			       sizeof(*pollset->epoll_ctxs) * new_size);
 		if (ctxs) {
-			map->epoll_ctxs = ctxs;
-			map->epoll_ctxs_sz = new_size;
+			pollset->epoll_ctxs = ctxs;
+			pollset->epoll_ctxs_sz = new_size;
 		}
 	}
 
-	num_fds = ofi_epoll_wait(map->epoll_set, map->epoll_ctxs,
-	                        MIN(map->used, map->epoll_ctxs_sz), 0);
+	num_fds = ofi_epoll_wait(pollset->epoll_set, pollset->epoll_ctxs,
+	                        MIN(map->used, pollset->epoll_ctxs_sz), 0);
 	if (num_fds < 0 || num_fds == 0) {
 		if (num_fds < 0)
 			SOCK_LOG_ERROR("epoll failed: %d\n", num_fds);
@@ -2398,7 +2449,7 @@ static int sock_pe_progress_rx_ep(struct sock_pe *pe,
 
 	fastlock_acquire(&map->lock);
 	for (i = 0; i < num_fds; i++) {
-		conn = map->epoll_ctxs[i];
+		conn = pollset->epoll_ctxs[i];
 		if (!conn)
 			SOCK_LOG_ERROR("ofi_idm_lookup failed\n");
 
@@ -2412,7 +2463,8 @@ static int sock_pe_progress_rx_ep(struct sock_pe *pe,
 	return 0;
 }
 
-int sock_pe_progress_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx)
+static int sock_pe_worker_progress_rx_ctx(struct sock_pe_worker *pe,
+					  struct sock_rx_ctx *rx_ctx)
 {
 	int ret = 0;
 	struct sock_ep_attr *ep_attr;
@@ -2442,8 +2494,8 @@ int sock_pe_progress_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx)
 			goto out;
 	}
 
-	for (entry = rx_ctx->pe_entry_list.next;
-	     entry != &rx_ctx->pe_entry_list;) {
+	for (entry = rx_ctx->pe_entry_list[pe->idx].next;
+	     entry != &rx_ctx->pe_entry_list[pe->idx];) {
 		pe_entry = container_of(entry, struct sock_pe_entry, ctx_entry);
 		entry = entry->next;
 		ret = sock_pe_progress_rx_pe_entry(pe, pe_entry, rx_ctx);
@@ -2457,6 +2509,18 @@ out:
 	return ret;
 }
 
+int sock_pe_progress_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx)
+{
+	int ret, i;
+
+	for (i = 0; i < pe->num_workers; i++) {
+		ret = sock_pe_worker_progress_rx_ctx(&pe->workers[i], rx_ctx);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
 int sock_pe_progress_ep_rx(struct sock_pe *pe, struct sock_ep_attr *ep_attr)
 {
 	struct sock_rx_ctx *rx_ctx;
@@ -2491,8 +2555,9 @@ int sock_pe_progress_ep_tx(struct sock_pe *pe, struct sock_ep_attr *ep_attr)
 	return 0;
 }
 
-void sock_pe_progress_rx_ctrl_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
-				  struct sock_tx_ctx *tx_ctx)
+static void sock_pe_progress_rx_ctrl_ctx(struct sock_pe_worker *pe,
+					 struct sock_rx_ctx *rx_ctx,
+					 struct sock_tx_ctx *tx_ctx)
 {
 	struct sock_ep_attr *ep_attr;
 	struct dlist_entry *entry;
@@ -2509,15 +2574,72 @@ void sock_pe_progress_rx_ctrl_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx
 		sock_pe_progress_rx_ep(pe, tx_ctx->ep_attr, tx_ctx->rx_ctrl_ctx);
 	}
 
-	for (entry = rx_ctx->pe_entry_list.next;
-	     entry != &rx_ctx->pe_entry_list;) {
+	for (entry = rx_ctx->pe_entry_list[pe->idx].next;
+	     entry != &rx_ctx->pe_entry_list[pe->idx];) {
 		pe_entry = container_of(entry, struct sock_pe_entry, ctx_entry);
 		entry = entry->next;
 		sock_pe_progress_rx_pe_entry(pe, pe_entry, rx_ctx);
 	}
 }
 
-int sock_pe_progress_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
+/* A fenced op may only start once no other worker has ops of this ctx */
+static int sock_pe_tx_fence_ok(struct sock_pe_worker *pe,
+			       struct sock_tx_ctx *tx_ctx)
+{
+	struct sock_pe_worker *worker;
+	int i, busy;
+
+	for (i = 0; i < pe->pe->num_workers; i++) {
+		worker = &pe->pe->workers[i];
+		if (worker == pe)
+			continue;
+
+		fastlock_acquire(&worker->lock);
+		busy = !dlist_empty(&tx_ctx->pe_entry_list[i]);
+		fastlock_release(&worker->lock);
+		if (busy)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Move the next op of the TX ring to the worker owning its connection.
+ * Any worker may do this; ops are taken in ring order under rb_lock, so
+ * per-connection ordering is kept in the owner's list.
+ */
+static int sock_pe_dispatch_tx(struct sock_pe_worker *pe,
+			       struct sock_tx_ctx *tx_ctx)
+{
+	struct sock_pe_worker *owner;
+	struct sock_conn *conn;
+	uint64_t flags;
+	int ret = 0, dispatched = 0;
+
+	fastlock_acquire(&tx_ctx->rb_lock);
+	if (ofi_rbempty(&tx_ctx->rb))
+		goto out;
+
+	sock_tx_ctx_peek_op_send(tx_ctx, &flags, &conn);
+	owner = conn ? sock_pe_conn_worker(pe->pe, conn) : pe;
+	if ((flags & FI_FENCE) && !sock_pe_tx_fence_ok(owner, tx_ctx))
+		goto out;
+
+	fastlock_acquire(&owner->lock);
+	if (!dlist_empty(&owner->free_list)) {
+		ret = sock_pe_new_tx_entry(owner, tx_ctx);
+		dispatched = 1;
+	}
+	fastlock_release(&owner->lock);
+out:
+	fastlock_release(&tx_ctx->rb_lock);
+	if (dispatched && owner != pe)
+		sock_pe_signal_worker(owner);
+	return ret;
+}
+
+static int sock_pe_worker_progress_tx_ctx(struct sock_pe_worker *pe,
+					  struct sock_tx_ctx *tx_ctx)
 {
 	int ret = 0;
 	struct dlist_entry *entry;
@@ -2526,65 +2648,75 @@ int sock_pe_progress_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 	fastlock_acquire(&pe->lock);
 
 	/* progress tx_ctx in PE table */
-	for (entry = tx_ctx->pe_entry_list.next;
-	     entry != &tx_ctx->pe_entry_list;) {
+	for (entry = tx_ctx->pe_entry_list[pe->idx].next;
+	     entry != &tx_ctx->pe_entry_list[pe->idx];) {
 		pe_entry = container_of(entry, struct sock_pe_entry, ctx_entry);
 		entry = entry->next;
 
 		ret = sock_pe_progress_tx_entry(pe, tx_ctx, pe_entry);
 		if (ret < 0) {
 			SOCK_LOG_ERROR("Error in progressing %p\n", pe_entry);
+			fastlock_release(&pe->lock);
 			goto out;
 		}
 	}
 
-	fastlock_acquire(&tx_ctx->rb_lock);
-	if (!ofi_rbempty(&tx_ctx->rb) && !dlist_empty(&pe->free_list)) {
-		ret = sock_pe_new_tx_entry(pe, tx_ctx);
-	}
-	fastlock_release(&tx_ctx->rb_lock);
-	if (ret < 0)
-		goto out;
-
 	sock_pe_progress_rx_ctrl_ctx(pe, tx_ctx->rx_ctrl_ctx, tx_ctx);
+	fastlock_release(&pe->lock);
+
+	/* the owner's lock is taken under rb_lock, so do not hold ours */
+	ret = sock_pe_dispatch_tx(pe, tx_ctx);
 out:
 	if (ret < 0)
 		SOCK_LOG_ERROR("failed to progress TX ctx\n");
-	fastlock_release(&pe->lock);
 	return ret;
 }
 
-static int sock_pe_wait_ok(struct sock_pe *pe)
+int sock_pe_progress_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
+{
+	int ret, i;
+
+	for (i = 0; i < pe->num_workers; i++) {
+		ret = sock_pe_worker_progress_tx_ctx(&pe->workers[i], tx_ctx);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+static int sock_pe_wait_ok(struct sock_pe_worker *pe)
 {
 	struct dlist_entry *entry;
 	struct sock_tx_ctx *tx_ctx;
 	struct sock_rx_ctx *rx_ctx;
+	struct dlist_entry *tx_list = &pe->pe->tx_list;
+	struct dlist_entry *rx_list = &pe->pe->rx_list;
 
 	if (pe->waittime && ((ofi_gettime_ms() - pe->waittime) < (uint64_t)sock_pe_waittime))
 		return 0;
 
-	if (dlist_empty(&pe->tx_list) && dlist_empty(&pe->rx_list))
+	if (dlist_empty(tx_list) && dlist_empty(rx_list))
 		return 1;
 
-	if (!dlist_empty(&pe->tx_list)) {
-		for (entry = pe->tx_list.next;
-		     entry != &pe->tx_list; entry = entry->next) {
+	if (!dlist_empty(tx_list)) {
+		for (entry = tx_list->next;
+		     entry != tx_list; entry = entry->next) {
 			tx_ctx = container_of(entry, struct sock_tx_ctx,
 						pe_entry);
 			if (!ofi_rbempty(&tx_ctx->rb) ||
-			    !dlist_empty(&tx_ctx->pe_entry_list)) {
+			    !dlist_empty(&tx_ctx->pe_entry_list[pe->idx])) {
 				return 0;
 			}
 		}
 	}
 
-	if (!dlist_empty(&pe->rx_list)) {
-		for (entry = pe->rx_list.next;
-		     entry != &pe->rx_list; entry = entry->next) {
+	if (!dlist_empty(rx_list)) {
+		for (entry = rx_list->next;
+		     entry != rx_list; entry = entry->next) {
 			rx_ctx = container_of(entry, struct sock_rx_ctx,
 						pe_entry);
 			if (!dlist_empty(&rx_ctx->rx_buffered_list) ||
-			    !dlist_empty(&rx_ctx->pe_entry_list)) {
+			    !dlist_empty(&rx_ctx->pe_entry_list[pe->idx])) {
 				return 0;
 			}
 		}
@@ -2593,7 +2725,7 @@ static int sock_pe_wait_ok(struct sock_pe *pe)
 	return 1;
 }
 
-static void sock_pe_wait(struct sock_pe *pe)
+static void sock_pe_wait(struct sock_pe_worker *pe)
 {
 	char tmp;
 	int ret;
@@ -2633,9 +2765,11 @@ static void *sock_pe_progress_thread(void *data)
 	struct dlist_entry *entry;
 	struct sock_tx_ctx *tx_ctx;
 	struct sock_rx_ctx *rx_ctx;
-	struct sock_pe *pe = (struct sock_pe *)data;
+	struct sock_pe_worker *pe = (struct sock_pe_worker *)data;
+	struct dlist_entry *tx_list = &pe->pe->tx_list;
+	struct dlist_entry *rx_list = &pe->pe->rx_list;
 
-	SOCK_LOG_DBG("Progress thread started\n");
+	SOCK_LOG_DBG("Progress thread %d started\n", pe->idx);
 	sock_pe_set_affinity();
 	while (*((volatile int *)&pe->do_progress)) {
 		pthread_mutex_lock(&pe->list_lock);
@@ -2646,12 +2780,12 @@ static void *sock_pe_progress_thread(void *data)
 			pthread_mutex_lock(&pe->list_lock);
 		}
 
-		if (!dlist_empty(&pe->tx_list)) {
-			for (entry = pe->tx_list.next;
-			     entry != &pe->tx_list; entry = entry->next) {
+		if (!dlist_empty(tx_list)) {
+			for (entry = tx_list->next;
+			     entry != tx_list; entry = entry->next) {
 				tx_ctx = container_of(entry, struct sock_tx_ctx,
 						      pe_entry);
-				ret = sock_pe_progress_tx_ctx(pe, tx_ctx);
+				ret = sock_pe_worker_progress_tx_ctx(pe, tx_ctx);
 				if (ret < 0) {
 					SOCK_LOG_ERROR("failed to progress TX\n");
 					pthread_mutex_unlock(&pe->list_lock);
@@ -2660,12 +2794,12 @@ static void *sock_pe_progress_thread(void *data)
 			}
 		}
 
-		if (!dlist_empty(&pe->rx_list)) {
-			for (entry = pe->rx_list.next;
-			     entry != &pe->rx_list; entry = entry->next) {
+		if (!dlist_empty(rx_list)) {
+			for (entry = rx_list->next;
+			     entry != rx_list; entry = entry->next) {
 				rx_ctx = container_of(entry, struct sock_rx_ctx,
 						      pe_entry);
-				ret = sock_pe_progress_rx_ctx(pe, rx_ctx);
+				ret = sock_pe_worker_progress_rx_ctx(pe, rx_ctx);
 				if (ret < 0) {
 					SOCK_LOG_ERROR("failed to progress RX\n");
 					pthread_mutex_unlock(&pe->list_lock);
@@ -2676,11 +2810,11 @@ static void *sock_pe_progress_thread(void *data)
 		pthread_mutex_unlock(&pe->list_lock);
 	}
 
-	SOCK_LOG_DBG("Progress thread terminated\n");
+	SOCK_LOG_DBG("Progress thread %d terminated\n", pe->idx);
 	return NULL;
 }
 
-static void sock_pe_init_table(struct sock_pe *pe)
+static void sock_pe_init_table(struct sock_pe_worker *pe)
 {
 	int i;
 
@@ -2702,79 +2836,76 @@ static void sock_pe_init_table(struct sock_pe *pe)
 	SOCK_LOG_DBG("PE table init: OK\n");
 }
 
-struct sock_pe *sock_pe_init(struct sock_domain *domain)
+static int sock_pe_worker_init(struct sock_pe *pe, int idx)
 {
-	struct sock_pe *pe;
+	struct sock_pe_worker *worker = &pe->workers[idx];
 	int ret;
 
-	pe = calloc(1, sizeof(*pe));
-	if (!pe)
-		return NULL;
+	sock_pe_init_table(worker);
+	fastlock_init(&worker->lock);
+	fastlock_init(&worker->signal_lock);
+	pthread_mutex_init(&worker->list_lock, NULL);
+	worker->pe = pe;
+	worker->domain = pe->domain;
+	worker->idx = idx;
 
-	sock_pe_init_table(pe);
-	dlist_init(&pe->tx_list);
-	dlist_init(&pe->rx_list);
-	fastlock_init(&pe->lock);
-	fastlock_init(&pe->signal_lock);
-	pthread_mutex_init(&pe->list_lock, NULL);
-	pe->domain = domain;
-
-
-	ret = ofi_bufpool_create(&pe->pe_rx_pool,
+	ret = ofi_bufpool_create(&worker->pe_rx_pool,
 				 sizeof(struct sock_pe_entry), 16, 0, 1024, 0);
 	if (ret) {
 		SOCK_LOG_ERROR("failed to create buffer pool\n");
 		goto err1;
 	}
 
-	ret = ofi_bufpool_create(&pe->atomic_rx_pool,
+	ret = ofi_bufpool_create(&worker->atomic_rx_pool,
 				 SOCK_EP_MAX_ATOMIC_SZ, 16, 0, 32, 0);
 	if (ret) {
 		SOCK_LOG_ERROR("failed to create atomic rx buffer pool\n");
 		goto err2;
 	}
 
-	if (ofi_epoll_create(&pe->epoll_set) < 0) {
+	if (ofi_epoll_create(&worker->epoll_set) < 0) {
                 SOCK_LOG_ERROR("failed to create epoll set\n");
                 goto err3;
 	}
 
-	if (domain->progress_mode == FI_PROGRESS_AUTO) {
-		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pe->signal_fds) < 0)
+	if (pe->domain->progress_mode == FI_PROGRESS_AUTO) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, worker->signal_fds) < 0)
 			goto err4;
 
-		if (fd_set_nonblock(pe->signal_fds[SOCK_SIGNAL_RD_FD]) ||
-		    ofi_epoll_add(pe->epoll_set,
-				 pe->signal_fds[SOCK_SIGNAL_RD_FD],
+		if (fd_set_nonblock(worker->signal_fds[SOCK_SIGNAL_RD_FD]) ||
+		    ofi_epoll_add(worker->epoll_set,
+				 worker->signal_fds[SOCK_SIGNAL_RD_FD],
 				 OFI_EPOLL_IN, NULL))
 			goto err5;
 
-		pe->do_progress = 1;
-		if (pthread_create(&pe->progress_thread, NULL,
-				   sock_pe_progress_thread, (void *)pe)) {
+		worker->do_progress = 1;
+		if (pthread_create(&worker->progress_thread, NULL,
+				   sock_pe_progress_thread, (void *)worker)) {
 			SOCK_LOG_ERROR("Couldn't create progress thread\n");
 			goto err5;
 		}
 	}
-	SOCK_LOG_DBG("PE init: OK\n");
-	return pe;
+	return 0;
 
 err5:
-	ofi_close_socket(pe->signal_fds[0]);
-	ofi_close_socket(pe->signal_fds[1]);
+	ofi_close_socket(worker->signal_fds[0]);
+	ofi_close_socket(worker->signal_fds[1]);
 err4:
-	ofi_epoll_close(pe->epoll_set);
+	ofi_epoll_close(worker->epoll_set);
 err3:
-	ofi_bufpool_destroy(pe->atomic_rx_pool);
+	ofi_bufpool_destroy(worker->atomic_rx_pool);
 err2:
-	ofi_bufpool_destroy(pe->pe_rx_pool);
+	ofi_bufpool_destroy(worker->pe_rx_pool);
 err1:
-	fastlock_destroy(&pe->lock);
-	free(pe);
-	return NULL;
+	for (idx = 0; idx < SOCK_PE_MAX_ENTRIES; idx++)
+		ofi_rbfree(&worker->pe_table[idx].comm_buf);
+	pthread_mutex_destroy(&worker->list_lock);
+	fastlock_destroy(&worker->signal_lock);
+	fastlock_destroy(&worker->lock);
+	return -FI_ENOMEM;
 }
 
-static void sock_pe_free_util_pool(struct sock_pe *pe)
+static void sock_pe_free_util_pool(struct sock_pe_worker *pe)
 {
 	struct dlist_entry *entry;
 	struct sock_pe_entry *pe_entry;
@@ -2791,26 +2922,73 @@ static void sock_pe_free_util_pool(struct sock_pe *pe)
 	ofi_bufpool_destroy(pe->atomic_rx_pool);
 }
 
-void sock_pe_finalize(struct sock_pe *pe)
+static void sock_pe_worker_finalize(struct sock_pe_worker *worker)
 {
 	int i;
-	if (pe->domain->progress_mode == FI_PROGRESS_AUTO) {
-		pe->do_progress = 0;
-		sock_pe_signal(pe);
-		pthread_join(pe->progress_thread, NULL);
-		ofi_close_socket(pe->signal_fds[0]);
-		ofi_close_socket(pe->signal_fds[1]);
+	if (worker->domain->progress_mode == FI_PROGRESS_AUTO) {
+		worker->do_progress = 0;
+		sock_pe_signal_worker(worker);
+		pthread_join(worker->progress_thread, NULL);
+		ofi_close_socket(worker->signal_fds[0]);
+		ofi_close_socket(worker->signal_fds[1]);
 	}
 
 	for (i = 0; i < SOCK_PE_MAX_ENTRIES; i++) {
-		ofi_rbfree(&pe->pe_table[i].comm_buf);
+		ofi_rbfree(&worker->pe_table[i].comm_buf);
+	}
+
+	sock_pe_free_util_pool(worker);
+	fastlock_destroy(&worker->lock);
+	fastlock_destroy(&worker->signal_lock);
+	pthread_mutex_destroy(&worker->list_lock);
+	ofi_epoll_close(worker->epoll_set);
+}
+
+struct sock_pe *sock_pe_init(struct sock_domain *domain)
+{
+	struct sock_pe *pe;
+	int i;
+
+	pe = calloc(1, sizeof(*pe));
+	if (!pe)
+		return NULL;
+
+	pe->workers = calloc(sock_pe_workers, sizeof(*pe->workers));
+	if (!pe->workers)
+		goto err1;
+
+	dlist_init(&pe->tx_list);
+	dlist_init(&pe->rx_list);
+	fastlock_init(&pe->atomic_lock);
+	pe->domain = domain;
+
+	for (i = 0; i < sock_pe_workers; i++) {
+		if (sock_pe_worker_init(pe, i))
+			goto err2;
+		pe->num_workers++;
 	}
+	SOCK_LOG_DBG("PE init: OK, %d worker(s)\n", pe->num_workers);
+	return pe;
+
+err2:
+	while (i--)
+		sock_pe_worker_finalize(&pe->workers[i]);
+	fastlock_destroy(&pe->atomic_lock);
+	free(pe->workers);
+err1:
+	free(pe);
+	return NULL;
+}
+
+void sock_pe_finalize(struct sock_pe *pe)
+{
+	int i;
+
+	for (i = 0; i < pe->num_workers; i++)
+		sock_pe_worker_finalize(&pe->workers[i]);
 
-	sock_pe_free_util_pool(pe);
-	fastlock_destroy(&pe->lock);
-	fastlock_destroy(&pe->signal_lock);
-	pthread_mutex_destroy(&pe->list_lock);
-	ofi_epoll_close(pe->epoll_set);
+	fastlock_destroy(&pe->atomic_lock);
+	free(pe->workers);
 	free(pe);
 	SOCK_LOG_DBG("Progress engine finalize: OK\n");
 }
@@ -53,18 +53,25 @@
 
 #include <ofi.h>
 #include <ofi_enosys.h>
+#include <ofi_iov.h>
 #include <ofi_rbuf.h>
 #include <ofi_list.h>
 #include <ofi_signal.h>
 #include <ofi_util.h>
 #include <ofi_proto.h>
 #include <ofi_net.h>
+#include <ofi_trace.h>
 
 #ifndef _TCP_H_
 #define _TCP_H_
 
 
 #define TCPX_MAX_INJECT		128
+#define TCPX_COALESCE_INJECT	1024
+#define TCPX_TX_BATCH_IOV	64
+#define TCPX_TX_DEFER_ENTRY	8192
+#define TCPX_TX_DEFER_MAX	65536
+#define TCPX_MAX_STRIPES	8
 #define MAX_POLL_EVENTS		100
 #define TCPX_MIN_MULTI_RECV	16384
 #define TCPX_PORT_MAX_RANGE	(USHRT_MAX)
@@ -76,6 +83,10 @@ extern struct tcpx_port_range	port_range;
 extern int tcpx_nodelay;
 extern int tcpx_staging_sbuf_size;
 extern int tcpx_prefetch_rbuf_size;
+extern int tcpx_compact_hdr;
+extern int tcpx_tx_coalesce_usec;
+extern int tcpx_stripe_cnt;
+extern size_t tcpx_stripe_size;
 
 struct tcpx_xfer_entry;
 struct tcpx_ep;
@@ -96,7 +107,14 @@ struct tcpx_cm_msg {
 	char data[TCPX_MAX_CM_DATA_SIZE];
 };
 
-#define TCPX_HDR_VERSION	3
+/* Version 4 adds the compact header format and piggybacked acks.  Each
+ * side advertises the highest data header version it supports in the CM
+ * exchange (ofi_ctrl_hdr::msg_id), and both use the lower of the two.
+ * Full headers keep carrying TCPX_HDR_FULL_VERSION in base_hdr.version.
+ */
+#define TCPX_HDR_VERSION	4
+#define TCPX_HDR_FULL_VERSION	3
+#define TCPX_HDR_COMPACT	4
 
 enum {
 	TCPX_IOV_LIMIT = 4
@@ -151,6 +169,64 @@ struct tcpx_tag_data_hdr {
 #define TCPX_MAX_HDR (sizeof(struct tcpx_cq_data_hdr) + \
 		     sizeof(struct ofi_rma_iov) * TCPX_IOV_LIMIT)
 
+/*
+ * Compact header.  The first byte is distinguished from a full header by
+ * TCPX_CHDR, which is never set in base_hdr.version.  The op and the most
+ * common flags are implied by the first byte.  The second byte is the total
+ * header length, followed by LEB128 varints:
+ *
+ *   payload length		(not present for TCPX_CHDR_OP_ACK)
+ *   ack count			if TCPX_CHDR_ACK
+ *   cq data			if TCPX_CHDR_DATA
+ *   tag			if TCPX_CHDR_TAG
+ *   rma_iov_cnt (1 byte) + addr/len/key per rma iov, for read_req and write
+ *
+ * The ack count completes that many delivery complete transfers, in order,
+ * on the receiving side.  It replaces the separate response messages used
+ * with full headers.  Commit complete transfers always use a full header.
+ */
+#define TCPX_CHDR		(1 << 7)
+#define TCPX_CHDR_ACK		(1 << 6)
+#define TCPX_CHDR_DC		(1 << 5)
+#define TCPX_CHDR_TAG		(1 << 4)
+#define TCPX_CHDR_DATA		(1 << 3)
+#define TCPX_CHDR_OP_MASK	0x7
+#define TCPX_CHDR_OP_ACK	TCPX_CHDR_OP_MASK
+#define TCPX_CHDR_MIN		2
+#define TCPX_VARINT_MAX		10
+#define TCPX_MAX_CHDR		(TCPX_CHDR_MIN + 4 * TCPX_VARINT_MAX + 1 + \
+				 3 * TCPX_VARINT_MAX * TCPX_IOV_LIMIT)
+
+static inline size_t tcpx_put_varint(uint8_t *buf, uint64_t val)
+{
+	size_t i = 0;
+
+	while (val >= 0x80) {
+		buf[i++] = (uint8_t) (val | 0x80);
+		val >>= 7;
+	}
+	buf[i++] = (uint8_t) val;
+	return i;
+}
+
+static inline int tcpx_get_varint(const uint8_t **buf, const uint8_t *end,
+				  uint64_t *val)
+{
+	const uint8_t *ptr = *buf;
+	unsigned int shift = 0;
+
+	*val = 0;
+	while (ptr < end && shift < 64) {
+		*val |= (uint64_t) (*ptr & 0x7f) << shift;
+		if (!(*ptr++ & 0x80)) {
+			*buf = ptr;
+			return 0;
+		}
+		shift += 7;
+	}
+	return -FI_EIO;
+}
+
 /*
  * End wire protocol definitions
  */
@@ -163,6 +239,9 @@ enum tcpx_cm_state {
 	TCPX_CM_REQ_SENT,
 	TCPX_CM_REQ_RVCD,
 	TCPX_CM_RESP_READY,
+	TCPX_CM_STRIPE_LISTEN,
+	TCPX_CM_STRIPE_CONNECTING,
+	TCPX_CM_STRIPE_WAIT_REQ,
 	/* CM context is freed once connected */
 };
 
@@ -170,6 +249,10 @@ struct tcpx_cm_context {
 	fid_t			fid;
 	enum tcpx_cm_state	state;
 	size_t			cm_data_sz;
+	/* carried in ofi_ctrl_hdr seg_no and conn_id, see tcpx_stripe.c */
+	uint32_t		stripe_info;
+	uint64_t		stripe_id;
+	SOCKET			stripe_sock;
 	struct tcpx_cm_msg	msg;
 };
 
@@ -183,6 +266,8 @@ struct tcpx_conn_handle {
 	struct tcpx_pep		*pep;
 	SOCKET			sock;
 	bool			endian_match;
+	uint8_t			hdr_version;
+	uint32_t		stripe_info;
 };
 
 struct tcpx_pep {
@@ -206,6 +291,7 @@ struct tcpx_cur_rx_msg {
 		struct tcpx_base_hdr	base_hdr;
 		uint8_t			max_hdr[TCPX_MAX_HDR];
 	} hdr;
+	uint8_t			chdr[TCPX_MAX_CHDR];
 	size_t			hdr_len;
 	size_t			done_len;
 };
@@ -220,6 +306,21 @@ struct tcpx_rx_ctx {
 
 typedef int (*tcpx_rx_process_fn_t)(struct tcpx_xfer_entry *rx_entry);
 
+/* Part of a striped payload that is carried by one additional socket */
+struct tcpx_stripe_xfer {
+	struct iovec		iov[TCPX_IOV_LIMIT];
+	size_t			iov_cnt;
+	size_t			rem_len;
+};
+
+struct tcpx_stripe {
+	SOCKET			sock;
+	/* a stripe connection that is still being set up */
+	struct tcpx_cm_context	*cm_ctx;
+	struct tcpx_stripe_xfer	tx;
+	struct tcpx_stripe_xfer	rx;
+};
+
 struct tcpx_ep {
 	struct util_ep		util_ep;
 	struct ofi_bsock	bsock;
@@ -237,6 +338,23 @@ struct tcpx_ep {
 	fastlock_t		lock;
 	int (*start_op[ofi_op_write + 1])(struct tcpx_ep *ep);
 	void (*hdr_bswap)(struct tcpx_base_hdr *hdr);
+	uint8_t			hdr_version;
+	/* delivery complete acks owed to the peer */
+	size_t			ack_cnt;
+	/* small sends held back to be coalesced into one writev */
+	size_t			tx_defer_len;
+	uint64_t		tx_defer_start;
+	/* stripes[0] is unused, stripe 0 is carried by bsock */
+	struct tcpx_stripe	*stripes;
+	uint8_t			stripe_cnt;
+	size_t			stripe_size;
+	uint64_t		stripe_id;
+	/* the stripe listener, or the connect response held until all
+	 * stripes are connected
+	 */
+	struct tcpx_cm_context	*stripe_cm_ctx;
+	struct tcpx_xfer_entry	*stripe_tx_entry;
+	size_t			stripe_rx_len;
 	size_t			min_multi_recv_size;
 	bool			pollout_set;
 };
@@ -246,6 +364,7 @@ struct tcpx_fabric {
 };
 
 #define TCPX_NEED_DYN_RBUF 	BIT_ULL(61)
+#define TCPX_STRIPED		BIT_ULL(60)
 
 struct tcpx_xfer_entry {
 	struct slist_entry	entry;
@@ -263,6 +382,11 @@ struct tcpx_xfer_entry {
 	void			*context;
 	uint64_t		rem_len;
 	void			*mrecv_msg_start;
+	/* set when the compact header in chdr replaces hdr on the wire */
+	uint8_t			chdr_len;
+	uint8_t			chdr[TCPX_MAX_CHDR + TCPX_MAX_INJECT];
+	/* inject data above TCPX_MAX_INJECT, only allocated when coalescing */
+	uint8_t			inject_buf[];
 };
 
 struct tcpx_domain {
@@ -351,11 +475,66 @@ void tcpx_hdr_bswap(struct tcpx_base_hdr *hdr);
 void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
 			  struct tcpx_xfer_entry *tx_entry);
 
+static inline size_t tcpx_inject_size(void)
+{
+	return tcpx_tx_coalesce_usec ? TCPX_COALESCE_INJECT : TCPX_MAX_INJECT;
+}
+
+/* Inject data is copied behind the header, so that it goes out with a
+ * single send.  Data that only fits because coalescing raised the inject
+ * size is copied into inject_buf and sent as a second iov.
+ */
+static inline void
+tcpx_copy_inject(struct tcpx_xfer_entry *tx_entry, size_t hdr_len,
+		 const struct iovec *iov, size_t count, size_t data_len)
+{
+	assert(data_len <= tcpx_inject_size());
+	tx_entry->iov[0].iov_base = (void *) &tx_entry->hdr;
+	if (data_len <= TCPX_MAX_INJECT) {
+		ofi_copy_iov_buf(iov, count, 0, (uint8_t *) &tx_entry->hdr +
+				 hdr_len, data_len, OFI_COPY_IOV_TO_BUF);
+		tx_entry->iov[0].iov_len = hdr_len + data_len;
+		tx_entry->iov_cnt = 1;
+	} else {
+		ofi_copy_iov_buf(iov, count, 0, tx_entry->inject_buf,
+				 data_len, OFI_COPY_IOV_TO_BUF);
+		tx_entry->iov[0].iov_len = hdr_len;
+		tx_entry->iov[1].iov_base = tx_entry->inject_buf;
+		tx_entry->iov[1].iov_len = data_len;
+		tx_entry->iov_cnt = 2;
+	}
+}
+
+static inline bool tcpx_use_chdr(struct tcpx_ep *ep)
+{
+	return ep->hdr_version >= TCPX_HDR_COMPACT;
+}
+
+static inline size_t tcpx_rx_hdr_min(struct tcpx_ep *ep)
+{
+	return tcpx_use_chdr(ep) ? TCPX_CHDR_MIN :
+	       sizeof(ep->cur_rx_msg.hdr.base_hdr);
+}
+
 static inline bool tcpx_tx_pending(struct tcpx_ep *ep)
 {
 	return !slist_empty(&ep->tx_queue) || ofi_bsock_tosend(&ep->bsock);
 }
 
+uint32_t tcpx_stripe_local_info(void);
+uint32_t tcpx_stripe_negotiate(uint32_t local, uint32_t peer);
+int tcpx_stripe_init(struct tcpx_ep *ep, uint32_t info);
+int tcpx_stripe_listen(struct tcpx_ep *ep, struct tcpx_cm_context *cm_ctx);
+int tcpx_stripe_wait_add(struct tcpx_ep *ep, struct util_wait *wait);
+void tcpx_stripe_wait_del(struct tcpx_ep *ep, struct util_wait *wait);
+void tcpx_stripe_shutdown(struct tcpx_ep *ep);
+void tcpx_stripe_close(struct tcpx_ep *ep);
+void tcpx_stripe_tx_check(struct tcpx_ep *ep,
+			  struct tcpx_xfer_entry *tx_entry);
+void tcpx_stripe_rx_setup(struct tcpx_xfer_entry *rx_entry);
+int tcpx_send_stripes(struct tcpx_xfer_entry *tx_entry);
+int tcpx_recv_stripes(struct tcpx_ep *ep);
+
 void tcpx_conn_mgr_run(struct util_eq *eq);
 int tcpx_eq_wait_try_func(void *arg);
 int tcpx_eq_create(struct fid_fabric *fabric_fid, struct fi_eq_attr *attr,
@@ -65,7 +65,7 @@ ssize_t tcpx_recv_hdr(struct tcpx_ep *ep)
 	return ofi_bsock_recv(&ep->bsock, buf, len);
 }
 
-int tcpx_recv_msg_data(struct tcpx_xfer_entry *rx_entry)
+static int tcpx_recv_main(struct tcpx_xfer_entry *rx_entry)
 {
 	ssize_t ret;
 
@@ -87,3 +87,21 @@ int tcpx_recv_msg_data(struct tcpx_xfer_entry *rx_entry)
 	}
 	return FI_SUCCESS;
 }
+
+int tcpx_recv_msg_data(struct tcpx_xfer_entry *rx_entry)
+{
+	int ret, stripe_ret;
+
+	if (!rx_entry->ep->stripe_rx_len)
+		return tcpx_recv_main(rx_entry);
+
+	/* The main socket's part of a striped payload is done once
+	 * rem_len drops to 0, but its iov is left in place.
+	 */
+	ret = rx_entry->rem_len ? tcpx_recv_main(rx_entry) : 0;
+	if (ret && ret != -FI_EAGAIN)
+		return ret;
+
+	stripe_ret = tcpx_recv_stripes(rx_entry->ep);
+	return stripe_ret ? stripe_ret : ret;
+}
@@ -36,9 +36,25 @@
 #include "tcpx.h"
 #include <poll.h>
 #include <sys/types.h>
+#include <netinet/tcp.h>
 #include <ofi_util.h>
 
 
+static uint8_t tcpx_local_hdr_version(void)
+{
+	return tcpx_compact_hdr ? TCPX_HDR_VERSION : TCPX_HDR_FULL_VERSION;
+}
+
+/* Peers that predate header negotiation leave msg_id zeroed */
+static uint8_t tcpx_peer_hdr_version(struct ofi_ctrl_hdr *hdr)
+{
+	uint64_t version = ntohll(hdr->msg_id);
+
+	if (version < TCPX_HDR_FULL_VERSION)
+		return TCPX_HDR_FULL_VERSION;
+	return (uint8_t) MIN(version, tcpx_local_hdr_version());
+}
+
 /* The underlying socket has the POLLIN event set.  The entire
  * CM message should be readable, as it fits within a single MTU
  * and is the first data transferred over the socket.
@@ -121,6 +137,9 @@ static int tx_cm_data(SOCKET fd, uint8_t type, struct tcpx_cm_context *cm_ctx)
 	cm_ctx->msg.hdr.type = type;
 	cm_ctx->msg.hdr.seg_size = htons((uint16_t) cm_ctx->cm_data_sz);
 	cm_ctx->msg.hdr.conn_data = 1; /* tests endianess mismatch at peer */
+	cm_ctx->msg.hdr.msg_id = htonll(tcpx_local_hdr_version());
+	cm_ctx->msg.hdr.seg_no = htonl(cm_ctx->stripe_info);
+	cm_ctx->msg.hdr.conn_id = htonll(cm_ctx->stripe_id);
 
 	ret = ofi_send_socket(fd, &cm_ctx->msg, sizeof(cm_ctx->msg.hdr) +
 			      cm_ctx->cm_data_sz, MSG_NOSIGNAL);
@@ -152,7 +171,10 @@ static int tcpx_ep_enable(struct tcpx_ep *ep,
 	}
 
 	ep->state = TCPX_CONNECTED;
+	ep->cur_rx_msg.hdr_len = tcpx_rx_hdr_min(ep);
 	fastlock_release(&ep->lock);
+	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "using header version %d\n",
+	       ep->hdr_version);
 
 	if (ep->util_ep.rx_cq) {
 		ret = ofi_wait_add_fd(ep->util_ep.rx_cq->wait,
@@ -178,6 +200,18 @@ static int tcpx_ep_enable(struct tcpx_ep *ep,
 		}
 	}
 
+	if (ep->util_ep.rx_cq) {
+		ret = tcpx_stripe_wait_add(ep, ep->util_ep.rx_cq->wait);
+		if (ret)
+			return ret;
+	}
+
+	if (ep->util_ep.tx_cq) {
+		ret = tcpx_stripe_wait_add(ep, ep->util_ep.tx_cq->wait);
+		if (ret)
+			return ret;
+	}
+
 	ret = (int) fi_eq_write(&ep->util_ep.eq->eq_fid, FI_CONNECTED, cm_entry,
 				cm_entry_sz, 0);
 	if (ret < 0) {
@@ -191,10 +225,194 @@ unlock:
 	return ret;
 }
 
+static int tcpx_cm_connected(struct tcpx_ep *ep,
+			     struct tcpx_cm_context *cm_ctx)
+{
+	struct fi_eq_cm_entry *cm_entry;
+	int ret;
+
+	cm_entry = calloc(1, sizeof(*cm_entry) + cm_ctx->cm_data_sz);
+	if (!cm_entry)
+		return -FI_ENOMEM;
+
+	cm_entry->fid = cm_ctx->fid;
+	memcpy(cm_entry->data, cm_ctx->msg.data, cm_ctx->cm_data_sz);
+
+	ret = tcpx_ep_enable(ep, cm_entry,
+			     sizeof(*cm_entry) + cm_ctx->cm_data_sz);
+	free(cm_entry);
+	return ret;
+}
+
+/* Stripe connections are driven by the EQ, like the main connection.
+ * Each is tracked by its own CM context in a free stripes[] slot until
+ * it is identified.  A handler only frees its own context, as others may
+ * still be reported by the same wait call.  Contexts left behind by a
+ * failed or completed setup drop themselves once they are reported
+ * again, or when the endpoint is closed.
+ */
+static void tcpx_stripe_cm_free(struct tcpx_ep *ep,
+				struct tcpx_cm_context *cm_ctx)
+{
+	int i;
+
+	for (i = 0; i < ep->stripe_cnt; i++) {
+		if (ep->stripes[i].cm_ctx == cm_ctx)
+			ep->stripes[i].cm_ctx = NULL;
+	}
+	free(cm_ctx);
+}
+
+static void tcpx_stripe_cm_drop(struct util_wait *wait, struct tcpx_ep *ep,
+				struct tcpx_cm_context *cm_ctx)
+{
+	ofi_wait_del_fd(wait, cm_ctx->stripe_sock);
+	ofi_close_socket(cm_ctx->stripe_sock);
+	tcpx_stripe_cm_free(ep, cm_ctx);
+}
+
+static void tcpx_stripe_listen_stop(struct util_wait *wait,
+				    struct tcpx_ep *ep)
+{
+	if (ep->stripes[0].sock == INVALID_SOCKET)
+		return;
+
+	ofi_wait_del_fd(wait, ep->stripes[0].sock);
+	ofi_close_socket(ep->stripes[0].sock);
+	ep->stripes[0].sock = INVALID_SOCKET;
+}
+
+static void tcpx_stripe_cm_fail(struct tcpx_ep *ep, int err)
+{
+	FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+		"Failed to set up stripes: %s\n", fi_strerror(err));
+	fastlock_acquire(&ep->lock);
+	tcpx_ep_disable(ep, err);
+	fastlock_release(&ep->lock);
+}
+
+/* Starts connecting the additional stripes to the listener that the
+ * server opened for this endpoint.
+ */
+static int tcpx_stripe_connect(struct util_wait *wait, struct tcpx_ep *ep,
+			       uint64_t stripe_id)
+{
+	struct tcpx_cm_context *cm_ctx;
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	SOCKET sock;
+	int i, ret;
+
+	ret = ofi_getpeername(ep->bsock.sock, (struct sockaddr *) &addr, &len);
+	if (ret)
+		return -ofi_sockerr();
+
+	ofi_addr_set_port((struct sockaddr *) &addr, (uint16_t) stripe_id);
+
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		cm_ctx = calloc(1, sizeof(*cm_ctx));
+		if (!cm_ctx)
+			return -FI_ENOMEM;
+
+		sock = ofi_socket(addr.ss_family, SOCK_STREAM, 0);
+		if (sock == INVALID_SOCKET) {
+			ret = -ofi_sockerr();
+			goto free;
+		}
+
+		ret = fi_fd_nonblock(sock);
+		if (ret)
+			goto close;
+
+		ret = connect(sock, (struct sockaddr *) &addr, len);
+		if (ret && !OFI_SOCK_TRY_CONN_AGAIN(ofi_sockerr())) {
+			ret = -ofi_sockerr();
+			goto close;
+		}
+
+		cm_ctx->fid = &ep->util_ep.ep_fid.fid;
+		cm_ctx->state = TCPX_CM_STRIPE_CONNECTING;
+		cm_ctx->stripe_info = i;
+		cm_ctx->stripe_id = stripe_id;
+		cm_ctx->stripe_sock = sock;
+		ret = ofi_wait_add_fd(wait, sock, POLLOUT,
+				      tcpx_eq_wait_try_func, NULL, cm_ctx);
+		if (ret)
+			goto close;
+
+		ep->stripes[i].cm_ctx = cm_ctx;
+	}
+	return 0;
+
+close:
+	ofi_close_socket(sock);
+free:
+	free(cm_ctx);
+	return ret;
+}
+
+/* A stripe is connected.  Identify it to the server with a connreq that
+ * carries the server's token and the stripe index.  Once all stripes are
+ * connected, report the connect response held in stripe_cm_ctx.
+ */
+static void tcpx_stripe_send_req(struct util_wait *wait,
+				 struct tcpx_cm_context *cm_ctx)
+{
+	struct tcpx_cm_context *resp_ctx;
+	struct tcpx_ep *ep;
+	SOCKET sock = cm_ctx->stripe_sock;
+	uint32_t index = cm_ctx->stripe_info;
+	socklen_t len;
+	int i, ret, status, optval = 1;
+
+	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
+	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
+	if (ep->state != TCPX_CONNECTING) {
+		tcpx_stripe_cm_drop(wait, ep, cm_ctx);
+		return;
+	}
+
+	len = sizeof(status);
+	ret = getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *) &status, &len);
+	if (ret < 0 || status) {
+		ret = (ret < 0) ? -ofi_sockerr() : -status;
+		goto err;
+	}
+
+	ret = tx_cm_data(sock, ofi_ctrl_connreq, cm_ctx);
+	if (ret)
+		goto err;
+
+	ret = ofi_wait_del_fd(wait, sock);
+	if (ret)
+		goto err;
+
+	(void) setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+			  (char *) &optval, sizeof(optval));
+	ep->stripes[index].sock = sock;
+	tcpx_stripe_cm_free(ep, cm_ctx);
+
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		if (ep->stripes[i].cm_ctx)
+			return;
+	}
+
+	resp_ctx = ep->stripe_cm_ctx;
+	ep->stripe_cm_ctx = NULL;
+	ret = tcpx_cm_connected(ep, resp_ctx);
+	free(resp_ctx);
+	if (ret)
+		tcpx_stripe_cm_fail(ep, -ret);
+	return;
+
+err:
+	tcpx_stripe_cm_drop(wait, ep, cm_ctx);
+	tcpx_stripe_cm_fail(ep, -ret);
+}
+
 static void tcpx_cm_recv_resp(struct util_wait *wait,
 			      struct tcpx_cm_context *cm_ctx)
 {
-	struct fi_eq_cm_entry *cm_entry;
 	struct tcpx_ep *ep;
 	int ret;
 
@@ -212,38 +430,44 @@ static void tcpx_cm_recv_resp(struct util_wait *wait,
 		FI_LOG(&tcpx_prov, level, FI_LOG_EP_CTRL,
 			"Failed to receive connect response\n");
 		ofi_wait_del_fd(wait, ep->bsock.sock);
-		goto err1;
+		goto err;
 	}
 
 	ret = ofi_wait_del_fd(wait, ep->bsock.sock);
 	if (ret) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
 			"Could not remove fd from wait\n");
-		goto err1;
+		goto err;
 	}
 
-	cm_entry = calloc(1, sizeof(*cm_entry) + cm_ctx->cm_data_sz);
-	if (!cm_entry)
-		goto err1;
-
-	cm_entry->fid = cm_ctx->fid;
-	memcpy(cm_entry->data, cm_ctx->msg.data, cm_ctx->cm_data_sz);
-
 	ep->hdr_bswap = (cm_ctx->msg.hdr.conn_data == 1) ?
 			tcpx_hdr_none : tcpx_hdr_bswap;
+	ep->hdr_version = tcpx_peer_hdr_version(&cm_ctx->msg.hdr);
 
-	ret = tcpx_ep_enable(ep, cm_entry,
-				sizeof(*cm_entry) + cm_ctx->cm_data_sz);
+	ret = tcpx_stripe_init(ep, ntohl(cm_ctx->msg.hdr.seg_no));
+	if (!ret && ep->stripe_cnt > 1)
+		ret = tcpx_stripe_connect(wait, ep,
+					  ntohll(cm_ctx->msg.hdr.conn_id));
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"Failed to connect stripes: %s\n", fi_strerror(-ret));
+		goto err;
+	}
+
+	/* FI_CONNECTED is reported once all stripes are connected */
+	if (ep->stripe_cnt > 1) {
+		ep->stripe_cm_ctx = cm_ctx;
+		return;
+	}
+
+	ret = tcpx_cm_connected(ep, cm_ctx);
 	if (ret)
-		goto err2;
+		goto err;
 
-	free(cm_entry);
 	free(cm_ctx);
 	return;
 
-err2:
-	free(cm_entry);
-err1:
+err:
 	fastlock_acquire(&ep->lock);
 	tcpx_ep_disable(ep, -ret);
 	fastlock_release(&ep->lock);
@@ -282,6 +506,17 @@ static void tcpx_cm_send_resp(struct util_wait *wait,
 		goto disable;
 	}
 
+	if (ep->stripe_cm_ctx) {
+		ret = ofi_wait_add_fd(wait, ep->stripes[0].sock, POLLIN,
+				      tcpx_eq_wait_try_func, NULL,
+				      ep->stripe_cm_ctx);
+		if (ret)
+			goto disable;
+
+		free(cm_ctx);
+		return;
+	}
+
 	cm_entry.fid =  cm_ctx->fid;
 
 	ret = tcpx_ep_enable(ep, &cm_entry, sizeof(cm_entry));
@@ -346,6 +581,9 @@ static void tcpx_cm_recv_req(struct util_wait *wait,
 		goto err3;
 
 	handle->endian_match = (cm_ctx->msg.hdr.conn_data == 1);
+	handle->hdr_version = tcpx_peer_hdr_version(&cm_ctx->msg.hdr);
+	handle->stripe_info = tcpx_stripe_negotiate(tcpx_stripe_local_info(),
+					ntohl(cm_ctx->msg.hdr.seg_no));
 	cm_entry->info->handle = &handle->handle;
 	memcpy(cm_entry->data, cm_ctx->msg.data, cm_ctx->cm_data_sz);
 	cm_ctx->state = TCPX_CM_REQ_RVCD;
@@ -473,6 +711,135 @@ err1:
 	ofi_close_socket(sock);
 }
 
+/* Accepts a stripe connection for an endpoint whose connect response
+ * has been sent.  The connreq that identifies the stripe is read once it
+ * arrives.
+ */
+static void tcpx_stripe_listen_process(struct util_wait *wait,
+				       struct tcpx_cm_context *listen_ctx)
+{
+	struct tcpx_cm_context *cm_ctx;
+	struct tcpx_ep *ep;
+	SOCKET sock;
+	int i, ret;
+
+	assert(listen_ctx->fid->fclass == FI_CLASS_EP);
+	ep = container_of(listen_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
+	if (ep->state != TCPX_ACCEPTING) {
+		tcpx_stripe_listen_stop(wait, ep);
+		return;
+	}
+
+	sock = accept(ep->stripes[0].sock, NULL, 0);
+	if (sock == INVALID_SOCKET) {
+		if (OFI_SOCK_TRY_ACCEPT_AGAIN(ofi_sockerr()))
+			return;
+		ret = -ofi_sockerr();
+		goto err;
+	}
+
+	for (i = 0; i < ep->stripe_cnt; i++) {
+		if (!ep->stripes[i].cm_ctx)
+			break;
+	}
+	if (i == ep->stripe_cnt) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"discarding unexpected stripe connection\n");
+		ofi_close_socket(sock);
+		return;
+	}
+
+	cm_ctx = calloc(1, sizeof(*cm_ctx));
+	if (!cm_ctx) {
+		ret = -FI_ENOMEM;
+		goto close;
+	}
+
+	ret = fi_fd_nonblock(sock);
+	if (ret)
+		goto free;
+
+	cm_ctx->fid = listen_ctx->fid;
+	cm_ctx->state = TCPX_CM_STRIPE_WAIT_REQ;
+	cm_ctx->stripe_sock = sock;
+	ret = ofi_wait_add_fd(wait, sock, POLLIN, tcpx_eq_wait_try_func,
+			      NULL, cm_ctx);
+	if (ret)
+		goto free;
+
+	ep->stripes[i].cm_ctx = cm_ctx;
+	return;
+
+free:
+	free(cm_ctx);
+close:
+	ofi_close_socket(sock);
+err:
+	tcpx_stripe_listen_stop(wait, ep);
+	tcpx_stripe_cm_fail(ep, -ret);
+}
+
+/* Reads the connreq of an accepted stripe.  Once all stripes are
+ * identified, the listener is closed and the endpoint is connected.
+ */
+static void tcpx_stripe_recv_req(struct util_wait *wait,
+				 struct tcpx_cm_context *cm_ctx)
+{
+	struct fi_eq_cm_entry cm_entry = {0};
+	struct tcpx_ep *ep;
+	SOCKET sock = cm_ctx->stripe_sock;
+	uint32_t index;
+	int i, ret, optval = 1;
+
+	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
+	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
+	if (ep->state != TCPX_ACCEPTING) {
+		tcpx_stripe_cm_drop(wait, ep, cm_ctx);
+		return;
+	}
+
+	ret = rx_cm_data(sock, ofi_ctrl_connreq, cm_ctx);
+	if (ret) {
+		if (ret == -FI_EAGAIN)
+			return;
+		tcpx_stripe_cm_drop(wait, ep, cm_ctx);
+		tcpx_stripe_listen_stop(wait, ep);
+		tcpx_stripe_cm_fail(ep, -ret);
+		return;
+	}
+
+	index = ntohl(cm_ctx->msg.hdr.seg_no);
+	if (ntohll(cm_ctx->msg.hdr.conn_id) != ep->stripe_id ||
+	    !index || index >= ep->stripe_cnt ||
+	    ep->stripes[index].sock != INVALID_SOCKET) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"discarding unexpected stripe connection\n");
+		tcpx_stripe_cm_drop(wait, ep, cm_ctx);
+		return;
+	}
+
+	ofi_wait_del_fd(wait, sock);
+	tcpx_stripe_cm_free(ep, cm_ctx);
+	(void) setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+			  (char *) &optval, sizeof(optval));
+	ep->stripes[index].sock = sock;
+
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		if (ep->stripes[i].sock == INVALID_SOCKET)
+			return;
+	}
+
+	tcpx_stripe_listen_stop(wait, ep);
+	cm_entry.fid = &ep->util_ep.ep_fid.fid;
+	ret = tcpx_ep_enable(ep, &cm_entry, sizeof(cm_entry));
+	if (ret) {
+		tcpx_stripe_cm_fail(ep, -ret);
+		return;
+	}
+
+	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "Connection Accept Successful\n");
+}
+
 static void process_cm_ctx(struct util_wait *wait,
 			   struct tcpx_cm_context *cm_ctx)
 {
@@ -506,6 +873,15 @@ static void process_cm_ctx(struct util_wait *wait,
 							  TCPX_CONNECTING));
 		tcpx_cm_recv_resp(wait, cm_ctx);
 		break;
+	case TCPX_CM_STRIPE_LISTEN:
+		tcpx_stripe_listen_process(wait, cm_ctx);
+		break;
+	case TCPX_CM_STRIPE_CONNECTING:
+		tcpx_stripe_send_req(wait, cm_ctx);
+		break;
+	case TCPX_CM_STRIPE_WAIT_REQ:
+		tcpx_stripe_recv_req(wait, cm_ctx);
+		break;
 	default:
 		break;
 	}
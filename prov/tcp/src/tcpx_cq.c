@@ -101,11 +101,11 @@ static int tcpx_cq_close(struct fid *fid)
 	struct tcpx_cq *tcpx_cq;
 
 	tcpx_cq = container_of(fid, struct tcpx_cq, util_cq.cq_fid.fid);
-	tcpx_buf_pools_destroy(tcpx_cq->buf_pools);
 	ret = ofi_cq_cleanup(&tcpx_cq->util_cq);
 	if (ret)
 		return ret;
 
+	tcpx_buf_pools_destroy(tcpx_cq->buf_pools);
 	free(tcpx_cq);
 	return 0;
 }
@@ -243,7 +243,7 @@ static void tcpx_buf_pool_init(struct ofi_bufpool_region *region, void *buf)
 	struct tcpx_buf_pool *pool = region->pool->attr.context;
 	struct tcpx_xfer_entry *xfer_entry = buf;
 
-	xfer_entry->hdr.base_hdr.version = TCPX_HDR_VERSION;
+	xfer_entry->hdr.base_hdr.version = TCPX_HDR_FULL_VERSION;
 	xfer_entry->hdr.base_hdr.op_data = pool->op_type;
 
 	switch (pool->op_type) {
@@ -289,6 +289,11 @@ static int tcpx_buf_pools_create(struct tcpx_buf_pool *buf_pools)
 		else
 			attr.chunk_cnt = 64;
 
+		/* only sends carry inject data beyond TCPX_MAX_INJECT */
+		attr.size = sizeof(struct tcpx_xfer_entry);
+		if (i == TCPX_OP_MSG_SEND || i == TCPX_OP_WRITE)
+			attr.size += tcpx_inject_size() - TCPX_MAX_INJECT;
+
 		attr.context = &buf_pools[i];
 		ret = ofi_bufpool_create_attr(&attr, &buf_pools[i].pool);
 		if (ret) {
@@ -338,8 +343,15 @@ int tcpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 
 	*cq_fid = &tcpx_cq->util_cq.cq_fid;
 	(*cq_fid)->fid.ops = &tcpx_cq_fi_ops;
+
+	/* socket fds are tracked by the CQ's internal wait set */
+	ret = ofi_cq_progress_add(&tcpx_cq->util_cq, &(*cq_fid)->fid);
+	if (ret)
+		goto cleanup;
 	return 0;
 
+cleanup:
+	ofi_cq_cleanup(&tcpx_cq->util_cq);
 destroy_pool:
 	tcpx_buf_pools_destroy(tcpx_cq->buf_pools);
 free_cq:
@@ -192,6 +192,8 @@ int tcpx_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err;
 
+	tcpx_domain->util_domain.auto_progress = ofi_progress_enabled(info);
+
 	*domain = &tcpx_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &tcpx_domain_fi_ops;
 	(*domain)->ops = &tcpx_domain_ops;
@@ -139,6 +139,7 @@ static int tcpx_ep_connect(struct fid_ep *ep, const void *addr,
 
 	cm_ctx->fid = &tcpx_ep->util_ep.ep_fid.fid;
 	cm_ctx->state = TCPX_CM_CONNECTING;
+	cm_ctx->stripe_info = tcpx_stripe_local_info();
 
 	if (paramlen) {
 		cm_ctx->cm_data_sz = paramlen;
@@ -186,6 +187,12 @@ static int tcpx_ep_accept(struct fid_ep *ep, const void *param, size_t paramlen)
 		memcpy(cm_ctx->msg.data, param, paramlen);
 	}
 
+	if (tcpx_ep->stripe_cnt > 1 && !tcpx_ep->stripe_cm_ctx) {
+		ret = tcpx_stripe_listen(tcpx_ep, cm_ctx);
+		if (ret)
+			goto free;
+	}
+
 	ret = ofi_wait_add_fd(tcpx_ep->util_ep.eq->wait, tcpx_ep->bsock.sock,
 			      POLLOUT, tcpx_eq_wait_try_func, NULL, cm_ctx);
 	if (ret)
@@ -226,6 +233,8 @@ static void tcpx_ep_flush_all_queues(struct tcpx_ep *ep)
 
 	tcpx_cq = container_of(ep->util_ep.rx_cq, struct tcpx_cq, util_cq);
 	tcpx_ep_flush_queue(&ep->rx_queue, tcpx_cq);
+	ep->stripe_tx_entry = NULL;
+	ep->stripe_rx_len = 0;
 }
 
 void tcpx_ep_disable(struct tcpx_ep *ep, int cm_err)
@@ -247,12 +256,14 @@ void tcpx_ep_disable(struct tcpx_ep *ep, int cm_err)
 			wait = container_of(ep->util_ep.tx_cq->wait,
 					    struct util_wait_fd, util_wait);
 			ofi_wait_fdset_del(wait, ep->bsock.sock);
+			tcpx_stripe_wait_del(ep, ep->util_ep.tx_cq->wait);
 		}
 
 		if (ep->util_ep.rx_cq) {
 			wait = container_of(ep->util_ep.rx_cq->wait,
 					    struct util_wait_fd, util_wait);
 			ofi_wait_fdset_del(wait, ep->bsock.sock);
+			tcpx_stripe_wait_del(ep, ep->util_ep.rx_cq->wait);
 		}
 		/* fall through */
 	case TCPX_ACCEPTING:
@@ -290,10 +301,17 @@ static int tcpx_ep_shutdown(struct fid_ep *ep, uint64_t flags)
 
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 
+	/* send anything held back, such as coalesced sends and acks */
+	fastlock_acquire(&tcpx_ep->lock);
+	if (tcpx_ep->state == TCPX_CONNECTED)
+		tcpx_progress_tx(tcpx_ep);
+	fastlock_release(&tcpx_ep->lock);
+
 	ret = ofi_shutdown(tcpx_ep->bsock.sock, SHUT_RDWR);
 	if (ret && ofi_sockerr() != ENOTCONN) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA, "ep shutdown unsuccessful\n");
 	}
+	tcpx_stripe_shutdown(tcpx_ep);
 
 	fastlock_acquire(&tcpx_ep->lock);
 	tcpx_ep_disable(tcpx_ep, 0);
@@ -505,6 +523,12 @@ static int tcpx_ep_close(struct fid *fid)
 	eq = ep->util_ep.eq ?
 	     container_of(ep->util_ep.eq, struct tcpx_eq, util_eq) : NULL;
 
+	/* send anything held back, such as coalesced sends and acks */
+	fastlock_acquire(&ep->lock);
+	if (ep->state == TCPX_CONNECTED)
+		tcpx_progress_tx(ep);
+	fastlock_release(&ep->lock);
+
 	/* eq->close_lock protects from processing stale connection events */
 	if (eq)
 		fastlock_acquire(&eq->close_lock);
@@ -518,9 +542,12 @@ static int tcpx_ep_close(struct fid *fid)
 	if (ep->util_ep.eq && ep->util_ep.eq->wait)
 		ofi_wait_del_fd(ep->util_ep.eq->wait, ep->bsock.sock);
 
+	tcpx_stripe_close(ep);
 	if (eq)
 		fastlock_release(&eq->close_lock);
 
+	ofi_progress_ep_detach(&ep->util_ep);
+
 	/* Lock not technically needed, since we're freeing the EP.  But it's
 	 * harmless to acquire and silences static code analysis tools.
 	 */
@@ -668,6 +695,7 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 
 	ofi_bsock_init(&ep->bsock, tcpx_staging_sbuf_size,
 		       tcpx_prefetch_rbuf_size);
+	ep->stripe_cnt = 1;
 	if (info->handle) {
 		if (((fid_t) info->handle)->fclass == FI_CLASS_PEP) {
 			pep = container_of(info->handle, struct tcpx_pep,
@@ -682,7 +710,11 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 			ep->bsock.sock = handle->sock;
 			ep->hdr_bswap = handle->endian_match ?
 					tcpx_hdr_none : tcpx_hdr_bswap;
+			ep->hdr_version = handle->hdr_version;
+			ret = tcpx_stripe_init(ep, handle->stripe_info);
 			free(handle);
+			if (ret)
+				goto err3;
 
 			ret = tcpx_setup_socket(ep->bsock.sock, info);
 			if (ret)
@@ -729,6 +761,7 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 	ep->start_op[ofi_op_write] = tcpx_op_write;
 	return 0;
 err3:
+	free(ep->stripes);
 	ofi_close_socket(ep->bsock.sock);
 err2:
 	ofi_endpoint_close(&ep->util_ep);
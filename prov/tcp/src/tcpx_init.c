@@ -56,6 +56,10 @@ int tcpx_nodelay = -1;
 
 int tcpx_staging_sbuf_size = 0; /* disable send buffering for now */
 int tcpx_prefetch_rbuf_size = OFI_BYTEQ_SIZE;
+int tcpx_compact_hdr = 1;
+int tcpx_tx_coalesce_usec = 0;
+int tcpx_stripe_cnt = 1;
+size_t tcpx_stripe_size = 262144;
 
 
 static void tcpx_init_env(void)
@@ -85,6 +89,35 @@ static void tcpx_init_env(void)
 	fi_param_get_int(&tcpx_prov, "prefetch_rbuf_size",
 			 &tcpx_prefetch_rbuf_size);
 
+	fi_param_define(&tcpx_prov, "compact_hdr", FI_PARAM_BOOL,
+			"offer the compact message header format and "
+			"piggybacked delivery complete acks to peers "
+			"(default: true)");
+	fi_param_get_bool(&tcpx_prov, "compact_hdr", &tcpx_compact_hdr);
+
+	fi_param_define(&tcpx_prov, "tx_coalesce_usec", FI_PARAM_INT,
+			"hold back small sends for up to this many "
+			"microseconds, so that they can be sent together with "
+			"a single writev, set to 0 to disable (default: 0)");
+	fi_param_get_int(&tcpx_prov, "tx_coalesce_usec",
+			 &tcpx_tx_coalesce_usec);
+	if (tcpx_tx_coalesce_usec < 0)
+		tcpx_tx_coalesce_usec = 0;
+	tcpx_info.tx_attr->inject_size = tcpx_inject_size();
+
+	fi_param_define(&tcpx_prov, "stripe_cnt", FI_PARAM_INT,
+			"number of sockets over which large RMA payloads "
+			"are striped, both peers must enable striping, "
+			"max %d (default: 1, disabled)", TCPX_MAX_STRIPES);
+	fi_param_get_int(&tcpx_prov, "stripe_cnt", &tcpx_stripe_cnt);
+	if (tcpx_stripe_cnt > TCPX_MAX_STRIPES)
+		tcpx_stripe_cnt = TCPX_MAX_STRIPES;
+
+	fi_param_define(&tcpx_prov, "stripe_size", FI_PARAM_SIZE_T,
+			"minimum RMA payload size that is striped "
+			"(default: %zu)", tcpx_stripe_size);
+	fi_param_get_size_t(&tcpx_prov, "stripe_size", &tcpx_stripe_size);
+
 	fi_param_get_int(&tcpx_prov, "port_high_range", &port_range.high);
 	fi_param_get_int(&tcpx_prov, "port_low_range", &port_range.low);
 
@@ -90,14 +90,13 @@ static inline void
 tcpx_init_tx_inject(struct tcpx_xfer_entry *tx_entry, size_t hdr_len,
 		    const void *buf, size_t data_len)
 {
-	assert(data_len <= TCPX_MAX_INJECT);
-	tcpx_init_tx_sizes(tx_entry, hdr_len, data_len);
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = data_len,
+	};
 
-	tx_entry->iov[0].iov_base = (void *) &tx_entry->hdr;
-	memcpy((uint8_t *) &tx_entry->hdr + hdr_len, (uint8_t *) buf,
-		data_len);
-	tx_entry->iov[0].iov_len = hdr_len + data_len;
-	tx_entry->iov_cnt = 1;
+	tcpx_init_tx_sizes(tx_entry, hdr_len, data_len);
+	tcpx_copy_inject(tx_entry, hdr_len, &iov, 1, data_len);
 }
 
 static inline void
@@ -119,7 +118,7 @@ tcpx_init_tx_buf(struct tcpx_xfer_entry *tx_entry, size_t hdr_len,
 
 static inline void
 tcpx_init_tx_iov(struct tcpx_xfer_entry *tx_entry, size_t hdr_len,
-		 const struct iovec *iov, size_t count)
+		 const struct iovec *iov, size_t count, uint64_t flags)
 {
 	size_t data_len;
 
@@ -127,6 +126,11 @@ tcpx_init_tx_iov(struct tcpx_xfer_entry *tx_entry, size_t hdr_len,
 	data_len = ofi_total_iov_len(iov, count);
 	tcpx_init_tx_sizes(tx_entry, hdr_len, data_len);
 
+	if (flags & FI_INJECT) {
+		tcpx_copy_inject(tx_entry, hdr_len, iov, count, data_len);
+		return;
+	}
+
 	tx_entry->iov[0].iov_base = (void *) &tx_entry->hdr;
 	if (data_len <= TCPX_MAX_INJECT) {
 		ofi_copy_iov_buf(iov, count, 0, (uint8_t *) &tx_entry->hdr +
@@ -227,7 +231,6 @@ static inline void tcpx_queue_send(struct tcpx_ep *ep,
 				   struct tcpx_xfer_entry *tx_entry)
 {
 	tx_entry->rem_len = tx_entry->hdr.base_hdr.size;
-	ep->hdr_bswap(&tx_entry->hdr.base_hdr);
 
 	fastlock_acquire(&ep->lock);
 	tcpx_tx_queue_insert(ep, tx_entry);
@@ -254,7 +257,8 @@ static ssize_t tcpx_sendmsg(struct fid_ep *ep, const struct fi_msg *msg,
 		hdr_len = sizeof(tx_entry->hdr.base_hdr);
 	}
 
-	tcpx_init_tx_iov(tx_entry, hdr_len, msg->msg_iov, msg->iov_count);
+	tcpx_init_tx_iov(tx_entry, hdr_len, msg->msg_iov, msg->iov_count,
+			 flags);
 
 	tx_entry->flags = ((tcpx_ep->util_ep.tx_op_flags & FI_COMPLETION) |
 			    flags | FI_MSG | FI_SEND);
@@ -307,7 +311,8 @@ static ssize_t tcpx_sendv(struct fid_ep *ep, const struct iovec *iov,
 	if (!tx_entry)
 		return -FI_EAGAIN;
 
-	tcpx_init_tx_iov(tx_entry, sizeof(tx_entry->hdr.base_hdr), iov, count);
+	tcpx_init_tx_iov(tx_entry, sizeof(tx_entry->hdr.base_hdr), iov, count,
+			 0);
 
 	tx_entry->context = context;
 	tx_entry->flags = (tcpx_ep->util_ep.tx_op_flags & FI_COMPLETION) |
@@ -446,7 +451,8 @@ tcpx_tsendmsg(struct fid_ep *fid_ep, const struct fi_msg_tagged *msg,
 		hdr_len = sizeof(tx_entry->hdr.tag_hdr);
 	}
 
-	tcpx_init_tx_iov(tx_entry, hdr_len, msg->msg_iov, msg->iov_count);
+	tcpx_init_tx_iov(tx_entry, hdr_len, msg->msg_iov, msg->iov_count,
+			 flags);
 
 	tx_entry->flags = ((ep->util_ep.tx_op_flags & FI_COMPLETION) |
 			    flags | FI_TAGGED | FI_SEND);
@@ -504,7 +510,8 @@ tcpx_tsendv(struct fid_ep *fid_ep, const struct iovec *iov, void **desc,
 	tx_entry->hdr.base_hdr.flags = TCPX_TAGGED;
 	tx_entry->hdr.tag_hdr.tag = tag;
 
-	tcpx_init_tx_iov(tx_entry, sizeof(tx_entry->hdr.tag_hdr), iov, count);
+	tcpx_init_tx_iov(tx_entry, sizeof(tx_entry->hdr.tag_hdr), iov, count,
+			 0);
 
 	tx_entry->context = context;
 	tx_entry->flags = (ep->util_ep.tx_op_flags & FI_COMPLETION) |
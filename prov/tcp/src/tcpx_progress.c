@@ -43,18 +43,17 @@
 #include <ofi_iov.h>
 
 
-static void tcpx_process_tx_entry(struct tcpx_xfer_entry *tx_entry)
+static void tcpx_tx_entry_done(struct tcpx_xfer_entry *tx_entry, int ret)
 {
 	struct tcpx_cq *tcpx_cq;
-	int ret;
-
-	ret = tcpx_send_msg(tx_entry);
-	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
-		return;
 
 	/* Keep this path below as a single pass path.*/
-	tx_entry->ep->hdr_bswap(&tx_entry->hdr.base_hdr);
+	if (!tx_entry->chdr_len)
+		tx_entry->ep->hdr_bswap(&tx_entry->hdr.base_hdr);
 	slist_remove_head(&tx_entry->ep->tx_queue);
+	OFI_TRACEPOINT(OFI_TRACE_TCP_TX_DONE, tx_entry->hdr.base_hdr.op,
+		       tx_entry->hdr.base_hdr.flags,
+		       tx_entry->hdr.base_hdr.size, ret);
 
 	if (ret) {
 		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN, "msg send failed\n");
@@ -75,11 +74,81 @@ static void tcpx_process_tx_entry(struct tcpx_xfer_entry *tx_entry)
 	tcpx_xfer_entry_free(tcpx_cq, tx_entry);
 }
 
+static void tcpx_process_tx_entry(struct tcpx_xfer_entry *tx_entry)
+{
+	int ret;
+
+	if (tx_entry->flags & TCPX_STRIPED)
+		ret = tcpx_send_stripes(tx_entry);
+	else
+		ret = tcpx_send_msg(tx_entry);
+	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+		return;
+
+	tcpx_tx_entry_done(tx_entry, ret);
+}
+
+/* Send as many whole queued entries as fit in one writev, then retire
+ * the bytes sent from the head of the queue.
+ */
+static void tcpx_process_tx_batch(struct tcpx_ep *ep)
+{
+	struct iovec iov[TCPX_TX_BATCH_IOV];
+	struct tcpx_xfer_entry *tx_entry;
+	struct slist_entry *item, *prev;
+	size_t cnt = 0, len;
+	ssize_t ret;
+
+	slist_foreach(&ep->tx_queue, item, prev) {
+		tx_entry = container_of(item, struct tcpx_xfer_entry, entry);
+		if (cnt + tx_entry->iov_cnt > TCPX_TX_BATCH_IOV ||
+		    tx_entry->flags & TCPX_STRIPED)
+			break;
+		memcpy(&iov[cnt], tx_entry->iov,
+		       tx_entry->iov_cnt * sizeof(*iov));
+		cnt += tx_entry->iov_cnt;
+	}
+	(void) prev;
+
+	tx_entry = container_of(ep->tx_queue.head, struct tcpx_xfer_entry,
+				entry);
+	if (!cnt || cnt == tx_entry->iov_cnt) {
+		tcpx_process_tx_entry(tx_entry);
+		return;
+	}
+
+	ret = ofi_bsock_sendv(&ep->bsock, iov, cnt);
+	if (ret < 0) {
+		if (!OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			tcpx_tx_entry_done(tx_entry, (int) ret);
+		return;
+	}
+
+	while (ret) {
+		tx_entry = container_of(ep->tx_queue.head,
+					struct tcpx_xfer_entry, entry);
+		len = MIN((size_t) ret, tx_entry->rem_len);
+		tx_entry->rem_len -= len;
+		ret -= len;
+		if (tx_entry->rem_len) {
+			ofi_consume_iov(tx_entry->iov, &tx_entry->iov_cnt, len);
+			break;
+		}
+		tcpx_tx_entry_done(tx_entry, 0);
+	}
+}
+
 static int tcpx_prepare_rx_entry_resp(struct tcpx_xfer_entry *rx_entry)
 {
 	struct tcpx_cq *tcpx_tx_cq;
 	struct tcpx_xfer_entry *resp_entry;
 
+	/* Compact headers carry the ack on later outgoing traffic */
+	if (tcpx_use_chdr(rx_entry->ep)) {
+		rx_entry->ep->ack_cnt++;
+		goto out;
+	}
+
 	tcpx_tx_cq = container_of(rx_entry->ep->util_ep.tx_cq,
 			       struct tcpx_cq, util_cq);
 
@@ -101,8 +170,8 @@ static int tcpx_prepare_rx_entry_resp(struct tcpx_xfer_entry *rx_entry)
 	resp_entry->rem_len = sizeof(resp_entry->hdr.base_hdr);
 	resp_entry->ep = rx_entry->ep;
 
-	resp_entry->ep->hdr_bswap(&resp_entry->hdr.base_hdr);
 	tcpx_tx_queue_insert(resp_entry->ep, resp_entry);
+out:
 	tcpx_cq_report_success(rx_entry->ep->util_ep.rx_cq, rx_entry);
 
 	tcpx_rx_entry_free(rx_entry);
@@ -194,6 +263,11 @@ static int tcpx_prepare_rx_write_resp(struct tcpx_xfer_entry *rx_entry)
 	struct tcpx_cq *tcpx_rx_cq, *tcpx_tx_cq;
 	struct tcpx_xfer_entry *resp_entry;
 
+	if (tcpx_use_chdr(rx_entry->ep)) {
+		rx_entry->ep->ack_cnt++;
+		goto out;
+	}
+
 	tcpx_tx_cq = container_of(rx_entry->ep->util_ep.tx_cq,
 				  struct tcpx_cq, util_cq);
 
@@ -214,9 +288,9 @@ static int tcpx_prepare_rx_write_resp(struct tcpx_xfer_entry *rx_entry)
 	resp_entry->context = NULL;
 	resp_entry->rem_len = resp_entry->hdr.base_hdr.size;
 	resp_entry->ep = rx_entry->ep;
-	resp_entry->ep->hdr_bswap(&resp_entry->hdr.base_hdr);
 	tcpx_tx_queue_insert(resp_entry->ep, resp_entry);
 
+out:
 	tcpx_cq_report_success(rx_entry->ep->util_ep.rx_cq, rx_entry);
 	tcpx_rx_cq = container_of(rx_entry->ep->util_ep.rx_cq,
 				  struct tcpx_cq, util_cq);
@@ -356,7 +430,6 @@ static int tcpx_prepare_rx_remote_read_resp(struct tcpx_xfer_entry *resp_entry)
 	resp_entry->context = NULL;
 	resp_entry->rem_len = resp_entry->hdr.base_hdr.size;
 
-	resp_entry->ep->hdr_bswap(&resp_entry->hdr.base_hdr);
 	tcpx_tx_queue_insert(resp_entry->ep, resp_entry);
 	resp_entry->ep->cur_rx_entry = NULL;
 	return FI_SUCCESS;
@@ -418,7 +491,7 @@ static void tcpx_rx_setup(struct tcpx_ep *ep, struct tcpx_xfer_entry *rx_entry,
 			    ep->cur_rx_msg.hdr.base_hdr.payload_off;
 
 	/* Reset to receive next message */
-	ep->cur_rx_msg.hdr_len = sizeof(ep->cur_rx_msg.hdr.base_hdr);
+	ep->cur_rx_msg.hdr_len = tcpx_rx_hdr_min(ep);
 	ep->cur_rx_msg.done_len = 0;
 }
 
@@ -436,6 +509,24 @@ static int tcpx_handle_resp(struct tcpx_xfer_entry *tx_entry)
 	return FI_SUCCESS;
 }
 
+static int tcpx_handle_acks(struct tcpx_ep *ep, uint64_t ack_cnt)
+{
+	struct tcpx_xfer_entry *tx_entry;
+
+	for (; ack_cnt; ack_cnt--) {
+		if (slist_empty(&ep->tx_rsp_pend_queue)) {
+			FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+				"ack received with no transfer pending\n");
+			return -FI_EIO;
+		}
+
+		tx_entry = container_of(ep->tx_rsp_pend_queue.head,
+					struct tcpx_xfer_entry, entry);
+		tcpx_handle_resp(tx_entry);
+	}
+	return FI_SUCCESS;
+}
+
 int tcpx_op_msg(struct tcpx_ep *tcpx_ep)
 {
 	struct tcpx_xfer_entry *rx_entry;
@@ -568,6 +659,7 @@ int tcpx_op_write(struct tcpx_ep *tcpx_ep)
 
 	tcpx_copy_rma_iov_to_msg_iov(rx_entry);
 	tcpx_rx_setup(tcpx_ep, rx_entry, tcpx_process_remote_write);
+	tcpx_stripe_rx_setup(rx_entry);
 	return FI_SUCCESS;
 
 }
@@ -589,6 +681,7 @@ int tcpx_op_read_rsp(struct tcpx_ep *tcpx_ep)
 	rx_entry->hdr.base_hdr.op_data = TCPX_OP_READ_RSP;
 
 	tcpx_rx_setup(tcpx_ep, rx_entry, tcpx_process_remote_read);
+	tcpx_stripe_rx_setup(rx_entry);
 	return FI_SUCCESS;
 }
 
@@ -623,18 +716,284 @@ static int tcpx_get_next_rx_hdr(struct tcpx_ep *ep)
 		return -FI_EAGAIN;
 
 	ep->hdr_bswap(&ep->cur_rx_msg.hdr.base_hdr);
+	OFI_TRACEPOINT(OFI_TRACE_TCP_RX_HDR, ep->cur_rx_msg.hdr.base_hdr.op,
+		       ep->cur_rx_msg.hdr.base_hdr.flags,
+		       ep->cur_rx_msg.hdr.base_hdr.size,
+		       ep->cur_rx_msg.hdr_len);
+	return FI_SUCCESS;
+}
+
+/* Replace the full header with a compact one in the first iov.  Any acks
+ * owed to the peer are carried in the compact header.
+ */
+static void tcpx_encode_chdr(struct tcpx_ep *ep,
+			     struct tcpx_xfer_entry *tx_entry)
+{
+	struct tcpx_base_hdr *hdr = &tx_entry->hdr.base_hdr;
+	struct ofi_rma_iov *rma_iov;
+	uint64_t *field;
+	uint8_t *ptr = &tx_entry->chdr[TCPX_CHDR_MIN];
+	size_t inject_len;
+	uint8_t ctl;
+	int i;
+
+	if (hdr->op == ofi_op_msg && hdr->op_data == TCPX_OP_MSG_RESP) {
+		ctl = TCPX_CHDR | TCPX_CHDR_OP_ACK;
+	} else {
+		ctl = TCPX_CHDR | hdr->op;
+		ptr += tcpx_put_varint(ptr, hdr->size - hdr->payload_off);
+	}
+
+	if (ep->ack_cnt) {
+		ctl |= TCPX_CHDR_ACK;
+		ptr += tcpx_put_varint(ptr, ep->ack_cnt);
+		ep->ack_cnt = 0;
+	}
+
+	field = (uint64_t *) (hdr + 1);
+	if (hdr->flags & TCPX_REMOTE_CQ_DATA) {
+		ctl |= TCPX_CHDR_DATA;
+		ptr += tcpx_put_varint(ptr, *field++);
+	}
+
+	if (hdr->flags & TCPX_TAGGED) {
+		ctl |= TCPX_CHDR_TAG;
+		ptr += tcpx_put_varint(ptr, *field++);
+	}
+
+	if (hdr->flags & TCPX_DELIVERY_COMPLETE)
+		ctl |= TCPX_CHDR_DC;
+
+	if (hdr->op == ofi_op_read_req || hdr->op == ofi_op_write) {
+		rma_iov = (struct ofi_rma_iov *) field;
+		*ptr++ = hdr->rma_iov_cnt;
+		for (i = 0; i < hdr->rma_iov_cnt; i++) {
+			ptr += tcpx_put_varint(ptr, rma_iov[i].addr);
+			ptr += tcpx_put_varint(ptr, rma_iov[i].len);
+			ptr += tcpx_put_varint(ptr, rma_iov[i].key);
+		}
+	}
+
+	tx_entry->chdr_len = (uint8_t) (ptr - tx_entry->chdr);
+	tx_entry->chdr[0] = ctl;
+	tx_entry->chdr[1] = tx_entry->chdr_len;
+
+	/* Keep inject data contiguous with the header, so that it still
+	 * goes out with a single send.
+	 */
+	inject_len = tx_entry->iov[0].iov_len - hdr->payload_off;
+	if (inject_len) {
+		assert(tx_entry->iov_cnt == 1 && inject_len <= TCPX_MAX_INJECT);
+		memcpy(ptr, (uint8_t *) hdr + hdr->payload_off, inject_len);
+	}
+	tx_entry->iov[0].iov_base = tx_entry->chdr;
+	tx_entry->iov[0].iov_len = tx_entry->chdr_len + inject_len;
+	tx_entry->rem_len = tx_entry->rem_len - hdr->payload_off +
+			    tx_entry->chdr_len;
+}
+
+/* Commit complete needs the peer to see the flag, so keeps a full header */
+static void tcpx_set_tx_hdr(struct tcpx_ep *ep,
+			    struct tcpx_xfer_entry *tx_entry)
+{
+	if (tcpx_use_chdr(ep) &&
+	    !(tx_entry->hdr.base_hdr.flags & TCPX_COMMIT_COMPLETE)) {
+		tcpx_encode_chdr(ep, tx_entry);
+	} else {
+		tx_entry->chdr_len = 0;
+		ep->hdr_bswap(&tx_entry->hdr.base_hdr);
+	}
+}
+
+/* Acks owed to the peer ride on the next outgoing header.  Acks generated
+ * while receiving are held until the next tx progress call, which gives
+ * the application a chance to post a reply that carries them.  If nothing
+ * has been sent by then, they go out in an ack-only header, once the tx
+ * queue has drained.  Closing or shutting down the endpoint also sends
+ * them.
+ */
+static void tcpx_send_ack(struct tcpx_ep *ep)
+{
+	struct tcpx_xfer_entry *ack_entry;
+	struct tcpx_cq *tcpx_cq;
+
+	if (!ep->ack_cnt || !slist_empty(&ep->tx_queue) ||
+	    ep->state != TCPX_CONNECTED)
+		return;
+
+	tcpx_cq = container_of(ep->util_ep.tx_cq, struct tcpx_cq, util_cq);
+	ack_entry = tcpx_xfer_entry_alloc(tcpx_cq, TCPX_OP_MSG_RESP);
+	if (!ack_entry)
+		return;
+
+	ack_entry->iov[0].iov_base = (void *) &ack_entry->hdr;
+	ack_entry->iov[0].iov_len = sizeof(ack_entry->hdr.base_hdr);
+	ack_entry->iov_cnt = 1;
+
+	ack_entry->hdr.base_hdr.size = sizeof(ack_entry->hdr.base_hdr);
+	ack_entry->hdr.base_hdr.payload_off =
+		(uint8_t) sizeof(ack_entry->hdr.base_hdr);
+
+	ack_entry->flags = 0;
+	ack_entry->context = NULL;
+	ack_entry->rem_len = sizeof(ack_entry->hdr.base_hdr);
+	ack_entry->ep = ep;
+	tcpx_tx_queue_insert(ep, ack_entry);
+}
+
+/* Expand a compact header into the full header layout, so that the
+ * op handlers do not need to know which format was received.
+ */
+static int tcpx_decode_chdr(struct tcpx_ep *ep)
+{
+	struct tcpx_cur_rx_msg *msg = &ep->cur_rx_msg;
+	struct tcpx_base_hdr *hdr = &msg->hdr.base_hdr;
+	const uint8_t *ptr = &msg->chdr[TCPX_CHDR_MIN];
+	const uint8_t *end = &msg->chdr[msg->hdr_len];
+	struct ofi_rma_iov *rma_iov;
+	uint64_t *field, len = 0, ack_cnt = 0;
+	uint8_t ctl = msg->chdr[0];
+	int i;
+
+	hdr->version = TCPX_HDR_FULL_VERSION;
+	hdr->op = ctl & TCPX_CHDR_OP_MASK;
+	hdr->flags = 0;
+	hdr->op_data = 0;
+	hdr->rma_iov_cnt = 0;
+	hdr->rsvd = 0;
+
+	if (hdr->op != TCPX_CHDR_OP_ACK && tcpx_get_varint(&ptr, end, &len))
+		return -FI_EIO;
+
+	if ((ctl & TCPX_CHDR_ACK) && tcpx_get_varint(&ptr, end, &ack_cnt))
+		return -FI_EIO;
+
+	field = (uint64_t *) (hdr + 1);
+	if (ctl & TCPX_CHDR_DATA) {
+		hdr->flags |= TCPX_REMOTE_CQ_DATA;
+		if (tcpx_get_varint(&ptr, end, field++))
+			return -FI_EIO;
+	}
+
+	if (ctl & TCPX_CHDR_TAG) {
+		hdr->flags |= TCPX_TAGGED;
+		if (tcpx_get_varint(&ptr, end, field++))
+			return -FI_EIO;
+	}
+
+	if (ctl & TCPX_CHDR_DC)
+		hdr->flags |= TCPX_DELIVERY_COMPLETE;
+
+	if (hdr->op == ofi_op_read_req || hdr->op == ofi_op_write) {
+		if (ptr == end || *ptr > TCPX_IOV_LIMIT)
+			return -FI_EIO;
+
+		hdr->rma_iov_cnt = *ptr++;
+		rma_iov = (struct ofi_rma_iov *) field;
+		for (i = 0; i < hdr->rma_iov_cnt; i++) {
+			if (tcpx_get_varint(&ptr, end, &rma_iov[i].addr) ||
+			    tcpx_get_varint(&ptr, end, &rma_iov[i].len) ||
+			    tcpx_get_varint(&ptr, end, &rma_iov[i].key))
+				return -FI_EIO;
+		}
+		field = (uint64_t *) &rma_iov[i];
+	}
+
+	if (ptr != end)
+		return -FI_EIO;
+
+	hdr->payload_off = (uint8_t) ((uint8_t *) field - (uint8_t *) hdr);
+	hdr->size = hdr->payload_off + len;
+
+	return ack_cnt ? tcpx_handle_acks(ep, ack_cnt) : FI_SUCCESS;
+}
+
+static int tcpx_get_next_rx_chdr(struct tcpx_ep *ep)
+{
+	struct tcpx_cur_rx_msg *msg = &ep->cur_rx_msg;
+	ssize_t ret;
+
+next:
+	if (msg->done_len < TCPX_CHDR_MIN) {
+		ret = ofi_bsock_recv(&ep->bsock, &msg->chdr[msg->done_len],
+				     TCPX_CHDR_MIN - msg->done_len);
+		if (ret < 0)
+			return (int) ret;
+
+		msg->done_len += ret;
+		if (msg->done_len < TCPX_CHDR_MIN)
+			return -FI_EAGAIN;
+
+		if (msg->chdr[0] & TCPX_CHDR) {
+			msg->hdr_len = msg->chdr[1];
+			if (msg->hdr_len < TCPX_CHDR_MIN ||
+			    msg->hdr_len > TCPX_MAX_CHDR) {
+				FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+					"Invalid compact header length\n");
+				return -FI_ENOTCONN; /* force shutdown */
+			}
+		} else {
+			memcpy(&msg->hdr, msg->chdr, TCPX_CHDR_MIN);
+			msg->hdr_len = sizeof(msg->hdr.base_hdr);
+		}
+	}
+
+	/* The peer may still send full headers, e.g. for commit complete */
+	if (!(msg->chdr[0] & TCPX_CHDR))
+		return tcpx_get_next_rx_hdr(ep);
+
+	if (msg->done_len < msg->hdr_len) {
+		ret = ofi_bsock_recv(&ep->bsock, &msg->chdr[msg->done_len],
+				     msg->hdr_len - msg->done_len);
+		if (ret < 0)
+			return (int) ret;
+
+		msg->done_len += ret;
+		if (msg->done_len < msg->hdr_len)
+			return -FI_EAGAIN;
+	}
+
+	if (tcpx_decode_chdr(ep)) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+			"Invalid compact header received\n");
+		return -FI_ENOTCONN; /* force shutdown */
+	}
+
+	OFI_TRACEPOINT(OFI_TRACE_TCP_RX_HDR, msg->hdr.base_hdr.op,
+		       msg->hdr.base_hdr.flags, msg->hdr.base_hdr.size,
+		       msg->hdr_len);
+
+	if (msg->hdr.base_hdr.op == TCPX_CHDR_OP_ACK) {
+		msg->hdr_len = TCPX_CHDR_MIN;
+		msg->done_len = 0;
+		if (!ofi_bsock_readable(&ep->bsock))
+			return -FI_EAGAIN;
+		goto next;
+	}
 	return FI_SUCCESS;
 }
 
+/* A progress thread may block right after receiving, so do not wait for
+ * the application to reply.
+ */
+static void tcpx_progress_ack(struct tcpx_ep *ep)
+{
+	if (ep->util_ep.domain->auto_progress)
+		tcpx_send_ack(ep);
+}
+
 void tcpx_progress_rx(struct tcpx_ep *ep)
 {
 	int ret;
 
 	assert(fastlock_held(&ep->lock));
+	ofi_perf_region_start(OFI_PERF_TCPX_PROGRESS_RX);
 	do {
 		if (!ep->cur_rx_entry) {
 			if (ep->cur_rx_msg.done_len < ep->cur_rx_msg.hdr_len) {
-				ret = tcpx_get_next_rx_hdr(ep);
+				ret = tcpx_use_chdr(ep) ?
+				      tcpx_get_next_rx_chdr(ep) :
+				      tcpx_get_next_rx_hdr(ep);
 				if (ret)
 					goto err;
 			}
@@ -653,12 +1012,18 @@ void tcpx_progress_rx(struct tcpx_ep *ep)
 		assert(ep->cur_rx_proc_fn);
 		ep->cur_rx_proc_fn(ep->cur_rx_entry);
 
-	} while (ofi_bsock_readable(&ep->bsock));
+		/* the rest of a striped payload arrives on other sockets */
+	} while (ofi_bsock_readable(&ep->bsock) && !ep->stripe_rx_len);
 
+	ofi_perf_region_end(OFI_PERF_TCPX_PROGRESS_RX);
+	tcpx_progress_ack(ep);
 	return;
 err:
-	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+	ofi_perf_region_end(OFI_PERF_TCPX_PROGRESS_RX);
+	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret)) {
+		tcpx_progress_ack(ep);
 		return;
+	}
 
 	if (ret == -FI_ENOTCONN)
 		tcpx_ep_disable(ep, 0);
@@ -670,13 +1035,17 @@ void tcpx_progress_tx(struct tcpx_ep *ep)
 	struct slist_entry *entry;
 
 	assert(fastlock_held(&ep->lock));
-	if (!slist_empty(&ep->tx_queue)) {
+	if (!slist_empty(&ep->tx_queue) && tcpx_tx_coalesce_usec) {
+		ep->tx_defer_len = 0;
+		tcpx_process_tx_batch(ep);
+	} else if (!slist_empty(&ep->tx_queue)) {
 		entry = ep->tx_queue.head;
 		tx_entry = container_of(entry, struct tcpx_xfer_entry, entry);
 		tcpx_process_tx_entry(tx_entry);
 	} else {
 		(void) ofi_bsock_flush(&ep->bsock);
 	}
+	tcpx_send_ack(ep);
 }
 
 int tcpx_try_func(void *util_ep)
@@ -718,14 +1087,77 @@ epoll_mod:
 	return ret;
 }
 
+/* With coalescing enabled, application sends are queued behind a blocked
+ * socket, and small ones are held back until TCPX_TX_DEFER_MAX bytes are
+ * waiting or the coalescing deadline has passed.  Either way, the next
+ * progress call sends everything that is queued.
+ */
+static bool tcpx_tx_defer(struct tcpx_ep *ep,
+			  struct tcpx_xfer_entry *tx_entry)
+{
+	uint64_t now;
+
+	switch (tx_entry->hdr.base_hdr.op_data) {
+	case TCPX_OP_MSG_SEND:
+	case TCPX_OP_WRITE:
+	case TCPX_OP_READ_REQ:
+		break;
+	default:
+		return false;
+	}
+
+	if (tx_entry->rem_len > TCPX_TX_DEFER_ENTRY)
+		return false;
+
+	now = ofi_gettime_us();
+	if (!ep->tx_defer_len)
+		ep->tx_defer_start = now;
+	ep->tx_defer_len += tx_entry->rem_len;
+	return ep->tx_defer_len < TCPX_TX_DEFER_MAX &&
+	       now - ep->tx_defer_start < (uint64_t) tcpx_tx_coalesce_usec;
+}
+
+static void tcpx_tx_queue_coalesce(struct tcpx_ep *ep,
+				   struct tcpx_xfer_entry *tx_entry,
+				   bool pending)
+{
+	struct util_wait *wait = ep->util_ep.tx_cq->wait;
+
+	if (pending && !ep->tx_defer_len)
+		return;
+
+	if (tcpx_tx_defer(ep, tx_entry)) {
+		/* A thread blocked on the wait set only wakes for pollout
+		 * once it is set, so kick it when a new batch starts.
+		 */
+		if (!pending && !ep->pollout_set && wait)
+			wait->signal(wait);
+		return;
+	}
+
+	ep->tx_defer_len = 0;
+	tcpx_process_tx_batch(ep);
+	if (!slist_empty(&ep->tx_queue) && wait)
+		wait->signal(wait);
+}
+
 void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
 			  struct tcpx_xfer_entry *tx_entry)
 {
 	bool pending;
 	struct util_wait *wait = tcpx_ep->util_ep.tx_cq->wait;
 
+	tcpx_set_tx_hdr(tcpx_ep, tx_entry);
+	tcpx_stripe_tx_check(tcpx_ep, tx_entry);
 	pending = tcpx_tx_pending(tcpx_ep);
 	slist_insert_tail(&tx_entry->entry, &tcpx_ep->tx_queue);
+	OFI_TRACEPOINT(OFI_TRACE_TCP_TX_QUEUE, tx_entry->hdr.base_hdr.op,
+		       pending, 0, 0);
+
+	if (tcpx_tx_coalesce_usec) {
+		tcpx_tx_queue_coalesce(tcpx_ep, tx_entry, pending);
+		return;
+	}
 
 	if (!pending) {
 		tcpx_process_tx_entry(tx_entry);
@@ -117,7 +117,6 @@ static ssize_t tcpx_rma_readmsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
 	tcpx_rma_read_send_entry_fill(send_entry, tcpx_ep, msg);
 	tcpx_rma_read_recv_entry_fill(recv_entry, tcpx_ep, msg, flags);
 
-	tcpx_ep->hdr_bswap(&send_entry->hdr.base_hdr);
 	fastlock_acquire(&tcpx_ep->lock);
 	slist_insert_tail(&recv_entry->entry, &tcpx_ep->rma_read_queue);
 	tcpx_tx_queue_insert(tcpx_ep, send_entry);
@@ -197,7 +196,7 @@ static ssize_t tcpx_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg
 
 	data_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count);
 
-	assert(!(flags & FI_INJECT) || (data_len <= TCPX_MAX_INJECT));
+	assert(!(flags & FI_INJECT) || (data_len <= tcpx_inject_size()));
 
 	if (flags & FI_REMOTE_CQ_DATA) {
 		send_entry->hdr.base_hdr.flags = TCPX_REMOTE_CQ_DATA;
@@ -217,21 +216,16 @@ static ssize_t tcpx_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg
 	send_entry->hdr.base_hdr.payload_off = (uint8_t)offset;
 	send_entry->hdr.base_hdr.size = data_len + offset;
 	if (flags & FI_INJECT) {
-		ofi_copy_iov_buf(msg->msg_iov, msg->iov_count, 0,
-				 (uint8_t *)&send_entry->hdr + offset,
-				 data_len,
-				 OFI_COPY_IOV_TO_BUF);
-		send_entry->iov_cnt = 1;
-		offset += data_len;
+		tcpx_copy_inject(send_entry, offset, msg->msg_iov,
+				 msg->iov_count, data_len);
 	} else {
 		memcpy(&send_entry->iov[1], &msg->msg_iov[0],
 		       msg->iov_count * sizeof(struct iovec));
 		send_entry->iov_cnt = msg->iov_count + 1;
+		send_entry->iov[0].iov_base = (void *) &send_entry->hdr;
+		send_entry->iov[0].iov_len = offset;
 	}
 
-	send_entry->iov[0].iov_base = (void *) &send_entry->hdr;
-	send_entry->iov[0].iov_len = offset;
-
 	send_entry->flags = (tcpx_ep->util_ep.tx_op_flags & FI_COMPLETION) |
 			     flags | FI_RMA | FI_WRITE;
 
@@ -245,7 +239,6 @@ static ssize_t tcpx_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg
 	send_entry->context = msg->context;
 	send_entry->rem_len = send_entry->hdr.base_hdr.size;
 
-	tcpx_ep->hdr_bswap(&send_entry->hdr.base_hdr);
 	fastlock_acquire(&tcpx_ep->lock);
 	tcpx_tx_queue_insert(tcpx_ep, send_entry);
 	fastlock_release(&tcpx_ep->lock);
@@ -340,6 +333,10 @@ static ssize_t tcpx_rma_inject_common(struct fid_ep *ep, const void *buf,
 	struct ofi_rma_iov *rma_iov;
 	uint64_t *cq_data;
 	size_t offset;
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
 
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 	tcpx_cq = container_of(tcpx_ep->util_ep.tx_cq, struct tcpx_cq,
@@ -349,7 +346,6 @@ static ssize_t tcpx_rma_inject_common(struct fid_ep *ep, const void *buf,
 	if (!send_entry)
 		return -FI_EAGAIN;
 
-	assert(len <= TCPX_MAX_INJECT);
 	offset = sizeof(send_entry->hdr.base_hdr);
 
 	if (flags & FI_REMOTE_CQ_DATA) {
@@ -367,18 +363,12 @@ static ssize_t tcpx_rma_inject_common(struct fid_ep *ep, const void *buf,
 	offset += sizeof(*rma_iov);
 
 	send_entry->hdr.base_hdr.payload_off = (uint8_t)offset;
-	memcpy((uint8_t *)&send_entry->hdr + offset, (uint8_t *)buf, len);
-	offset += len;
+	tcpx_copy_inject(send_entry, offset, &iov, 1, len);
 
-	send_entry->iov[0].iov_base = (void *) &send_entry->hdr;
-	send_entry->iov[0].iov_len = offset;
-	send_entry->iov_cnt = 1;
-
-	send_entry->hdr.base_hdr.size = offset;
+	send_entry->hdr.base_hdr.size = offset + len;
 	send_entry->ep = tcpx_ep;
 	send_entry->rem_len = send_entry->hdr.base_hdr.size;
 
-	tcpx_ep->hdr_bswap(&send_entry->hdr.base_hdr);
 	fastlock_acquire(&tcpx_ep->lock);
 	tcpx_tx_queue_insert(tcpx_ep, send_entry);
 	fastlock_release(&tcpx_ep->lock);
@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *	   Redistribution and use in source and binary forms, with or
+ *	   without modification, are permitted provided that the following
+ *	   conditions are met:
+ *
+ *		- Redistributions of source code must retain the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer.
+ *
+ *		- Redistributions in binary form must reproduce the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer in the documentation and/or other materials
+ *		  provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Striping spreads large RMA payloads over several sockets to the peer.
+ *
+ * The socket count and minimum payload size are negotiated during the CM
+ * exchange.  Each side offers them in ofi_ctrl_hdr::seg_no (count in the
+ * low byte, size in KiB above it).  The server answers with the agreed
+ * values, together with the port of a listening socket it opened for the
+ * endpoint, in ofi_ctrl_hdr::conn_id (a random token above the low 16
+ * bits).  The client then connects one socket per additional stripe and
+ * identifies each with a connreq carrying the token and stripe index.
+ * Both sides report FI_CONNECTED only once every stripe is connected.
+ *
+ * A write or read response whose payload is at least the agreed size is
+ * split into as many equal, contiguous stripes as there are sockets.
+ * Stripe 0 follows the header on the endpoint's main socket and stripe i
+ * goes over stripes[i].sock.  Both sides derive the stripe offsets from
+ * the payload length, so stripes carry no framing of their own.  All
+ * other traffic, including sends of any size, stays on the main socket.
+ * A striped transfer completes before the next message is started on
+ * either side, which keeps the ordering of the main socket.
+ */
+
+#include <rdma/fi_errno.h>
+#include <ofi_prov.h>
+#include <sys/types.h>
+#include <ofi_util.h>
+#include <ofi_iov.h>
+#include "tcpx.h"
+
+
+static uint32_t tcpx_stripe_info(uint8_t cnt, size_t size)
+{
+	return cnt | (uint32_t) (size >> 10) << 8;
+}
+
+uint32_t tcpx_stripe_local_info(void)
+{
+	if (tcpx_stripe_cnt < 2)
+		return 0;
+
+	return tcpx_stripe_info((uint8_t) MIN(tcpx_stripe_cnt,
+					      TCPX_MAX_STRIPES),
+				MAX(tcpx_stripe_size, 1024));
+}
+
+/* Peers that predate striping leave seg_no zeroed */
+uint32_t tcpx_stripe_negotiate(uint32_t local, uint32_t peer)
+{
+	uint8_t cnt;
+
+	cnt = (uint8_t) MIN(local & 0xff, peer & 0xff);
+	if (cnt < 2)
+		return 0;
+
+	return cnt | MAX(local & ~0xffU, peer & ~0xffU);
+}
+
+int tcpx_stripe_init(struct tcpx_ep *ep, uint32_t info)
+{
+	uint8_t i, cnt = info & 0xff;
+
+	ep->stripe_cnt = 1;
+	if (cnt < 2)
+		return 0;
+
+	if (cnt > TCPX_MAX_STRIPES || !(info >> 8)) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"invalid stripe parameters from peer\n");
+		return -FI_EINVAL;
+	}
+
+	ep->stripes = calloc(cnt, sizeof(*ep->stripes));
+	if (!ep->stripes)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < cnt; i++)
+		ep->stripes[i].sock = INVALID_SOCKET;
+
+	ep->stripe_cnt = cnt;
+	ep->stripe_size = (size_t) (info >> 8) << 10;
+	FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+		"striping RMA payloads of %zu bytes or more over %d sockets\n",
+		ep->stripe_size, cnt);
+	return 0;
+}
+
+/* Opens the socket that the client connects its stripes to.  While the
+ * server waits for them, it is kept in stripes[0].sock.
+ */
+int tcpx_stripe_listen(struct tcpx_ep *ep, struct tcpx_cm_context *cm_ctx)
+{
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	SOCKET sock;
+	int ret;
+
+	ret = ofi_getsockname(ep->bsock.sock, (struct sockaddr *) &addr, &len);
+	if (ret)
+		return -ofi_sockerr();
+
+	ofi_addr_set_port((struct sockaddr *) &addr, 0);
+	sock = ofi_socket(addr.ss_family, SOCK_STREAM, 0);
+	if (sock == INVALID_SOCKET)
+		return -ofi_sockerr();
+
+	if (bind(sock, (struct sockaddr *) &addr, len) ||
+	    listen(sock, ep->stripe_cnt) ||
+	    ofi_getsockname(sock, (struct sockaddr *) &addr, &len)) {
+		ret = -ofi_sockerr();
+		goto close;
+	}
+
+	ret = fi_fd_nonblock(sock);
+	if (ret)
+		goto close;
+
+	ep->stripe_cm_ctx = calloc(1, sizeof(*ep->stripe_cm_ctx));
+	if (!ep->stripe_cm_ctx) {
+		ret = -FI_ENOMEM;
+		goto close;
+	}
+
+	ep->stripe_cm_ctx->fid = &ep->util_ep.ep_fid.fid;
+	ep->stripe_cm_ctx->state = TCPX_CM_STRIPE_LISTEN;
+	ep->stripes[0].sock = sock;
+	ep->stripe_id = (uint64_t) ofi_generate_seed() << 16 |
+			ofi_addr_get_port((struct sockaddr *) &addr);
+
+	cm_ctx->stripe_info = tcpx_stripe_info(ep->stripe_cnt,
+					       ep->stripe_size);
+	cm_ctx->stripe_id = ep->stripe_id;
+	return 0;
+
+close:
+	FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+		"failed to open stripe listener: %s\n", fi_strerror(-ret));
+	ofi_close_socket(sock);
+	return ret;
+}
+
+int tcpx_stripe_wait_add(struct tcpx_ep *ep, struct util_wait *wait)
+{
+	int i, ret;
+
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		ret = ofi_wait_add_fd(wait, ep->stripes[i].sock, POLLIN,
+				      tcpx_try_func, (void *) &ep->util_ep,
+				      &ep->util_ep.ep_fid.fid);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* Counterpart of ofi_wait_fdset_del for the main socket in tcpx_ep_disable */
+void tcpx_stripe_wait_del(struct tcpx_ep *ep, struct util_wait *wait)
+{
+	struct util_wait_fd *wait_fd;
+	int i;
+
+	wait_fd = container_of(wait, struct util_wait_fd, util_wait);
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		if (ep->stripes[i].sock != INVALID_SOCKET)
+			ofi_wait_fdset_del(wait_fd, ep->stripes[i].sock);
+	}
+}
+
+void tcpx_stripe_shutdown(struct tcpx_ep *ep)
+{
+	int i;
+
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		if (ep->stripes[i].sock != INVALID_SOCKET)
+			ofi_shutdown(ep->stripes[i].sock, SHUT_RDWR);
+	}
+}
+
+/* Drops the stripe connections that are still being set up, and the
+ * stripe listener or held connect response.  Caller holds the EQ
+ * close_lock.
+ */
+static void tcpx_stripe_cm_close(struct tcpx_ep *ep)
+{
+	struct tcpx_cm_context *cm_ctx;
+	struct util_wait *wait;
+	int i;
+
+	/* stripes are only set up once the endpoint is bound to an EQ */
+	if (!ep->util_ep.eq)
+		return;
+
+	wait = ep->util_ep.eq->wait;
+	for (i = 0; i < ep->stripe_cnt; i++) {
+		cm_ctx = ep->stripes[i].cm_ctx;
+		if (!cm_ctx)
+			continue;
+
+		ofi_wait_del_fd(wait, cm_ctx->stripe_sock);
+		ofi_close_socket(cm_ctx->stripe_sock);
+		free(cm_ctx);
+		ep->stripes[i].cm_ctx = NULL;
+	}
+
+	if (ep->stripes[0].sock != INVALID_SOCKET) {
+		ofi_wait_del_fd(wait, ep->stripes[0].sock);
+		ofi_close_socket(ep->stripes[0].sock);
+		ep->stripes[0].sock = INVALID_SOCKET;
+	}
+
+	free(ep->stripe_cm_ctx);
+	ep->stripe_cm_ctx = NULL;
+}
+
+/* Caller holds the EQ close_lock */
+void tcpx_stripe_close(struct tcpx_ep *ep)
+{
+	int i;
+
+	if (!ep->stripes)
+		return;
+
+	tcpx_stripe_cm_close(ep);
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		if (ep->stripes[i].sock == INVALID_SOCKET)
+			continue;
+
+		if (ep->util_ep.rx_cq)
+			ofi_wait_del_fd(ep->util_ep.rx_cq->wait,
+					ep->stripes[i].sock);
+		if (ep->util_ep.tx_cq)
+			ofi_wait_del_fd(ep->util_ep.tx_cq->wait,
+					ep->stripes[i].sock);
+		ofi_close_socket(ep->stripes[i].sock);
+	}
+
+	free(ep->stripes);
+	ep->stripes = NULL;
+	ep->stripe_cnt = 1;
+}
+
+static void tcpx_stripe_slice(struct tcpx_stripe_xfer *xfer,
+			      const struct iovec *iov, size_t iov_cnt,
+			      size_t offset, size_t len)
+{
+	xfer->rem_len = len;
+	xfer->iov_cnt = 0;
+	if (!len)
+		return;
+
+	memcpy(xfer->iov, iov, iov_cnt * sizeof(*iov));
+	xfer->iov_cnt = iov_cnt;
+	ofi_consume_iov(xfer->iov, &xfer->iov_cnt, offset);
+	(void) ofi_truncate_iov(xfer->iov, &xfer->iov_cnt, len);
+}
+
+/* Slices stripes 1..n out of the payload and returns the length of
+ * stripe 0, which stays with the transfer entry.
+ */
+static size_t tcpx_stripe_split(struct tcpx_ep *ep, bool tx,
+				const struct iovec *iov, size_t iov_cnt,
+				size_t len)
+{
+	size_t stripe_len, offset;
+	int i;
+
+	stripe_len = ofi_div_ceil(len, ep->stripe_cnt);
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		offset = stripe_len * i;
+		tcpx_stripe_slice(tx ? &ep->stripes[i].tx : &ep->stripes[i].rx,
+				  iov, iov_cnt, offset, offset < len ?
+				  MIN(stripe_len, len - offset) : 0);
+	}
+	return MIN(stripe_len, len);
+}
+
+void tcpx_stripe_tx_check(struct tcpx_ep *ep,
+			  struct tcpx_xfer_entry *tx_entry)
+{
+	tx_entry->flags &= ~TCPX_STRIPED;
+	if (ep->stripe_cnt < 2)
+		return;
+
+	switch (tx_entry->hdr.base_hdr.op) {
+	case ofi_op_write:
+	case ofi_op_read_rsp:
+		break;
+	default:
+		return;
+	}
+
+	if (tx_entry->rem_len - tx_entry->iov[0].iov_len >= ep->stripe_size)
+		tx_entry->flags |= TCPX_STRIPED;
+}
+
+void tcpx_stripe_rx_setup(struct tcpx_xfer_entry *rx_entry)
+{
+	struct tcpx_ep *ep = rx_entry->ep;
+
+	if (ep->stripe_cnt < 2 || rx_entry->rem_len < ep->stripe_size)
+		return;
+
+	ep->stripe_rx_len = rx_entry->rem_len;
+	rx_entry->rem_len = tcpx_stripe_split(ep, false, rx_entry->iov,
+					      rx_entry->iov_cnt,
+					      rx_entry->rem_len);
+	ep->stripe_rx_len -= rx_entry->rem_len;
+	(void) ofi_truncate_iov(rx_entry->iov, &rx_entry->iov_cnt,
+				rx_entry->rem_len);
+}
+
+static int tcpx_stripe_xfer(SOCKET sock, struct tcpx_stripe_xfer *xfer,
+			    bool tx)
+{
+	struct msghdr msg = {0};
+	ssize_t ret;
+
+	while (xfer->rem_len) {
+		msg.msg_iov = xfer->iov;
+		msg.msg_iovlen = xfer->iov_cnt;
+		ret = tx ? ofi_sendmsg_tcp(sock, &msg, MSG_NOSIGNAL) :
+			   ofi_recvmsg_tcp(sock, &msg, 0);
+		if (ret < 0) {
+			if (OFI_SOCK_TRY_SND_RCV_AGAIN(ofi_sockerr()))
+				return -FI_EAGAIN;
+			return ofi_sockerr() == EPIPE ?
+			       -FI_ENOTCONN : -ofi_sockerr();
+		} else if (!ret) {
+			return -FI_ENOTCONN;
+		}
+
+		xfer->rem_len -= ret;
+		if (xfer->rem_len)
+			ofi_consume_iov(xfer->iov, &xfer->iov_cnt, ret);
+	}
+	return 0;
+}
+
+/* Sends the main socket's part, header and stripe 0, through the normal
+ * path, and moves the other stripes along as their sockets allow.
+ */
+int tcpx_send_stripes(struct tcpx_xfer_entry *tx_entry)
+{
+	struct tcpx_ep *ep = tx_entry->ep;
+	size_t hdr_len;
+	int i, ret, stripe_ret = 0;
+
+	if (ep->stripe_tx_entry != tx_entry) {
+		hdr_len = tx_entry->iov[0].iov_len;
+		tx_entry->rem_len = hdr_len +
+			tcpx_stripe_split(ep, true, &tx_entry->iov[1],
+					  tx_entry->iov_cnt - 1,
+					  tx_entry->rem_len - hdr_len);
+		(void) ofi_truncate_iov(tx_entry->iov, &tx_entry->iov_cnt,
+					tx_entry->rem_len);
+		ep->stripe_tx_entry = tx_entry;
+	}
+
+	ret = tx_entry->rem_len ? tcpx_send_msg(tx_entry) : 0;
+	if (ret && ret != -FI_EAGAIN)
+		goto done;
+
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		stripe_ret = tcpx_stripe_xfer(ep->stripes[i].sock,
+					      &ep->stripes[i].tx, true);
+		if (stripe_ret && stripe_ret != -FI_EAGAIN) {
+			ret = stripe_ret;
+			goto done;
+		}
+		if (ep->stripes[i].tx.rem_len)
+			ret = -FI_EAGAIN;
+	}
+
+	if (ret)
+		return ret;
+done:
+	ep->stripe_tx_entry = NULL;
+	tx_entry->flags &= ~TCPX_STRIPED;
+	return ret;
+}
+
+int tcpx_recv_stripes(struct tcpx_ep *ep)
+{
+	struct tcpx_stripe_xfer *xfer;
+	int i, ret;
+
+	for (i = 1; i < ep->stripe_cnt; i++) {
+		xfer = &ep->stripes[i].rx;
+		if (!xfer->rem_len)
+			continue;
+
+		ep->stripe_rx_len -= xfer->rem_len;
+		ret = tcpx_stripe_xfer(ep->stripes[i].sock, xfer, false);
+		ep->stripe_rx_len += xfer->rem_len;
+		if (ret && ret != -FI_EAGAIN) {
+			ep->stripe_rx_len = 0;
+			return ret;
+		}
+	}
+
+	return ep->stripe_rx_len ? -FI_EAGAIN : 0;
+}
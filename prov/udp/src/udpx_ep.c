@@ -226,6 +226,7 @@ static void udpx_tx_comp(struct udpx_ep *ep, void *context)
 	comp->buf = NULL;
 	comp->data = 0;
 	ofi_cirque_commit(ep->util_ep.tx_cq->cirq);
+	ofi_poll_notify(&ep->util_ep.tx_cq->poll_notify);
 }
 
 static void udpx_tx_comp_signal(struct udpx_ep *ep, void *context)
@@ -246,6 +247,7 @@ static void udpx_rx_comp(struct udpx_ep *ep, void *context, uint64_t flags,
 	comp->buf = buf;
 	comp->data = 0;
 	ofi_cirque_commit(ep->util_ep.rx_cq->cirq);
+	ofi_poll_notify(&ep->util_ep.rx_cq->poll_notify);
 }
 
 static void udpx_rx_src_comp(struct udpx_ep *ep, void *context, uint64_t flags,
@@ -49,6 +49,7 @@
 #endif
 
 #include <ofi_util.h>
+#include <fasthash.h>
 
 
 enum {
@@ -274,42 +275,282 @@ int ofi_verify_av_insert(struct util_av *av, uint64_t flags, void *context)
 	return 0;
 }
 
+/*
+ * The reverse lookup index is a power of two array of slots, probed
+ * linearly from the fasthash of the address.  A slot is free, a tombstone,
+ * or an entry pointer with the top bits of the hash folded into the unused
+ * low bits of the (16-byte aligned) pointer, so that most mismatches are
+ * rejected without touching the entry.  Occupied slots plus tombstones are
+ * kept at or below half of the index.
+ *
+ * Readers take no lock.  Slots are written atomically after the entry is
+ * filled in, and entries are never returned to the system while the AV is
+ * open.  An entry can still be released and reused for another address
+ * while a reader compares it, so each entry carries a generation that is
+ * odd while it is free; readers skip free entries and retry if the
+ * generation moved during the compare.  When the index grows, the old
+ * array is retired, not freed, since readers may still be walking it.
+ * Purging tombstones rewrites the index in place under a sequence count,
+ * which readers check to retry.
+ */
+#define UTIL_AV_SLOT_FREE	((uintptr_t) 0)
+#define UTIL_AV_SLOT_TOMBSTONE	((uintptr_t) 1)
+#define UTIL_AV_SLOT_TAG	((uintptr_t) 0xf)
+#define UTIL_AV_MIN_INDEX	16
+
+static inline uint64_t util_av_hash(struct util_av *av, const void *addr)
+{
+	return fasthash64(addr, av->addrlen, 0);
+}
+
+static inline uintptr_t util_av_tag(uint64_t hash)
+{
+	return (uintptr_t) (hash >> 60) & UTIL_AV_SLOT_TAG;
+}
+
+static inline struct util_av_index *util_av_index(struct util_av *av)
+{
+	return (struct util_av_index *) (uintptr_t) ofi_atomic_get64(&av->index);
+}
+
+static inline uintptr_t util_av_slot(struct util_av_index *index, size_t i)
+{
+	return (uintptr_t) ofi_atomic_get64(&index->slot[i]);
+}
+
+static inline void
+util_av_set_slot(struct util_av_index *index, size_t i, uintptr_t val)
+{
+	ofi_atomic_set64(&index->slot[i], (int64_t) val);
+}
+
+static struct util_av_index *util_av_index_alloc(size_t size)
+{
+	struct util_av_index *index;
+	size_t i;
+
+	index = malloc(sizeof(*index) + size * sizeof(index->slot[0]));
+	if (!index)
+		return NULL;
+
+	ofi_atomic_initialize32(&index->seq, 0);
+	index->size = size;
+	index->retired = NULL;
+	for (i = 0; i < size; i++)
+		ofi_atomic_initialize64(&index->slot[i], UTIL_AV_SLOT_FREE);
+	return index;
+}
+
+/* use_cnt is initialized to 0 as the pool grows and drops back to 0 when
+ * an entry is released, so live entries can be found by walking the pool in
+ * fi_addr order.
+ */
+static struct util_av_entry *
+util_av_next_entry(struct util_av *av, size_t *fi_addr)
+{
+	struct ofi_bufpool *pool = av->av_entry_pool;
+	struct util_av_entry *entry;
+	size_t i;
+
+	for (i = *fi_addr; i < pool->entry_cnt; i++) {
+		entry = (struct util_av_entry *)
+			(pool->region_table[i / pool->attr.chunk_cnt]->
+			 mem_region + (i % pool->attr.chunk_cnt) *
+			 pool->entry_size);
+		if (ofi_atomic_get32(&entry->use_cnt)) {
+			*fi_addr = i + 1;
+			return entry;
+		}
+	}
+	*fi_addr = i;
+	return NULL;
+}
+
+static void util_av_index_add(struct util_av *av, struct util_av_index *index,
+			      struct util_av_entry *entry)
+{
+	uint64_t hash;
+	uintptr_t val;
+	size_t i, mask = index->size - 1;
+
+	assert(!((uintptr_t) entry & UTIL_AV_SLOT_TAG));
+	hash = util_av_hash(av, entry->data);
+	for (i = hash & mask; ; i = (i + 1) & mask) {
+		val = util_av_slot(index, i);
+		if (val == UTIL_AV_SLOT_FREE || val == UTIL_AV_SLOT_TOMBSTONE)
+			break;
+	}
+
+	if (val == UTIL_AV_SLOT_TOMBSTONE)
+		av->index_tombs--;
+	av->index_used++;
+	util_av_set_slot(index, i, (uintptr_t) entry | util_av_tag(hash));
+}
+
+static void util_av_index_fill(struct util_av *av, struct util_av_index *index)
+{
+	struct util_av_entry *entry;
+	size_t fi_addr = 0;
+
+	av->index_used = 0;
+	av->index_tombs = 0;
+	while ((entry = util_av_next_entry(av, &fi_addr)))
+		util_av_index_add(av, index, entry);
+}
+
+/* Make room for cnt more entries.  Tombstones are purged in place when they
+ * account for enough of the index to make that worthwhile, otherwise the
+ * index is doubled until it fits.
+ */
+static int util_av_index_reserve(struct util_av *av, size_t cnt)
+{
+	struct util_av_index *index, *new_index;
+	size_t i, size;
+
+	assert(fastlock_held(&av->lock));
+	index = util_av_index(av);
+	if ((av->index_used + av->index_tombs + cnt) * 2 <= index->size)
+		return 0;
+
+	if ((av->index_used + cnt) * 2 <= index->size &&
+	    av->index_tombs >= index->size / 8) {
+		ofi_atomic_inc32(&index->seq);
+		for (i = 0; i < index->size; i++)
+			util_av_set_slot(index, i, UTIL_AV_SLOT_FREE);
+		util_av_index_fill(av, index);
+		ofi_atomic_inc32(&index->seq);
+		return 0;
+	}
+
+	for (size = index->size * 2; (av->index_used + cnt) * 2 > size; )
+		size *= 2;
+
+	new_index = util_av_index_alloc(size);
+	if (!new_index)
+		return -FI_ENOMEM;
+
+	util_av_index_fill(av, new_index);
+	new_index->retired = index;
+	ofi_atomic_set64(&av->index, (int64_t) (uintptr_t) new_index);
+	FI_DBG(av->prov, FI_LOG_AV, "AV index resized to %zu\n", size);
+	return 0;
+}
+
+static struct util_av_entry *
+util_av_index_find(struct util_av *av, const void *addr)
+{
+	struct util_av_index *index;
+	struct util_av_entry *entry;
+	uint64_t hash;
+	uintptr_t val, tag;
+	size_t i, mask;
+	int32_t seq, gen;
+
+	hash = util_av_hash(av, addr);
+	tag = util_av_tag(hash);
+	for (;;) {
+		index = util_av_index(av);
+		seq = ofi_atomic_get32(&index->seq);
+		if (seq & 1)
+			continue;
+
+		mask = index->size - 1;
+		entry = NULL;
+		for (i = hash & mask; ; i = (i + 1) & mask) {
+			val = util_av_slot(index, i);
+			if (val == UTIL_AV_SLOT_FREE)
+				break;
+			if ((val & UTIL_AV_SLOT_TAG) != tag ||
+			    val == UTIL_AV_SLOT_TOMBSTONE)
+				continue;
+
+			entry = (struct util_av_entry *) (val & ~UTIL_AV_SLOT_TAG);
+			gen = ofi_atomic_get32(&entry->gen);
+			ofi_atomic_acquire_fence();
+			if (!(gen & 1) &&
+			    !memcmp(entry->data, addr, av->addrlen))
+				break;
+			entry = NULL;
+		}
+
+		ofi_atomic_acquire_fence();
+		if (entry && ofi_atomic_get32(&entry->gen) != gen)
+			continue;
+		if (ofi_atomic_get32(&index->seq) == seq)
+			return entry;
+	}
+}
+
+static void util_av_index_del(struct util_av *av, struct util_av_entry *entry)
+{
+	struct util_av_index *index = util_av_index(av);
+	uint64_t hash;
+	uintptr_t val;
+	size_t i, mask = index->size - 1;
+
+	hash = util_av_hash(av, entry->data);
+	val = (uintptr_t) entry | util_av_tag(hash);
+	for (i = hash & mask; util_av_slot(index, i) != val; i = (i + 1) & mask)
+		assert(util_av_slot(index, i) != UTIL_AV_SLOT_FREE);
+
+	/* A probe that reaches this slot stops at the next one if it is free,
+	 * so the slot can be freed rather than left as a tombstone.
+	 */
+	av->index_used--;
+	if (util_av_slot(index, (i + 1) & mask) == UTIL_AV_SLOT_FREE) {
+		util_av_set_slot(index, i, UTIL_AV_SLOT_FREE);
+	} else {
+		util_av_set_slot(index, i, UTIL_AV_SLOT_TOMBSTONE);
+		av->index_tombs++;
+	}
+}
+
 int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr)
 {
-	struct util_av_entry *entry = NULL;
+	struct util_av_entry *entry;
 
 	assert(fastlock_held(&av->lock));
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
+	entry = util_av_index_find(av, addr);
 	if (entry) {
 		if (fi_addr)
 			*fi_addr = ofi_buf_index(entry);
 		ofi_atomic_inc32(&entry->use_cnt);
 		return 0;
-	} else {
-		entry = ofi_ibuf_alloc(av->av_entry_pool);
-		if (!entry) {
-			if (fi_addr)
-				*fi_addr = FI_ADDR_NOTAVAIL;
-			return -FI_ENOMEM;
-		}
-
-		if (fi_addr)
-			*fi_addr = ofi_buf_index(entry);
-		memcpy(entry->data, addr, av->addrlen);
-		ofi_atomic_initialize32(&entry->use_cnt, 1);
-		HASH_ADD(hh, av->hash, data, av->addrlen, entry);
 	}
+
+	if (util_av_index_reserve(av, 1))
+		goto nomem;
+
+	entry = ofi_ibuf_alloc(av->av_entry_pool);
+	if (!entry)
+		goto nomem;
+
+	if (fi_addr)
+		*fi_addr = ofi_buf_index(entry);
+
+	/* Readers may still be comparing the entry's previous address */
+	ofi_atomic_release_fence();
+	memcpy(entry->data, addr, av->addrlen);
+	ofi_atomic_initialize32(&entry->use_cnt, 1);
+	ofi_atomic_release_fence();
+	ofi_atomic_inc32(&entry->gen);
+	util_av_index_add(av, util_av_index(av), entry);
 	return 0;
+
+nomem:
+	if (fi_addr)
+		*fi_addr = FI_ADDR_NOTAVAIL;
+	return -FI_ENOMEM;
 }
 
 int ofi_av_elements_iter(struct util_av *av, ofi_av_apply_func apply, void *arg)
 {
-	struct util_av_entry *av_entry = NULL, *av_entry_tmp = NULL;
+	struct util_av_entry *av_entry;
+	size_t fi_addr = 0;
 	int ret;
 
-	HASH_ITER(hh, av->hash, av_entry, av_entry_tmp) {
-		ret = apply(av, av_entry->data,
-			    ofi_buf_index(av_entry), arg);
+	while ((av_entry = util_av_next_entry(av, &fi_addr))) {
+		ret = apply(av, av_entry->data, ofi_buf_index(av_entry), arg);
 		if (OFI_UNLIKELY(ret))
 			return ret;
 	}
@@ -328,26 +569,24 @@ int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr)
 	if (ofi_atomic_dec32(&av_entry->use_cnt))
 		return FI_SUCCESS;
 
-	HASH_DELETE(hh, av->hash, av_entry);
+	util_av_index_del(av, av_entry);
+	ofi_atomic_inc32(&av_entry->gen);
 	ofi_ibuf_free(av_entry);
 	return 0;
 }
 
+/* Lookups no longer need the AV lock; both calls are kept for callers. */
 fi_addr_t ofi_av_lookup_fi_addr_unsafe(struct util_av *av, const void *addr)
 {
-	struct util_av_entry *entry = NULL;
+	struct util_av_entry *entry;
 
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
+	entry = util_av_index_find(av, addr);
 	return entry ? ofi_buf_index(entry) : FI_ADDR_NOTAVAIL;
 }
 
 fi_addr_t ofi_av_lookup_fi_addr(struct util_av *av, const void *addr)
 {
-	fi_addr_t fi_addr;
-	fastlock_acquire(&av->lock);
-	fi_addr = ofi_av_lookup_fi_addr_unsafe(av, addr);
-	fastlock_release(&av->lock);
-	return fi_addr;
+	return ofi_av_lookup_fi_addr_unsafe(av, addr);
 }
 
 static void *
@@ -388,7 +627,12 @@ int ofi_av_bind(struct fid *av_fid, struct fid *eq_fid, uint64_t flags)
 
 static void util_av_close(struct util_av *av)
 {
-	HASH_CLEAR(hh, av->hash);
+	struct util_av_index *index, *retired;
+
+	for (index = util_av_index(av); index; index = retired) {
+		retired = index->retired;
+		free(index);
+	}
 	ofi_bufpool_destroy(av->av_entry_pool);
 }
 
@@ -437,9 +681,18 @@ static int util_verify_av_util_attr(struct util_domain *domain,
 	return 0;
 }
 
+static void util_av_entry_init(struct ofi_bufpool_region *region, void *buf)
+{
+	struct util_av_entry *entry = buf;
+
+	ofi_atomic_initialize32(&entry->use_cnt, 0);
+	ofi_atomic_initialize32(&entry->gen, 1);
+}
+
 static int util_av_init(struct util_av *av, const struct fi_av_attr *attr,
 			const struct util_av_attr *util_attr)
 {
+	struct util_av_index *index;
 	int ret = 0;
 	size_t orig_size;
 	size_t offset;
@@ -454,6 +707,7 @@ static int util_av_init(struct util_av *av, const struct fi_av_attr *attr,
 				  sizeof(struct util_av_entry),
 		.alignment	= 16,
 		.max_cnt	= 0,
+		.init_fn	= util_av_entry_init,
 		/* Don't use track of buffer, because user can close
 		 * the AV without prior deletion of addresses */
 		.flags		= OFI_BUFPOOL_NO_TRACK | OFI_BUFPOOL_INDEXED,
@@ -473,10 +727,19 @@ static int util_av_init(struct util_av *av, const struct fi_av_attr *attr,
 	av->addrlen = util_attr->addrlen;
 	av->context_offset = offset + av->addrlen;
 	av->flags = util_attr->flags | attr->flags;
-	av->hash = NULL;
+
+	index = util_av_index_alloc(MAX(orig_size * 2, UTIL_AV_MIN_INDEX));
+	if (!index)
+		return -FI_ENOMEM;
+	ofi_atomic_initialize64(&av->index, (int64_t) (uintptr_t) index);
+	av->index_used = 0;
+	av->index_tombs = 0;
 
 	pool_attr.chunk_cnt = orig_size;
-	return ofi_bufpool_create_attr(&pool_attr, &av->av_entry_pool);
+	ret = ofi_bufpool_create_attr(&pool_attr, &av->av_entry_pool);
+	if (ret)
+		free(index);
+	return ret;
 }
 
 static int util_verify_av_attr(struct util_domain *domain,
@@ -595,9 +858,7 @@ static int ip_av_insert_addr(struct util_av *av, const void *addr,
 	int ret;
 
 	if (ofi_valid_dest_ipaddr(addr)) {
-		fastlock_acquire(&av->lock);
 		ret = ofi_av_insert_addr(av, addr, fi_addr);
-		fastlock_release(&av->lock);
 	} else {
 		ret = -FI_EADDRNOTAVAIL;
 		if (fi_addr)
@@ -627,6 +888,11 @@ int ofi_ip_av_insertv(struct util_av *av, const void *addr, size_t addrlen,
 		memset(sync_err, 0, sizeof(*sync_err) * count);
 	}
 
+	/* Size the index for the whole vector up front and take the lock
+	 * once.  If the reservation fails, inserts grow the index as needed.
+	 */
+	fastlock_acquire(&av->lock);
+	(void) util_av_index_reserve(av, count);
 	for (i = 0; i < count; i++) {
 		ret = ip_av_insert_addr(av, (const char *) addr + i * addrlen,
 					fi_addr ? &fi_addr[i] : NULL, context);
@@ -637,6 +903,7 @@ int ofi_ip_av_insertv(struct util_av *av, const void *addr, size_t addrlen,
 		else if (sync_err)
 			sync_err[i] = -ret;
 	}
+	fastlock_release(&av->lock);
 
 	FI_DBG(av->prov, FI_LOG_AV, "%d addresses successful\n", success_cnt);
 	if (av->eq) {
@@ -884,16 +1151,16 @@ int ofi_ip_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr,
 	 * added -- i.e. fi_addr passed in here was also passed into insert.
 	 * Thus, we walk through the array backwards.
 	 */
+	fastlock_acquire(&av->lock);
 	for (i = count - 1; i >= 0; i--) {
-		fastlock_acquire(&av->lock);
 		ret = ofi_av_remove_addr(av, fi_addr[i]);
-		fastlock_release(&av->lock);
 		if (ret) {
 			FI_WARN(av->prov, FI_LOG_AV,
 				"removal of fi_addr %"PRIu64" failed\n",
 				fi_addr[i]);
 		}
 	}
+	fastlock_release(&av->lock);
 	return 0;
 }
 
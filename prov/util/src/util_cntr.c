@@ -89,15 +89,75 @@ static uint64_t ofi_cntr_readerr(struct fid_cntr *cntr_fid)
 	return ofi_atomic_get64(&cntr->err);
 }
 
+#define OFI_CNTR_NO_WAITER UINT64_MAX
+
+void ofi_cntr_wake(struct util_cntr *cntr)
+{
+	char c = 0;
+	int write_fd = 0;
+
+	fastlock_acquire(&cntr->wake_lock);
+	if (cntr->waiter_cnt) {
+		cntr->wake_gen++;
+		cntr->wake_pending = cntr->waiter_cnt;
+		write_fd = !cntr->wake_set;
+		cntr->wake_set = 1;
+	}
+	/* woken waiters that still need more register again */
+	ofi_atomic_set64(&cntr->wake_threshold, (int64_t) OFI_CNTR_NO_WAITER);
+	fastlock_release(&cntr->wake_lock);
+
+	/* The write is kept out of the lock so that a waiter never spins
+	 * behind a waker that was preempted in the system call.
+	 */
+	if (write_fd)
+		(void) ofi_write_socket(cntr->wake_fd[FI_WRITE_FD], &c, sizeof c);
+}
+
+static inline void util_cntr_check_deferred(struct util_cntr *cntr,
+					    uint64_t cnt)
+{
+	uint64_t threshold;
+
+	threshold = (uint64_t) ofi_atomic_get64(&cntr->deferred_threshold);
+	if (OFI_UNLIKELY(threshold != OFI_DEFERRED_NO_THRESHOLD) &&
+	    cnt >= threshold)
+		ofi_deferred_trigger(cntr);
+}
+
+static inline void util_cntr_update(struct util_cntr *cntr, uint64_t cnt)
+{
+	util_cntr_check_deferred(cntr, cnt);
+	ofi_poll_notify(&cntr->poll_notify);
+	if (cntr->threshold_wait) {
+		if (cnt >= (uint64_t) ofi_atomic_get64(&cntr->wake_threshold))
+			ofi_cntr_wake(cntr);
+	} else if (cntr->wait) {
+		cntr->wait->signal(cntr->wait);
+	}
+}
+
+static inline void util_cntr_update_err(struct util_cntr *cntr)
+{
+	ofi_poll_notify(&cntr->poll_notify);
+	if (cntr->threshold_wait) {
+		if ((uint64_t) ofi_atomic_get64(&cntr->wake_threshold) !=
+		    OFI_CNTR_NO_WAITER)
+			ofi_cntr_wake(cntr);
+	} else if (cntr->wait) {
+		cntr->wait->signal(cntr->wait);
+	}
+}
+
 static int ofi_cntr_add(struct fid_cntr *cntr_fid, uint64_t value)
 {
 	struct util_cntr *cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
+	uint64_t cnt;
 
 	assert(cntr->cntr_fid.fid.fclass == FI_CLASS_CNTR);
 
-	ofi_atomic_add64(&cntr->cnt, value);
-	if (cntr->wait)
-		cntr->wait->signal(cntr->wait);
+	cnt = ofi_atomic_add64(&cntr->cnt, value);
+	util_cntr_update(cntr, cnt);
 
 	return FI_SUCCESS;
 }
@@ -109,8 +169,7 @@ static int ofi_cntr_adderr(struct fid_cntr *cntr_fid, uint64_t value)
 	assert(cntr->cntr_fid.fid.fclass == FI_CLASS_CNTR);
 
 	ofi_atomic_add64(&cntr->err, value);
-	if (cntr->wait)
-		cntr->wait->signal(cntr->wait);
+	util_cntr_update_err(cntr);
 
 	return FI_SUCCESS;
 }
@@ -122,8 +181,7 @@ static int ofi_cntr_set(struct fid_cntr *cntr_fid, uint64_t value)
 	assert(cntr->cntr_fid.fid.fclass == FI_CLASS_CNTR);
 
 	ofi_atomic_set64(&cntr->cnt, value);
-	if (cntr->wait)
-		cntr->wait->signal(cntr->wait);
+	util_cntr_update(cntr, value);
 
 	return FI_SUCCESS;
 }
@@ -134,12 +192,113 @@ static int ofi_cntr_seterr(struct fid_cntr *cntr_fid, uint64_t value)
 	assert(cntr->cntr_fid.fid.fclass == FI_CLASS_CNTR);
 
 	ofi_atomic_set64(&cntr->err, value);
-	if (cntr->wait)
-		cntr->wait->signal(cntr->wait);
+	util_cntr_update_err(cntr);
 
 	return FI_SUCCESS;
 }
 
+/* Register a blocked waiter and return the wake generation it must see
+ * change.  The threshold is published with an atomic read-modify-write so
+ * that it is ordered before the caller re-reads the count; an update that
+ * lands in between either sees the threshold or is seen by the caller.
+ * Returns false if a wake is still outstanding for earlier waiters, in
+ * which case wake_fd is readable and the caller should not block yet.
+ */
+static bool util_cntr_add_waiter(struct util_cntr *cntr, uint64_t threshold,
+				 uint64_t *gen)
+{
+	uint64_t cur;
+	bool idle;
+
+	fastlock_acquire(&cntr->wake_lock);
+	cntr->waiter_cnt++;
+	*gen = cntr->wake_gen;
+	idle = !cntr->wake_set;
+	cur = (uint64_t) ofi_atomic_get64(&cntr->wake_threshold);
+	if (threshold < cur)
+		ofi_atomic_cas_bool_strong64(&cntr->wake_threshold,
+					     (int64_t) cur, (int64_t) threshold);
+	fastlock_release(&cntr->wake_lock);
+	return idle;
+}
+
+static void util_cntr_drain(struct util_cntr *cntr)
+{
+	char buf[16];
+
+	while (ofi_read_socket(cntr->wake_fd[FI_READ_FD], buf, sizeof buf) > 0)
+		;
+}
+
+/* The last waiter to see a wake clears it.  A waker may not have written
+ * its byte yet at that point; the late byte then only causes a spurious
+ * wakeup, and is drained by whichever waiter it woke.
+ */
+static void util_cntr_del_waiter(struct util_cntr *cntr, uint64_t gen,
+				 bool woken)
+{
+	fastlock_acquire(&cntr->wake_lock);
+	cntr->waiter_cnt--;
+	if (gen != cntr->wake_gen && !--cntr->wake_pending) {
+		cntr->wake_set = 0;
+		woken = true;
+	}
+	if (woken && !cntr->wake_set)
+		util_cntr_drain(cntr);
+	if (!cntr->waiter_cnt)
+		ofi_atomic_set64(&cntr->wake_threshold,
+				 (int64_t) OFI_CNTR_NO_WAITER);
+	fastlock_release(&cntr->wake_lock);
+}
+
+static int ofi_cntr_wake_try(void *arg)
+{
+	struct util_cntr *cntr = arg;
+
+	return cntr->wake_set ? -FI_EAGAIN : FI_SUCCESS;
+}
+
+static int ofi_cntr_threshold_wait(struct util_cntr *cntr, uint64_t threshold,
+				   int timeout)
+{
+	uint64_t endtime, errcnt, gen;
+	bool idle;
+	int ret;
+
+	errcnt = ofi_atomic_get64(&cntr->err);
+	endtime = ofi_timeout_time(timeout);
+
+	for (;;) {
+		cntr->progress(cntr);
+		if (threshold <= ofi_atomic_get64(&cntr->cnt))
+			return FI_SUCCESS;
+
+		if (errcnt != ofi_atomic_get64(&cntr->err))
+			return -FI_EAVAIL;
+
+		if (ofi_adjust_timeout(endtime, &timeout))
+			return -FI_ETIMEDOUT;
+
+		idle = util_cntr_add_waiter(cntr, threshold, &gen);
+		if (threshold > ofi_atomic_get64(&cntr->cnt) &&
+		    errcnt == ofi_atomic_get64(&cntr->err)) {
+			if (idle) {
+				ret = fi_wait(&cntr->wait->wait_fid, timeout);
+			} else {
+				/* let the earlier waiters see their wake */
+				sched_yield();
+				ret = FI_SUCCESS;
+			}
+		} else {
+			ret = FI_SUCCESS;
+		}
+		util_cntr_del_waiter(cntr, gen, idle && !ret);
+
+		if (ret && ret != -FI_ETIMEDOUT)
+			return ret;
+	}
+}
+
 #define OFI_TIMEOUT_QUANTUM_MS 50
 
 static int ofi_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int timeout)
@@ -150,6 +309,9 @@ static int ofi_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int time
 
 	cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
 	assert(cntr->wait);
+	if (cntr->threshold_wait)
+		return ofi_cntr_threshold_wait(cntr, threshold, timeout);
+
 	errcnt = ofi_atomic_get64(&cntr->err);
 	endtime = ofi_timeout_time(timeout);
 
@@ -165,7 +327,8 @@ static int ofi_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int time
 			return -FI_ETIMEDOUT;
 
 		/*
-		 * Temporary work-around to avoid a thread hanging in underlying
+		 * Wait objects without threshold support (wait sets, yield)
+		 * keep this work-around to avoid a thread hanging in underlying
 		 * epoll_wait called from fi_wait. This can happen if one thread
 		 * updates the counter, another thread reads it (thereby resetting
 		 * cntr signal fd) and the current thread is about to wait. The
@@ -211,9 +374,17 @@ int ofi_cntr_cleanup(struct util_cntr *cntr)
 	if (ofi_atomic_get32(&cntr->ref))
 		return -FI_EBUSY;
 
+	ofi_deferred_cleanup_cntr(cntr);
+	ofi_poll_notify_cleanup(&cntr->poll_notify, &cntr->cntr_fid.fid);
 	if (cntr->wait) {
 		fi_poll_del(&cntr->wait->pollset->poll_fid,
 			    &cntr->cntr_fid.fid, 0);
+		if (cntr->threshold_wait) {
+			ofi_wait_del_fd(cntr->wait, cntr->wake_fd[FI_READ_FD]);
+			ofi_close_socket(cntr->wake_fd[FI_READ_FD]);
+			ofi_close_socket(cntr->wake_fd[FI_WRITE_FD]);
+			fastlock_destroy(&cntr->wake_lock);
+		}
 		if (cntr->internal_wait)
 			fi_close(&cntr->wait->wait_fid.fid);
 	}
@@ -249,6 +420,40 @@ void ofi_cntr_progress(struct util_cntr *cntr)
 		ep->progress(ep);
 	}
 	fastlock_release(&cntr->ep_list_lock);
+	ofi_deferred_progress(cntr->domain);
+}
+
+static int util_cntr_init_threshold_wait(struct util_cntr *cntr)
+{
+	int ret;
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM, 0, cntr->wake_fd);
+	if (ret < 0)
+		return -ofi_sockerr();
+
+	ret = fi_fd_nonblock(cntr->wake_fd[FI_READ_FD]);
+	if (ret)
+		goto err;
+
+	ret = ofi_wait_add_fd(cntr->wait, cntr->wake_fd[FI_READ_FD], POLLIN,
+			      ofi_cntr_wake_try, cntr, &cntr->cntr_fid.fid);
+	if (ret)
+		goto err;
+
+	fastlock_init(&cntr->wake_lock);
+	ofi_atomic_initialize64(&cntr->wake_threshold,
+				(int64_t) OFI_CNTR_NO_WAITER);
+	cntr->wake_set = 0;
+	cntr->wake_gen = 0;
+	cntr->waiter_cnt = 0;
+	cntr->wake_pending = 0;
+	cntr->threshold_wait = 1;
+	return 0;
+
+err:
+	ofi_close_socket(cntr->wake_fd[FI_READ_FD]);
+	ofi_close_socket(cntr->wake_fd[FI_WRITE_FD]);
+	return ret;
 }
 
 static struct fi_ops util_cntr_fi_ops = {
@@ -273,11 +478,16 @@ int ofi_cntr_init(const struct fi_provider *prov, struct fid_domain *domain,
 		return ret;
 
 	cntr->progress = progress;
+	cntr->threshold_wait = 0;
 	cntr->domain = container_of(domain, struct util_domain, domain_fid);
 	ofi_atomic_initialize32(&cntr->ref, 0);
 	ofi_atomic_initialize64(&cntr->cnt, 0);
 	ofi_atomic_initialize64(&cntr->err, 0);
 	dlist_init(&cntr->ep_list);
+	ofi_poll_notify_init(&cntr->poll_notify);
+	dlist_init(&cntr->deferred_list);
+	ofi_atomic_initialize64(&cntr->deferred_threshold,
+				(int64_t) OFI_DEFERRED_NO_THRESHOLD);
 
 	cntr->cntr_fid.fid.fclass = FI_CLASS_CNTR;
 	cntr->cntr_fid.fid.context = context;
@@ -322,6 +532,19 @@ int ofi_cntr_init(const struct fi_provider *prov, struct fid_domain *domain,
 			ofi_cntr_cleanup(cntr);
 			return ret;
 		}
+
+		/* Nothing outside the counter can wait on an internal fd
+		 * wait object, so updates only need to wake threshold waiters.
+		 */
+		if (cntr->internal_wait &&
+		    (cntr->wait->wait_obj == FI_WAIT_FD ||
+		     cntr->wait->wait_obj == FI_WAIT_POLLFD)) {
+			ret = util_cntr_init_threshold_wait(cntr);
+			if (ret) {
+				ofi_cntr_cleanup(cntr);
+				return ret;
+			}
+		}
 	}
 
 	return 0;
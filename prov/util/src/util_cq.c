@@ -97,9 +97,15 @@ int ofi_cq_insert_error(struct util_cq *cq,
 int ofi_cq_write_error(struct util_cq *cq,
 		       const struct fi_cq_err_entry *err_entry)
 {
+	struct fi_cq_err_entry entry = *err_entry;
+
+	if (ofi_cq_deferred_comp(cq, &entry.op_context, entry.err))
+		return 0;
+
 	cq->cq_fastlock_acquire(&cq->cq_lock);
-	ofi_cq_insert_error(cq, err_entry);
+	ofi_cq_insert_error(cq, &entry);
 	cq->cq_fastlock_release(&cq->cq_lock);
+	ofi_poll_notify(&cq->poll_notify);
 
 	if (cq->wait)
 		cq->wait->signal(cq->wait);
@@ -227,6 +233,8 @@ ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 	cq->cq_fastlock_acquire(&cq->cq_lock);
 	if (ofi_cirque_isempty(cq->cirq) || !count) {
 		cq->cq_fastlock_release(&cq->cq_lock);
+		if (cq->domain->auto_progress)
+			cq->progress_seq++;
 		cq->progress(cq);
 		cq->cq_fastlock_acquire(&cq->cq_lock);
 		if (ofi_cirque_isempty(cq->cirq)) {
@@ -414,6 +422,11 @@ int ofi_cq_cleanup(struct util_cq *cq)
 	if (ofi_atomic_get32(&cq->ref))
 		return -FI_EBUSY;
 
+	ofi_progress_del(&cq->progress_item);
+	ofi_poll_notify_cleanup(&cq->poll_notify, &cq->cq_fid.fid);
+	if (ofi_atomic_get32(&cq->deferred_cnt))
+		ofi_deferred_cleanup_cq(cq);
+
 	while (!slist_empty(&cq->aux_queue)) {
 		entry = slist_remove_head(&cq->aux_queue);
 		err = container_of(entry, struct util_cq_aux_entry, list_entry);
@@ -487,8 +500,10 @@ static int fi_cq_init(struct fid_domain *domain, struct fi_cq_attr *attr,
 	dlist_init(&cq->ep_list);
 	fastlock_init(&cq->ep_list_lock);
 	fastlock_init(&cq->cq_lock);
-	if (cq->domain->threading == FI_THREAD_COMPLETION ||
-	    (cq->domain->threading == FI_THREAD_DOMAIN)) {
+	ofi_poll_notify_init(&cq->poll_notify);
+	if ((cq->domain->threading == FI_THREAD_COMPLETION ||
+	     cq->domain->threading == FI_THREAD_DOMAIN) &&
+	    !cq->domain->auto_progress) {
 		cq->cq_fastlock_acquire = ofi_fastlock_acquire_noop;
 		cq->cq_fastlock_release = ofi_fastlock_release_noop;
 	} else {
@@ -497,6 +512,8 @@ static int fi_cq_init(struct fid_domain *domain, struct fi_cq_attr *attr,
 	}
 	slist_init(&cq->aux_queue);
 	cq->read_entry = read_entry;
+	cq->progress_item.worker = NULL;
+	cq->progress_seq = 0;
 
 	cq->cq_fid.fid.fclass = FI_CLASS_CQ;
 	cq->cq_fid.fid.context = context;
@@ -568,6 +585,35 @@ void ofi_cq_progress(struct util_cq *cq)
 
 	}
 	cq->cq_fastlock_release(&cq->ep_list_lock);
+	ofi_deferred_progress(cq->domain);
+}
+
+/* Any new entry, including an error, means progress found work */
+static bool util_cq_progress_item(void *arg)
+{
+	struct util_cq *cq = arg;
+	size_t wcnt = cq->cirq->wcnt;
+
+	cq->progress(cq);
+	return cq->cirq->wcnt != wcnt;
+}
+
+/*
+ * Hands progress of the CQ to the fabric's progress threads if the
+ * provider enabled them for the domain.  wait_fid, if given, is the
+ * object whose wait fds signal new work for the CQ.
+ */
+int ofi_cq_progress_add(struct util_cq *cq, struct fid *wait_fid)
+{
+	if (!cq->domain->auto_progress)
+		return 0;
+
+	cq->progress_item.progress = util_cq_progress_item;
+	cq->progress_item.arg = cq;
+	cq->progress_item.wait_fid = wait_fid;
+	cq->progress_item.wait_try = NULL;
+	cq->progress_item.poll_seq = &cq->progress_seq;
+	return ofi_progress_add(cq->domain->fabric, &cq->progress_item);
 }
 
 int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
@@ -585,6 +631,8 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 	cq->cq_fid.fid.ops = &util_cq_fi_ops;
 	cq->cq_fid.ops = &util_cq_ops;
 	cq->progress = progress;
+	dlist_init(&cq->deferred_list);
+	ofi_atomic_initialize32(&cq->deferred_cnt, 0);
 
 	switch (attr->format) {
 	case FI_CQ_FORMAT_UNSPEC:
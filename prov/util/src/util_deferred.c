@@ -0,0 +1,708 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Deferred work queue for util based providers.
+ *
+ * A queued request is copied and placed on its triggering counter's list,
+ * kept in threshold order.  The counter caches the lowest pending
+ * threshold, so counter updates only take the domain's deferred_lock once
+ * a request is due.  Due requests move to the domain's ready list and are
+ * issued by the next CQ or counter progress call, after the provider has
+ * released its endpoint locks.  Requests are never issued from within a
+ * counter update, which usually runs with provider locks held.
+ *
+ * Requests whose completion must be counted or hidden are issued with a
+ * context owned by the request, so that their completions can be told
+ * apart from those of other operations sharing the CQ, even if the
+ * application reuses its context.  Operations are issued with
+ * FI_COMPLETION so that the completion is seen even when the CQ is bound
+ * with FI_SELECTIVE_COMPLETION; it is then consumed here, or reported
+ * with the application's context if the application asked for it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ofi_util.h>
+
+
+#define UTIL_DEFERRED_IOV_LIMIT 4
+
+enum util_deferred_state {
+	UTIL_DEFERRED_QUEUED,
+	UTIL_DEFERRED_READY,
+	UTIL_DEFERRED_ACTIVE,
+};
+
+struct util_deferred_work {
+	/* counter, domain ready, or CQ list, depending on state */
+	struct dlist_entry	entry;
+	struct dlist_entry	domain_entry;
+	enum util_deferred_state state;
+
+	struct fi_deferred_work	*work;
+	struct util_cntr	*cntr;
+	struct fid_cntr		*comp_cntr;
+	struct util_cq		*cq;
+	/* issued in place of the application's context when tracked */
+	struct fi_context2	ctx;
+	void			*context;
+	uint64_t		threshold;
+	uint64_t		flags;
+	enum fi_op_type		op_type;
+
+	union {
+		struct fi_op_msg		msg;
+		struct fi_op_tagged		tagged;
+		struct fi_op_rma		rma;
+		struct fi_op_atomic		atomic;
+		struct fi_op_fetch_atomic	fetch_atomic;
+		struct fi_op_compare_atomic	compare_atomic;
+		struct fi_op_cntr		cntr;
+	} op;
+
+	union {
+		struct iovec		iov[UTIL_DEFERRED_IOV_LIMIT];
+		struct fi_ioc		ioc[UTIL_DEFERRED_IOV_LIMIT];
+	} msg_iov;
+	union {
+		struct fi_rma_iov	iov[UTIL_DEFERRED_IOV_LIMIT];
+		struct fi_rma_ioc	ioc[UTIL_DEFERRED_IOV_LIMIT];
+	} rma_iov;
+	struct fi_ioc		fetch_iov[UTIL_DEFERRED_IOV_LIMIT];
+	struct fi_ioc		compare_iov[UTIL_DEFERRED_IOV_LIMIT];
+};
+
+static int util_deferred_copy_iov(void *dst, const void *src, size_t count,
+				  size_t size)
+{
+	if (count > UTIL_DEFERRED_IOV_LIMIT)
+		return -FI_EINVAL;
+
+	if (count)
+		memcpy(dst, src, count * size);
+	return 0;
+}
+
+static struct util_ep *
+util_deferred_ep(struct util_domain *domain, struct fid_ep *ep_fid)
+{
+	struct util_ep *ep;
+
+	if (!ep_fid || ep_fid->fid.fclass != FI_CLASS_EP)
+		return NULL;
+
+	ep = container_of(ep_fid, struct util_ep, ep_fid);
+	return ep->domain == domain ? ep : NULL;
+}
+
+static int util_deferred_copy_msg(struct util_deferred_work *def,
+				  const struct fi_op_msg *op)
+{
+	def->op.msg = *op;
+	def->op.msg.msg.msg_iov = def->msg_iov.iov;
+	def->context = op->msg.context;
+	def->flags = op->flags;
+	return util_deferred_copy_iov(def->msg_iov.iov, op->msg.msg_iov,
+				      op->msg.iov_count, sizeof(struct iovec));
+}
+
+static int util_deferred_copy_tagged(struct util_deferred_work *def,
+				     const struct fi_op_tagged *op)
+{
+	def->op.tagged = *op;
+	def->op.tagged.msg.msg_iov = def->msg_iov.iov;
+	def->context = op->msg.context;
+	def->flags = op->flags;
+	return util_deferred_copy_iov(def->msg_iov.iov, op->msg.msg_iov,
+				      op->msg.iov_count, sizeof(struct iovec));
+}
+
+static int util_deferred_copy_rma(struct util_deferred_work *def,
+				  const struct fi_op_rma *op)
+{
+	int ret;
+
+	def->op.rma = *op;
+	def->op.rma.msg.msg_iov = def->msg_iov.iov;
+	def->op.rma.msg.rma_iov = def->rma_iov.iov;
+	def->context = op->msg.context;
+	def->flags = op->flags;
+	ret = util_deferred_copy_iov(def->msg_iov.iov, op->msg.msg_iov,
+				     op->msg.iov_count, sizeof(struct iovec));
+	return ret ? ret : util_deferred_copy_iov(def->rma_iov.iov,
+					op->msg.rma_iov, op->msg.rma_iov_count,
+					sizeof(struct fi_rma_iov));
+}
+
+static int util_deferred_copy_atomic(struct util_deferred_work *def,
+				     struct fi_msg_atomic *dst,
+				     const struct fi_msg_atomic *src)
+{
+	int ret;
+
+	*dst = *src;
+	dst->msg_iov = def->msg_iov.ioc;
+	dst->rma_iov = def->rma_iov.ioc;
+	def->context = src->context;
+	ret = util_deferred_copy_iov(def->msg_iov.ioc, src->msg_iov,
+				     src->iov_count, sizeof(struct fi_ioc));
+	return ret ? ret : util_deferred_copy_iov(def->rma_iov.ioc,
+					src->rma_iov, src->rma_iov_count,
+					sizeof(struct fi_rma_ioc));
+}
+
+static int util_deferred_copy_fetch(struct util_deferred_work *def,
+				    struct fi_msg_fetch *dst,
+				    const struct fi_msg_fetch *src)
+{
+	*dst = *src;
+	dst->msg_iov = def->fetch_iov;
+	return util_deferred_copy_iov(def->fetch_iov, src->msg_iov,
+				      src->iov_count, sizeof(struct fi_ioc));
+}
+
+static int util_deferred_copy_compare(struct util_deferred_work *def,
+				      struct fi_msg_compare *dst,
+				      const struct fi_msg_compare *src)
+{
+	*dst = *src;
+	dst->msg_iov = def->compare_iov;
+	return util_deferred_copy_iov(def->compare_iov, src->msg_iov,
+				      src->iov_count, sizeof(struct fi_ioc));
+}
+
+/* Copies the operation out of the request, so that the application may
+ * reuse its structures once the request has been queued.
+ */
+static int util_deferred_copy_op(struct util_deferred_work *def,
+				 const struct fi_deferred_work *work,
+				 struct fid_ep **ep_fid)
+{
+	int ret;
+
+	switch (work->op_type) {
+	case FI_OP_RECV:
+	case FI_OP_SEND:
+		if (!work->op.msg)
+			return -FI_EINVAL;
+		*ep_fid = work->op.msg->ep;
+		return util_deferred_copy_msg(def, work->op.msg);
+	case FI_OP_TRECV:
+	case FI_OP_TSEND:
+		if (!work->op.tagged)
+			return -FI_EINVAL;
+		*ep_fid = work->op.tagged->ep;
+		return util_deferred_copy_tagged(def, work->op.tagged);
+	case FI_OP_READ:
+	case FI_OP_WRITE:
+		if (!work->op.rma)
+			return -FI_EINVAL;
+		*ep_fid = work->op.rma->ep;
+		return util_deferred_copy_rma(def, work->op.rma);
+	case FI_OP_ATOMIC:
+		if (!work->op.atomic)
+			return -FI_EINVAL;
+		*ep_fid = work->op.atomic->ep;
+		def->op.atomic.ep = work->op.atomic->ep;
+		def->flags = work->op.atomic->flags;
+		return util_deferred_copy_atomic(def, &def->op.atomic.msg,
+						 &work->op.atomic->msg);
+	case FI_OP_FETCH_ATOMIC:
+		if (!work->op.fetch_atomic)
+			return -FI_EINVAL;
+		*ep_fid = work->op.fetch_atomic->ep;
+		def->op.fetch_atomic.ep = work->op.fetch_atomic->ep;
+		def->flags = work->op.fetch_atomic->flags;
+		ret = util_deferred_copy_atomic(def, &def->op.fetch_atomic.msg,
+						&work->op.fetch_atomic->msg);
+		return ret ? ret : util_deferred_copy_fetch(def,
+					&def->op.fetch_atomic.fetch,
+					&work->op.fetch_atomic->fetch);
+	case FI_OP_COMPARE_ATOMIC:
+		if (!work->op.compare_atomic)
+			return -FI_EINVAL;
+		*ep_fid = work->op.compare_atomic->ep;
+		def->op.compare_atomic.ep = work->op.compare_atomic->ep;
+		def->flags = work->op.compare_atomic->flags;
+		ret = util_deferred_copy_atomic(def,
+				&def->op.compare_atomic.msg,
+				&work->op.compare_atomic->msg);
+		if (!ret)
+			ret = util_deferred_copy_fetch(def,
+					&def->op.compare_atomic.fetch,
+					&work->op.compare_atomic->fetch);
+		return ret ? ret : util_deferred_copy_compare(def,
+					&def->op.compare_atomic.compare,
+					&work->op.compare_atomic->compare);
+	case FI_OP_CNTR_SET:
+	case FI_OP_CNTR_ADD:
+		if (!work->op.cntr || !work->op.cntr->cntr ||
+		    work->completion_cntr)
+			return -FI_EINVAL;
+		*ep_fid = NULL;
+		def->op.cntr = *work->op.cntr;
+		return 0;
+	default:
+		return -FI_ENOSYS;
+	}
+}
+
+static void util_deferred_set_context(struct util_deferred_work *def,
+				      void *context)
+{
+	switch (def->op_type) {
+	case FI_OP_RECV:
+	case FI_OP_SEND:
+		def->op.msg.msg.context = context;
+		break;
+	case FI_OP_TRECV:
+	case FI_OP_TSEND:
+		def->op.tagged.msg.context = context;
+		break;
+	case FI_OP_READ:
+	case FI_OP_WRITE:
+		def->op.rma.msg.context = context;
+		break;
+	case FI_OP_ATOMIC:
+		def->op.atomic.msg.context = context;
+		break;
+	case FI_OP_FETCH_ATOMIC:
+		def->op.fetch_atomic.msg.context = context;
+		break;
+	case FI_OP_COMPARE_ATOMIC:
+		def->op.compare_atomic.msg.context = context;
+		break;
+	default:
+		assert(0);
+	}
+}
+
+static int util_deferred_init(struct util_domain *domain,
+			      struct util_deferred_work *def,
+			      struct fi_deferred_work *work)
+{
+	struct fid_ep *ep_fid;
+	struct util_ep *ep;
+	struct util_cq *cq;
+	int ret;
+
+	if (!work->triggering_cntr ||
+	    work->triggering_cntr->fid.fclass != FI_CLASS_CNTR)
+		return -FI_EINVAL;
+
+	def->cntr = container_of(work->triggering_cntr, struct util_cntr,
+				 cntr_fid);
+	if (def->cntr->domain != domain)
+		return -FI_EINVAL;
+
+	ret = util_deferred_copy_op(def, work, &ep_fid);
+	if (ret)
+		return ret;
+
+	def->work = work;
+	def->threshold = work->threshold;
+	def->op_type = work->op_type;
+	def->comp_cntr = work->completion_cntr;
+	if (!ep_fid)
+		return 0;
+
+	ep = util_deferred_ep(domain, ep_fid);
+	if (!ep)
+		return -FI_EINVAL;
+
+	/* Track the completion if it must either be counted or hidden. */
+	cq = (def->op_type == FI_OP_RECV || def->op_type == FI_OP_TRECV) ?
+	     ep->rx_cq : ep->tx_cq;
+	if (!cq)
+		return def->comp_cntr ? -FI_ENOCQ : 0;
+
+	if (def->comp_cntr || !(def->flags & FI_COMPLETION)) {
+		def->cq = cq;
+		util_deferred_set_context(def, &def->ctx);
+	}
+	return 0;
+}
+
+static void util_deferred_set_threshold(struct util_cntr *cntr)
+{
+	struct util_deferred_work *def;
+
+	if (dlist_empty(&cntr->deferred_list)) {
+		ofi_atomic_set64(&cntr->deferred_threshold,
+				 (int64_t) OFI_DEFERRED_NO_THRESHOLD);
+		return;
+	}
+
+	def = container_of(cntr->deferred_list.next,
+			   struct util_deferred_work, entry);
+	ofi_atomic_set64(&cntr->deferred_threshold, (int64_t) def->threshold);
+}
+
+/* Requests are usually queued with increasing thresholds, so search from
+ * the tail.  Equal thresholds keep submission order.
+ */
+static void util_deferred_insert(struct util_cntr *cntr,
+				 struct util_deferred_work *def)
+{
+	struct util_deferred_work *cur;
+	struct dlist_entry *item;
+
+	dlist_foreach_reverse(&cntr->deferred_list, item) {
+		cur = container_of(item, struct util_deferred_work, entry);
+		if (cur->threshold <= def->threshold)
+			break;
+	}
+	dlist_insert_after(&def->entry, item);
+	util_deferred_set_threshold(cntr);
+}
+
+static void util_deferred_remove(struct util_domain *domain,
+				 struct util_deferred_work *def)
+{
+	dlist_remove(&def->entry);
+	dlist_remove(&def->domain_entry);
+
+	switch (def->state) {
+	case UTIL_DEFERRED_QUEUED:
+		util_deferred_set_threshold(def->cntr);
+		break;
+	case UTIL_DEFERRED_READY:
+		ofi_atomic_dec32(&domain->deferred_ready_cnt);
+		break;
+	case UTIL_DEFERRED_ACTIVE:
+		ofi_atomic_dec32(&def->cq->deferred_cnt);
+		break;
+	}
+}
+
+void ofi_deferred_trigger(struct util_cntr *cntr)
+{
+	struct util_domain *domain = cntr->domain;
+	struct util_deferred_work *def;
+	uint64_t value;
+
+	fastlock_acquire(&domain->deferred_lock);
+	value = ofi_atomic_get64(&cntr->cnt);
+	while (!dlist_empty(&cntr->deferred_list)) {
+		def = container_of(cntr->deferred_list.next,
+				   struct util_deferred_work, entry);
+		if (def->threshold > value)
+			break;
+
+		dlist_remove(&def->entry);
+		def->state = UTIL_DEFERRED_READY;
+		dlist_insert_tail(&def->entry, &domain->deferred_ready);
+		ofi_atomic_inc32(&domain->deferred_ready_cnt);
+	}
+	util_deferred_set_threshold(cntr);
+	fastlock_release(&domain->deferred_lock);
+}
+
+static ssize_t util_deferred_issue(struct util_deferred_work *def)
+{
+	uint64_t flags;
+
+	flags = def->cq ? def->flags | FI_COMPLETION : def->flags;
+	switch (def->op_type) {
+	case FI_OP_RECV:
+		return fi_recvmsg(def->op.msg.ep, &def->op.msg.msg, flags);
+	case FI_OP_SEND:
+		return fi_sendmsg(def->op.msg.ep, &def->op.msg.msg, flags);
+	case FI_OP_TRECV:
+		return fi_trecvmsg(def->op.tagged.ep, &def->op.tagged.msg,
+				   flags);
+	case FI_OP_TSEND:
+		return fi_tsendmsg(def->op.tagged.ep, &def->op.tagged.msg,
+				   flags);
+	case FI_OP_READ:
+		return fi_readmsg(def->op.rma.ep, &def->op.rma.msg, flags);
+	case FI_OP_WRITE:
+		return fi_writemsg(def->op.rma.ep, &def->op.rma.msg, flags);
+	case FI_OP_ATOMIC:
+		return fi_atomicmsg(def->op.atomic.ep, &def->op.atomic.msg,
+				    flags);
+	case FI_OP_FETCH_ATOMIC:
+		return fi_fetch_atomicmsg(def->op.fetch_atomic.ep,
+				&def->op.fetch_atomic.msg,
+				def->op.fetch_atomic.fetch.msg_iov,
+				def->op.fetch_atomic.fetch.desc,
+				def->op.fetch_atomic.fetch.iov_count, flags);
+	case FI_OP_COMPARE_ATOMIC:
+		return fi_compare_atomicmsg(def->op.compare_atomic.ep,
+				&def->op.compare_atomic.msg,
+				def->op.compare_atomic.compare.msg_iov,
+				def->op.compare_atomic.compare.desc,
+				def->op.compare_atomic.compare.iov_count,
+				def->op.compare_atomic.fetch.msg_iov,
+				def->op.compare_atomic.fetch.desc,
+				def->op.compare_atomic.fetch.iov_count, flags);
+	case FI_OP_CNTR_SET:
+		return fi_cntr_set(def->op.cntr.cntr, def->op.cntr.value);
+	case FI_OP_CNTR_ADD:
+		return fi_cntr_add(def->op.cntr.cntr, def->op.cntr.value);
+	default:
+		assert(0);
+		return -FI_ENOSYS;
+	}
+}
+
+/*
+ * Issues ready requests in the order they became ready.  Only one thread
+ * issues at a time; others find deferred_running set and leave the work
+ * to it.  Counter operations and inline completions may make further
+ * requests ready while we run, which are picked up by the same loop.
+ */
+void ofi_deferred_run(struct util_domain *domain)
+{
+	struct util_deferred_work *def;
+	struct fid_cntr *comp_cntr;
+	bool tracked;
+	ssize_t ret;
+
+	fastlock_acquire(&domain->deferred_lock);
+	if (domain->deferred_running) {
+		fastlock_release(&domain->deferred_lock);
+		return;
+	}
+
+	domain->deferred_running = true;
+	while (!dlist_empty(&domain->deferred_ready)) {
+		def = container_of(domain->deferred_ready.next,
+				   struct util_deferred_work, entry);
+		dlist_remove(&def->entry);
+		ofi_atomic_dec32(&domain->deferred_ready_cnt);
+
+		/* The completion may be reported before the call returns. */
+		tracked = def->cq != NULL;
+		if (tracked) {
+			def->state = UTIL_DEFERRED_ACTIVE;
+			dlist_insert_tail(&def->entry, &def->cq->deferred_list);
+			ofi_atomic_inc32(&def->cq->deferred_cnt);
+		}
+		fastlock_release(&domain->deferred_lock);
+
+		ret = util_deferred_issue(def);
+
+		fastlock_acquire(&domain->deferred_lock);
+		if (!ret) {
+			if (!tracked) {
+				dlist_remove(&def->domain_entry);
+				free(def);
+			}
+			continue;
+		}
+
+		if (tracked) {
+			dlist_remove(&def->entry);
+			ofi_atomic_dec32(&def->cq->deferred_cnt);
+		}
+
+		if (ret == -FI_EAGAIN) {
+			def->state = UTIL_DEFERRED_READY;
+			dlist_insert_head(&def->entry, &domain->deferred_ready);
+			ofi_atomic_inc32(&domain->deferred_ready_cnt);
+			break;
+		}
+
+		FI_WARN(domain->prov, FI_LOG_DOMAIN,
+			"unable to issue deferred %s: %s\n",
+			fi_tostr(&def->op_type, FI_TYPE_OP_TYPE),
+			fi_strerror((int) -ret));
+		dlist_remove(&def->domain_entry);
+		comp_cntr = def->comp_cntr;
+		free(def);
+
+		fastlock_release(&domain->deferred_lock);
+		if (comp_cntr)
+			fi_cntr_adderr(comp_cntr, 1);
+		fastlock_acquire(&domain->deferred_lock);
+	}
+	domain->deferred_running = false;
+	fastlock_release(&domain->deferred_lock);
+}
+
+/* Restores the application's context if the completion is reported. */
+bool ofi_deferred_complete(struct util_cq *cq, void **context, uint64_t err)
+{
+	struct util_domain *domain = cq->domain;
+	struct util_deferred_work *def;
+	struct fid_cntr *comp_cntr;
+	struct dlist_entry *item;
+	bool hide;
+
+	fastlock_acquire(&domain->deferred_lock);
+	dlist_foreach(&cq->deferred_list, item) {
+		def = container_of(item, struct util_deferred_work, entry);
+		if (&def->ctx == *context)
+			goto found;
+	}
+	fastlock_release(&domain->deferred_lock);
+	return false;
+
+found:
+	util_deferred_remove(domain, def);
+	fastlock_release(&domain->deferred_lock);
+
+	comp_cntr = def->comp_cntr;
+	hide = !(def->flags & FI_COMPLETION);
+	*context = def->context;
+	free(def);
+
+	if (comp_cntr) {
+		if (err)
+			fi_cntr_adderr(comp_cntr, 1);
+		else
+			fi_cntr_add(comp_cntr, 1);
+	}
+	return hide;
+}
+
+int ofi_deferred_queue(struct util_domain *domain,
+		       struct fi_deferred_work *work)
+{
+	struct util_deferred_work *def;
+	int ret;
+
+	if (!work)
+		return -FI_EINVAL;
+
+	def = calloc(1, sizeof(*def));
+	if (!def)
+		return -FI_ENOMEM;
+
+	ret = util_deferred_init(domain, def, work);
+	if (ret) {
+		FI_WARN(domain->prov, FI_LOG_DOMAIN,
+			"invalid deferred work request\n");
+		free(def);
+		return ret;
+	}
+
+	fastlock_acquire(&domain->deferred_lock);
+	def->state = UTIL_DEFERRED_QUEUED;
+	dlist_insert_tail(&def->domain_entry, &domain->deferred_list);
+	util_deferred_insert(def->cntr, def);
+	fastlock_release(&domain->deferred_lock);
+
+	/* The threshold is published before the counter is read again, so
+	 * an update racing with us is seen either here or by the updater.
+	 */
+	ofi_deferred_trigger(def->cntr);
+	ofi_deferred_progress(domain);
+	return 0;
+}
+
+int ofi_deferred_cancel(struct util_domain *domain,
+			struct fi_deferred_work *work)
+{
+	struct util_deferred_work *def;
+	struct dlist_entry *item;
+	int ret = -FI_ENOENT;
+
+	fastlock_acquire(&domain->deferred_lock);
+	dlist_foreach(&domain->deferred_list, item) {
+		def = container_of(item, struct util_deferred_work,
+				   domain_entry);
+		if (def->work == work && def->state != UTIL_DEFERRED_ACTIVE) {
+			util_deferred_remove(domain, def);
+			free(def);
+			ret = 0;
+			break;
+		}
+	}
+	fastlock_release(&domain->deferred_lock);
+	return ret;
+}
+
+/* Cancels all requests not yet issued, or only those waiting on cntr. */
+void ofi_deferred_flush(struct util_domain *domain, struct fid_cntr *cntr)
+{
+	struct util_deferred_work *def;
+	struct dlist_entry *item, *tmp;
+
+	fastlock_acquire(&domain->deferred_lock);
+	dlist_foreach_safe(&domain->deferred_list, item, tmp) {
+		def = container_of(item, struct util_deferred_work,
+				   domain_entry);
+		if (def->state == UTIL_DEFERRED_ACTIVE ||
+		    (cntr && &def->cntr->cntr_fid != cntr))
+			continue;
+
+		util_deferred_remove(domain, def);
+		free(def);
+	}
+	fastlock_release(&domain->deferred_lock);
+}
+
+void ofi_deferred_cleanup_cq(struct util_cq *cq)
+{
+	struct util_deferred_work *def;
+
+	fastlock_acquire(&cq->domain->deferred_lock);
+	while (!dlist_empty(&cq->deferred_list)) {
+		def = container_of(cq->deferred_list.next,
+				   struct util_deferred_work, entry);
+		util_deferred_remove(cq->domain, def);
+		free(def);
+	}
+	fastlock_release(&cq->domain->deferred_lock);
+}
+
+/* Drops requests that would use the counter after it is closed. */
+void ofi_deferred_cleanup_cntr(struct util_cntr *cntr)
+{
+	struct util_domain *domain = cntr->domain;
+	struct util_deferred_work *def;
+	struct dlist_entry *item, *tmp;
+
+	fastlock_acquire(&domain->deferred_lock);
+	dlist_foreach_safe(&domain->deferred_list, item, tmp) {
+		def = container_of(item, struct util_deferred_work,
+				   domain_entry);
+		if (def->comp_cntr == &cntr->cntr_fid)
+			def->comp_cntr = NULL;
+
+		if (def->state == UTIL_DEFERRED_ACTIVE)
+			continue;
+
+		if ((def->state == UTIL_DEFERRED_QUEUED && def->cntr == cntr) ||
+		    ((def->op_type == FI_OP_CNTR_SET ||
+		      def->op_type == FI_OP_CNTR_ADD) &&
+		     def->op.cntr.cntr == &cntr->cntr_fid)) {
+			util_deferred_remove(domain, def);
+			free(def);
+		}
+	}
+	fastlock_release(&domain->deferred_lock);
+}
@@ -71,11 +71,35 @@ int ofi_domain_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 	}
 }
 
+int ofi_domain_control(struct fid *fid, int command, void *arg)
+{
+	struct util_domain *domain;
+	struct fi_deferred_work *work;
+
+	domain = container_of(fid, struct util_domain, domain_fid.fid);
+	switch (command) {
+	case FI_QUEUE_WORK:
+		return ofi_deferred_queue(domain, arg);
+	case FI_CANCEL_WORK:
+		return ofi_deferred_cancel(domain, arg);
+	case FI_FLUSH_WORK:
+		/* a request, if given, selects its triggering counter */
+		work = arg;
+		ofi_deferred_flush(domain, work ? work->triggering_cntr : NULL);
+		return 0;
+	default:
+		return -FI_ENOSYS;
+	}
+}
+
 int ofi_domain_close(struct util_domain *domain)
 {
 	if (ofi_atomic_get32(&domain->ref))
 		return -FI_EBUSY;
 
+	ofi_deferred_flush(domain, NULL);
+	fastlock_destroy(&domain->deferred_lock);
+
 	if (domain->eq)
 		ofi_atomic_dec32(&domain->eq->ref);
 	if (domain->mr_map.rbtree)
@@ -111,6 +135,13 @@ static int util_domain_init(struct util_domain *domain,
 	domain->name = strdup(info->domain_attr->name);
 	domain->threading = info->domain_attr->threading;
 	domain->data_progress = info->domain_attr->data_progress;
+	domain->auto_progress = false;
+
+	fastlock_init(&domain->deferred_lock);
+	dlist_init(&domain->deferred_list);
+	dlist_init(&domain->deferred_ready);
+	ofi_atomic_initialize32(&domain->deferred_ready_cnt, 0);
+	domain->deferred_running = false;
 	return domain->name ? 0 : -FI_ENOMEM;
 }
 
@@ -62,6 +62,7 @@ int ofi_fabric_init(const struct fi_provider *prov,
 	ofi_atomic_initialize32(&fabric->ref, 0);
 	dlist_init(&fabric->domain_list);
 	fastlock_init(&fabric->lock);
+	fabric->progress = NULL;
 	fabric->name = strdup(user_attr->name);
 	if (!fabric->name)
 		return -FI_ENOMEM;
@@ -49,27 +49,25 @@ struct ofi_mr_cache_params cache_params = {
 	.rocr_monitor_enabled = true,
 };
 
-static int util_mr_find_within(struct ofi_rbmap *map, void *key, void *data)
+/* Cached regions are keyed inline by their address range. */
+static void util_mr_range(struct ofi_rbrange *range, const struct iovec *iov)
 {
-	struct ofi_mr_entry *entry = data;
-	struct ofi_mr_info *info = key;
-
-	if (ofi_iov_shifted_left(&info->iov, &entry->info.iov))
-		return -1;
-	if (ofi_iov_shifted_right(&info->iov, &entry->info.iov))
-		return 1;
-
-	return 0;
+	range->start = (uintptr_t) iov->iov_base;
+	range->len = iov->iov_len;
 }
 
-static int util_mr_find_overlap(struct ofi_rbmap *map, void *key, void *data)
+static int util_mr_find_within(struct ofi_rbmap *map, void *key,
+			       union ofi_rbkey *node_key)
 {
-	struct ofi_mr_entry *entry = data;
-	struct ofi_mr_info *info = key;
+	struct ofi_rbrange *range = key;
+	uint64_t end, node_end;
+
+	end = range->start + range->len - 1;
+	node_end = node_key->range.start + node_key->range.len - 1;
 
-	if (ofi_iov_left(&info->iov, &entry->info.iov))
+	if (range->start < node_key->range.start && end < node_end)
 		return -1;
-	if (ofi_iov_right(&info->iov, &entry->info.iov))
+	if (range->start > node_key->range.start && end > node_end)
 		return 1;
 
 	return 0;
@@ -143,9 +141,11 @@ static void util_mr_uncache_entry(struct ofi_mr_cache *cache,
 static struct ofi_mr_entry *ofi_mr_rbt_find(struct ofi_rbmap *tree,
 					    const struct ofi_mr_info *key)
 {
+	struct ofi_rbrange range;
 	struct ofi_rbnode *node;
 
-	node = ofi_rbmap_find(tree, (void *) key);
+	util_mr_range(&range, &key->iov);
+	node = ofi_rbmap_find(tree, &range);
 	if (!node)
 		return NULL;
 
@@ -155,10 +155,11 @@ static struct ofi_mr_entry *ofi_mr_rbt_find(struct ofi_rbmap *tree,
 static struct ofi_mr_entry *ofi_mr_rbt_overlap(struct ofi_rbmap *tree,
 					       const struct iovec *key)
 {
+	struct ofi_rbrange range;
 	struct ofi_rbnode *node;
 
-	node = ofi_rbmap_search(tree, (void *) key,
-				util_mr_find_overlap);
+	util_mr_range(&range, key);
+	node = ofi_rbmap_search_key(tree, &range, ofi_rbkey_range_compare);
 	if (!node)
 		return NULL;
 
@@ -258,6 +259,7 @@ util_mr_cache_create(struct ofi_mr_cache *cache, const struct ofi_mr_info *info,
 		     struct ofi_mr_entry **entry)
 {
 	struct ofi_mr_entry *cur;
+	struct ofi_rbrange range;
 	int ret;
 	struct ofi_mem_monitor *monitor = cache->monitors[info->iface];
 
@@ -290,7 +292,8 @@ util_mr_cache_create(struct ofi_mr_cache *cache, const struct ofi_mr_info *info,
 		cache->uncached_cnt++;
 		cache->uncached_size += info->iov.iov_len;
 	} else {
-		if (ofi_rbmap_insert(&cache->tree, (void *) &(*entry)->info,
+		util_mr_range(&range, &(*entry)->info.iov);
+		if (ofi_rbmap_insert(&cache->tree, &range,
 				     (void *) *entry, &(*entry)->node)) {
 			ret = -FI_ENOMEM;
 			goto unlock;
@@ -317,8 +320,9 @@ free:
 	return ret;
 }
 
-int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
-			struct ofi_mr_entry **entry)
+static int util_mr_cache_search(struct ofi_mr_cache *cache,
+				const struct fi_mr_attr *attr,
+				struct ofi_mr_entry **entry)
 {
 	struct ofi_mr_info info;
 	int ret;
@@ -384,6 +388,17 @@ hit:
 	return 0;
 }
 
+int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
+			struct ofi_mr_entry **entry)
+{
+	int ret;
+
+	ofi_perf_region_start(OFI_PERF_MR_CACHE_SEARCH);
+	ret = util_mr_cache_search(cache, attr, entry);
+	ofi_perf_region_end(OFI_PERF_MR_CACHE_SEARCH);
+	return ret;
+}
+
 struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 				       const struct fi_mr_attr *attr)
 {
@@ -504,7 +519,8 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	cache->domain = domain;
 	ofi_atomic_inc32(&domain->ref);
 
-	ofi_rbmap_init(&cache->tree, util_mr_find_within);
+	ofi_rbmap_init_keyed(&cache->tree, util_mr_find_within,
+			     sizeof(struct ofi_rbrange));
 	ret = ofi_monitors_add_cache(monitors, cache);
 	if (ret)
 		goto destroy;
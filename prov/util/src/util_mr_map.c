@@ -55,12 +55,132 @@ dup_mr_attr(const struct fi_mr_attr *attr)
 	return dup_attr;
 }
 
+static uint32_t ofi_mr_slot_cnt(struct ofi_mr_map *map)
+{
+	uint32_t cnt;
+
+	cnt = (uint32_t) ofi_atomic_get32(&map->slot_cnt);
+	ofi_atomic_acquire_fence();
+	return cnt;
+}
+
+static int ofi_mr_slot_grow(struct ofi_mr_map *map)
+{
+	struct ofi_mr_slot *chunk;
+	uint32_t i, cnt, chunk_idx;
+
+	cnt = (uint32_t) ofi_atomic_get32(&map->slot_cnt);
+	chunk_idx = cnt >> OFI_MR_SLOT_CHUNK_SHIFT;
+	if (chunk_idx >= OFI_MR_SLOT_CHUNK_MAX)
+		return -FI_ENOSPC;
+
+	if (!map->slots) {
+		map->slots = calloc(OFI_MR_SLOT_CHUNK_MAX, sizeof(*map->slots));
+		if (!map->slots)
+			return -FI_ENOMEM;
+	}
+
+	chunk = calloc(OFI_MR_SLOT_CHUNK, sizeof(*chunk));
+	if (!chunk)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < OFI_MR_SLOT_CHUNK; i++) {
+		ofi_atomic_initialize64(&chunk[i].key, 0);
+		chunk[i].next_free = (i + 1 < OFI_MR_SLOT_CHUNK) ?
+				     cnt + i + 2 : 0;
+	}
+
+	map->slots[chunk_idx] = chunk;
+	map->free_slot = cnt + 1;
+
+	/* Readers that see the new count also see the chunk */
+	ofi_atomic_release_fence();
+	ofi_atomic_set32(&map->slot_cnt, (int32_t) (cnt + OFI_MR_SLOT_CHUNK));
+	return 0;
+}
+
+static bool ofi_mr_slot_key(struct ofi_mr_map *map, uint64_t key)
+{
+	return (key >> 32) && ofi_mr_slot_cnt(map);
+}
+
+static struct ofi_mr_slot *
+ofi_mr_slot_find(struct ofi_mr_map *map, uint64_t key)
+{
+	uint32_t index = (uint32_t) key;
+
+	if (index >= ofi_mr_slot_cnt(map))
+		return NULL;
+
+	return &map->slots[index >> OFI_MR_SLOT_CHUNK_SHIFT]
+			  [index & (OFI_MR_SLOT_CHUNK - 1)];
+}
+
+static int ofi_mr_slot_insert(struct ofi_mr_map *map,
+			      const struct fi_mr_attr *attr,
+			      uint64_t *key, void *context)
+{
+	struct ofi_mr_slot *slot;
+	uint32_t index;
+	int ret;
+
+	if (!map->free_slot) {
+		ret = ofi_mr_slot_grow(map);
+		if (ret)
+			return ret;
+	}
+
+	index = map->free_slot - 1;
+	slot = ofi_mr_slot_find(map, index);
+	map->free_slot = slot->next_free;
+
+	/* The slot's key was cleared when it was freed.  Keep that store
+	 * ahead of the field updates, so a reader still holding the old key
+	 * fails its re-check if it sees any of them.
+	 */
+	ofi_atomic_release_fence();
+
+	slot->access = attr->access;
+	slot->iov = attr->mr_iov[0];
+	slot->offset = (map->mode & FI_MR_VIRT_ADDR) ? attr->offset :
+		       (uintptr_t) attr->mr_iov[0].iov_base;
+	slot->context = context;
+	if (!++slot->gen)
+		slot->gen = 1;
+
+	/* Publishing the key makes the slot visible to lookups */
+	*key = (uint64_t) slot->gen << 32 | index;
+	ofi_atomic_release_fence();
+	ofi_atomic_set64(&slot->key, (int64_t) *key);
+	return 0;
+}
+
+static int ofi_mr_slot_remove(struct ofi_mr_map *map, uint64_t key)
+{
+	struct ofi_mr_slot *slot;
+
+	slot = ofi_mr_slot_find(map, key);
+	if (!slot || (uint64_t) ofi_atomic_get64(&slot->key) != key)
+		return -FI_ENOKEY;
+
+	ofi_atomic_set64(&slot->key, 0);
+	slot->next_free = map->free_slot;
+	map->free_slot = (uint32_t) key + 1;
+	return 0;
+}
+
 int ofi_mr_map_insert(struct ofi_mr_map *map, const struct fi_mr_attr *attr,
 		      uint64_t *key, void *context)
 {
 	struct fi_mr_attr *item;
 	int ret;
 
+	if (map->mode & FI_MR_PROV_KEY) {
+		ret = ofi_mr_slot_insert(map, attr, key, context);
+		if (ret != -FI_ENOSPC)
+			return ret;
+	}
+
 	item = dup_mr_attr(attr);
 	if (!item)
 		return -FI_ENOMEM;
@@ -88,8 +208,22 @@ err:
 
 void *ofi_mr_map_get(struct ofi_mr_map *map, uint64_t key)
 {
+	struct ofi_mr_slot *slot;
 	struct fi_mr_attr *attr;
 	struct ofi_rbnode *node;
+	void *context;
+
+	if (ofi_mr_slot_key(map, key)) {
+		slot = ofi_mr_slot_find(map, key);
+		if (!slot || (uint64_t) ofi_atomic_get64(&slot->key) != key)
+			return NULL;
+
+		ofi_atomic_acquire_fence();
+		context = slot->context;
+		ofi_atomic_acquire_fence();
+		return (uint64_t) ofi_atomic_get64(&slot->key) == key ?
+		       context : NULL;
+	}
 
 	node = ofi_rbmap_find(map->rbtree, &key);
 	if (!node)
@@ -99,13 +233,75 @@ void *ofi_mr_map_get(struct ofi_mr_map *map, uint64_t key)
 	return attr->context;
 }
 
+static int ofi_mr_map_check(struct ofi_mr_map *map, const struct iovec *iov,
+			    uint64_t mr_access, uint64_t offset,
+			    uintptr_t *io_addr, size_t len, uint64_t access)
+{
+	void *addr;
+
+	if ((access & mr_access) != access) {
+		FI_DBG(map->prov, FI_LOG_MR, "verify_addr: invalid access\n");
+		return -FI_EACCES;
+	}
+
+	addr = (void *) (*io_addr + (uintptr_t) offset);
+
+	if ((addr < iov->iov_base) ||
+	    (((char *) addr + len) > ((char *) iov->iov_base +
+			    	      iov->iov_len))) {
+		return -FI_EACCES;
+	}
+
+	*io_addr = (uintptr_t) addr;
+	return 0;
+}
+
+/* Does not need the domain lock: a slot is only written while its key
+ * is 0, and the key is checked again once the slot has been read, in
+ * case it was released and reused in the meantime.  The acquire fences
+ * keep the field loads between the two key loads.
+ */
+static int ofi_mr_slot_verify(struct ofi_mr_map *map, uintptr_t *io_addr,
+			      size_t len, uint64_t key, uint64_t access,
+			      void **context)
+{
+	struct ofi_mr_slot *slot;
+	struct iovec iov;
+	uint64_t mr_access, offset;
+	void *mr_context;
+	int ret;
+
+	slot = ofi_mr_slot_find(map, key);
+	if (!slot || (uint64_t) ofi_atomic_get64(&slot->key) != key)
+		return -FI_EINVAL;
+
+	ofi_atomic_acquire_fence();
+	iov = slot->iov;
+	mr_access = slot->access;
+	offset = slot->offset;
+	mr_context = slot->context;
+	ofi_atomic_acquire_fence();
+	if ((uint64_t) ofi_atomic_get64(&slot->key) != key)
+		return -FI_EINVAL;
+
+	ret = ofi_mr_map_check(map, &iov, mr_access, offset, io_addr, len,
+			       access);
+	if (!ret && context)
+		*context = mr_context;
+	return ret;
+}
+
 int ofi_mr_map_verify(struct ofi_mr_map *map, uintptr_t *io_addr,
 		      size_t len, uint64_t key, uint64_t access,
 		      void **context)
 {
 	struct fi_mr_attr *attr;
 	struct ofi_rbnode *node;
-	void *addr;
+	int ret;
+
+	if (ofi_mr_slot_key(map, key))
+		return ofi_mr_slot_verify(map, io_addr, len, key, access,
+					  context);
 
 	node = ofi_rbmap_find(map->rbtree, &key);
 	if (!node)
@@ -114,23 +310,11 @@ int ofi_mr_map_verify(struct ofi_mr_map *map, uintptr_t *io_addr,
 	attr = node->data;
 	assert(attr);
 
-	if ((access & attr->access) != access) {
-		FI_DBG(map->prov, FI_LOG_MR, "verify_addr: invalid access\n");
-		return -FI_EACCES;
-	}
-
-	addr = (void *) (*io_addr + (uintptr_t) attr->offset);
-
-	if ((addr < attr->mr_iov[0].iov_base) ||
-	    (((char *) addr + len) > ((char *) attr->mr_iov[0].iov_base +
-			    	      attr->mr_iov[0].iov_len))) {
-		return -FI_EACCES;
-	}
-
-	if (context)
+	ret = ofi_mr_map_check(map, &attr->mr_iov[0], attr->access,
+			       attr->offset, io_addr, len, access);
+	if (!ret && context)
 		*context = attr->context;
-	*io_addr = (uintptr_t) addr;
-	return 0;
+	return ret;
 }
 
 int ofi_mr_map_remove(struct ofi_mr_map *map, uint64_t key)
@@ -138,6 +322,9 @@ int ofi_mr_map_remove(struct ofi_mr_map *map, uint64_t key)
 	struct ofi_rbnode *node;
 	struct fi_mr_attr *attr;
 
+	if (ofi_mr_slot_key(map, key))
+		return ofi_mr_slot_remove(map, key);
+
 	node = ofi_rbmap_find(map->rbtree, &key);
 	if (!node)
 		return -FI_ENOKEY;
@@ -149,18 +336,6 @@ int ofi_mr_map_remove(struct ofi_mr_map *map, uint64_t key)
 	return 0;
 }
 
-/* assumes uint64_t keys */
-static int compare_mr_keys(struct ofi_rbmap *rbtree,
-			   void *key, void *data)
-{
-	struct fi_mr_attr *attr = data;
-	uint64_t mrkey = *((uint64_t *) key);
-
-	return (mrkey < attr->requested_key) ? -1 :
-	       (mrkey > attr->requested_key);
-}
-
-
 /*
  * If a provider or app whose version is < 1.5, calls this function and passes
  * FI_MR_UNSPEC as mode, it would be treated as MR scalable.
@@ -168,7 +343,8 @@ static int compare_mr_keys(struct ofi_rbmap *rbtree,
 int ofi_mr_map_init(const struct fi_provider *prov, int mode,
 		    struct ofi_mr_map *map)
 {
-	map->rbtree = ofi_rbmap_create(compare_mr_keys);
+	map->rbtree = ofi_rbmap_create_keyed(ofi_rbkey_u64_compare,
+					     sizeof(uint64_t));
 	if (!map->rbtree)
 		return -FI_ENOMEM;
 
@@ -184,13 +360,26 @@ int ofi_mr_map_init(const struct fi_provider *prov, int mode,
 	}
 	map->prov = prov;
 	map->key = 1;
+	map->slots = NULL;
+	ofi_atomic_initialize32(&map->slot_cnt, 0);
+	map->free_slot = 0;
 
 	return 0;
 }
 
 void ofi_mr_map_close(struct ofi_mr_map *map)
 {
+	uint32_t i;
+
 	ofi_rbmap_destroy(map->rbtree);
+	if (!map->slots)
+		return;
+
+	for (i = 0; i < ofi_atomic_get32(&map->slot_cnt) >>
+			OFI_MR_SLOT_CHUNK_SHIFT; i++)
+		free(map->slots[i]);
+	free(map->slots);
+	map->slots = NULL;
 }
 
 int ofi_mr_close(struct fid *fid)
@@ -330,6 +519,9 @@ int ofi_mr_verify(struct ofi_mr_map *map, ssize_t len,
 	struct util_domain *domain;
 	int ret;
 
+	if (ofi_mr_slot_key(map, key))
+		return ofi_mr_map_verify(map, addr, len, key, access, NULL);
+
 	domain = container_of(map, struct util_domain, mr_map);
 	fastlock_acquire(&domain->lock);
 	ret = ofi_mr_map_verify(&domain->mr_map, addr, len,
@@ -37,10 +37,119 @@
 #include <ofi_util.h>
 
 
+/*
+ * Poll sets opened by the application track which members may be ready
+ * instead of checking every member on each fi_poll call.  A member is
+ * queued on the ready list when it gains entries (see ofi_poll_notify),
+ * or, if its progress is driven through an fd wait object of its own,
+ * when that wait fd becomes readable.  Queued members are progressed and
+ * checked for entries, and stay queued for as long as they report any.
+ * Members whose entries only appear when progress is driven and that have
+ * no such fd are still checked on every call, as are all members of the
+ * internal poll sets that back wait sets.
+ */
+
+void ofi_poll_notify_init(struct util_poll_notify *notify)
+{
+	dlist_init(&notify->list);
+	fastlock_init(&notify->lock);
+}
+
+void ofi_poll_notify_cleanup(struct util_poll_notify *notify,
+			     struct fid *fid)
+{
+	struct util_poll_entry *entry;
+
+	while (!dlist_empty(&notify->list)) {
+		entry = container_of(notify->list.next, struct util_poll_entry,
+				     notify_entry);
+		fi_poll_del(&entry->pollset->poll_fid, fid, 0);
+	}
+	fastlock_destroy(&notify->lock);
+}
+
+static void util_poll_queue(struct util_poll_entry *entry)
+{
+	struct util_poll *pollset = entry->pollset;
+
+	if (!ofi_atomic_cas_bool_strong32(&entry->ready, 0, 1))
+		return;
+
+	fastlock_acquire(&pollset->ready_lock);
+	dlist_insert_tail(&entry->ready_entry, &pollset->ready_list);
+	fastlock_release(&pollset->ready_lock);
+}
+
+void ofi_poll_notify_ready(struct util_poll_notify *notify)
+{
+	struct util_poll_entry *entry;
+
+	fastlock_acquire(&notify->lock);
+	dlist_foreach_container(&notify->list, struct util_poll_entry,
+				entry, notify_entry)
+		util_poll_queue(entry);
+	fastlock_release(&notify->lock);
+}
+
+static struct util_poll_entry *
+util_poll_find(struct util_poll *pollset, struct fid *fid)
+{
+	struct util_poll_entry *entry;
+
+	dlist_foreach_container(&pollset->fid_list, struct util_poll_entry,
+				entry, entry) {
+		if (entry->fid == fid)
+			return entry;
+	}
+	dlist_foreach_container(&pollset->tracked_list, struct util_poll_entry,
+				entry, entry) {
+		if (entry->fid == fid)
+			return entry;
+	}
+	return NULL;
+}
+
+/* A wait object that belongs to the member alone tells us when progress
+ * may produce new entries, provided it can be nested in an epoll set.
+ */
+static int util_poll_track_wait(struct util_poll *pollset,
+				struct util_poll_entry *entry,
+				struct util_wait *wait, int internal_wait)
+{
+	int fd, ret;
+
+	if (!wait || !internal_wait || wait->wait_obj != FI_WAIT_FD)
+		return 0;
+
+	ret = fi_control(&wait->wait_fid.fid, FI_GETWAIT, &fd);
+	if (ret)
+		return 0;
+
+	if (!pollset->epoll_open) {
+		ret = ofi_epoll_create(&pollset->epoll_fd);
+		if (ret)
+			return 0;
+		pollset->epoll_open = true;
+	}
+
+	ret = ofi_epoll_add(pollset->epoll_fd, fd, OFI_EPOLL_IN, entry);
+	if (ret)
+		return 0;
+
+	entry->wait = wait;
+	entry->fd = fd;
+	return 1;
+}
+
 static int util_poll_add(struct fid_poll *poll_fid, struct fid *event_fid,
 			 uint64_t flags)
 {
 	struct util_poll *pollset;
+	struct util_poll_entry *entry;
+	struct util_poll_notify *notify = NULL;
+	struct util_cq *cq;
+	struct util_cntr *cntr;
+	int tracked = 0;
 
 	pollset = container_of(poll_fid, struct util_poll, poll_fid);
 	switch (event_fid->fclass) {
@@ -58,72 +167,221 @@ static int util_poll_add(struct fid_poll *poll_fid, struct fid *event_fid,
 		return -FI_EINVAL;
 	}
 
-	return fid_list_insert(&pollset->fid_list, &pollset->lock, event_fid);
+	fastlock_acquire(&pollset->lock);
+	if (util_poll_find(pollset, event_fid)) {
+		fastlock_release(&pollset->lock);
+		return 0;
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		fastlock_release(&pollset->lock);
+		return -FI_ENOMEM;
+	}
+
+	entry->pollset = pollset;
+	entry->fid = event_fid;
+	entry->fd = -1;
+	ofi_atomic_initialize32(&entry->ready, 0);
+	dlist_init(&entry->notify_entry);
+
+	if (pollset->domain) {
+		if (event_fid->fclass == FI_CLASS_CQ) {
+			cq = container_of(event_fid, struct util_cq,
+					  cq_fid.fid);
+			notify = &cq->poll_notify;
+			/* progress threads drive the CQ for us */
+			tracked = cq->progress_item.worker != NULL ||
+				  util_poll_track_wait(pollset, entry, cq->wait,
+						       cq->internal_wait);
+		} else {
+			cntr = container_of(event_fid, struct util_cntr,
+					    cntr_fid.fid);
+			notify = &cntr->poll_notify;
+			tracked = util_poll_track_wait(pollset, entry,
+						cntr->wait, cntr->internal_wait);
+		}
+	}
+
+	if (tracked) {
+		fastlock_acquire(&notify->lock);
+		dlist_insert_tail(&entry->notify_entry, &notify->list);
+		fastlock_release(&notify->lock);
+		dlist_insert_tail(&entry->entry, &pollset->tracked_list);
+		/* entries may predate the notification */
+		util_poll_queue(entry);
+	} else {
+		dlist_insert_tail(&entry->entry, &pollset->fid_list);
+	}
+	fastlock_release(&pollset->lock);
+	return 0;
+}
+
+static void util_poll_remove(struct util_poll *pollset,
+			     struct util_poll_entry *entry)
+{
+	struct util_poll_notify *notify;
+	struct util_cq *cq;
+	struct util_cntr *cntr;
+
+	if (!dlist_empty(&entry->notify_entry)) {
+		if (entry->fid->fclass == FI_CLASS_CQ) {
+			cq = container_of(entry->fid, struct util_cq,
+					  cq_fid.fid);
+			notify = &cq->poll_notify;
+		} else {
+			cntr = container_of(entry->fid, struct util_cntr,
+					    cntr_fid.fid);
+			notify = &cntr->poll_notify;
+		}
+		fastlock_acquire(&notify->lock);
+		dlist_remove(&entry->notify_entry);
+		fastlock_release(&notify->lock);
+	}
+
+	if (entry->fd >= 0)
+		(void) ofi_epoll_del(pollset->epoll_fd, entry->fd);
+
+	fastlock_acquire(&pollset->ready_lock);
+	if (ofi_atomic_get32(&entry->ready))
+		dlist_remove(&entry->ready_entry);
+	fastlock_release(&pollset->ready_lock);
+
+	dlist_remove(&entry->entry);
+	free(entry);
 }
 
 static int util_poll_del(struct fid_poll *poll_fid, struct fid *event_fid,
 			 uint64_t flags)
 {
 	struct util_poll *pollset;
+	struct util_poll_entry *entry;
 
 	pollset = container_of(poll_fid, struct util_poll, poll_fid);
-	fid_list_remove(&pollset->fid_list, &pollset->lock, event_fid);
+	fastlock_acquire(&pollset->lock);
+	entry = util_poll_find(pollset, event_fid);
+	if (entry)
+		util_poll_remove(pollset, entry);
+	fastlock_release(&pollset->lock);
 	return 0;
 }
 
-static int util_poll_run(struct fid_poll *poll_fid, void **context, int count)
+static ssize_t util_poll_check(struct util_poll_entry *entry)
 {
-	struct util_poll *pollset;
+	struct fid *fid = entry->fid;
 	struct util_eq *eq;
 	struct util_cq *cq;
 	struct util_cntr *cntr;
-	struct fid_list_entry *fid_entry;
-	struct dlist_entry *item;
-	int i = 0, err = 0;
 	ssize_t ret;
 	uint64_t val;
 
+	switch (fid->fclass) {
+	case FI_CLASS_CQ:
+		cq = container_of(fid, struct util_cq, cq_fid.fid);
+		ret = fi_cq_read(&cq->cq_fid, NULL, 0);
+		if (ret == 0 || ret == -FI_EAVAIL)
+			ret = 1;
+		break;
+	case FI_CLASS_CNTR:
+		cntr = container_of(fid, struct util_cntr, cntr_fid.fid);
+		val = fi_cntr_read(&cntr->cntr_fid);
+		ret = (val != entry->checkpoint_cnt);
+		if (ret) {
+			entry->checkpoint_cnt = val;
+		} else {
+			val = fi_cntr_readerr(&cntr->cntr_fid);
+			ret = (val != entry->checkpoint_err);
+			if (ret)
+				entry->checkpoint_err = val;
+		}
+		break;
+	case FI_CLASS_EQ:
+		eq = container_of(fid, struct util_eq, eq_fid.fid);
+		ret = fi_eq_read(&eq->eq_fid, NULL, NULL, 0, FI_PEEK);
+		if (ret == 0 || ret == -FI_EAVAIL)
+			ret = 1;
+		break;
+	default:
+		ret = -FI_EINVAL;
+		break;
+	}
+	return ret;
+}
+
+#define UTIL_POLL_FD_BATCH 32
+
+static void util_poll_queue_fds(struct util_poll *pollset)
+{
+	void *contexts[UTIL_POLL_FD_BATCH];
+	int i, ret;
+
+	do {
+		ret = ofi_epoll_wait(pollset->epoll_fd, contexts,
+				     UTIL_POLL_FD_BATCH, 0);
+		for (i = 0; i < ret; i++)
+			util_poll_queue(contexts[i]);
+	} while (ret == UTIL_POLL_FD_BATCH);
+}
+
+/* Check a queued member.  For members tracked through their wait fd, the
+ * wait object's own test runs first: it clears the wait signal, so the fd
+ * only fires again on new activity, and reports whether anything is
+ * pending, including work that does not show up as entries yet.
+ */
+static ssize_t util_poll_check_ready(struct util_poll_entry *entry)
+{
+	ssize_t ret;
+	int pending = 0;
+
+	if (entry->wait) {
+		ret = entry->wait->wait_try(entry->wait);
+		if (ret == FI_SUCCESS)
+			return 0;
+		pending = (ret == -FI_EAGAIN);
+	}
+
+	ret = util_poll_check(entry);
+	if (ret > 0 || pending)
+		util_poll_queue(entry);
+	return ret;
+}
+
+static int util_poll_run(struct fid_poll *poll_fid, void **context, int count)
+{
+	struct util_poll *pollset;
+	struct util_poll_entry *entry;
+	struct dlist_entry ready_list;
+	int i = 0, err = 0;
+	ssize_t ret;
+
 	pollset = container_of(poll_fid, struct util_poll, poll_fid.fid);
 
 	fastlock_acquire(&pollset->lock);
-	dlist_foreach(&pollset->fid_list, item) {
-		fid_entry = container_of(item, struct fid_list_entry, entry);
-		switch (fid_entry->fid->fclass) {
-		case FI_CLASS_CQ:
-			cq = container_of(fid_entry->fid, struct util_cq,
-					  cq_fid.fid);
-			ret = fi_cq_read(&cq->cq_fid, NULL, 0);
-			if (ret == 0 || ret == -FI_EAVAIL)
-				ret = 1;
-			break;
-		case FI_CLASS_CNTR:
-			cntr = container_of(fid_entry->fid, struct util_cntr,
-					    cntr_fid.fid);
-			val = fi_cntr_read(&cntr->cntr_fid);
-			ret = (val != cntr->checkpoint_cnt);
-			if (ret) {
-				cntr->checkpoint_cnt = val;
-			} else {
-				val = fi_cntr_readerr(&cntr->cntr_fid);
-				ret = (val != cntr->checkpoint_err);
-				if (ret)
-					cntr->checkpoint_err = val;
-			}
-			break;
-		case FI_CLASS_EQ:
-			eq = container_of(fid_entry->fid, struct util_eq,
-					  eq_fid.fid);
-			ret = fi_eq_read(&eq->eq_fid, NULL, NULL, 0, FI_PEEK);
-			if (ret == 0 || ret == -FI_EAVAIL)
-				ret = 1;
-			break;
-		default:
-			ret = -FI_EINVAL;
-			break;
-		}
+	if (pollset->epoll_open)
+		util_poll_queue_fds(pollset);
+
+	dlist_init(&ready_list);
+	fastlock_acquire(&pollset->ready_lock);
+	dlist_splice_tail(&ready_list, &pollset->ready_list);
+	fastlock_release(&pollset->ready_lock);
 
+	while (!dlist_empty(&ready_list)) {
+		dlist_pop_front(&ready_list, struct util_poll_entry,
+				entry, ready_entry);
+		ofi_atomic_set32(&entry->ready, 0);
+
+		ret = util_poll_check_ready(entry);
 		if (ret > 0 && i < count)
-			context[i++] = fid_entry->fid->context;
+			context[i++] = entry->fid->context;
+		else if (ret < 0 && ret != -FI_EAGAIN)
+			err = (int) ret;
+	}
+
+	dlist_foreach_container(&pollset->fid_list, struct util_poll_entry,
+				entry, entry) {
+		ret = util_poll_check(entry);
+		if (ret > 0 && i < count)
+			context[i++] = entry->fid->context;
 		else if (ret < 0 && ret != -FI_EAGAIN)
 			err = (int) ret;
 	}
@@ -142,6 +400,17 @@ static int util_poll_close(struct fid *fid)
 	if (pollset->domain)
 		ofi_atomic_dec32(&pollset->domain->ref);
 
+	while (!dlist_empty(&pollset->fid_list))
+		util_poll_remove(pollset, container_of(pollset->fid_list.next,
+					struct util_poll_entry, entry));
+	while (!dlist_empty(&pollset->tracked_list))
+		util_poll_remove(pollset,
+				 container_of(pollset->tracked_list.next,
+					      struct util_poll_entry, entry));
+
+	if (pollset->epoll_open)
+		ofi_epoll_close(pollset->epoll_fd);
+	fastlock_destroy(&pollset->ready_lock);
 	fastlock_destroy(&pollset->lock);
 
 	free(pollset);
@@ -191,6 +460,9 @@ int fi_poll_create_(const struct fi_provider *prov, struct fid_domain *domain,
 	pollset->prov = prov;
 	ofi_atomic_initialize32(&pollset->ref, 0);
 	dlist_init(&pollset->fid_list);
+	dlist_init(&pollset->tracked_list);
+	dlist_init(&pollset->ready_list);
+	fastlock_init(&pollset->ready_lock);
 	fastlock_init(&pollset->lock);
 
 	pollset->poll_fid.fid.fclass = FI_CLASS_POLL;
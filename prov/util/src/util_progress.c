@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ofi_util.h>
+#include "shared/ofi_str.h"
+
+
+struct util_progress_worker {
+	struct util_progress	*progress;
+	struct fid_wait		*wait;
+	fastlock_t		lock;
+	struct dlist_entry	item_list;
+	size_t			item_cnt;
+	/* items with no wait object, which must be polled */
+	size_t			poll_cnt;
+	pthread_t		thread;
+	char			*cpus;
+	volatile int		stop;
+};
+
+struct util_progress {
+	struct util_fabric	*fabric;
+	size_t			item_cnt;
+	uint64_t		spin_usec;
+	int			block_msec;
+	size_t			worker_cnt;
+	struct util_progress_worker workers[];
+};
+
+static size_t progress_spin_usec = 100;
+static int progress_block_msec = 1;
+
+void ofi_progress_init(void)
+{
+	fi_param_define(NULL, "progress_threads", FI_PARAM_SIZE_T,
+			"Number of worker threads per fabric used to drive "
+			"progress of domains opened with FI_PROGRESS_AUTO, "
+			"for providers that support it (tcp, shm, rxm). "
+			"(default: 0, providers progress on their own)");
+	fi_param_define(NULL, "progress_spin_usec", FI_PARAM_SIZE_T,
+			"Time in microseconds a progress thread keeps polling "
+			"after it last saw activity before it blocks "
+			"(default: 100)");
+	fi_param_define(NULL, "progress_block_msec", FI_PARAM_INT,
+			"Maximum time in milliseconds a progress thread "
+			"blocks before polling again, -1 to block until "
+			"woken.  Threads driving items with no file "
+			"descriptor, such as shm CQs, block no longer than "
+			"the spin time, rounded up to 1 ms (default: 1)");
+	fi_param_define(NULL, "progress_cpus", FI_PARAM_STRING,
+			"Comma separated CPU affinity for progress threads. "
+			"Thread i is bound to entry i, which is a CPU or a "
+			"range a-b[:stride]; entries are reused round-robin "
+			"(default: no affinity)");
+}
+
+size_t ofi_progress_threads(void)
+{
+	size_t threads = 0;
+
+	fi_param_get_size_t(NULL, "progress_threads", &threads);
+	return threads;
+}
+
+bool ofi_progress_enabled(const struct fi_info *info)
+{
+	return info->domain_attr->data_progress == FI_PROGRESS_AUTO &&
+	       ofi_progress_threads() > 0;
+}
+
+static int util_progress_wait_try(void *arg)
+{
+	return FI_SUCCESS;
+}
+
+/*
+ * Returns true if any item found work, and sets polled if any item was
+ * run at all.  Items being driven by the application are skipped; the
+ * sequence counter changes each time an application thread progresses
+ * the item itself.
+ */
+static bool util_progress_worker_run(struct util_progress_worker *worker,
+				     bool *polled)
+{
+	struct util_progress_item *item;
+	bool busy = false;
+	uint32_t seq;
+
+	*polled = false;
+	fastlock_acquire(&worker->lock);
+	dlist_foreach_container(&worker->item_list, struct util_progress_item,
+				item, entry) {
+		if (item->poll_seq) {
+			seq = *item->poll_seq;
+			if (seq != item->last_seq) {
+				item->last_seq = seq;
+				continue;
+			}
+		}
+		if (item->progress(item->arg))
+			busy = true;
+		*polled = true;
+	}
+	fastlock_release(&worker->lock);
+	return busy;
+}
+
+/*
+ * Nothing signals work for items without a wait object, so never block
+ * longer than the spin interval (at least 1 ms) while there are any.
+ */
+static int util_progress_timeout(struct util_progress_worker *worker)
+{
+	struct util_progress *progress = worker->progress;
+	int poll_msec;
+
+	if (!worker->poll_cnt)
+		return progress->block_msec;
+
+	poll_msec = (int) MAX((progress->spin_usec + 999) / 1000, 1);
+	return progress->block_msec >= 0 ?
+	       MIN(progress->block_msec, poll_msec) : poll_msec;
+}
+
+static void *util_progress_worker_func(void *arg)
+{
+	struct util_progress_worker *worker = arg;
+	struct util_progress *progress = worker->progress;
+	const struct fi_provider *prov = progress->fabric->prov;
+	uint64_t last_active;
+	bool polled;
+	int ret;
+
+	if (worker->cpus) {
+		ret = ofi_set_thread_affinity(worker->cpus);
+		if (ret) {
+			FI_WARN(prov, FI_LOG_FABRIC,
+				"unable to set progress thread affinity to %s: "
+				"%s\n", worker->cpus, fi_strerror(-ret));
+		}
+	}
+
+	last_active = ofi_gettime_us();
+	while (!worker->stop) {
+		if (util_progress_worker_run(worker, &polled)) {
+			last_active = ofi_gettime_us();
+			continue;
+		}
+
+		if (!polled) {
+			/* no items, or the application is driving progress */
+			usleep(progress->block_msec > 0 ?
+			       progress->block_msec * 1000 : 1000);
+			last_active = 0;
+			continue;
+		}
+
+		if (ofi_gettime_us() - last_active < progress->spin_usec)
+			continue;
+
+		ret = fi_wait(worker->wait, util_progress_timeout(worker));
+		if (!ret) {
+			last_active = ofi_gettime_us();
+		} else if (ret != -FI_ETIMEDOUT && ret != -FI_EAGAIN &&
+			   ret != -FI_EINTR) {
+			FI_WARN(prov, FI_LOG_FABRIC,
+				"progress thread wait failed: %s\n",
+				fi_strerror(-ret));
+		}
+	}
+
+	return NULL;
+}
+
+static char *util_progress_cpus(const char *list, size_t index)
+{
+	char **cpus;
+	char *ret;
+	size_t cnt;
+
+	cpus = ofi_split_and_alloc(list, ",", &cnt);
+	if (!cpus)
+		return NULL;
+
+	ret = cnt ? strdup(cpus[index % cnt]) : NULL;
+	ofi_free_string_array(cpus);
+	return ret;
+}
+
+static void util_progress_stop(struct util_progress_worker *worker)
+{
+	struct util_wait *wait;
+
+	if (!worker->thread)
+		return;
+
+	worker->stop = 1;
+	wait = container_of(worker->wait, struct util_wait, wait_fid);
+	wait->signal(wait);
+	pthread_join(worker->thread, NULL);
+	worker->thread = 0;
+}
+
+static void util_progress_destroy(struct util_progress *progress)
+{
+	struct util_progress_worker *worker;
+	size_t i;
+
+	for (i = 0; i < progress->worker_cnt; i++) {
+		worker = &progress->workers[i];
+		util_progress_stop(worker);
+		if (worker->wait)
+			fi_close(&worker->wait->fid);
+		fastlock_destroy(&worker->lock);
+		free(worker->cpus);
+	}
+	free(progress);
+}
+
+static int util_progress_create(struct util_fabric *fabric,
+				struct util_progress **progress)
+{
+	struct util_progress_worker *worker;
+	struct fi_wait_attr wait_attr = {
+		.wait_obj = FI_WAIT_UNSPEC,
+	};
+	char *cpus = NULL;
+	size_t i, cnt;
+	int ret;
+
+	cnt = ofi_progress_threads();
+	if (!cnt)
+		return -FI_ENODATA;
+
+	*progress = calloc(1, sizeof(**progress) + cnt * sizeof(*worker));
+	if (!*progress)
+		return -FI_ENOMEM;
+
+	fi_param_get_size_t(NULL, "progress_spin_usec", &progress_spin_usec);
+	fi_param_get_int(NULL, "progress_block_msec", &progress_block_msec);
+	fi_param_get_str(NULL, "progress_cpus", &cpus);
+
+	(*progress)->fabric = fabric;
+	(*progress)->spin_usec = progress_spin_usec;
+	(*progress)->block_msec = progress_block_msec;
+	(*progress)->worker_cnt = cnt;
+
+	for (i = 0; i < cnt; i++) {
+		worker = &(*progress)->workers[i];
+		worker->progress = *progress;
+		fastlock_init(&worker->lock);
+		dlist_init(&worker->item_list);
+		if (cpus)
+			worker->cpus = util_progress_cpus(cpus, i);
+	}
+
+	for (i = 0; i < cnt; i++) {
+		worker = &(*progress)->workers[i];
+		ret = ofi_wait_fd_open(&fabric->fabric_fid, &wait_attr,
+				       &worker->wait);
+		if (ret)
+			goto err;
+
+		ret = pthread_create(&worker->thread, NULL,
+				     util_progress_worker_func, worker);
+		if (ret) {
+			worker->thread = 0;
+			ret = -ret;
+			goto err;
+		}
+	}
+
+	FI_INFO(fabric->prov, FI_LOG_FABRIC,
+		"started %zu progress thread(s)\n", cnt);
+	return 0;
+err:
+	FI_WARN(fabric->prov, FI_LOG_FABRIC,
+		"unable to start progress threads: %s\n", fi_strerror(-ret));
+	util_progress_destroy(*progress);
+	*progress = NULL;
+	return ret;
+}
+
+static struct util_progress_worker *
+util_progress_select(struct util_progress *progress)
+{
+	struct util_progress_worker *worker;
+	size_t i;
+
+	worker = &progress->workers[0];
+	for (i = 1; i < progress->worker_cnt; i++) {
+		if (progress->workers[i].item_cnt < worker->item_cnt)
+			worker = &progress->workers[i];
+	}
+	return worker;
+}
+
+int ofi_progress_add(struct util_fabric *fabric,
+		     struct util_progress_item *item)
+{
+	struct util_progress_worker *worker;
+	struct util_wait *wait;
+	int ret = 0;
+
+	assert(item->progress && !item->worker);
+	fastlock_acquire(&fabric->lock);
+	if (!fabric->progress) {
+		ret = util_progress_create(fabric, &fabric->progress);
+		if (ret)
+			goto unlock;
+	}
+
+	worker = util_progress_select(fabric->progress);
+	wait = container_of(worker->wait, struct util_wait, wait_fid);
+	if (item->wait_fid) {
+		ret = ofi_wait_add_fid(wait, item->wait_fid, POLLIN,
+				       item->wait_try ? item->wait_try :
+				       util_progress_wait_try);
+		if (ret)
+			goto err;
+	}
+
+	item->last_seq = item->poll_seq ? *item->poll_seq : 0;
+	fastlock_acquire(&worker->lock);
+	dlist_insert_tail(&item->entry, &worker->item_list);
+	worker->item_cnt++;
+	if (!item->wait_fid)
+		worker->poll_cnt++;
+	fastlock_release(&worker->lock);
+
+	item->worker = worker;
+	fabric->progress->item_cnt++;
+	fastlock_release(&fabric->lock);
+
+	wait->signal(wait);
+	return 0;
+err:
+	if (!fabric->progress->item_cnt) {
+		util_progress_destroy(fabric->progress);
+		fabric->progress = NULL;
+	}
+unlock:
+	fastlock_release(&fabric->lock);
+	return ret;
+}
+
+/*
+ * Once this returns, the item's progress function is not running and
+ * will not be called again.
+ */
+void ofi_progress_del(struct util_progress_item *item)
+{
+	struct util_progress_worker *worker = item->worker;
+	struct util_progress *progress;
+	struct util_fabric *fabric;
+
+	if (!worker)
+		return;
+
+	progress = worker->progress;
+	fabric = progress->fabric;
+
+	fastlock_acquire(&worker->lock);
+	dlist_remove(&item->entry);
+	worker->item_cnt--;
+	if (!item->wait_fid)
+		worker->poll_cnt--;
+	fastlock_release(&worker->lock);
+
+	if (item->wait_fid) {
+		ofi_wait_del_fid(container_of(worker->wait, struct util_wait,
+					      wait_fid), item->wait_fid);
+	}
+	item->worker = NULL;
+
+	fastlock_acquire(&fabric->lock);
+	if (!--progress->item_cnt) {
+		fabric->progress = NULL;
+		util_progress_destroy(progress);
+	}
+	fastlock_release(&fabric->lock);
+}
+
+/*
+ * Providers release endpoint resources before calling
+ * ofi_endpoint_close().  Unlink the endpoint from its CQs first, so that
+ * a progress thread driving those CQs no longer touches it.
+ */
+void ofi_progress_ep_detach(struct util_ep *ep)
+{
+	if (!ep->domain->auto_progress)
+		return;
+
+	if (ep->tx_cq) {
+		fid_list_remove(&ep->tx_cq->ep_list, &ep->tx_cq->ep_list_lock,
+				&ep->ep_fid.fid);
+	}
+	if (ep->rx_cq) {
+		fid_list_remove(&ep->rx_cq->ep_list, &ep->rx_cq->ep_list_lock,
+				&ep->ep_fid.fid);
+	}
+}
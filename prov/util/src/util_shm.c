@@ -283,6 +283,7 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 		smr_peer_addr_init(&smr_peer_data(*smr)[i].addr);
 		smr_peer_data(*smr)[i].sar_status = 0;
 		smr_peer_data(*smr)[i].name_sent = 0;
+		smr_peer_data(*smr)[i].rnr_status = 0;
 	}
 
 	strncpy((char *) smr_name(*smr), attr->name, total_size - name_offset);
@@ -425,6 +426,7 @@ void smr_unmap_from_endpoint(struct smr_region *region, int64_t id)
 	local_peers = smr_peer_data(region);
 
 	memset(local_peers[id].addr.name, 0, SMR_NAME_MAX);
+	local_peers[id].rnr_status = 0;
 	peer_id = region->map->peers[id].peer.id;
 	if (peer_id < 0)
 		return;
@@ -295,7 +295,7 @@ static int util_wait_update_pollfd(struct util_wait_fd *wait_fd,
 	int ret;
 
 	ret = fi_control(fid_entry->fid, FI_GETWAIT, &pollfds);
-	if (ret != FI_ETOOSMALL)
+	if (ret != -FI_ETOOSMALL)
 		return ret;
 
 	if (pollfds.change_index == fid_entry->pollfds.change_index)
@@ -303,7 +303,7 @@ static int util_wait_update_pollfd(struct util_wait_fd *wait_fd,
 
 	fds = fid_entry->pollfds.fd;
 	for (i = 0; i < fid_entry->pollfds.nfds; i++) {
-		ret = ofi_wait_fdset_del(wait_fd, fds->fd);
+		ret = ofi_wait_fdset_del(wait_fd, fds[i].fd);
 		if (ret) {
 			FI_WARN(wait_fd->util_wait.prov, FI_LOG_EP_CTRL,
 				"epoll_del failed %s\n", fi_strerror(ret));
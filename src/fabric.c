@@ -48,6 +48,7 @@
 #include "shared/ofi_str.h"
 #include "ofi_prov.h"
 #include "ofi_perf.h"
+#include "ofi_trace.h"
 #include "ofi_hmem.h"
 
 #ifdef HAVE_LIBDL
@@ -60,9 +61,18 @@ struct ofi_prov {
 	struct fi_provider	*provider;
 	void			*dlhandle;
 	bool			hidden;
+	bool			probed;
+
+	/* Set until the provider is first selected, see ofi_load_prov() */
+	bool			pending;
+	struct fi_provider	*(*init)(void);
+	char			**libs;
+	size_t			lib_cnt;
 };
 
 static struct ofi_prov *prov_head, *prov_tail;
+static int prov_pending;
+static int prov_lazy_init = 1;
 int ofi_init = 0;
 extern struct ofi_common_locks common_locks;
 
@@ -278,6 +288,9 @@ static struct ofi_prov *ofi_getprov(const char *prov_name, size_t len)
 	return NULL;
 }
 
+static struct ofi_prov *ofi_getprov_loaded(const char *prov_name,
+					   size_t len);
+
 struct fi_provider *ofi_get_hook(const char *name)
 {
 	struct ofi_prov *prov;
@@ -285,11 +298,11 @@ struct fi_provider *ofi_get_hook(const char *name)
 	char *try_name = NULL;
 	int ret;
 
-	prov = ofi_getprov(name, strlen(name));
+	prov = ofi_getprov_loaded(name, strlen(name));
 	if (!prov) {
 		ret = asprintf(&try_name, "ofi_hook_%s", name);
 		if (ret > 0)
-			prov = ofi_getprov(try_name, ret);
+			prov = ofi_getprov_loaded(try_name, ret);
 		else
 			try_name = NULL;
 	}
@@ -384,6 +397,14 @@ static void ofi_ordered_provs_init(void)
 		ofi_create_prov_entry(ordered_prov_names[i]);
 }
 
+static void ofi_set_prov_pending(struct ofi_prov *prov)
+{
+	if (!prov->pending) {
+		prov->pending = true;
+		prov_pending++;
+	}
+}
+
 static void ofi_set_prov_type(struct fi_prov_context *ctx,
 			      struct fi_provider *provider)
 {
@@ -487,10 +508,9 @@ static void ofi_register_provider(struct fi_provider *provider, void *dlhandle)
 			goto cleanup;
 	}
 
+update_prov_registry:
 	if (hidden)
 		prov->hidden = true;
-
-update_prov_registry:
 	prov->dlhandle = dlhandle;
 	prov->provider = provider;
 	return;
@@ -590,6 +610,65 @@ static void ofi_reg_dl_prov(const char *lib)
 	}
 }
 
+/* Map lib<name>-fi.so to the registry entry of provider <name> */
+static struct ofi_prov *ofi_lib_prov(const char *lib)
+{
+	static const char sfx[] = "-" FI_LIB_SUFFIX;
+	struct ofi_prov *prov;
+	const char *file;
+	char *name;
+	size_t len;
+
+	file = strrchr(lib, '/');
+	file = file ? file + 1 : lib;
+	if (strncmp(file, "lib", 3))
+		return NULL;
+
+	file += 3;
+	len = strlen(file);
+	if (len <= sizeof(sfx) - 1 ||
+	    strcmp(&file[len - (sizeof(sfx) - 1)], sfx))
+		return NULL;
+	len -= sizeof(sfx) - 1;
+
+	prov = ofi_getprov(file, len);
+	if (!prov && asprintf(&name, "%s%.*s", OFI_UTIL_PREFIX,
+			      (int) len, file) > 0) {
+		prov = ofi_getprov(name, strlen(name));
+		free(name);
+	}
+	return prov;
+}
+
+/*
+ * Libraries of known providers are opened once the provider is selected.
+ * Any other library must be opened now to learn the provider's name.
+ */
+static void ofi_add_dl_prov(const char *lib)
+{
+	struct ofi_prov *prov;
+	char **libs;
+
+	prov = prov_lazy_init ? ofi_lib_prov(lib) : NULL;
+	if (!prov)
+		goto load;
+
+	libs = realloc(prov->libs, sizeof(*libs) * (prov->lib_cnt + 1));
+	if (!libs)
+		goto load;
+
+	prov->libs = libs;
+	libs[prov->lib_cnt] = strdup(lib);
+	if (!libs[prov->lib_cnt])
+		goto load;
+
+	prov->lib_cnt++;
+	ofi_set_prov_pending(prov);
+	return;
+load:
+	ofi_reg_dl_prov(lib);
+}
+
 static void ofi_ini_dir(const char *dir)
 {
 	int n = 0;
@@ -606,7 +685,7 @@ static void ofi_ini_dir(const char *dir)
 			       "asprintf failed to allocate memory\n");
 			goto libdl_done;
 		}
-		ofi_reg_dl_prov(lib);
+		ofi_add_dl_prov(lib);
 
 		free(liblist[n]);
 		free(lib);
@@ -646,15 +725,221 @@ static void ofi_find_prov_libs(void)
 			continue;
 		}
 
-		ofi_reg_dl_prov(lib);
+		ofi_add_dl_prov(lib);
 		free(lib);
 	}
 }
 #endif
 
+#define OFI_BUILTIN_PROV(name, init)				\
+static struct fi_provider *ofi_##name##_ini(void)		\
+{								\
+	return init;						\
+}
+
+OFI_BUILTIN_PROV(psm3, PSM3_INIT)
+OFI_BUILTIN_PROV(psm2, PSM2_INIT)
+OFI_BUILTIN_PROV(psm, PSM_INIT)
+OFI_BUILTIN_PROV(usnic, USNIC_INIT)
+OFI_BUILTIN_PROV(gni, GNI_INIT)
+OFI_BUILTIN_PROV(bgq, BGQ_INIT)
+OFI_BUILTIN_PROV(netdir, NETDIR_INIT)
+OFI_BUILTIN_PROV(shm, SHM_INIT)
+OFI_BUILTIN_PROV(rxm, RXM_INIT)
+OFI_BUILTIN_PROV(verbs, VERBS_INIT)
+OFI_BUILTIN_PROV(rstream, RSTREAM_INIT)
+OFI_BUILTIN_PROV(mrail, MRAIL_INIT)
+OFI_BUILTIN_PROV(rxd, RXD_INIT)
+OFI_BUILTIN_PROV(efa, EFA_INIT)
+OFI_BUILTIN_PROV(udp, UDP_INIT)
+OFI_BUILTIN_PROV(sockets, SOCKETS_INIT)
+OFI_BUILTIN_PROV(tcp, TCP_INIT)
+OFI_BUILTIN_PROV(hook_perf, HOOK_PERF_INIT)
+OFI_BUILTIN_PROV(hook_debug, HOOK_DEBUG_INIT)
+OFI_BUILTIN_PROV(hook_noop, HOOK_NOOP_INIT)
+
+/* Registration order of built-in providers.  Names must match the
+ * provider structure so that the provider can be selected before its
+ * initialization function runs.
+ */
+static const struct {
+	const char *name;
+	struct fi_provider *(*init)(void);
+} ofi_builtin_provs[] = {
+	{ "psm3", ofi_psm3_ini },
+	{ "psm2", ofi_psm2_ini },
+	{ "psm", ofi_psm_ini },
+	{ "usnic", ofi_usnic_ini },
+	{ "gni", ofi_gni_ini },
+	{ "bgq", ofi_bgq_ini },
+	{ "netdir", ofi_netdir_ini },
+	{ "shm", ofi_shm_ini },
+	{ "ofi_rxm", ofi_rxm_ini },
+	{ "verbs", ofi_verbs_ini },
+	{ "ofi_rstream", ofi_rstream_ini },
+	{ "ofi_mrail", ofi_mrail_ini },
+	{ "ofi_rxd", ofi_rxd_ini },
+	{ "efa", ofi_efa_ini },
+	{ "udp", ofi_udp_ini },
+	{ "sockets", ofi_sockets_ini },
+	{ "tcp", ofi_tcp_ini },
+	{ "ofi_hook_perf", ofi_hook_perf_ini },
+	{ "ofi_hook_debug", ofi_hook_debug_ini },
+	{ "ofi_hook_noop", ofi_hook_noop_ini },
+};
+
+static void ofi_add_builtin_prov(const char *name,
+				 struct fi_provider *(*init)(void))
+{
+	struct ofi_prov *prov;
+
+	if (!prov_lazy_init) {
+		ofi_register_provider(init(), NULL);
+		return;
+	}
+
+	prov = ofi_getprov(name, strlen(name));
+	if (!prov) {
+		prov = ofi_create_prov_entry(name);
+		if (!prov) {
+			ofi_register_provider(init(), NULL);
+			return;
+		}
+	}
+
+	prov->init = init;
+	ofi_set_prov_pending(prov);
+}
+
+/*
+ * Open the provider's libraries and run its initialization functions.
+ * Libraries go first, so that they take precedence over a built-in
+ * provider of the same version, as with eager initialization.
+ * Caller must hold the ini_lock.
+ */
+static void ofi_load_prov(struct ofi_prov *prov)
+{
+	struct fi_provider *(*init)(void);
+	size_t i;
+
+	if (!prov->pending)
+		return;
+
+	prov->pending = false;
+	prov_pending--;
+
+	FI_DBG(&core_prov, FI_LOG_CORE, "loading provider %s\n",
+	       prov->prov_name);
+	for (i = 0; i < prov->lib_cnt; i++) {
+#ifdef HAVE_LIBDL
+		ofi_reg_dl_prov(prov->libs[i]);
+#endif
+		free(prov->libs[i]);
+	}
+	free(prov->libs);
+	prov->libs = NULL;
+	prov->lib_cnt = 0;
+
+	init = prov->init;
+	prov->init = NULL;
+	if (init)
+		ofi_register_provider(init(), NULL);
+}
+
+/* Same as ofi_getinfo_filter(), using only the provider's name */
+static int ofi_getinfo_name_filter(const char *name)
+{
+	if (!prov_filter.negated && ofi_has_util_prefix(name))
+		return 0;
+
+	return ofi_apply_prov_init_filter(&prov_filter, name);
+}
+
+/*
+ * Decide whether a fi_getinfo() call may select a provider that has not
+ * been loaded yet.  This is a superset of ofi_layering_ok().  Utility
+ * providers are loaded for any core provider request, since they may
+ * layer over it.  They load their core providers through nested
+ * fi_getinfo() calls.  Hooks are only loaded by ofi_get_hook().
+ */
+static bool ofi_prov_wanted(const struct ofi_prov *prov, char **prov_vec,
+			    size_t count, uint64_t flags)
+{
+	bool util, util_named = false;
+	size_t i;
+
+	if (!strncasecmp(prov->prov_name, "ofi_hook_", 9))
+		return false;
+
+	if (!(flags & OFI_GETINFO_HIDDEN) &&
+	    ofi_getinfo_name_filter(prov->prov_name))
+		return false;
+
+	util = ofi_has_util_prefix(prov->prov_name);
+	if (util && (flags & OFI_CORE_PROV_ONLY))
+		return false;
+
+	if (!count)
+		return true;
+
+	for (i = 0; i < count; i++) {
+		if (prov_vec[i][0] == '^')
+			continue;
+		if (!strcasecmp(prov_vec[i], prov->prov_name))
+			return true;
+		if (ofi_has_util_prefix(prov_vec[i]))
+			util_named = true;
+	}
+
+	return util && !util_named;
+}
+
+static void ofi_load_provs(char **prov_vec, size_t count, uint64_t flags)
+{
+	struct ofi_prov *prov;
+
+	if (!prov_pending)
+		return;
+
+	pthread_mutex_lock(&common_locks.ini_lock);
+	for (prov = prov_head; prov; prov = prov->next) {
+		if (prov->pending &&
+		    ofi_prov_wanted(prov, prov_vec, count, flags))
+			ofi_load_prov(prov);
+	}
+	pthread_mutex_unlock(&common_locks.ini_lock);
+}
+
+void ofi_load_all_provs(void)
+{
+	struct ofi_prov *prov;
+
+	if (!prov_pending)
+		return;
+
+	pthread_mutex_lock(&common_locks.ini_lock);
+	for (prov = prov_head; prov; prov = prov->next)
+		ofi_load_prov(prov);
+	pthread_mutex_unlock(&common_locks.ini_lock);
+}
+
+static struct ofi_prov *ofi_getprov_loaded(const char *prov_name, size_t len)
+{
+	struct ofi_prov *prov;
+
+	prov = ofi_getprov(prov_name, len);
+	if (prov && prov->pending) {
+		pthread_mutex_lock(&common_locks.ini_lock);
+		ofi_load_prov(prov);
+		pthread_mutex_unlock(&common_locks.ini_lock);
+	}
+	return prov;
+}
+
 void fi_ini(void)
 {
 	char *param_val = NULL;
+	size_t i;
 
 	pthread_mutex_lock(&common_locks.ini_lock);
 
@@ -668,9 +953,12 @@ void fi_ini(void)
 	ofi_mem_init();
 	ofi_pmem_init();
 	ofi_perf_init();
+	ofi_perf_region_init();
+	ofi_trace_init();
 	ofi_hook_init();
 	ofi_hmem_init();
 	ofi_monitors_init();
+	ofi_progress_init();
 
 	fi_param_define(NULL, "provider", FI_PARAM_STRING,
 			"Only use specified provider (default: all available)");
@@ -684,9 +972,15 @@ void fi_ini(void)
 			" used by distribute OFI application. The provider uses"
 			" this to optimize resource allocations"
 			" (default: provider specific)");
+	fi_param_define(NULL, "provider_lazy_init", FI_PARAM_BOOL,
+			"Defer loading and initializing a provider until an "
+			"application call selects it through fi_getinfo "
+			"hints or FI_PROVIDER (default: yes)");
 	fi_param_get_size_t(NULL, "universe_size", &ofi_universe_size);
+	fi_param_get_bool(NULL, "provider_lazy_init", &prov_lazy_init);
 	fi_param_get_str(NULL, "provider", &param_val);
 	ofi_create_filter(&prov_filter, param_val);
+	ofi_getinfo_cache_init();
 
 #ifdef HAVE_LIBDL
 	int n = 0;
@@ -720,27 +1014,9 @@ void fi_ini(void)
 libdl_done:
 #endif
 
-	ofi_register_provider(PSM3_INIT, NULL);
-	ofi_register_provider(PSM2_INIT, NULL);
-	ofi_register_provider(PSM_INIT, NULL);
-	ofi_register_provider(USNIC_INIT, NULL);
-	ofi_register_provider(GNI_INIT, NULL);
-	ofi_register_provider(BGQ_INIT, NULL);
-	ofi_register_provider(NETDIR_INIT, NULL);
-	ofi_register_provider(SHM_INIT, NULL);
-	ofi_register_provider(RXM_INIT, NULL);
-	ofi_register_provider(VERBS_INIT, NULL);
-	/* ofi_register_provider(RSTREAM_INIT, NULL); - no support */
-	ofi_register_provider(MRAIL_INIT, NULL);
-	ofi_register_provider(RXD_INIT, NULL);
-	ofi_register_provider(EFA_INIT, NULL);
-	ofi_register_provider(UDP_INIT, NULL);
-	ofi_register_provider(SOCKETS_INIT, NULL);
-	ofi_register_provider(TCP_INIT, NULL);
-
-	ofi_register_provider(HOOK_PERF_INIT, NULL);
-	ofi_register_provider(HOOK_DEBUG_INIT, NULL);
-	ofi_register_provider(HOOK_NOOP_INIT, NULL);
+	for (i = 0; i < ARRAY_SIZE(ofi_builtin_provs); i++)
+		ofi_add_builtin_prov(ofi_builtin_provs[i].name,
+				     ofi_builtin_provs[i].init);
 
 	ofi_init = 1;
 
@@ -759,10 +1035,14 @@ FI_DESTRUCTOR(fi_fini(void))
 		prov = prov_head;
 		prov_head = prov->next;
 		cleanup_provider(prov->provider, prov->dlhandle);
+		while (prov->lib_cnt)
+			free(prov->libs[--prov->lib_cnt]);
+		free(prov->libs);
 		free(prov->prov_name);
 		free(prov);
 	}
 
+	ofi_getinfo_cache_fini();
 	ofi_free_filter(&prov_filter);
 	ofi_monitors_cleanup();
 	ofi_hmem_cleanup();
@@ -961,6 +1241,7 @@ int DEFAULT_SYMVER_PRE(fi_getinfo)(uint32_t version, const char *node,
 	struct ofi_prov *prov;
 	struct fi_info *tail, *cur;
 	char **prov_vec = NULL;
+	char *cache_key = NULL;
 	size_t count = 0;
 	enum fi_log_level level;
 	int ret;
@@ -975,18 +1256,33 @@ int DEFAULT_SYMVER_PRE(fi_getinfo)(uint32_t version, const char *node,
 	}
 
 	if (flags == FI_PROV_ATTR_ONLY) {
+		ofi_load_all_provs();
 		return ofi_getprovinfo(info);
 	}
 
+	if (!(flags & (OFI_CORE_PROV_ONLY | OFI_GETINFO_INTERNAL |
+		       OFI_GETINFO_HIDDEN))) {
+		cache_key = ofi_getinfo_cache_key(version, node, service,
+						  flags, hints);
+		if (cache_key && !ofi_getinfo_cache_get(cache_key, info)) {
+			free(cache_key);
+			return 0;
+		}
+	}
+
 	if (hints && hints->fabric_attr && hints->fabric_attr->prov_name) {
 		prov_vec = ofi_split_and_alloc(hints->fabric_attr->prov_name,
 					       ";", &count);
-		if (!prov_vec)
+		if (!prov_vec) {
+			free(cache_key);
 			return -FI_ENOMEM;
+		}
 		FI_DBG(&core_prov, FI_LOG_CORE, "hints prov_name: %s\n",
 		       hints->fabric_attr->prov_name);
 	}
 
+	ofi_load_provs(prov_vec, count, flags);
+
 	*info = tail = NULL;
 	for (prov = prov_head; prov; prov = prov->next) {
 		if (!prov->provider || !prov->provider->getinfo)
@@ -1009,6 +1305,7 @@ int DEFAULT_SYMVER_PRE(fi_getinfo)(uint32_t version, const char *node,
 		}
 
 		cur = NULL;
+		prov->probed = true;
 		ret = prov->provider->getinfo(version, node, service, flags,
 					      hints, &cur);
 		if (ret) {
@@ -1050,6 +1347,14 @@ int DEFAULT_SYMVER_PRE(fi_getinfo)(uint32_t version, const char *node,
 	               OFI_GETINFO_HIDDEN)))
 		ofi_filter_info(info);
 
+	if (cache_key) {
+		if (*info)
+			ofi_getinfo_cache_put(cache_key, *info,
+					      (node && (flags & FI_SOURCE)) ||
+					      (hints && hints->src_addr));
+		free(cache_key);
+	}
+
 	return *info ? 0 : -FI_ENODATA;
 }
 DEFAULT_SYMVER(fi_getinfo_, fi_getinfo, FABRIC_1.3);
@@ -1185,6 +1490,29 @@ fail:
 }
 DEFAULT_SYMVER(fi_dupinfo_, fi_dupinfo, FABRIC_1.3);
 
+/*
+ * Attributes restored from the getinfo cache never reached the provider's
+ * getinfo(), which some providers rely on to discover their devices.
+ * Run it once before the provider opens its first fabric.
+ */
+static void ofi_probe_prov(const struct fi_fabric_attr *attr)
+{
+	struct fi_info *hints, *info = NULL;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return;
+
+	hints->fabric_attr->prov_name = strdup(attr->prov_name);
+	if (hints->fabric_attr->prov_name) {
+		fi_getinfo(attr->api_version ? attr->api_version : fi_version(),
+			   NULL, NULL, OFI_GETINFO_INTERNAL | OFI_GETINFO_HIDDEN,
+			   hints, &info);
+		fi_freeinfo(info);
+	}
+	fi_freeinfo(hints);
+}
+
 __attribute__((visibility ("default"),EXTERNALLY_VISIBLE))
 int DEFAULT_SYMVER_PRE(fi_fabric)(struct fi_fabric_attr *attr,
 		struct fid_fabric **fabric, void *context)
@@ -1208,10 +1536,13 @@ int DEFAULT_SYMVER_PRE(fi_fabric)(struct fi_fabric_attr *attr,
 	if (!top_name)
 		return -FI_EINVAL;
 
-	prov = ofi_getprov(top_name, strlen(top_name));
+	prov = ofi_getprov_loaded(top_name, strlen(top_name));
 	if (!prov || !prov->provider || !prov->provider->fabric)
 		return -FI_ENODEV;
 
+	if (!prov->probed)
+		ofi_probe_prov(attr);
+
 	ret = prov->provider->fabric(attr, fabric, context);
 	if (!ret) {
 		if (FI_VERSION_GE(prov->provider->fi_version, FI_VERSION(1, 5)))
@@ -0,0 +1,861 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * fi_getinfo() result cache.
+ *
+ * Results are keyed by the call's arguments, with the hints reduced to
+ * their attribute values and strings, so that equal hints map to the same
+ * key wherever they are stored.  The in-process cache keeps the most
+ * recently used result sets.
+ *
+ * The optional node-level cache stores result sets as files in a shared
+ * directory, so that only the first process on a node has to load the
+ * providers and probe the hardware.  A file is only used if it was
+ * written by the same user and library build, with the same FI_*
+ * environment and the same network interfaces and addresses.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <rdma/fi_errno.h>
+#include "ofi.h"
+#include "ofi_list.h"
+#include "ofi_mem.h"
+#include "ofi_net.h"
+#include "fasthash.h"
+
+#define OFI_GETINFO_CACHE_SIZE	32
+#define OFI_GETINFO_KEY_LEN	8192
+#define OFI_GETINFO_FILE_MAX	(1 << 20)
+#define OFI_GETINFO_FILE_MAGIC	"ofigi01"
+
+struct ofi_getinfo_entry {
+	struct dlist_entry	entry;
+	char			*key;
+	struct fi_info		*info;
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static DEFINE_LIST(cache_list);
+static size_t cache_cnt;
+static int cache_enabled = 1;
+static char *cache_dir;
+
+static struct fi_info *ofi_getinfo_dup(const struct fi_info *info)
+{
+	struct fi_info *head = NULL, *tail = NULL, *cur;
+
+	for (; info; info = info->next) {
+		cur = fi_dupinfo(info);
+		if (!cur) {
+			fi_freeinfo(head);
+			return NULL;
+		}
+
+		if (tail)
+			tail->next = cur;
+		else
+			head = cur;
+		tail = cur;
+	}
+	return head;
+}
+
+static void ofi_getinfo_entry_free(struct ofi_getinfo_entry *entry)
+{
+	fi_freeinfo(entry->info);
+	free(entry->key);
+	free(entry);
+}
+
+/*
+ * Key fields are appended as hex, or as length prefixed strings, each
+ * followed by a separator.  Returns OFI_GETINFO_KEY_LEN if the key does
+ * not fit, since a truncated key could match different arguments.
+ */
+static size_t ofi_getinfo_key_hex(char *key, size_t len, const void *data,
+				  size_t size)
+{
+	static const char hex[] = "0123456789abcdef";
+	const uint8_t *bytes = data;
+	size_t i;
+
+	if (len + size * 2 + 2 > OFI_GETINFO_KEY_LEN)
+		return OFI_GETINFO_KEY_LEN;
+
+	for (i = 0; i < size; i++) {
+		key[len++] = hex[bytes[i] >> 4];
+		key[len++] = hex[bytes[i] & 0xf];
+	}
+	key[len++] = '|';
+	key[len] = '\0';
+	return len;
+}
+
+static size_t ofi_getinfo_key_str(char *key, size_t len, const char *str)
+{
+	int ret;
+
+	if (len >= OFI_GETINFO_KEY_LEN)
+		return OFI_GETINFO_KEY_LEN;
+
+	ret = str ? snprintf(key + len, OFI_GETINFO_KEY_LEN - len, "%zu:%s|",
+			     strlen(str), str) :
+		    snprintf(key + len, OFI_GETINFO_KEY_LEN - len, "-|");
+	if (ret < 0 || len + ret >= OFI_GETINFO_KEY_LEN)
+		return OFI_GETINFO_KEY_LEN;
+	return len + ret;
+}
+
+/*
+ * Attribute structures are added with their pointers cleared.  They are
+ * copied with memcpy, so padding is taken from the hints, which are
+ * normally allocated zeroed by fi_allocinfo().
+ */
+static size_t ofi_getinfo_key_hints(char *key, size_t len,
+				    const struct fi_info *hints)
+{
+	struct fi_info info;
+	struct fi_ep_attr ep_attr;
+	struct fi_domain_attr domain_attr;
+	struct fi_fabric_attr fabric_attr;
+
+	memcpy(&info, hints, sizeof(info));
+	info.next = NULL;
+	info.src_addr = NULL;
+	info.dest_addr = NULL;
+	info.tx_attr = NULL;
+	info.rx_attr = NULL;
+	info.ep_attr = NULL;
+	info.domain_attr = NULL;
+	info.fabric_attr = NULL;
+	len = ofi_getinfo_key_hex(key, len, &info, sizeof(info));
+	len = ofi_getinfo_key_hex(key, len, hints->src_addr,
+				  hints->src_addr ? hints->src_addrlen : 0);
+	len = ofi_getinfo_key_hex(key, len, hints->dest_addr,
+				  hints->dest_addr ? hints->dest_addrlen : 0);
+	len = ofi_getinfo_key_hex(key, len, hints->tx_attr, hints->tx_attr ?
+				  sizeof(*hints->tx_attr) : 0);
+	len = ofi_getinfo_key_hex(key, len, hints->rx_attr, hints->rx_attr ?
+				  sizeof(*hints->rx_attr) : 0);
+
+	if (hints->ep_attr) {
+		memcpy(&ep_attr, hints->ep_attr, sizeof(ep_attr));
+		ep_attr.auth_key = NULL;
+		len = ofi_getinfo_key_hex(key, len, &ep_attr, sizeof(ep_attr));
+	} else {
+		len = ofi_getinfo_key_hex(key, len, NULL, 0);
+	}
+
+	if (hints->domain_attr) {
+		memcpy(&domain_attr, hints->domain_attr, sizeof(domain_attr));
+		domain_attr.name = NULL;
+		domain_attr.auth_key = NULL;
+		len = ofi_getinfo_key_hex(key, len, &domain_attr,
+					  sizeof(domain_attr));
+		len = ofi_getinfo_key_str(key, len, hints->domain_attr->name);
+	} else {
+		len = ofi_getinfo_key_hex(key, len, NULL, 0);
+	}
+
+	if (hints->fabric_attr) {
+		memcpy(&fabric_attr, hints->fabric_attr, sizeof(fabric_attr));
+		fabric_attr.name = NULL;
+		fabric_attr.prov_name = NULL;
+		len = ofi_getinfo_key_hex(key, len, &fabric_attr,
+					  sizeof(fabric_attr));
+		len = ofi_getinfo_key_str(key, len, hints->fabric_attr->name);
+		len = ofi_getinfo_key_str(key, len,
+					  hints->fabric_attr->prov_name);
+	} else {
+		len = ofi_getinfo_key_hex(key, len, NULL, 0);
+	}
+
+	return len;
+}
+
+/*
+ * Hints that refer to open objects or carry keys are not cached.
+ */
+static bool ofi_getinfo_cacheable(const struct fi_info *hints)
+{
+	if (!hints)
+		return true;
+
+	return !hints->handle && !hints->nic &&
+	       !(hints->ep_attr && hints->ep_attr->auth_key) &&
+	       !(hints->domain_attr && (hints->domain_attr->domain ||
+					hints->domain_attr->auth_key)) &&
+	       !(hints->fabric_attr && hints->fabric_attr->fabric);
+}
+
+char *ofi_getinfo_cache_key(uint32_t version, const char *node,
+			    const char *service, uint64_t flags,
+			    const struct fi_info *hints)
+{
+	char *key;
+	size_t len;
+
+	if (!cache_enabled || !ofi_getinfo_cacheable(hints))
+		return NULL;
+
+	key = malloc(OFI_GETINFO_KEY_LEN);
+	if (!key)
+		return NULL;
+
+	len = ofi_getinfo_key_hex(key, 0, &version, sizeof(version));
+	len = ofi_getinfo_key_hex(key, len, &flags, sizeof(flags));
+	len = ofi_getinfo_key_str(key, len, node);
+	len = ofi_getinfo_key_str(key, len, service);
+	if (hints)
+		len = ofi_getinfo_key_hints(key, len, hints);
+
+	if (len >= OFI_GETINFO_KEY_LEN) {
+		free(key);
+		return NULL;
+	}
+	return key;
+}
+
+#ifndef _WIN32
+
+struct ofi_getinfo_file_hdr {
+	char		magic[8];
+	uint64_t	env_hash;
+	uint32_t	info_cnt;
+	uint32_t	key_len;
+};
+
+struct ofi_getinfo_buf {
+	uint8_t		*data;
+	size_t		len;
+	size_t		size;
+};
+
+static uint64_t cache_env_hash;
+
+static int ofi_getinfo_env_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static bool ofi_getinfo_env_var(const char *var)
+{
+	return !strncmp(var, "FI_", 3) && strncmp(var, "FI_LOG_", 7);
+}
+
+/* FI_* variables other than logging ones, sorted so that their order
+ * does not matter */
+static uint64_t ofi_getinfo_hash_env(uint64_t hash)
+{
+	extern char **environ;
+	char **vars;
+	size_t i, cnt;
+
+	for (i = 0, cnt = 0; environ[i]; i++) {
+		if (ofi_getinfo_env_var(environ[i]))
+			cnt++;
+	}
+
+	vars = calloc(cnt + 1, sizeof(*vars));
+	if (!vars)
+		return 0;
+
+	for (i = 0, cnt = 0; environ[i]; i++) {
+		if (ofi_getinfo_env_var(environ[i]))
+			vars[cnt++] = environ[i];
+	}
+	qsort(vars, cnt, sizeof(*vars), ofi_getinfo_env_cmp);
+
+	for (i = 0; i < cnt; i++)
+		hash = fasthash64(vars[i], strlen(vars[i]) + 1, hash);
+
+	free(vars);
+	return hash;
+}
+
+#if HAVE_GETIFADDRS
+static uint64_t ofi_getinfo_hash_ifaddrs(uint64_t hash)
+{
+	struct ifaddrs *ifaddrs, *ifa;
+
+	if (ofi_getifaddrs(&ifaddrs))
+		return 0;
+
+	for (ifa = ifaddrs; ifa; ifa = ifa->ifa_next) {
+		hash = fasthash64(ifa->ifa_name, strlen(ifa->ifa_name), hash);
+		hash = fasthash64(&ifa->ifa_flags, sizeof(ifa->ifa_flags),
+				  hash);
+		if (ifa->ifa_addr && (ifa->ifa_addr->sa_family == AF_INET ||
+				      ifa->ifa_addr->sa_family == AF_INET6))
+			hash = fasthash64(ifa->ifa_addr,
+					  ofi_sizeofaddr(ifa->ifa_addr), hash);
+	}
+
+	freeifaddrs(ifaddrs);
+	return hash;
+}
+#else
+static uint64_t ofi_getinfo_hash_ifaddrs(uint64_t hash)
+{
+	return hash;
+}
+#endif
+
+/*
+ * Identifies the library build and node configuration that a cache file
+ * is valid for.  Zero means the configuration could not be read.
+ */
+static uint64_t ofi_getinfo_config_hash(void)
+{
+	uint64_t hash;
+
+	if (cache_env_hash)
+		return cache_env_hash;
+
+	hash = fasthash64(PACKAGE_VERSION, sizeof(PACKAGE_VERSION),
+			  sizeof(struct fi_info));
+	hash = ofi_getinfo_hash_env(hash);
+	if (hash)
+		hash = ofi_getinfo_hash_ifaddrs(hash);
+
+	cache_env_hash = hash;
+	return hash;
+}
+
+static char *ofi_getinfo_file_path(const char *key, uint64_t config)
+{
+	char *path;
+	uint64_t hash;
+
+	hash = fasthash64(key, strlen(key), config);
+	if (asprintf(&path, "%s/fi_getinfo.%u.%016" PRIx64, cache_dir,
+		     (unsigned) geteuid(), hash) < 0)
+		return NULL;
+	return path;
+}
+
+static int ofi_getinfo_buf_add(struct ofi_getinfo_buf *buf, const void *data,
+			       size_t len)
+{
+	uint8_t *tmp;
+	size_t size;
+
+	if (buf->len + len > buf->size) {
+		size = MAX(buf->size * 2, buf->len + len + 1024);
+		if (size > OFI_GETINFO_FILE_MAX)
+			return -FI_ETOOSMALL;
+
+		tmp = realloc(buf->data, size);
+		if (!tmp)
+			return -FI_ENOMEM;
+		buf->data = tmp;
+		buf->size = size;
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+	return 0;
+}
+
+static int ofi_getinfo_buf_blob(struct ofi_getinfo_buf *buf, const void *data,
+				size_t len)
+{
+	uint32_t blob_len = data ? (uint32_t) len : 0;
+	int ret;
+
+	ret = ofi_getinfo_buf_add(buf, &blob_len, sizeof(blob_len));
+	if (ret || !blob_len)
+		return ret;
+
+	return ofi_getinfo_buf_add(buf, data, blob_len);
+}
+
+static int ofi_getinfo_buf_str(struct ofi_getinfo_buf *buf, const char *str)
+{
+	return ofi_getinfo_buf_blob(buf, str, str ? strlen(str) + 1 : 0);
+}
+
+/*
+ * Attribute structures are stored as is, followed by the data they
+ * point to.  Pointers are reset when the entry is read back.
+ *
+ * A source address in string format, such as shm's fi_shm://<pid>, names
+ * the process that made the call.  Unless the caller chose it, it is not
+ * stored, and the provider picks its own default when an endpoint is
+ * opened from the cached entry.
+ */
+static int ofi_getinfo_pack(struct ofi_getinfo_buf *buf,
+			    const struct fi_info *info, bool src_given)
+{
+	struct fi_info tmp;
+
+	if (info->src_addr && info->addr_format == FI_ADDR_STR &&
+	    !src_given) {
+		tmp = *info;
+		tmp.src_addr = NULL;
+		tmp.src_addrlen = 0;
+		info = &tmp;
+	}
+
+	if (ofi_getinfo_buf_add(buf, info, sizeof(*info)) ||
+	    ofi_getinfo_buf_add(buf, info->tx_attr, sizeof(*info->tx_attr)) ||
+	    ofi_getinfo_buf_add(buf, info->rx_attr, sizeof(*info->rx_attr)) ||
+	    ofi_getinfo_buf_add(buf, info->ep_attr, sizeof(*info->ep_attr)) ||
+	    ofi_getinfo_buf_add(buf, info->domain_attr,
+				sizeof(*info->domain_attr)) ||
+	    ofi_getinfo_buf_add(buf, info->fabric_attr,
+				sizeof(*info->fabric_attr)))
+		return -FI_ETOOSMALL;
+
+	if (ofi_getinfo_buf_blob(buf, info->src_addr, info->src_addrlen) ||
+	    ofi_getinfo_buf_blob(buf, info->dest_addr, info->dest_addrlen) ||
+	    ofi_getinfo_buf_blob(buf, info->ep_attr->auth_key,
+				 info->ep_attr->auth_key_size) ||
+	    ofi_getinfo_buf_blob(buf, info->domain_attr->auth_key,
+				 info->domain_attr->auth_key_size) ||
+	    ofi_getinfo_buf_str(buf, info->domain_attr->name) ||
+	    ofi_getinfo_buf_str(buf, info->fabric_attr->name) ||
+	    ofi_getinfo_buf_str(buf, info->fabric_attr->prov_name))
+		return -FI_ETOOSMALL;
+
+	return 0;
+}
+
+static int ofi_getinfo_buf_get(struct ofi_getinfo_buf *buf, void *data,
+			       size_t len)
+{
+	if (buf->size - buf->len < len)
+		return -FI_EINVAL;
+
+	memcpy(data, buf->data + buf->len, len);
+	buf->len += len;
+	return 0;
+}
+
+static int ofi_getinfo_buf_get_blob(struct ofi_getinfo_buf *buf, void **data,
+				    bool str)
+{
+	uint32_t len;
+	int ret;
+
+	*data = NULL;
+	ret = ofi_getinfo_buf_get(buf, &len, sizeof(len));
+	if (ret || !len)
+		return ret;
+
+	if (buf->size - buf->len < len ||
+	    (str && buf->data[buf->len + len - 1] != '\0'))
+		return -FI_EINVAL;
+
+	*data = mem_dup(buf->data + buf->len, len);
+	if (!*data)
+		return -FI_ENOMEM;
+
+	buf->len += len;
+	return 0;
+}
+
+static int ofi_getinfo_unpack(struct ofi_getinfo_buf *buf,
+			      struct fi_info **info)
+{
+	struct fi_tx_attr *tx_attr;
+	struct fi_rx_attr *rx_attr;
+	struct fi_ep_attr *ep_attr;
+	struct fi_domain_attr *domain_attr;
+	struct fi_fabric_attr *fabric_attr;
+	struct fi_info *cur;
+	int ret;
+
+	cur = fi_allocinfo();
+	if (!cur)
+		return -FI_ENOMEM;
+
+	tx_attr = cur->tx_attr;
+	rx_attr = cur->rx_attr;
+	ep_attr = cur->ep_attr;
+	domain_attr = cur->domain_attr;
+	fabric_attr = cur->fabric_attr;
+
+	ret = ofi_getinfo_buf_get(buf, cur, sizeof(*cur));
+	cur->next = NULL;
+	cur->src_addr = NULL;
+	cur->dest_addr = NULL;
+	cur->handle = NULL;
+	cur->nic = NULL;
+	cur->tx_attr = tx_attr;
+	cur->rx_attr = rx_attr;
+	cur->ep_attr = ep_attr;
+	cur->domain_attr = domain_attr;
+	cur->fabric_attr = fabric_attr;
+	if (ret)
+		goto err;
+
+	if (ofi_getinfo_buf_get(buf, tx_attr, sizeof(*tx_attr)) ||
+	    ofi_getinfo_buf_get(buf, rx_attr, sizeof(*rx_attr)) ||
+	    ofi_getinfo_buf_get(buf, ep_attr, sizeof(*ep_attr)) ||
+	    ofi_getinfo_buf_get(buf, domain_attr, sizeof(*domain_attr)) ||
+	    ofi_getinfo_buf_get(buf, fabric_attr, sizeof(*fabric_attr)))
+		ret = -FI_EINVAL;
+	ep_attr->auth_key = NULL;
+	domain_attr->name = NULL;
+	domain_attr->domain = NULL;
+	domain_attr->auth_key = NULL;
+	fabric_attr->name = NULL;
+	fabric_attr->prov_name = NULL;
+	fabric_attr->fabric = NULL;
+	if (ret)
+		goto err;
+
+	ret = ofi_getinfo_buf_get_blob(buf, &cur->src_addr, false);
+	if (!ret)
+		ret = ofi_getinfo_buf_get_blob(buf, &cur->dest_addr, false);
+	if (!ret)
+		ret = ofi_getinfo_buf_get_blob(buf,
+				(void **) &ep_attr->auth_key, false);
+	if (!ret)
+		ret = ofi_getinfo_buf_get_blob(buf,
+				(void **) &domain_attr->auth_key, false);
+	if (!ret)
+		ret = ofi_getinfo_buf_get_blob(buf,
+				(void **) &domain_attr->name, true);
+	if (!ret)
+		ret = ofi_getinfo_buf_get_blob(buf,
+				(void **) &fabric_attr->name, true);
+	if (!ret)
+		ret = ofi_getinfo_buf_get_blob(buf,
+				(void **) &fabric_attr->prov_name, true);
+	if (ret)
+		goto err;
+
+	if (!cur->src_addr)
+		cur->src_addrlen = 0;
+	if (!cur->dest_addr)
+		cur->dest_addrlen = 0;
+	if (!fabric_attr->prov_name) {
+		ret = -FI_EINVAL;
+		goto err;
+	}
+
+	*info = cur;
+	return 0;
+err:
+	fi_freeinfo(cur);
+	return ret;
+}
+
+static int ofi_getinfo_file_read(const char *path, const char *key,
+				 uint64_t config, struct fi_info **info)
+{
+	struct ofi_getinfo_file_hdr hdr;
+	struct ofi_getinfo_buf buf = { 0 };
+	struct fi_info *tail = NULL, *cur;
+	struct stat st;
+	uint32_t i;
+	int fd, ret = -FI_ENODATA;
+
+	*info = NULL;
+	fd = open(path, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0)
+		return -FI_ENODATA;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+	    st.st_uid != geteuid() || st.st_size < (off_t) sizeof(hdr) ||
+	    st.st_size > OFI_GETINFO_FILE_MAX)
+		goto out;
+
+	buf.size = st.st_size;
+	buf.data = malloc(buf.size);
+	if (!buf.data || read(fd, buf.data, buf.size) != (ssize_t) buf.size)
+		goto out;
+
+	if (ofi_getinfo_buf_get(&buf, &hdr, sizeof(hdr)) ||
+	    memcmp(hdr.magic, OFI_GETINFO_FILE_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.env_hash != config || !hdr.info_cnt ||
+	    hdr.key_len != strlen(key) + 1 ||
+	    buf.size - buf.len < hdr.key_len ||
+	    memcmp(buf.data + buf.len, key, hdr.key_len))
+		goto out;
+
+	buf.len += hdr.key_len;
+	for (i = 0; i < hdr.info_cnt; i++) {
+		if (ofi_getinfo_unpack(&buf, &cur)) {
+			fi_freeinfo(*info);
+			*info = NULL;
+			goto out;
+		}
+
+		if (tail)
+			tail->next = cur;
+		else
+			*info = cur;
+		tail = cur;
+	}
+	ret = 0;
+out:
+	free(buf.data);
+	close(fd);
+	return ret;
+}
+
+/* Results with open objects, such as NIC attributes, are not stored */
+static void ofi_getinfo_file_write(const char *path, const char *key,
+				   uint64_t config, const struct fi_info *info,
+				   bool src_given)
+{
+	struct ofi_getinfo_file_hdr hdr = { .magic = OFI_GETINFO_FILE_MAGIC };
+	struct ofi_getinfo_buf buf = { 0 };
+	const struct fi_info *cur;
+	char *tmp = NULL;
+	int fd = -1;
+
+	hdr.env_hash = config;
+	hdr.key_len = strlen(key) + 1;
+	for (cur = info; cur; cur = cur->next) {
+		if (cur->nic || cur->handle || !cur->tx_attr || !cur->rx_attr ||
+		    !cur->ep_attr || !cur->domain_attr || !cur->fabric_attr)
+			return;
+		hdr.info_cnt++;
+	}
+
+	if (ofi_getinfo_buf_add(&buf, &hdr, sizeof(hdr)) ||
+	    ofi_getinfo_buf_add(&buf, key, hdr.key_len))
+		goto out;
+
+	for (cur = info; cur; cur = cur->next) {
+		if (ofi_getinfo_pack(&buf, cur, src_given))
+			goto out;
+	}
+
+	/* Readers only ever see complete files */
+	if (asprintf(&tmp, "%s.%d", path, (int) getpid()) < 0) {
+		tmp = NULL;
+		goto out;
+	}
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW,
+		  S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		goto out;
+
+	if (write(fd, buf.data, buf.len) != (ssize_t) buf.len ||
+	    rename(tmp, path)) {
+		FI_INFO(&core_prov, FI_LOG_CORE,
+			"unable to write getinfo cache file %s\n", path);
+		unlink(tmp);
+	}
+out:
+	if (fd >= 0)
+		close(fd);
+	free(tmp);
+	free(buf.data);
+}
+
+static int ofi_getinfo_disk_get(const char *key, struct fi_info **info)
+{
+	uint64_t config;
+	char *path;
+	int ret;
+
+	config = ofi_getinfo_config_hash();
+	if (!config)
+		return -FI_ENODATA;
+
+	path = ofi_getinfo_file_path(key, config);
+	if (!path)
+		return -FI_ENODATA;
+
+	ret = ofi_getinfo_file_read(path, key, config, info);
+	if (!ret) {
+		FI_INFO(&core_prov, FI_LOG_CORE,
+			"using getinfo results from %s\n", path);
+	}
+	free(path);
+	return ret;
+}
+
+static void ofi_getinfo_disk_put(const char *key, const struct fi_info *info,
+				 bool src_given)
+{
+	uint64_t config;
+	char *path;
+
+	config = ofi_getinfo_config_hash();
+	if (!config)
+		return;
+
+	path = ofi_getinfo_file_path(key, config);
+	if (path) {
+		ofi_getinfo_file_write(path, key, config, info, src_given);
+		free(path);
+	}
+}
+
+#else /* _WIN32 */
+
+static int ofi_getinfo_disk_get(const char *key, struct fi_info **info)
+{
+	return -FI_ENODATA;
+}
+
+static void ofi_getinfo_disk_put(const char *key, const struct fi_info *info,
+				 bool src_given)
+{
+}
+
+#endif /* _WIN32 */
+
+/* Caller must hold the cache_lock */
+static void ofi_getinfo_mem_put(char *key, struct fi_info *info)
+{
+	struct ofi_getinfo_entry *entry;
+
+	if (cache_cnt == OFI_GETINFO_CACHE_SIZE) {
+		entry = container_of(cache_list.prev, struct ofi_getinfo_entry,
+				     entry);
+		dlist_remove(&entry->entry);
+		ofi_getinfo_entry_free(entry);
+		cache_cnt--;
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		free(key);
+		fi_freeinfo(info);
+		return;
+	}
+
+	entry->key = key;
+	entry->info = info;
+	dlist_insert_head(&entry->entry, &cache_list);
+	cache_cnt++;
+}
+
+int ofi_getinfo_cache_get(const char *key, struct fi_info **info)
+{
+	struct ofi_getinfo_entry *entry;
+	struct fi_info *disk_info;
+	char *disk_key;
+	int ret = -FI_ENODATA;
+
+	pthread_mutex_lock(&cache_lock);
+	dlist_foreach_container(&cache_list, struct ofi_getinfo_entry,
+				entry, entry) {
+		if (strcmp(entry->key, key))
+			continue;
+
+		*info = ofi_getinfo_dup(entry->info);
+		if (*info) {
+			dlist_remove(&entry->entry);
+			dlist_insert_head(&entry->entry, &cache_list);
+			ret = 0;
+		}
+		goto unlock;
+	}
+
+	if (!cache_dir || ofi_getinfo_disk_get(key, &disk_info))
+		goto unlock;
+
+	*info = ofi_getinfo_dup(disk_info);
+	disk_key = strdup(key);
+	if (*info && disk_key) {
+		ofi_getinfo_mem_put(disk_key, disk_info);
+		ret = 0;
+	} else {
+		fi_freeinfo(*info);
+		fi_freeinfo(disk_info);
+		free(disk_key);
+	}
+unlock:
+	pthread_mutex_unlock(&cache_lock);
+	return ret;
+}
+
+void ofi_getinfo_cache_put(const char *key, const struct fi_info *info,
+			   bool src_given)
+{
+	struct fi_info *dup;
+	char *dup_key;
+
+	dup = ofi_getinfo_dup(info);
+	dup_key = strdup(key);
+	if (!dup || !dup_key) {
+		fi_freeinfo(dup);
+		free(dup_key);
+		return;
+	}
+
+	pthread_mutex_lock(&cache_lock);
+	if (cache_dir)
+		ofi_getinfo_disk_put(key, info, src_given);
+	ofi_getinfo_mem_put(dup_key, dup);
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void ofi_getinfo_cache_init(void)
+{
+	fi_param_define(NULL, "getinfo_cache", FI_PARAM_BOOL,
+			"Cache fi_getinfo results within the process, keyed by "
+			"the call's arguments and hints (default: yes)");
+	fi_param_define(NULL, "getinfo_cache_dir", FI_PARAM_STRING,
+			"Directory used to share fi_getinfo results between "
+			"processes on a node, e.g. /dev/shm.  Entries are "
+			"ignored if the FI_* environment or the network "
+			"interfaces change (default: none)");
+
+	fi_param_get_bool(NULL, "getinfo_cache", &cache_enabled);
+	if (cache_enabled)
+		fi_param_get_str(NULL, "getinfo_cache_dir", &cache_dir);
+}
+
+void ofi_getinfo_cache_fini(void)
+{
+	struct ofi_getinfo_entry *entry;
+
+	pthread_mutex_lock(&cache_lock);
+	while (!dlist_empty(&cache_list)) {
+		dlist_pop_front(&cache_list, struct ofi_getinfo_entry,
+				entry, entry);
+		ofi_getinfo_entry_free(entry);
+	}
+	cache_cnt = 0;
+	pthread_mutex_unlock(&cache_lock);
+}
@@ -160,6 +160,8 @@ static uint64_t rdpmc_hw_id(uint32_t cntr_id)
 		return PERF_COUNT_HW_CPU_CYCLES;
 	case OFI_PMC_CPU_INSTR:
 		return PERF_COUNT_HW_INSTRUCTIONS;
+	case OFI_PMC_CPU_CACHE_MISS:
+		return PERF_COUNT_HW_CACHE_MISSES;
 	default:
 		return ~0;
 	}
@@ -209,14 +211,25 @@ int ofi_pmu_open(struct ofi_perf_ctx **ctx, enum ofi_perf_domain domain,
 		attr.config = rdpmc_sw_id(cntr_id);
 		break;
 	default:
-		return -FI_ENOSYS;
+		attr.config = ~0;
+		break;
 	}
 
-	if (attr.config == ~0)
-		return -FI_ENOSYS;
+	if (attr.config == ~0) {
+		ret = -FI_ENOSYS;
+		goto err;
+	}
 
 	ret = rdpmc_open_attr(&attr, &(*ctx)->ctx, NULL);
-	return ret ? -errno : 0;
+	if (ret) {
+		ret = errno ? -errno : -FI_EOTHER;
+		goto err;
+	}
+	return 0;
+err:
+	free(*ctx);
+	*ctx = NULL;
+	return ret;
 }
 
 inline uint64_t ofi_pmu_read(struct ofi_perf_ctx *ctx)
@@ -53,7 +53,7 @@ void ofi_perf_init(void)
 
 	fi_param_define(NULL, "perf_cntr", FI_PARAM_STRING,
 			"Performance counter to analyze (default: cpu_instr). "
-			"Options: cpu_instr, cpu_cycles.");
+			"Options: cpu_instr, cpu_cycles, cpu_cache_miss.");
 	fi_param_get_str(NULL, "perf_cntr", &param_val);
 	if (!param_val)
 		return;
@@ -61,6 +61,9 @@ void ofi_perf_init(void)
 	if (!strcasecmp(param_val, "cpu_cycles")) {
 		perf_domain = OFI_PMU_CPU;
 		perf_cntr = OFI_PMC_CPU_CYCLES;
+	} else if (!strcasecmp(param_val, "cpu_cache_miss")) {
+		perf_domain = OFI_PMU_CPU;
+		perf_cntr = OFI_PMC_CPU_CACHE_MISS;
 	}
 }
 
@@ -104,6 +107,8 @@ static const char *ofi_perf_name(void)
 			return "CPU cycles";
 		case OFI_PMC_CPU_INSTR:
 			return "CPU instr";
+		case OFI_PMC_CPU_CACHE_MISS:
+			return "CPU cache misses";
 		}
 		break;
 	case OFI_PMU_CACHE:
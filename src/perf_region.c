@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <ofi.h>
+#include <ofi_perf.h>
+
+
+#define OFI_PERF_MAX_THREADS	1024
+
+enum {
+	OFI_PERF_REGION_NS,
+	OFI_PERF_REGION_CYCLES,
+	OFI_PERF_REGION_INSTR,
+	OFI_PERF_REGION_CACHE_MISS,
+	OFI_PERF_REGION_CNTRS
+};
+
+/* The first entry is wall clock time, read without the PMU. */
+static const uint32_t region_pmc[OFI_PERF_REGION_CNTRS] = {
+	[OFI_PERF_REGION_CYCLES] = OFI_PMC_CPU_CYCLES,
+	[OFI_PERF_REGION_INSTR] = OFI_PMC_CPU_INSTR,
+	[OFI_PERF_REGION_CACHE_MISS] = OFI_PMC_CPU_CACHE_MISS,
+};
+
+static const char *region_str[] = {
+	[OFI_PERF_SMR_PROGRESS_CMD] = "smr_progress_cmd",
+	[OFI_PERF_TCPX_PROGRESS_RX] = "tcpx_progress_rx",
+	[OFI_PERF_RXM_HANDLE_COMP] = "rxm_handle_comp",
+	[OFI_PERF_MR_CACHE_SEARCH] = "ofi_mr_cache_search",
+	[OFI_PERF_CQ_WRITE] = "ofi_cq_write",
+	[OFI_PERF_BUF_ALLOC] = "ofi_buf_alloc",
+};
+
+struct ofi_perf_region_data {
+	uint64_t	start[OFI_PERF_REGION_CNTRS];
+	uint64_t	sum[OFI_PERF_REGION_CNTRS];
+	uint64_t	calls;
+	uint64_t	samples;
+	size_t		skip;
+	int		sampling;
+};
+
+struct ofi_perf_thread {
+	struct ofi_perf_ctx		*ctx[OFI_PERF_REGION_CNTRS];
+	struct ofi_perf_region_data	region[OFI_PERF_REGION_MAX];
+};
+
+int ofi_perf_region_active = 1;
+
+static pthread_once_t region_once = PTHREAD_ONCE_INIT;
+static size_t region_sample = 64;
+static int region_pmc_failed[OFI_PERF_REGION_CNTRS];
+
+static struct ofi_perf_thread *region_threads[OFI_PERF_MAX_THREADS];
+static ofi_atomic32_t region_thread_cnt;
+static __thread struct ofi_perf_thread *region_thread;
+static __thread int region_thread_failed;
+
+static void ofi_perf_region_log(void)
+{
+	struct ofi_perf_region_data total, *data;
+	int i, j, r, cnt;
+
+	cnt = MIN(ofi_atomic_get32(&region_thread_cnt), OFI_PERF_MAX_THREADS);
+
+	FI_TRACE(&core_prov, FI_LOG_CORE, "\n");
+	FI_TRACE(&core_prov, FI_LOG_CORE,
+		 "\tPERF REGIONS: sampling 1 of %zu calls\n", region_sample);
+	FI_TRACE(&core_prov, FI_LOG_CORE,
+		 "\t%-22s%-12s%-10s%-12s%-12s%-12s%-12s%s\n", "Region",
+		 "Calls", "Samples", "Avg ns", "Avg cycles", "Avg instr",
+		 "Avg misses", "Est. cycles");
+
+	for (r = 0; r < OFI_PERF_REGION_MAX; r++) {
+		memset(&total, 0, sizeof total);
+		for (i = 0; i < cnt; i++) {
+			if (!region_threads[i])
+				continue;
+
+			data = &region_threads[i]->region[r];
+			total.calls += data->calls;
+			total.samples += data->samples;
+			for (j = 0; j < OFI_PERF_REGION_CNTRS; j++)
+				total.sum[j] += data->sum[j];
+		}
+		if (!total.samples)
+			continue;
+
+		FI_TRACE(&core_prov, FI_LOG_CORE,
+			 "\t%-22s%-12" PRIu64 "%-10" PRIu64
+			 "%-12.1f%-12.1f%-12.1f%-12.2f%.0f\n",
+			 region_str[r], total.calls, total.samples,
+			 (double) total.sum[OFI_PERF_REGION_NS] / total.samples,
+			 (double) total.sum[OFI_PERF_REGION_CYCLES] / total.samples,
+			 (double) total.sum[OFI_PERF_REGION_INSTR] / total.samples,
+			 (double) total.sum[OFI_PERF_REGION_CACHE_MISS] /
+			 total.samples,
+			 (double) total.sum[OFI_PERF_REGION_CYCLES] /
+			 total.samples * total.calls);
+	}
+}
+
+static void ofi_perf_region_init_once(void)
+{
+	int enable = 0;
+
+	fi_param_define(NULL, "perf_regions", FI_PARAM_BOOL,
+			"Measure time, cycles, instructions and cache misses "
+			"spent in instrumented internal regions.  Results are "
+			"logged at the trace level on exit (default: no)");
+	fi_param_define(NULL, "perf_region_sample", FI_PARAM_SIZE_T,
+			"Measure 1 out of every N entries into a region "
+			"(default: 64)");
+
+	fi_param_get_bool(NULL, "perf_regions", &enable);
+	fi_param_get_size_t(NULL, "perf_region_sample", &region_sample);
+
+	ofi_atomic_initialize32(&region_thread_cnt, 0);
+	if (!enable) {
+		ofi_perf_region_active = 0;
+		return;
+	}
+
+	if (!region_sample)
+		region_sample = 1;
+	atexit(ofi_perf_region_log);
+}
+
+void ofi_perf_region_init(void)
+{
+	pthread_once(&region_once, ofi_perf_region_init_once);
+}
+
+static struct ofi_perf_thread *ofi_perf_thread_alloc(void)
+{
+	struct ofi_perf_thread *thread;
+	int i, idx, ret;
+
+	idx = ofi_atomic_inc32(&region_thread_cnt) - 1;
+	if (idx >= OFI_PERF_MAX_THREADS)
+		return NULL;
+
+	thread = calloc(1, sizeof(*thread));
+	if (!thread)
+		return NULL;
+
+	/* PMU counters count per thread, so each thread opens its own. */
+	for (i = OFI_PERF_REGION_CYCLES; i < OFI_PERF_REGION_CNTRS; i++) {
+		if (region_pmc_failed[i])
+			continue;
+
+		ret = ofi_pmu_open(&thread->ctx[i], OFI_PMU_CPU,
+				   region_pmc[i], 0);
+		if (ret) {
+			FI_INFO(&core_prov, FI_LOG_CORE,
+				"Unable to open PMU counter %d (%s)\n",
+				region_pmc[i], fi_strerror(-ret));
+			region_pmc_failed[i] = 1;
+			thread->ctx[i] = NULL;
+		}
+	}
+
+	for (i = 0; i < OFI_PERF_REGION_MAX; i++)
+		thread->region[i].skip = (size_t) idx % region_sample;
+
+	region_threads[idx] = thread;
+	return thread;
+}
+
+static inline void ofi_perf_region_read(struct ofi_perf_thread *thread,
+					uint64_t *val)
+{
+	int i;
+
+	val[OFI_PERF_REGION_NS] = ofi_gettime_ns();
+	for (i = OFI_PERF_REGION_CYCLES; i < OFI_PERF_REGION_CNTRS; i++)
+		val[i] = thread->ctx[i] ? ofi_pmu_read(thread->ctx[i]) : 0;
+}
+
+void ofi_perf_region_enter(enum ofi_perf_region region)
+{
+	struct ofi_perf_region_data *data;
+
+	if (OFI_UNLIKELY(!region_thread)) {
+		ofi_perf_region_init();
+		if (!ofi_perf_region_active || region_thread_failed)
+			return;
+
+		region_thread = ofi_perf_thread_alloc();
+		if (!region_thread) {
+			region_thread_failed = 1;
+			return;
+		}
+	}
+
+	data = &region_thread->region[region];
+	data->calls++;
+	if (data->skip--)
+		return;
+
+	data->skip = region_sample - 1;
+	data->sampling = 1;
+	ofi_perf_region_read(region_thread, data->start);
+}
+
+void ofi_perf_region_exit(enum ofi_perf_region region)
+{
+	struct ofi_perf_region_data *data;
+	uint64_t end[OFI_PERF_REGION_CNTRS];
+	int i;
+
+	if (!region_thread)
+		return;
+
+	data = &region_thread->region[region];
+	if (!data->sampling)
+		return;
+
+	ofi_perf_region_read(region_thread, end);
+	for (i = 0; i < OFI_PERF_REGION_CNTRS; i++)
+		data->sum[i] += end[i] - data->start[i];
+	data->samples++;
+	data->sampling = 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <ofi.h>
+#include <ofi_trace.h>
+
+
+const char *ofi_trace_event_str[] = {
+	OFI_TRACE_EVENTS(OFI_STR)
+};
+
+#if ENABLE_TRACE
+
+#define OFI_TRACE_MAX_RINGS	1024
+
+struct ofi_trace_ring {
+	ofi_atomic64_t		head;
+	uint64_t		mask;
+	uint32_t		tid;
+	struct ofi_trace_rec	rec[];
+};
+
+int ofi_trace_active = 1;
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static char trace_path[PATH_MAX];
+static size_t trace_entries = 65536;
+static int trace_signal = SIGUSR2;
+static struct sigaction trace_old_sigact;
+
+static struct ofi_trace_ring *trace_rings[OFI_TRACE_MAX_RINGS];
+static ofi_atomic32_t trace_ring_cnt;
+static __thread struct ofi_trace_ring *trace_ring;
+static __thread int trace_ring_failed;
+
+/* Only async-signal-safe calls are allowed below. */
+static int ofi_trace_write_all(int fd, const void *buf, size_t len)
+{
+	const char *pos = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, pos, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		pos += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int ofi_trace_write_ring(int fd, struct ofi_trace_ring *ring)
+{
+	struct ofi_trace_ring_hdr hdr = {0};
+	uint64_t head, start, cnt, first;
+
+	head = ofi_atomic_get64(&ring->head);
+	cnt = MIN(head, ring->mask + 1);
+	start = (head - cnt) & ring->mask;
+	first = MIN(cnt, ring->mask + 1 - start);
+
+	hdr.tid = ring->tid;
+	hdr.rec_cnt = cnt;
+	if (ofi_trace_write_all(fd, &hdr, sizeof hdr) ||
+	    ofi_trace_write_all(fd, &ring->rec[start],
+				first * sizeof(ring->rec[0])) ||
+	    ofi_trace_write_all(fd, &ring->rec[0],
+				(cnt - first) * sizeof(ring->rec[0])))
+		return -1;
+	return 0;
+}
+
+void ofi_trace_flush(void)
+{
+	struct ofi_trace_file_hdr hdr = {0};
+	struct ofi_trace_name name;
+	struct ofi_trace_ring *ring;
+	uint64_t head;
+	int i, cnt, fd;
+	size_t len;
+
+	if (!trace_path[0])
+		return;
+
+	fd = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return;
+
+	cnt = MIN(ofi_atomic_get32(&trace_ring_cnt), OFI_TRACE_MAX_RINGS);
+	hdr.magic = OFI_TRACE_MAGIC;
+	hdr.version = OFI_TRACE_VERSION;
+	hdr.pid = (uint32_t) getpid();
+	hdr.event_cnt = OFI_TRACE_MAX;
+	for (i = 0; i < cnt; i++) {
+		ring = trace_rings[i];
+		if (!ring)
+			continue;
+		hdr.ring_cnt++;
+		head = ofi_atomic_get64(&ring->head);
+		if (head > ring->mask + 1)
+			hdr.dropped += head - (ring->mask + 1);
+	}
+	if (ofi_trace_write_all(fd, &hdr, sizeof hdr))
+		goto out;
+
+	for (i = 0; i < OFI_TRACE_MAX; i++) {
+		memset(&name, 0, sizeof name);
+		len = strlen(ofi_trace_event_str[i]);
+		memcpy(name.name, ofi_trace_event_str[i],
+		       MIN(len, sizeof(name.name) - 1));
+		if (len > 6 && !strcmp(&ofi_trace_event_str[i][len - 6], "_BEGIN"))
+			name.phase = 'B';
+		else if (len > 4 && !strcmp(&ofi_trace_event_str[i][len - 4], "_END"))
+			name.phase = 'E';
+		else
+			name.phase = 'i';
+		if (ofi_trace_write_all(fd, &name, sizeof name))
+			goto out;
+	}
+
+	for (i = 0; i < cnt && hdr.ring_cnt; i++) {
+		if (!trace_rings[i])
+			continue;
+		if (ofi_trace_write_ring(fd, trace_rings[i]))
+			break;
+		hdr.ring_cnt--;
+	}
+out:
+	close(fd);
+}
+
+static void ofi_trace_sighandler(int signum, siginfo_t *info, void *ucontext)
+{
+	ofi_trace_flush();
+
+	if (trace_old_sigact.sa_flags & SA_SIGINFO) {
+		trace_old_sigact.sa_sigaction(signum, info, ucontext);
+	} else if (trace_old_sigact.sa_handler != SIG_DFL &&
+		   trace_old_sigact.sa_handler != SIG_IGN) {
+		trace_old_sigact.sa_handler(signum);
+	}
+}
+
+static void ofi_trace_atexit(void)
+{
+	ofi_trace_flush();
+}
+
+static void ofi_trace_init_once(void)
+{
+	struct sigaction act;
+	char *path = NULL;
+
+	fi_param_define(NULL, "trace_file", FI_PARAM_STRING,
+			"Enable binary tracepoints and write them to the "
+			"given file, suffixed with the process id, at exit "
+			"(default: disabled)");
+	fi_param_define(NULL, "trace_entries", FI_PARAM_SIZE_T,
+			"Number of events kept per thread, rounded up to a "
+			"power of 2 (default: 65536)");
+	fi_param_define(NULL, "trace_signal", FI_PARAM_INT,
+			"Signal that causes the trace file to be written "
+			"immediately, or 0 to disable (default: SIGUSR2)");
+
+	fi_param_get_str(NULL, "trace_file", &path);
+	fi_param_get_size_t(NULL, "trace_entries", &trace_entries);
+	fi_param_get_int(NULL, "trace_signal", &trace_signal);
+
+	ofi_atomic_initialize32(&trace_ring_cnt, 0);
+	if (!path || !*path || !trace_entries) {
+		ofi_trace_active = 0;
+		return;
+	}
+
+	snprintf(trace_path, sizeof(trace_path), "%s.%d", path, getpid());
+	trace_entries = roundup_power_of_two(trace_entries);
+	atexit(ofi_trace_atexit);
+
+	if (trace_signal > 0) {
+		memset(&act, 0, sizeof act);
+		act.sa_sigaction = ofi_trace_sighandler;
+		act.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&act.sa_mask);
+		if (sigaction(trace_signal, &act, &trace_old_sigact)) {
+			FI_WARN(&core_prov, FI_LOG_CORE,
+				"unable to install trace signal handler\n");
+		}
+	}
+}
+
+void ofi_trace_init(void)
+{
+	pthread_once(&trace_once, ofi_trace_init_once);
+}
+
+static struct ofi_trace_ring *ofi_trace_ring_alloc(void)
+{
+	struct ofi_trace_ring *ring;
+	int idx;
+
+	idx = ofi_atomic_inc32(&trace_ring_cnt) - 1;
+	if (idx >= OFI_TRACE_MAX_RINGS)
+		return NULL;
+
+	ring = calloc(1, sizeof(*ring) + trace_entries * sizeof(ring->rec[0]));
+	if (!ring)
+		return NULL;
+
+	ofi_atomic_initialize64(&ring->head, 0);
+	ring->mask = trace_entries - 1;
+	ring->tid = idx + 1;
+	trace_rings[idx] = ring;
+	return ring;
+}
+
+void ofi_trace_record(enum ofi_trace_event event, uint64_t arg0,
+		      uint64_t arg1, uint64_t arg2, uint64_t arg3)
+{
+	struct ofi_trace_rec *rec;
+	uint64_t head;
+
+	if (OFI_UNLIKELY(!trace_ring)) {
+		ofi_trace_init();
+		if (!ofi_trace_active || trace_ring_failed)
+			return;
+
+		trace_ring = ofi_trace_ring_alloc();
+		if (!trace_ring) {
+			trace_ring_failed = 1;
+			return;
+		}
+	}
+
+	head = ofi_atomic_get64(&trace_ring->head);
+	rec = &trace_ring->rec[head & trace_ring->mask];
+	rec->ts = ofi_gettime_ns();
+	rec->event = event;
+	rec->tid = trace_ring->tid;
+	rec->arg[0] = arg0;
+	rec->arg[1] = arg1;
+	rec->arg[2] = arg2;
+	rec->arg[3] = arg3;
+	ofi_atomic_set64(&trace_ring->head, head + 1);
+}
+
+#endif /* ENABLE_TRACE */
@@ -45,18 +45,58 @@
 // reentrant red-black tree
 
 #include <assert.h>
+#include <string.h>
 
 #include <ofi_tree.h>
 #include <ofi_osd.h>
 #include <rdma/fi_errno.h>
 
+#define OFI_RBSLAB_ALIGN	64
+#define OFI_RBSLAB_MIN_SIZE	16
+#define OFI_RBSLAB_MAX_SIZE	4096
+
+/* Slab header; the nodes follow in the next cache line. */
+struct ofi_rbslab {
+	struct ofi_rbslab	*next;
+};
+
+static const size_t ofi_rbnode_stride =
+	(sizeof(struct ofi_rbnode) + OFI_RBSLAB_ALIGN - 1) &
+	~((size_t) OFI_RBSLAB_ALIGN - 1);
+
+static int ofi_rbmap_grow(struct ofi_rbmap *map)
+{
+	struct ofi_rbslab *slab;
+	struct ofi_rbnode *node;
+	char *nodes;
+	size_t i;
+
+	if (ofi_memalign((void **) &slab, OFI_RBSLAB_ALIGN, OFI_RBSLAB_ALIGN +
+			 map->slab_size * ofi_rbnode_stride))
+		return -FI_ENOMEM;
+
+	slab->next = map->slabs;
+	map->slabs = slab;
+
+	/* hand out nodes in address order */
+	nodes = (char *) slab + OFI_RBSLAB_ALIGN;
+	for (i = map->slab_size; i > 0; i--) {
+		node = (struct ofi_rbnode *) (nodes + (i - 1) * ofi_rbnode_stride);
+		node->right = map->free_list;
+		map->free_list = node;
+	}
+
+	if (map->slab_size < OFI_RBSLAB_MAX_SIZE)
+		map->slab_size <<= 1;
+	return 0;
+}
 
 static struct ofi_rbnode *ofi_rbnode_alloc(struct ofi_rbmap *map)
 {
 	struct ofi_rbnode *node;
 
-	if (!map->free_list)
-		return malloc(sizeof(*node));
+	if (!map->free_list && ofi_rbmap_grow(map))
+		return NULL;
 
 	node = map->free_list;
 	map->free_list = node->right;
@@ -65,14 +105,26 @@ static struct ofi_rbnode *ofi_rbnode_alloc(struct ofi_rbmap *map)
 
 static void ofi_rbnode_free(struct ofi_rbmap *map, struct ofi_rbnode *node)
 {
-	node->right = map->free_list ? map->free_list : NULL;
+	node->right = map->free_list;
 	map->free_list = node;
 }
 
+static inline int
+ofi_rbmap_compare(struct ofi_rbmap *map, void *key, struct ofi_rbnode *node)
+{
+	return map->key_compare ? map->key_compare(map, key, &node->key) :
+	       map->compare(map, key, node->data);
+}
+
 void ofi_rbmap_init(struct ofi_rbmap *map,
 		int (*compare)(struct ofi_rbmap *map, void *key, void *data))
 {
 	map->compare = compare;
+	map->key_compare = NULL;
+	map->key_size = 0;
+	map->free_list = NULL;
+	map->slabs = NULL;
+	map->slab_size = OFI_RBSLAB_MIN_SIZE;
 
 	map->root = &map->sentinel;
 	map->sentinel.left = &map->sentinel;
@@ -82,6 +134,17 @@ void ofi_rbmap_init(struct ofi_rbmap *map,
 	map->sentinel.data = NULL;
 }
 
+void ofi_rbmap_init_keyed(struct ofi_rbmap *map,
+		int (*key_compare)(struct ofi_rbmap *map, void *key,
+				   union ofi_rbkey *node_key),
+		size_t key_size)
+{
+	assert(key_size <= sizeof(union ofi_rbkey));
+	ofi_rbmap_init(map, NULL);
+	map->key_compare = key_compare;
+	map->key_size = key_size;
+}
+
 struct ofi_rbmap *
 ofi_rbmap_create(int (*compare)(struct ofi_rbmap *map, void *key, void *data))
 {
@@ -93,26 +156,31 @@ ofi_rbmap_create(int (*compare)(struct ofi_rbmap *map, void *key, void *data))
 	return map;
 }
 
-static void ofi_delete_tree(struct ofi_rbmap *map, struct ofi_rbnode *node)
+struct ofi_rbmap *
+ofi_rbmap_create_keyed(int (*key_compare)(struct ofi_rbmap *map, void *key,
+					  union ofi_rbkey *node_key),
+		       size_t key_size)
 {
-	if (node == &map->sentinel)
-		return;
+	struct ofi_rbmap *map;
 
-	ofi_delete_tree(map, node->left);
-	ofi_delete_tree(map, node->right);
-	free(node);
+	map = calloc(1, sizeof *map);
+	if (map)
+		ofi_rbmap_init_keyed(map, key_compare, key_size);
+	return map;
 }
 
 void ofi_rbmap_cleanup(struct ofi_rbmap *map)
 {
-	struct ofi_rbnode *node;
+	struct ofi_rbslab *slab;
 
-	ofi_delete_tree(map, map->root);
-	while (map->free_list) {
-		node = map->free_list;
-		map->free_list = node->right;
-		free(node);
+	while (map->slabs) {
+		slab = map->slabs;
+		map->slabs = slab->next;
+		ofi_freealign(slab);
 	}
+	map->free_list = NULL;
+	map->slab_size = OFI_RBSLAB_MIN_SIZE;
+	map->root = &map->sentinel;
 }
 
 void ofi_rbmap_destroy(struct ofi_rbmap *map)
@@ -121,6 +189,26 @@ void ofi_rbmap_destroy(struct ofi_rbmap *map)
 	free(map);
 }
 
+int ofi_rbkey_u64_compare(struct ofi_rbmap *map, void *key,
+			  union ofi_rbkey *node_key)
+{
+	uint64_t k = *((uint64_t *) key);
+
+	return (k < node_key->u64) ? -1 : (k > node_key->u64);
+}
+
+int ofi_rbkey_range_compare(struct ofi_rbmap *map, void *key,
+			    union ofi_rbkey *node_key)
+{
+	struct ofi_rbrange *range = key;
+
+	if (range->start + range->len <= node_key->range.start)
+		return -1;
+	if (range->start >= node_key->range.start + node_key->range.len)
+		return 1;
+	return 0;
+}
+
 int ofi_rbmap_empty(struct ofi_rbmap *map)
 {
 	return map->root == &map->sentinel;
@@ -227,8 +315,9 @@ int ofi_rbmap_insert(struct ofi_rbmap *map, void *key, void *data,
 	current = map->root;
 	parent = NULL;
 
+	ret = 0;
 	while (current != &map->sentinel) {
-		ret = map->compare(map, key, current->data);
+		ret = ofi_rbmap_compare(map, key, current);
 		if (ret == 0) {
 			if (ret_node)
 				*ret_node = current;
@@ -248,9 +337,11 @@ int ofi_rbmap_insert(struct ofi_rbmap *map, void *key, void *data,
 	node->right = &map->sentinel;
 	node->color = RED;
 	node->data = data;
+	if (map->key_size)
+		memcpy(&node->key, key, map->key_size);
 
 	if (parent) {
-		if (map->compare(map, key, parent->data) < 0)
+		if (ret < 0)
 			parent->left = node;
 		else
 			parent->right = node;
@@ -370,8 +461,10 @@ void ofi_rbmap_delete(struct ofi_rbmap *map, struct ofi_rbnode *node)
 		map->root = x;
 	}
 
-	if (y != node)
+	if (y != node) {
 		node->data = y->data;
+		node->key = y->key;
+	}
 
 	if (y->color == BLACK)
 		ofi_delete_rebalance(map, x);
@@ -395,7 +488,7 @@ struct ofi_rbnode *ofi_rbmap_find(struct ofi_rbmap *map, void *key)
 
 	node = map->root;
 	while (node != &map->sentinel) {
-		ret = map->compare(map, key, node->data);
+		ret = ofi_rbmap_compare(map, key, node);
 		if (ret == 0)
 			return node;
 
@@ -432,3 +525,99 @@ struct ofi_rbnode *ofi_rbmap_search(struct ofi_rbmap *map, void *key,
 	}
 	return NULL;
 }
+
+struct ofi_rbnode *ofi_rbmap_search_key(struct ofi_rbmap *map, void *key,
+		int (*key_compare)(struct ofi_rbmap *map, void *key,
+				   union ofi_rbkey *node_key))
+{
+	struct ofi_rbnode *node;
+	int ret;
+
+	node = map->root;
+	while (node != &map->sentinel) {
+		ret = key_compare(map, key, &node->key);
+		if (ret == 0)
+			return node;
+
+		node = (ret < 0) ? node->left : node->right;
+	}
+	return NULL;
+}
+
+static struct ofi_rbnode *
+ofi_rbmap_leftmost(struct ofi_rbmap *map, struct ofi_rbnode *node)
+{
+	while (node->left != &map->sentinel)
+		node = node->left;
+	return node;
+}
+
+static struct ofi_rbnode *
+ofi_rbmap_rightmost(struct ofi_rbmap *map, struct ofi_rbnode *node)
+{
+	while (node->right != &map->sentinel)
+		node = node->right;
+	return node;
+}
+
+struct ofi_rbnode *ofi_rbmap_first(struct ofi_rbmap *map)
+{
+	if (ofi_rbmap_empty(map))
+		return NULL;
+	return ofi_rbmap_leftmost(map, map->root);
+}
+
+struct ofi_rbnode *ofi_rbmap_last(struct ofi_rbmap *map)
+{
+	if (ofi_rbmap_empty(map))
+		return NULL;
+	return ofi_rbmap_rightmost(map, map->root);
+}
+
+struct ofi_rbnode *ofi_rbmap_next(struct ofi_rbmap *map,
+				  struct ofi_rbnode *node)
+{
+	struct ofi_rbnode *parent;
+
+	if (node->right != &map->sentinel)
+		return ofi_rbmap_leftmost(map, node->right);
+
+	parent = node->parent;
+	while (parent && node == parent->right) {
+		node = parent;
+		parent = parent->parent;
+	}
+	return parent;
+}
+
+struct ofi_rbnode *ofi_rbmap_prev(struct ofi_rbmap *map,
+				  struct ofi_rbnode *node)
+{
+	struct ofi_rbnode *parent;
+
+	if (node->left != &map->sentinel)
+		return ofi_rbmap_rightmost(map, node->left);
+
+	parent = node->parent;
+	while (parent && node == parent->left) {
+		node = parent;
+		parent = parent->parent;
+	}
+	return parent;
+}
+
+struct ofi_rbnode *ofi_rbmap_lower_bound(struct ofi_rbmap *map, void *key)
+{
+	struct ofi_rbnode *node, *bound = NULL;
+
+	node = map->root;
+	while (node != &map->sentinel) {
+		if (ofi_rbmap_compare(map, key, node) <= 0) {
+			bound = node;
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+	return bound;
+}
@@ -90,6 +90,9 @@ int DEFAULT_SYMVER_PRE(fi_getparams)(struct fi_param **params, int *count)
 	if (!ofi_init)
 		fi_ini();
 
+	/* Providers define their parameters when they are initialized */
+	ofi_load_all_provs();
+
 	for (entry = param_list.next, cnt = 0; entry != &param_list;
 	     entry = entry->next)
 		cnt++;
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+/*
+ * Microbenchmark for ofi_rbmap.  Compares maps that compare keys held by
+ * the stored data, as most users do, against maps keyed inline in their
+ * nodes, for insertion, lookup, overlap search and range scans.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <ofi_tree.h>
+
+#define RANGE_STRIDE	4096
+#define RANGE_LEN	2048
+#define SCAN_LEN	(64 * RANGE_STRIDE)
+
+struct bench_obj {
+	uint64_t	key;
+	uint64_t	start;
+	uint64_t	len;
+};
+
+static size_t node_cnt = 1000000;
+static struct bench_obj **objs;
+static uint64_t *order;
+static volatile uint64_t sink;
+
+static uint64_t bench_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t bench_rand(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+static void bench_report(const char *name, uint64_t start, size_t ops)
+{
+	printf("%-24s %10zu ops %10.1f ns/op\n", name, ops,
+	       (double) (bench_time_ns() - start) / ops);
+}
+
+static int bench_data_key(struct ofi_rbmap *map, void *key, void *data)
+{
+	uint64_t k = *((uint64_t *) key);
+	struct bench_obj *obj = data;
+
+	return (k < obj->key) ? -1 : (k > obj->key);
+}
+
+static int bench_data_range(struct ofi_rbmap *map, void *key, void *data)
+{
+	struct ofi_rbrange *range = key;
+	struct bench_obj *obj = data;
+
+	if (range->start + range->len <= obj->start)
+		return -1;
+	if (range->start >= obj->start + obj->len)
+		return 1;
+	return 0;
+}
+
+static int bench_alloc(void)
+{
+	uint64_t state = 0x9e3779b97f4a7c15ULL, tmp;
+	size_t i, j;
+
+	objs = calloc(node_cnt, sizeof(*objs));
+	order = calloc(node_cnt, sizeof(*order));
+	if (!objs || !order)
+		return -1;
+
+	/* allocate the objects separately, as map users do */
+	for (i = 0; i < node_cnt; i++) {
+		objs[i] = malloc(sizeof(**objs));
+		if (!objs[i])
+			return -1;
+		objs[i]->key = i;
+		objs[i]->start = i * RANGE_STRIDE;
+		objs[i]->len = RANGE_LEN;
+		order[i] = i;
+	}
+
+	for (i = node_cnt - 1; i > 0; i--) {
+		j = bench_rand(&state) % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	return 0;
+}
+
+static void bench_free(void)
+{
+	size_t i;
+
+	for (i = 0; objs && i < node_cnt; i++)
+		free(objs[i]);
+	free(objs);
+	free(order);
+}
+
+static int bench_key_map(const char *name, struct ofi_rbmap *map)
+{
+	char label[64];
+	uint64_t start;
+	size_t i;
+
+	start = bench_time_ns();
+	for (i = 0; i < node_cnt; i++) {
+		if (ofi_rbmap_insert(map, &objs[order[i]]->key, objs[order[i]],
+				     NULL))
+			return -1;
+	}
+	snprintf(label, sizeof label, "%s insert", name);
+	bench_report(label, start, node_cnt);
+
+	start = bench_time_ns();
+	for (i = 0; i < node_cnt; i++)
+		sink += (uintptr_t) ofi_rbmap_find(map, &order[node_cnt - i - 1]);
+	snprintf(label, sizeof label, "%s find", name);
+	bench_report(label, start, node_cnt);
+
+	ofi_rbmap_cleanup(map);
+	return 0;
+}
+
+static int bench_range_map(const char *name, struct ofi_rbmap *map,
+			   int keyed)
+{
+	struct ofi_rbrange range;
+	struct ofi_rbnode *node;
+	char label[64];
+	uint64_t start, end;
+	size_t i, scans;
+
+	for (i = 0; i < node_cnt; i++) {
+		range.start = objs[order[i]]->start;
+		range.len = objs[order[i]]->len;
+		if (ofi_rbmap_insert(map, &range, objs[order[i]], NULL))
+			return -1;
+	}
+
+	/* each query straddles the end of one range */
+	start = bench_time_ns();
+	for (i = 0; i < node_cnt; i++) {
+		range.start = order[i] * RANGE_STRIDE + RANGE_LEN - 1;
+		range.len = RANGE_STRIDE;
+		node = keyed ?
+		       ofi_rbmap_search_key(map, &range,
+					    ofi_rbkey_range_compare) :
+		       ofi_rbmap_search(map, &range, bench_data_range);
+		sink += (uintptr_t) node;
+	}
+	snprintf(label, sizeof label, "%s overlap", name);
+	bench_report(label, start, node_cnt);
+
+	scans = node_cnt / 64;
+	start = bench_time_ns();
+	for (i = 0; i < scans; i++) {
+		range.start = order[i] * RANGE_STRIDE;
+		range.len = SCAN_LEN;
+		end = range.start + range.len;
+		for (node = ofi_rbmap_lower_bound(map, &range);
+		     node && ((struct bench_obj *) node->data)->start < end;
+		     node = ofi_rbmap_next(map, node))
+			sink++;
+	}
+	snprintf(label, sizeof label, "%s scan64", name);
+	bench_report(label, start, scans);
+
+	ofi_rbmap_cleanup(map);
+	return 0;
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [-n node_count]\n", argv0);
+	printf("Time ofi_rbmap insert, find, overlap search and range scans\n"
+	       "with keys held by the data and with inline node keys.\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct ofi_rbmap map;
+	int op, ret = EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "n:h")) != -1) {
+		switch (op) {
+		case 'n':
+			node_cnt = strtoul(optarg, NULL, 0);
+			if (!node_cnt) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return op == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (bench_alloc())
+		goto out;
+
+	ofi_rbmap_init(&map, bench_data_key);
+	if (bench_key_map("data u64", &map))
+		goto out;
+
+	ofi_rbmap_init_keyed(&map, ofi_rbkey_u64_compare, sizeof(uint64_t));
+	if (bench_key_map("inline u64", &map))
+		goto out;
+
+	ofi_rbmap_init(&map, bench_data_range);
+	if (bench_range_map("data range", &map, 0))
+		goto out;
+
+	ofi_rbmap_init_keyed(&map, ofi_rbkey_range_compare,
+			     sizeof(struct ofi_rbrange));
+	if (bench_range_map("inline range", &map, 1))
+		goto out;
+
+	ret = EXIT_SUCCESS;
+out:
+	if (ret)
+		fprintf(stderr, "rbmap benchmark failed\n");
+	bench_free();
+	return ret;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2021 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include <ofi_trace.h>
+
+static struct ofi_trace_name *names;
+static struct ofi_trace_file_hdr hdr;
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [-o output.json] trace_file\n", argv0);
+	printf("Convert a libfabric binary trace (FI_TRACE_FILE) into Chrome\n"
+	       "trace event JSON, viewable with chrome://tracing or Perfetto.\n");
+}
+
+static const char *trace_name(uint32_t event, char *buf, size_t len)
+{
+	const char *name;
+	size_t n;
+
+	if (event >= hdr.event_cnt)
+		return "unknown";
+
+	name = names[event].name;
+	if (!strncmp(name, "OFI_TRACE_", 10))
+		name += 10;
+
+	n = strlen(name);
+	if (names[event].phase == 'B' && n > 6)
+		n -= 6;
+	else if (names[event].phase == 'E' && n > 4)
+		n -= 4;
+
+	snprintf(buf, len, "%.*s", (int) n, name);
+	return buf;
+}
+
+static int read_rings(FILE *in, FILE *out, uint64_t *ts_base, int print)
+{
+	struct ofi_trace_ring_hdr ring;
+	struct ofi_trace_rec rec;
+	char name[OFI_TRACE_NAME_LEN];
+	uint64_t i;
+	uint32_t r;
+	int first = 1;
+
+	for (r = 0; r < hdr.ring_cnt; r++) {
+		if (fread(&ring, sizeof ring, 1, in) != 1)
+			return -1;
+
+		for (i = 0; i < ring.rec_cnt; i++) {
+			if (fread(&rec, sizeof rec, 1, in) != 1)
+				return -1;
+
+			if (!print) {
+				if (rec.ts < *ts_base)
+					*ts_base = rec.ts;
+				continue;
+			}
+
+			fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"%c\","
+				"%s\"pid\":%" PRIu32 ",\"tid\":%" PRIu32 ","
+				"\"ts\":%.3f,\"args\":{\"arg0\":\"0x%" PRIx64
+				"\",\"arg1\":\"0x%" PRIx64 "\",\"arg2\":\"0x%"
+				PRIx64 "\",\"arg3\":\"0x%" PRIx64 "\"}}",
+				first ? "" : ",",
+				trace_name(rec.event, name, sizeof name),
+				rec.event < hdr.event_cnt ?
+				names[rec.event].phase : 'i',
+				rec.event < hdr.event_cnt &&
+				names[rec.event].phase != 'i' ? "" : "\"s\":\"t\",",
+				hdr.pid, ring.tid,
+				(double) (rec.ts - *ts_base) / 1000.0,
+				rec.arg[0], rec.arg[1], rec.arg[2], rec.arg[3]);
+			first = 0;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in, *out = stdout;
+	uint64_t ts_base = UINT64_MAX;
+	long rings_off;
+	int op, ret = EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "o:h")) != -1) {
+		switch (op) {
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out) {
+				perror(optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return op == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	in = fopen(argv[optind], "rb");
+	if (!in) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	if (fread(&hdr, sizeof hdr, 1, in) != 1 ||
+	    hdr.magic != OFI_TRACE_MAGIC || hdr.version != OFI_TRACE_VERSION) {
+		fprintf(stderr, "%s: not a libfabric trace file\n", argv[optind]);
+		goto close;
+	}
+
+	names = calloc(hdr.event_cnt, sizeof(*names));
+	if (!names || fread(names, sizeof(*names), hdr.event_cnt, in) !=
+	    hdr.event_cnt) {
+		fprintf(stderr, "%s: truncated event table\n", argv[optind]);
+		goto free;
+	}
+
+	/* First pass finds the earliest timestamp, so times start at 0. */
+	rings_off = ftell(in);
+	if (read_rings(in, out, &ts_base, 0)) {
+		fprintf(stderr, "%s: truncated trace\n", argv[optind]);
+		goto free;
+	}
+
+	fseek(in, rings_off, SEEK_SET);
+	fprintf(out, "{\"displayTimeUnit\":\"ns\",\"otherData\":"
+		"{\"dropped\":%" PRIu64 "},\"traceEvents\":[", hdr.dropped);
+	read_rings(in, out, &ts_base, 1);
+	fprintf(out, "\n]}\n");
+	ret = EXIT_SUCCESS;
+free:
+	free(names);
+close:
+	fclose(in);
+	if (out != stdout)
+		fclose(out);
+	return ret;
+}